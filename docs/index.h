@@ -57,6 +57,7 @@
  * @{
  * \cond pico_aon_timer \defgroup pico_aon_timer pico_aon_timer \endcond
  * \cond pico_async_context \defgroup pico_async_context pico_async_context \endcond
+ * \cond pico_binary_log \defgroup pico_binary_log pico_binary_log \endcond
  * \cond pico_bootsel_via_double_reset \defgroup pico_bootsel_via_double_reset pico_bootsel_via_double_reset \endcond
  * \cond pico_fix \defgroup pico_fix pico_fix \endcond
  * \cond pico_flash \defgroup pico_flash pico_flash \endcond
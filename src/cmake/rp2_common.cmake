@@ -125,6 +125,7 @@ if (NOT PICO_BARE_METAL)
 
     # networking libraries - note dependency order is important
     pico_add_subdirectory(rp2_common/pico_async_context)
+    pico_add_subdirectory(rp2_common/pico_binary_log)
     pico_add_subdirectory(rp2_common/pico_btstack)
     pico_add_subdirectory(rp2_common/pico_cyw43_driver)
     pico_add_subdirectory(rp2_common/pico_mbedtls)
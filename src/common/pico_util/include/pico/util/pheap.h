@@ -34,7 +34,7 @@ extern "C" {
  * on the heap may cause them to overwrite that data as the id may be reused on subsequent operations
  *
  */
-// PICO_CONFIG: PICO_PHEAP_MAX_ENTRIES, Maximum number of entries in the pheap, min=1, max=65534, default=255, group=pico_util
+// PICO_CONFIG: PICO_PHEAP_MAX_ENTRIES, Maximum number of entries in the pheap (values of 65536 or more select 32-bit node ids), min=1, max=4294967295, default=255, group=pico_util
 #ifndef PICO_PHEAP_MAX_ENTRIES
 #define PICO_PHEAP_MAX_ENTRIES 255
 #endif
@@ -42,10 +42,13 @@ extern "C" {
 // public heap_node ids are numbered from 1 (0 means none)
 #if PICO_PHEAP_MAX_ENTRIES < 256
 typedef uint8_t pheap_node_id_t;
-#elif PICO_PHEAP_MAX_ENTRIES < 65535
+#define PHEAP_MAX_NODE_ID 255u
+#elif PICO_PHEAP_MAX_ENTRIES < 65536
 typedef uint16_t pheap_node_id_t;
+#define PHEAP_MAX_NODE_ID 65535u
 #else
-#error invalid PICO_PHEAP_MAX_ENTRIES
+typedef uint32_t pheap_node_id_t;
+#define PHEAP_MAX_NODE_ID 4294967295u
 #endif
 
 typedef struct pheap_node {
@@ -80,7 +83,7 @@ typedef struct pheap {
  *
  * \param max_nodes the maximum number of nodes that may be in the heap (this is bounded by
  *                  PICO_PHEAP_MAX_ENTRIES which defaults to 255 to be able to store indexes
- *                  in a single byte).
+ *                  in a single byte; larger values use 16-bit or 32-bit indexes).
  * \param comparator the node comparison function
  * \param user_data a user data pointer associated with the heap that is provided in callbacks
  * \return a newly allocated and initialized heap
@@ -233,6 +236,60 @@ static inline pheap_node_id_t ph_remove_and_free_head(pheap_t *heap) {
  */
 bool ph_remove_and_free_node(pheap_t *heap, pheap_node_id_t id);
 
+/**
+ * \brief Restore the heap ordering after the key of a node in the heap has decreased, i.e. the node
+ * now compares earlier than it did (or the same as it did)
+ * \ingroup util_pheap
+ *
+ * This is cheaper than ph_reposition(), as the node's subtree remains correctly ordered, and just
+ * needs to be merged back in at the top of the heap.
+ *
+ * @param heap the heap
+ * @param id the id of the node, which must be in the heap
+ * @return the id of the new head of the pairing heap
+ */
+pheap_node_id_t ph_decrease_key(pheap_t *heap, pheap_node_id_t id);
+
+/**
+ * \brief Restore the heap ordering after the key of a node in the heap has changed in either direction
+ * \ingroup util_pheap
+ *
+ * This is equivalent to removing the node (without freeing it) and inserting it again.
+ *
+ * @param heap the heap
+ * @param id the id of the node, which must be in the heap
+ * @return the id of the new head of the pairing heap
+ */
+pheap_node_id_t ph_reposition(pheap_t *heap, pheap_node_id_t id);
+
+/**
+ * \brief Insert a number of nodes into the heap at once
+ * \ingroup util_pheap
+ *
+ * The nodes (previously allocated by ph_new_node()) are merged in rounds of pairs, which takes count comparisons
+ * in total, and yields a better balanced heap than inserting them one at a time, making subsequent removals
+ * cheaper.
+ *
+ * @param heap the heap
+ * @param ids the ids of the nodes to insert
+ * @param count the number of nodes to insert
+ * @return the id of the new head of the pairing heap
+ */
+pheap_node_id_t ph_insert_nodes(pheap_t *heap, const pheap_node_id_t *ids, uint count);
+
+/**
+ * \brief Build a heap from the first count entries of the user's companion array in O(count) time
+ * \ingroup util_pheap
+ *
+ * The heap is cleared, then the nodes with ids 1 to count are allocated, and inserted as per ph_insert_nodes(); the
+ * companion array entries for these ids should thus be populated before calling this method.
+ *
+ * @param heap the heap
+ * @param count the number of nodes, which must be no more than the heap's max_nodes
+ * @return the id of the new head of the pairing heap
+ */
+pheap_node_id_t ph_heapify(pheap_t *heap, uint count);
+
 /**
  * \brief Determine if the heap contains a given node. Note containment refers
  * to whether the node is inserted (ph_insert_node()) vs allocated (ph_new_node())
@@ -294,7 +351,7 @@ void ph_post_alloc_init(pheap_t *heap, uint max_nodes, pheap_comparator comparat
  * \ingroup util_pheap
  */
 #define PHEAP_DEFINE_STATIC(name, _max_nodes) \
-    static_assert(_max_nodes && _max_nodes < (1u << (8 * sizeof(pheap_node_id_t))), ""); \
+    static_assert(_max_nodes && _max_nodes <= PHEAP_MAX_NODE_ID, ""); \
     static pheap_node_t name ## _nodes[_max_nodes]; \
     static pheap_t name = { \
             .nodes = name ## _nodes, \
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_UTIL_POOL_H
+#define _PICO_UTIL_POOL_H
+
+#include "pico.h"
+#include "hardware/sync.h"
+
+// PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_POOL, Enable/disable assertions in the pool module, type=bool, default=0, group=pico_util
+#ifndef PARAM_ASSERTIONS_ENABLED_POOL
+#define PARAM_ASSERTIONS_ENABLED_POOL 0
+#endif
+
+// PICO_CONFIG: PICO_POOL_PER_CORE_CACHE, Enable/disable a cache of free objects per core in each pool, which avoids taking the pool's spin lock on most allocations and frees, type=bool, default=0, group=pico_util
+#ifndef PICO_POOL_PER_CORE_CACHE
+#define PICO_POOL_PER_CORE_CACHE 0
+#endif
+
+// PICO_CONFIG: PICO_POOL_PER_CORE_CACHE_SIZE, Maximum number of free objects held in each core's cache if PICO_POOL_PER_CORE_CACHE is set, type=int, min=2, default=8, group=pico_util
+#ifndef PICO_POOL_PER_CORE_CACHE_SIZE
+#define PICO_POOL_PER_CORE_CACHE_SIZE 8
+#endif
+
+/** \file pool.h
+ * \defgroup util_pool pool
+ * \brief Multi-core and IRQ safe pool of fixed size objects
+ * \ingroup pico_util
+ *
+ * A pool hands out objects of a single size from a fixed block of storage, which is either provided by the caller
+ * (e.g. a static array defined with \ref POOL_DEFINE_STATIC_STORAGE) or allocated from the heap when the pool is
+ * initialized. Free objects are linked through their own storage, so there is no overhead per object, and both
+ * \ref pool_alloc and \ref pool_free take a constant time. Objects are only carved from the storage as they are first
+ * needed, so initializing a pool takes a constant time too.
+ *
+ * Objects may be freed on either core, or from an IRQ handler, whichever core or IRQ allocated them.
+ *
+ * If PICO_POOL_PER_CORE_CACHE is set, each core also keeps a cache of up to PICO_POOL_PER_CORE_CACHE_SIZE free
+ * objects, which it allocates from and frees to with only its own interrupts disabled. The pool's spin lock is only
+ * taken to move a batch of objects between a core's cache and the shared free list, when the cache is empty or full.
+ * Note that objects in one core's cache are not available to the other core, so the pool should be sized to allow
+ * for this.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pool_element {
+    struct pool_element *next;
+} pool_element_t;
+
+#if PICO_POOL_PER_CORE_CACHE
+typedef struct {
+    pool_element_t *free_list;
+    uint32_t count;
+    uint32_t alloc_count;
+    uint32_t free_count;
+} pool_core_cache_t;
+#endif
+
+typedef struct {
+    spin_lock_t *spin_lock;
+    uint8_t *storage;
+    pool_element_t *free_list;
+    uint32_t element_size;
+    uint32_t element_count;
+    // the number of objects carved from the storage so far
+    uint32_t used_count;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t failed_count;
+#if PICO_POOL_PER_CORE_CACHE
+    pool_core_cache_t caches[NUM_CORES];
+#endif
+    bool owns_storage;
+} pool_t;
+
+/*! \brief Usage statistics for a pool, see \ref pool_get_stats
+ *  \ingroup util_pool
+ */
+typedef struct {
+    uint32_t element_count; ///< the number of objects in the pool
+    uint32_t in_use;        ///< the number of objects currently allocated
+    uint32_t high_water;    ///< the most objects that have been in use (or in the per-core caches) at once
+    uint32_t alloc_count;   ///< the number of successful calls to \ref pool_alloc
+    uint32_t free_count;    ///< the number of calls to \ref pool_free
+    uint32_t failed_count;  ///< the number of calls to \ref pool_alloc which failed because the pool was empty
+} pool_stats_t;
+
+/*! \brief The size of each object in a pool of objects of the given size, which is rounded up for alignment
+ *  \ingroup util_pool
+ */
+#define POOL_ELEMENT_SIZE(element_size) (((element_size) + 7u) & ~7u)
+
+/*! \brief Define a static array suitable for the storage of a pool
+ *  \ingroup util_pool
+ *
+ * \code
+ * POOL_DEFINE_STATIC_STORAGE(packet_storage, sizeof(packet_t), 16);
+ * ...
+ * pool_init_with_storage(&packet_pool, packet_storage, sizeof(packet_t), 16);
+ * \endcode
+ */
+#define POOL_DEFINE_STATIC_STORAGE(name, element_size, element_count) \
+    static uint64_t name[POOL_ELEMENT_SIZE(element_size) / 8 * (element_count)]
+
+/*! \brief Initialise a pool using the given storage and a specific spinlock for concurrency protection
+ *  \ingroup util_pool
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ * \param storage Storage for the objects, which must be 8 byte aligned and at least
+ *                POOL_ELEMENT_SIZE(element_size) * element_count bytes
+ * \param element_size Size of each object in the pool
+ * \param element_count Number of objects in the pool
+ * \param spinlock_num The spin ID used to protect the pool
+ */
+void pool_init_with_storage_and_spinlock(pool_t *pool, void *storage, uint element_size, uint element_count,
+                                         uint spinlock_num);
+
+/*! \brief Initialise a pool using the given storage, allocating a (possibly shared) spinlock
+ *  \ingroup util_pool
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ * \param storage Storage for the objects, which must be 8 byte aligned and at least
+ *                POOL_ELEMENT_SIZE(element_size) * element_count bytes
+ * \param element_size Size of each object in the pool
+ * \param element_count Number of objects in the pool
+ */
+static inline void pool_init_with_storage(pool_t *pool, void *storage, uint element_size, uint element_count) {
+    pool_init_with_storage_and_spinlock(pool, storage, element_size, element_count, next_striped_spin_lock_num());
+}
+
+/*! \brief Initialise a pool with storage allocated from the heap, allocating a (possibly shared) spinlock
+ *  \ingroup util_pool
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ * \param element_size Size of each object in the pool
+ * \param element_count Number of objects in the pool
+ */
+void pool_init(pool_t *pool, uint element_size, uint element_count);
+
+/*! \brief Destroy the specified pool, freeing its storage if it was allocated by \ref pool_init
+ *  \ingroup util_pool
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ *
+ * Does not deallocate the pool_t structure itself.
+ */
+void pool_deinit(pool_t *pool);
+
+/*! \brief Allocate an object from the pool
+ *  \ingroup util_pool
+ *
+ * This function is interrupt and multicore safe.
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ * \return the object, or NULL if the pool is empty
+ */
+void *pool_alloc(pool_t *pool);
+
+/*! \brief Return an object to the pool
+ *  \ingroup util_pool
+ *
+ * This function is interrupt and multicore safe, and the object may have been allocated on the other core.
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ * \param obj An object allocated from this pool by \ref pool_alloc
+ */
+void pool_free(pool_t *pool, void *obj);
+
+/*! \brief Check whether an object belongs to a pool
+ *  \ingroup util_pool
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ * \param obj Pointer to check
+ * \return true if obj lies within the pool's storage
+ */
+static inline bool pool_contains(const pool_t *pool, const void *obj) {
+    return (const uint8_t *)obj >= pool->storage &&
+           (const uint8_t *)obj < pool->storage + pool->element_size * pool->element_count;
+}
+
+/*! \brief Get the usage statistics of a pool
+ *  \ingroup util_pool
+ *
+ * \param pool Pointer to a pool_t structure, used as a handle
+ * \param stats Filled in with the statistics
+ */
+void pool_get_stats(pool_t *pool, pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
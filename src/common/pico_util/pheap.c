@@ -9,7 +9,7 @@
 #include "pico/util/pheap.h"
 
 pheap_t *ph_create(uint max_nodes, pheap_comparator comparator, void *user_data) {
-    invalid_params_if(PHEAP, !max_nodes || max_nodes >= (1u << (8 * sizeof(pheap_node_id_t))));
+    invalid_params_if(PHEAP, !max_nodes || max_nodes > PHEAP_MAX_NODE_ID);
     pheap_t *heap = calloc(1, sizeof(pheap_t));
     heap->nodes = calloc(max_nodes, sizeof(pheap_node_t));
     ph_post_alloc_init(heap, max_nodes, comparator, user_data);
@@ -17,7 +17,7 @@ pheap_t *ph_create(uint max_nodes, pheap_comparator comparator, void *user_data)
 }
 
 void ph_post_alloc_init(pheap_t *heap, uint max_nodes, pheap_comparator comparator, void *user_data) {
-    invalid_params_if(PHEAP, !max_nodes || max_nodes >= (1u << (8 * sizeof(pheap_node_id_t))));
+    invalid_params_if(PHEAP, !max_nodes || max_nodes > PHEAP_MAX_NODE_ID);
     heap->max_nodes = (pheap_node_id_t) max_nodes;
     heap->comparator = comparator;
     heap->user_data = user_data;
@@ -40,16 +40,34 @@ void ph_destroy(pheap_t *heap) {
 }
 
 pheap_node_id_t ph_merge_two_pass(pheap_t *heap, pheap_node_id_t id) {
-    if (!id || !ph_get_node(heap, id)->sibling) {
-        return id;
-    } else {
-        pheap_node_id_t a, b, new_node;
-        a = id;
-        b = ph_get_node(heap, id)->sibling;
-        new_node = ph_get_node(heap, b)->sibling;
-        ph_get_node(heap, a)->sibling = ph_get_node(heap, b)->sibling = 0;
-        return ph_merge_nodes(heap, ph_merge_nodes(heap, a, b), ph_merge_two_pass(heap, new_node));
+    // first pass: merge siblings in pairs from left to right, pushing each merged pair onto a stack which is
+    // linked via the (otherwise unused) sibling of the pair's root
+    pheap_node_id_t stack = 0;
+    while (id) {
+        pheap_node_t *a = ph_get_node(heap, id);
+        pheap_node_id_t b = a->sibling;
+        pheap_node_id_t next = 0;
+        a->sibling = 0;
+        if (b) {
+            pheap_node_t *bn = ph_get_node(heap, b);
+            next = bn->sibling;
+            bn->sibling = 0;
+        }
+        pheap_node_id_t pair = ph_merge_nodes(heap, id, b);
+        ph_get_node(heap, pair)->sibling = stack;
+        stack = pair;
+        id = next;
+    }
+    // second pass: merge the pairs from right to left
+    pheap_node_id_t result = 0;
+    while (stack) {
+        pheap_node_t *n = ph_get_node(heap, stack);
+        pheap_node_id_t next = n->sibling;
+        n->sibling = 0;
+        result = ph_merge_nodes(heap, stack, result);
+        stack = next;
     }
+    return result;
 }
 
 static pheap_node_id_t ph_remove_any_head(pheap_t *heap, pheap_node_id_t root_id, bool free) {
@@ -79,16 +97,10 @@ pheap_node_id_t ph_remove_head(pheap_t *heap, bool free) {
     return old_root_id;
 }
 
-bool ph_remove_and_free_node(pheap_t *heap, pheap_node_id_t id) {
-    // 1) trivial cases
-    if (!id) return false;
-    if (id == heap->root_id) {
-        ph_remove_and_free_head(heap);
-        return true;
-    }
-    // 2) unlink the node from the tree
+// unlink a (non root) node, along with its subtree, from its parent
+static void ph_unlink_node(pheap_t *heap, pheap_node_id_t id) {
     pheap_node_t *node = ph_get_node(heap, id);
-    if (!node->parent) return false; // not in tree
+    assert(node->parent);
     pheap_node_t *parent = ph_get_node(heap, node->parent);
     if (parent->child == id) {
         parent->child = node->sibling;
@@ -107,14 +119,99 @@ bool ph_remove_and_free_node(pheap_t *heap, pheap_node_id_t id) {
         assert(found);
     }
     node->sibling = node->parent = 0;
+}
+
+static bool ph_remove_node(pheap_t *heap, pheap_node_id_t id, bool free) {
+    // 1) trivial cases
+    if (!id) return false;
+    if (id == heap->root_id) {
+        ph_remove_head(heap, free);
+        return true;
+    }
+    // 2) unlink the node from the tree
+    if (!ph_get_node(heap, id)->parent) return false; // not in tree
+    ph_unlink_node(heap, id);
 //    ph_dump(heap, NULL, NULL);
     // 3) remove it from the head of its own subtree
-    pheap_node_id_t new_sub_tree = ph_remove_any_head(heap, id, true);
+    pheap_node_id_t new_sub_tree = ph_remove_any_head(heap, id, free);
     assert(new_sub_tree != heap->root_id);
     heap->root_id = ph_merge_nodes(heap, heap->root_id, new_sub_tree);
     return true;
 }
 
+bool ph_remove_and_free_node(pheap_t *heap, pheap_node_id_t id) {
+    return ph_remove_node(heap, id, true);
+}
+
+pheap_node_id_t ph_decrease_key(pheap_t *heap, pheap_node_id_t id) {
+    assert(ph_contains_node(heap, id));
+    if (id != heap->root_id) {
+        // the node's subtree is still correctly ordered, so it can simply be merged back in at the top
+        ph_unlink_node(heap, id);
+        heap->root_id = ph_merge_nodes(heap, heap->root_id, id);
+    }
+    return heap->root_id;
+}
+
+pheap_node_id_t ph_reposition(pheap_t *heap, pheap_node_id_t id) {
+    bool __unused removed = ph_remove_node(heap, id, false);
+    assert(removed);
+    return ph_insert_node(heap, id);
+}
+
+// merge a list of n >= 1 heaps (linked via sibling, from head to tail) in rounds of pairs, which takes n - 1
+// comparisons and leaves a balanced tree
+static pheap_node_id_t ph_merge_multi_pass(pheap_t *heap, pheap_node_id_t head, pheap_node_id_t tail) {
+    while (head != tail) {
+        pheap_node_t *a = ph_get_node(heap, head);
+        pheap_node_id_t b = a->sibling;
+        pheap_node_t *bn = ph_get_node(heap, b);
+        pheap_node_id_t next = bn->sibling;
+        a->sibling = bn->sibling = 0;
+        pheap_node_id_t pair = ph_merge_nodes(heap, head, b);
+        if (!next) {
+            // b was the tail, so the pair is all that is left
+            return pair;
+        }
+        ph_get_node(heap, tail)->sibling = pair;
+        tail = pair;
+        head = next;
+    }
+    return head;
+}
+
+pheap_node_id_t ph_insert_nodes(pheap_t *heap, const pheap_node_id_t *ids, uint count) {
+    if (!count) return heap->root_id;
+    for (uint i = 0; i < count; i++) {
+        pheap_node_t *hn = ph_get_node(heap, ids[i]);
+        hn->child = hn->parent = 0;
+        hn->sibling = i + 1 < count ? ids[i + 1] : (pheap_node_id_t)0;
+    }
+    pheap_node_id_t sub_tree = ph_merge_multi_pass(heap, ids[0], ids[count - 1]);
+    heap->root_id = ph_merge_nodes(heap, heap->root_id, sub_tree);
+    return heap->root_id;
+}
+
+pheap_node_id_t ph_heapify(pheap_t *heap, uint count) {
+    invalid_params_if(PHEAP, count > heap->max_nodes);
+    ph_clear(heap);
+    if (!count) return 0;
+    if (count == heap->max_nodes) {
+        heap->free_head_id = heap->free_tail_id = 0;
+    } else {
+        heap->free_head_id = (pheap_node_id_t)(count + 1);
+    }
+    // nodes 1 to count are already linked via sibling by ph_clear
+    pheap_node_t *last = ph_get_node(heap, (pheap_node_id_t)count);
+    last->sibling = 0;
+    for (uint i = 1; i <= count; i++) {
+        pheap_node_t *hn = ph_get_node(heap, (pheap_node_id_t)i);
+        hn->child = hn->parent = 0;
+    }
+    heap->root_id = ph_merge_multi_pass(heap, 1, (pheap_node_id_t)count);
+    return heap->root_id;
+}
+
 static uint ph_dump_node(pheap_t *heap, pheap_node_id_t id, void (*dump_key)(pheap_node_id_t, void *), void *user_data, uint indent) {
     uint count = 0;
     if (id) {
@@ -123,7 +220,7 @@ static uint ph_dump_node(pheap_t *heap, pheap_node_id_t id, void (*dump_key)(phe
             putchar(' ');
         }
         pheap_node_t *node = ph_get_node(heap, id);
-        printf("%d (c=%d s=%d p=%d) ", id, node->child, node->sibling, node->parent);
+        printf("%u (c=%u s=%u p=%u) ", (uint)id, (uint)node->child, (uint)node->sibling, (uint)node->parent);
         if (dump_key) dump_key(id, user_data);
         printf("\n");
         count += ph_dump_node(heap, node->child, dump_key, user_data, indent + 1);
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico/util/pool.h"
+
+static_assert(sizeof(pool_element_t) <= POOL_ELEMENT_SIZE(1), "");
+
+void pool_init_with_storage_and_spinlock(pool_t *pool, void *storage, uint element_size, uint element_count,
+                                         uint spinlock_num) {
+    invalid_params_if(POOL, !element_count || ((uintptr_t)storage & 7));
+    memset(pool, 0, sizeof(pool_t));
+    pool->spin_lock = spin_lock_instance(spinlock_num);
+    pool->storage = (uint8_t *)storage;
+    pool->element_size = POOL_ELEMENT_SIZE(element_size);
+    pool->element_count = element_count;
+}
+
+void pool_init(pool_t *pool, uint element_size, uint element_count) {
+    pool_init_with_storage(pool, malloc(POOL_ELEMENT_SIZE(element_size) * element_count), element_size,
+                           element_count);
+    pool->owns_storage = true;
+    if (!pool->storage) pool->element_count = 0;
+}
+
+void pool_deinit(pool_t *pool) {
+    if (pool->owns_storage) {
+        free(pool->storage);
+    }
+    pool->storage = NULL;
+    pool->element_count = 0;
+}
+
+// takes an object from the shared free list, or failing that carves a new one from the storage
+static pool_element_t *pool_take_locked(pool_t *pool) {
+    pool_element_t *element = pool->free_list;
+    if (element) {
+        pool->free_list = element->next;
+    } else if (pool->used_count < pool->element_count) {
+        element = (pool_element_t *)(pool->storage + pool->used_count++ * pool->element_size);
+    }
+    return element;
+}
+
+static inline void pool_put_locked(pool_t *pool, pool_element_t *element) {
+    element->next = pool->free_list;
+    pool->free_list = element;
+}
+
+#if PICO_POOL_PER_CORE_CACHE
+void *pool_alloc(pool_t *pool) {
+    // the cache is only accessed by its own core, with interrupts disabled
+    uint32_t save = save_and_disable_interrupts();
+    pool_core_cache_t *cache = &pool->caches[get_core_num()];
+    pool_element_t *element = cache->free_list;
+    if (element) {
+        cache->free_list = element->next;
+        cache->count--;
+    } else {
+        // refill half the cache as well
+        spin_lock_unsafe_blocking(pool->spin_lock);
+        element = pool_take_locked(pool);
+        if (element) {
+            pool_element_t *extra;
+            while (cache->count < PICO_POOL_PER_CORE_CACHE_SIZE / 2 && (extra = pool_take_locked(pool))) {
+                extra->next = cache->free_list;
+                cache->free_list = extra;
+                cache->count++;
+            }
+        } else {
+            pool->failed_count++;
+        }
+        spin_unlock_unsafe(pool->spin_lock);
+    }
+    if (element) cache->alloc_count++;
+    restore_interrupts(save);
+    return element;
+}
+
+void pool_free(pool_t *pool, void *obj) {
+    invalid_params_if(POOL, !pool_contains(pool, obj));
+    pool_element_t *element = (pool_element_t *)obj;
+    uint32_t save = save_and_disable_interrupts();
+    pool_core_cache_t *cache = &pool->caches[get_core_num()];
+    cache->free_count++;
+    if (cache->count == PICO_POOL_PER_CORE_CACHE_SIZE) {
+        // return half the cache to the shared free list, so the other core can use the objects
+        spin_lock_unsafe_blocking(pool->spin_lock);
+        while (cache->count > PICO_POOL_PER_CORE_CACHE_SIZE / 2) {
+            pool_element_t *spare = cache->free_list;
+            cache->free_list = spare->next;
+            cache->count--;
+            pool_put_locked(pool, spare);
+        }
+        spin_unlock_unsafe(pool->spin_lock);
+    }
+    element->next = cache->free_list;
+    cache->free_list = element;
+    cache->count++;
+    restore_interrupts(save);
+}
+#else
+void *pool_alloc(pool_t *pool) {
+    uint32_t save = spin_lock_blocking(pool->spin_lock);
+    pool_element_t *element = pool_take_locked(pool);
+    if (element) {
+        pool->alloc_count++;
+    } else {
+        pool->failed_count++;
+    }
+    spin_unlock(pool->spin_lock, save);
+    return element;
+}
+
+void pool_free(pool_t *pool, void *obj) {
+    invalid_params_if(POOL, !pool_contains(pool, obj));
+    uint32_t save = spin_lock_blocking(pool->spin_lock);
+    pool_put_locked(pool, (pool_element_t *)obj);
+    pool->free_count++;
+    spin_unlock(pool->spin_lock, save);
+}
+#endif
+
+void pool_get_stats(pool_t *pool, pool_stats_t *stats) {
+    uint32_t save = spin_lock_blocking(pool->spin_lock);
+    stats->element_count = pool->element_count;
+    // when every object carved so far is in use, the next is carved from the storage, so this is the high water mark
+    stats->high_water = pool->used_count;
+    stats->alloc_count = pool->alloc_count;
+    stats->free_count = pool->free_count;
+    stats->failed_count = pool->failed_count;
+    spin_unlock(pool->spin_lock, save);
+#if PICO_POOL_PER_CORE_CACHE
+    // these are updated without the spin lock, so are only a snapshot
+    for (uint i = 0; i < NUM_CORES; i++) {
+        stats->alloc_count += pool->caches[i].alloc_count;
+        stats->free_count += pool->caches[i].free_count;
+    }
+#endif
+    stats->in_use = stats->alloc_count - stats->free_count;
+}
@@ -22,13 +22,19 @@ include (${CMAKE_DIR}/no_hardware.cmake)
 
 # host-specific
  pico_add_subdirectory(${HOST_DIR}/hardware_divider)
+ pico_add_subdirectory(${HOST_DIR}/hardware_dma)
+ pico_add_subdirectory(${HOST_DIR}/hardware_flash)
  pico_add_subdirectory(${HOST_DIR}/hardware_gpio)
  pico_add_subdirectory(${HOST_DIR}/hardware_irq)
+ pico_add_subdirectory(${HOST_DIR}/hardware_pio)
  pico_add_subdirectory(${HOST_DIR}/hardware_sync)
  pico_add_subdirectory(${HOST_DIR}/hardware_timer)
  pico_add_subdirectory(${HOST_DIR}/hardware_uart)
+ pico_add_subdirectory(${HOST_DIR}/pico_async_context)
+ pico_add_subdirectory(${HOST_DIR}/pico_binary_log)
  pico_add_subdirectory(${HOST_DIR}/pico_bit_ops)
  pico_add_subdirectory(${HOST_DIR}/pico_divider)
+ pico_add_subdirectory(${HOST_DIR}/pico_malloc)
  pico_add_subdirectory(${HOST_DIR}/pico_multicore)
  pico_add_subdirectory(${HOST_DIR}/pico_platform)
  pico_add_subdirectory(${HOST_DIR}/pico_rand)
@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include "hardware/dma.h"
+#include "hardware/claim.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+// The DMA is modelled by a thread which performs transfers for each busy channel in turn, in bursts of up to
+// PICO_HOST_DMA_BURST_TRANSFERS (twice that for high priority channels), and sleeps when no channel can make
+// progress. All channel state is protected by a mutex; callers on a (simulated) core also disable interrupts
+// while holding it, so that a DMA IRQ handler which calls back into this API cannot deadlock. An event (__sev)
+// is generated whenever a channel stops being busy, so waiting for a channel doesn't need the mutex.
+
+#define NUM_DREQS 64
+
+typedef struct {
+    uintptr_t read_addr;
+    uintptr_t write_addr;
+    uint32_t transfer_count;  // the (encoded) value loaded into the counter when the channel is triggered
+    uint32_t remaining;       // the number of transfers remaining in the current sequence
+    uint32_t ctrl;
+    atomic_uint_fast64_t bytes_transferred;
+} dma_host_channel_t;
+
+typedef struct {
+    uint64_t last_update_us;
+    uint64_t accumulator; // fractional DREQs, in units of 1 / (1000000 * denominator)
+} dma_host_timer_t;
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond; // signalled when there may be new work for the DMA thread
+    dma_host_channel_t ch[NUM_DMA_CHANNELS];
+    atomic_uint busy; // bit mask of busy channels
+    uint32_t intr; // raw interrupt status
+    uint32_t inte[NUM_DMA_IRQS];
+    uint32_t timer[NUM_DMA_TIMERS];
+    dma_host_timer_t timer_state[NUM_DMA_TIMERS];
+    uint dreq_credit[NUM_DREQS];
+    uint next_channel; // for round-robin scheduling
+} dma = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .work_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_once_t dma_thread_once = PTHREAD_ONCE_INIT;
+
+static_assert(NUM_DMA_CHANNELS <= 16, "");
+static uint16_t _claimed;
+static uint8_t _timer_claimed;
+
+static uint32_t dma_lock(void) {
+    uint32_t save = save_and_disable_interrupts();
+    pthread_mutex_lock(&dma.mutex);
+    return save;
+}
+
+static void dma_unlock(uint32_t save) {
+    pthread_mutex_unlock(&dma.mutex);
+    restore_interrupts(save);
+}
+
+// ----------------------------------------------------------------------------
+// Transfers
+
+static inline uint ctrl_field(uint32_t ctrl, uint32_t bits, uint lsb) {
+    return (ctrl & bits) >> lsb;
+}
+
+static uintptr_t update_address(uintptr_t addr, uint update_type, uint size, uint ring_bits) {
+    uintptr_t next = addr;
+    switch (update_type) {
+        case DMA_ADDRESS_UPDATE_INCREMENT: next += size; break;
+        case DMA_ADDRESS_UPDATE_INCREMENT_BY_TWO: next += 2 * size; break;
+        case DMA_ADDRESS_UPDATE_DECREMENT: next -= size; break;
+        default: break;
+    }
+    if (ring_bits) {
+        uintptr_t mask = (((uintptr_t)1) << ring_bits) - 1;
+        next = (addr & ~mask) | (next & mask);
+    }
+    return next;
+}
+
+static inline uint32_t bswap_transfer(uint32_t data, uint size) {
+    if (size == 2) return __builtin_bswap16((uint16_t)data);
+    if (size == 4) return __builtin_bswap32(data);
+    return data;
+}
+
+// perform up to count transfers for the channel
+static void do_transfers(dma_host_channel_t *ch, uint32_t count) {
+    uint32_t ctrl = ch->ctrl;
+    uint size = 1u << ctrl_field(ctrl, DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS, DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+    uint read_update = ctrl_field(ctrl, DMA_CH_CTRL_ALL_ADDRESS_UPDATE_READ_BITS, DMA_CH0_CTRL_TRIG_INCR_READ_LSB);
+    uint write_update = ctrl_field(ctrl, DMA_CH_CTRL_ALL_ADDRESS_UPDATE_WRITE_BITS, DMA_CH0_CTRL_TRIG_INCR_WRITE_LSB);
+    uint ring_bits = ctrl_field(ctrl, DMA_CH0_CTRL_TRIG_RING_SIZE_BITS, DMA_CH0_CTRL_TRIG_RING_SIZE_LSB);
+    bool ring_write = ctrl & DMA_CH0_CTRL_TRIG_RING_SEL_BITS;
+    bool bswap = ctrl & DMA_CH0_CTRL_TRIG_BSWAP_BITS;
+    uint read_ring_bits = ring_write ? 0 : ring_bits;
+    uint write_ring_bits = ring_write ? ring_bits : 0;
+    if (read_update == DMA_ADDRESS_UPDATE_INCREMENT && write_update == DMA_ADDRESS_UPDATE_INCREMENT && !ring_bits && !bswap) {
+        // the common memory to memory case
+        memmove((void *)ch->write_addr, (const void *)ch->read_addr, (size_t)count * size);
+        ch->read_addr += (uintptr_t)count * size;
+        ch->write_addr += (uintptr_t)count * size;
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t data;
+            switch (size) {
+                case 1: data = *(const volatile uint8_t *)ch->read_addr; break;
+                case 2: data = *(const volatile uint16_t *)ch->read_addr; break;
+                default: data = *(const volatile uint32_t *)ch->read_addr; break;
+            }
+            if (bswap) data = bswap_transfer(data, size);
+            switch (size) {
+                case 1: *(volatile uint8_t *)ch->write_addr = (uint8_t)data; break;
+                case 2: *(volatile uint16_t *)ch->write_addr = (uint16_t)data; break;
+                default: *(volatile uint32_t *)ch->write_addr = data; break;
+            }
+            ch->read_addr = update_address(ch->read_addr, read_update, size, read_ring_bits);
+            ch->write_addr = update_address(ch->write_addr, write_update, size, write_ring_bits);
+        }
+    }
+    atomic_fetch_add(&ch->bytes_transferred, (uint64_t)count * size);
+}
+
+// add any DREQs generated by a DMA timer since it was last updated
+static void update_timer(uint timer, uint64_t now_us) {
+    dma_host_timer_t *t = &dma.timer_state[timer];
+    uint x = dma.timer[timer] >> 16;
+    uint y = dma.timer[timer] & 0xffff;
+    if (x && y && now_us > t->last_update_us) {
+        // the timer generates x DREQs every y clock cycles
+        t->accumulator += (now_us - t->last_update_us) * (uint64_t)PICO_HOST_DMA_TIMER_CLOCK_HZ * x;
+        uint64_t unit = 1000000ull * y;
+        uint64_t credit = t->accumulator / unit;
+        t->accumulator -= credit * unit;
+        // as on device, DREQs don't accumulate indefinitely while no channel is consuming them
+        uint *dreq_credit = &dma.dreq_credit[DREQ_DMA_TIMER0 + timer];
+        *dreq_credit = (uint)MIN(*dreq_credit + credit, 64u);
+    }
+    t->last_update_us = now_us;
+}
+
+// the number of microseconds until a DMA timer generates its next DREQ
+static uint64_t timer_us_to_next_dreq(uint timer) {
+    uint x = dma.timer[timer] >> 16;
+    uint y = dma.timer[timer] & 0xffff;
+    if (!x || !y) return UINT64_MAX;
+    uint64_t unit = 1000000ull * y;
+    uint64_t rate = (uint64_t)PICO_HOST_DMA_TIMER_CLOCK_HZ * x;
+    return (unit - dma.timer_state[timer].accumulator + rate - 1) / rate;
+}
+
+static void trigger_channel(uint channel);
+
+static void raise_irqs(uint32_t channel_mask) {
+    dma.intr |= channel_mask;
+    for (uint i = 0; i < NUM_DMA_IRQS; i++) {
+        if (dma.inte[i] & channel_mask) {
+            irq_set_pending_on_enabled_cores(DMA_IRQ_NUM(i));
+        }
+    }
+}
+
+static void channel_stop(uint channel) {
+    atomic_fetch_and(&dma.busy, ~(1u << channel));
+    __sev();
+}
+
+static void channel_complete(uint channel) {
+    dma_host_channel_t *ch = &dma.ch[channel];
+    uint mode = ch->transfer_count >> DMA_CH0_TRANS_COUNT_MODE_LSB;
+    channel_stop(channel);
+    if (!(ch->ctrl & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS)) {
+        raise_irqs(1u << channel);
+    }
+    uint chain_to = ctrl_field(ch->ctrl, DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS, DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+    if (chain_to != channel && chain_to < NUM_DMA_CHANNELS) {
+        trigger_channel(chain_to);
+    }
+    if (mode == DMA_CH0_TRANS_COUNT_MODE_VALUE_TRIGGER_SELF) {
+        trigger_channel(channel);
+    }
+}
+
+// perform the next burst of transfers for the channel, returning the number performed; sets *wait_us to the
+// time until the channel is next able to make progress, if it is waiting on a DMA timer
+static uint32_t service_channel(uint channel, uint64_t now_us, uint64_t *wait_us) {
+    dma_host_channel_t *ch = &dma.ch[channel];
+    if (!(ch->ctrl & DMA_CH0_CTRL_TRIG_EN_BITS)) return 0; // paused
+    uint32_t count = PICO_HOST_DMA_BURST_TRANSFERS;
+    if (ch->ctrl & DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS) count *= 2;
+    bool endless = (ch->transfer_count >> DMA_CH0_TRANS_COUNT_MODE_LSB) == DMA_CH0_TRANS_COUNT_MODE_VALUE_ENDLESS;
+    if (!endless) count = MIN(count, ch->remaining);
+    uint dreq = ctrl_field(ch->ctrl, DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS, DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB);
+    if (dreq != DREQ_FORCE) {
+        if (dreq >= DREQ_DMA_TIMER0) {
+            uint timer = dreq - DREQ_DMA_TIMER0;
+            update_timer(timer, now_us);
+            if (!dma.dreq_credit[dreq]) *wait_us = MIN(*wait_us, timer_us_to_next_dreq(timer));
+        }
+        count = MIN(count, dma.dreq_credit[dreq]);
+        dma.dreq_credit[dreq] -= count;
+    }
+    if (!count) return 0;
+    do_transfers(ch, count);
+    if (!endless) {
+        ch->remaining -= count;
+        if (!ch->remaining) channel_complete(channel);
+    }
+    return count;
+}
+
+static void *dma_thread(__unused void *arg) {
+    pthread_mutex_lock(&dma.mutex);
+    while (true) {
+        uint32_t busy = atomic_load(&dma.busy);
+        uint64_t wait_us = UINT64_MAX;
+        bool progress = false;
+        if (busy) {
+            uint64_t now_us = time_us_64();
+            for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+                uint channel = (dma.next_channel + i) % NUM_DMA_CHANNELS;
+                if (atomic_load(&dma.busy) & (1u << channel)) {
+                    if (service_channel(channel, now_us, &wait_us)) progress = true;
+                }
+            }
+            dma.next_channel = (dma.next_channel + 1) % NUM_DMA_CHANNELS;
+        }
+        if (progress) {
+            // give API callers a chance to acquire the mutex between rounds
+            pthread_mutex_unlock(&dma.mutex);
+            pthread_mutex_lock(&dma.mutex);
+        } else if (wait_us == UINT64_MAX) {
+            pthread_cond_wait(&dma.work_cond, &dma.mutex);
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            uint64_t ns = (uint64_t)ts.tv_nsec + MAX(wait_us, 1) * 1000;
+            ts.tv_sec += (time_t)(ns / 1000000000);
+            ts.tv_nsec = (long)(ns % 1000000000);
+            pthread_cond_timedwait(&dma.work_cond, &dma.mutex, &ts);
+        }
+    }
+    return NULL;
+}
+
+static void start_dma_thread(void) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, dma_thread, NULL);
+    pthread_detach(thread);
+}
+
+static void trigger_channel(uint channel) {
+    dma_host_channel_t *ch = &dma.ch[channel];
+    // as on device, a channel which is not enabled ignores triggers, as does one which is already busy
+    if (!(ch->ctrl & DMA_CH0_CTRL_TRIG_EN_BITS) || (atomic_load(&dma.busy) & (1u << channel))) return;
+    ch->remaining = ch->transfer_count & DMA_CH0_TRANS_COUNT_COUNT_BITS;
+    bool endless = (ch->transfer_count >> DMA_CH0_TRANS_COUNT_MODE_LSB) == DMA_CH0_TRANS_COUNT_MODE_VALUE_ENDLESS;
+    if (!ch->remaining && !endless) {
+        // a null trigger; this is how the end of a control block chain is signalled in quiet mode
+        if (ch->ctrl & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS) raise_irqs(1u << channel);
+        return;
+    }
+    pthread_once(&dma_thread_once, start_dma_thread);
+    atomic_fetch_or(&dma.busy, 1u << channel);
+    pthread_cond_signal(&dma.work_cond);
+}
+
+// ----------------------------------------------------------------------------
+// API
+
+dma_channel_config_t dma_get_channel_config(uint channel) {
+    check_dma_channel_param(channel);
+    dma_channel_config_t c;
+    uint32_t save = dma_lock();
+    c.ctrl = dma.ch[channel].ctrl;
+    if (atomic_load(&dma.busy) & (1u << channel)) c.ctrl |= DMA_CH0_CTRL_TRIG_BUSY_BITS;
+    dma_unlock(save);
+    return c;
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config_t *config, bool trigger) {
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    dma.ch[channel].ctrl = channel_config_get_ctrl_value(config) & ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+    if (trigger) trigger_channel(channel);
+    // the channel may have been unpaused
+    pthread_cond_signal(&dma.work_cond);
+    dma_unlock(save);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    dma.ch[channel].read_addr = (uintptr_t)read_addr;
+    if (trigger) trigger_channel(channel);
+    dma_unlock(save);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    dma.ch[channel].write_addr = (uintptr_t)write_addr;
+    if (trigger) trigger_channel(channel);
+    dma_unlock(save);
+}
+
+void dma_channel_set_transfer_count(uint channel, uint32_t encoded_transfer_count, bool trigger) {
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    dma.ch[channel].transfer_count = encoded_transfer_count;
+    if (trigger) trigger_channel(channel);
+    dma_unlock(save);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+    valid_params_if(HARDWARE_DMA, chan_mask && chan_mask < (1u << NUM_DMA_CHANNELS));
+    uint32_t save = dma_lock();
+    for (uint i = 0; chan_mask; i++, chan_mask >>= 1u) {
+        if (chan_mask & 1u) trigger_channel(i);
+    }
+    dma_unlock(save);
+}
+
+void dma_channel_abort(uint channel) {
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    // the DMA thread never holds a channel part way through a transfer once it has released the mutex, so
+    // the channel is immediately in a safe state
+    channel_stop(channel);
+    dma_unlock(save);
+}
+
+bool dma_channel_is_busy(uint channel) {
+    check_dma_channel_param(channel);
+    return atomic_load(&dma.busy) & (1u << channel);
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    // as on device, interrupts are left enabled while waiting, so that DMA IRQ handlers can run
+    while (dma_channel_is_busy(channel)) __wfe();
+}
+
+void dma_irqn_set_channel_mask_enabled(uint irq_index, uint32_t channel_mask, bool enabled) {
+    invalid_params_if(HARDWARE_DMA, irq_index >= NUM_DMA_IRQS);
+    uint32_t save = dma_lock();
+    if (enabled) {
+        dma.inte[irq_index] |= channel_mask;
+        // as on device, an already raised channel interrupt asserts the IRQ as soon as it is enabled
+        if (dma.intr & channel_mask) irq_set_pending_on_enabled_cores(DMA_IRQ_NUM(irq_index));
+    } else {
+        dma.inte[irq_index] &= ~channel_mask;
+    }
+    dma_unlock(save);
+}
+
+bool dma_irqn_get_channel_status(uint irq_index, uint channel) {
+    invalid_params_if(HARDWARE_DMA, irq_index >= NUM_DMA_IRQS);
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    bool status = dma.intr & dma.inte[irq_index] & (1u << channel);
+    dma_unlock(save);
+    return status;
+}
+
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel) {
+    invalid_params_if(HARDWARE_DMA, irq_index >= NUM_DMA_IRQS);
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    dma.intr &= ~(1u << channel);
+    dma_unlock(save);
+}
+
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator) {
+    check_dma_timer_param(timer);
+    invalid_params_if(HARDWARE_DMA, numerator > denominator);
+    uint32_t save = dma_lock();
+    update_timer(timer, time_us_64());
+    dma.timer[timer] = (((uint32_t)numerator) << 16) | denominator;
+    dma.timer_state[timer].accumulator = 0;
+    pthread_cond_signal(&dma.work_cond);
+    dma_unlock(save);
+}
+
+void dma_host_dreq_signal(uint dreq, uint count) {
+    valid_params_if(HARDWARE_DMA, dreq < DREQ_DMA_TIMER0);
+    uint32_t save = dma_lock();
+    dma.dreq_credit[dreq] += count;
+    pthread_cond_signal(&dma.work_cond);
+    dma_unlock(save);
+}
+
+uint64_t dma_host_get_bytes_transferred(uint channel) {
+    check_dma_channel_param(channel);
+    return atomic_load(&dma.ch[channel].bytes_transferred);
+}
+
+void dma_host_reset_bytes_transferred(uint channel) {
+    check_dma_channel_param(channel);
+    atomic_store(&dma.ch[channel].bytes_transferred, 0);
+}
+
+// ----------------------------------------------------------------------------
+// Claiming
+
+void dma_channel_claim(uint channel) {
+    check_dma_channel_param(channel);
+    hw_claim_or_assert((uint8_t *) &_claimed, channel, "DMA channel %d is already claimed");
+}
+
+void dma_claim_mask(uint32_t mask) {
+    for(uint i = 0; mask; i++, mask >>= 1u) {
+        if (mask & 1u) dma_channel_claim(i);
+    }
+}
+
+void dma_channel_unclaim(uint channel) {
+    check_dma_channel_param(channel);
+    hw_claim_clear((uint8_t *) &_claimed, channel);
+}
+
+void dma_unclaim_mask(uint32_t mask) {
+    for(uint i = 0; mask; i++, mask >>= 1u) {
+        if (mask & 1u) dma_channel_unclaim(i);
+    }
+}
+
+int dma_claim_unused_channel(bool required) {
+    return hw_claim_unused_from_range((uint8_t*)&_claimed, required, 0, NUM_DMA_CHANNELS-1, "No DMA channels are available");
+}
+
+bool dma_channel_is_claimed(uint channel) {
+    check_dma_channel_param(channel);
+    return hw_is_claimed((uint8_t *) &_claimed, channel);
+}
+
+void dma_timer_claim(uint timer) {
+    check_dma_timer_param(timer);
+    hw_claim_or_assert(&_timer_claimed, timer, "DMA timer %d is already claimed");
+}
+
+void dma_timer_unclaim(uint timer) {
+    check_dma_timer_param(timer);
+    hw_claim_clear(&_timer_claimed, timer);
+}
+
+int dma_claim_unused_timer(bool required) {
+    return hw_claim_unused_from_range(&_timer_claimed, required, 0, NUM_DMA_TIMERS-1, "No DMA timers are available");
+}
+
+bool dma_timer_is_claimed(uint timer) {
+    check_dma_timer_param(timer);
+    return hw_is_claimed(&_timer_claimed, timer);
+}
+
+void dma_channel_cleanup(uint channel) {
+    check_dma_channel_param(channel);
+    uint32_t save = dma_lock();
+    // Disable CHAIN_TO, and disable channel, so that it ignores any further triggers
+    dma_host_channel_t *ch = &dma.ch[channel];
+    ch->ctrl = (ch->ctrl & ~(DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS | DMA_CH0_CTRL_TRIG_EN_BITS)) |
+               (channel << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+    for (uint i = 0; i < NUM_DMA_IRQS; i++) {
+        dma.inte[i] &= ~(1u << channel);
+    }
+    channel_stop(channel);
+    dma.intr &= ~(1u << channel);
+    dma_unlock(save);
+}
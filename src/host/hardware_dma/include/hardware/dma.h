@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_DMA_H
+#define _HARDWARE_DMA_H
+
+#include "pico.h"
+#include "hardware/platform_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file hardware/dma.h
+ *  \defgroup hardware_dma hardware_dma
+ *
+ * \brief Host model of the DMA Controller
+ *
+ * This provides the same API as the device, with transfers performed by a background thread, so that DMA-driven
+ * code can run (and be measured) on the host. Channels are scheduled round-robin, and support the configured
+ * transfer size, address update types, address wrapping (rings), byte swapping, chaining, IRQ quiet mode, and
+ * the self-triggering and endless transfer count modes. Completion IRQs are delivered via the simulated
+ * hardware_irq (DMA_IRQ_0, DMA_IRQ_1).
+ *
+ * Channels paced by a DMA timer are paced at the configured fraction of PICO_HOST_DMA_TIMER_CLOCK_HZ. Channels
+ * paced by any other DREQ only perform as many transfers as a simulated peripheral has permitted via
+ * \ref dma_host_dreq_signal.
+ *
+ * Unlike the device, transfer addresses are full host pointers, and the DMA sniffer is not modelled.
+ */
+
+// PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_HARDWARE_DMA, Enable/disable hardware_dma assertions, type=bool, default=0, group=hardware_dma
+#ifndef PARAM_ASSERTIONS_ENABLED_HARDWARE_DMA
+#ifdef PARAM_ASSERTIONS_ENABLED_DMA // backwards compatibility with SDK < 2.0.0
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_DMA PARAM_ASSERTIONS_ENABLED_DMA
+#else
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_DMA 0
+#endif
+#endif
+
+// PICO_CONFIG: PICO_HOST_DMA_TIMER_CLOCK_HZ, The clock frequency from which the host DMA timers derive their pacing rate, default=125000000, group=hardware_dma
+#ifndef PICO_HOST_DMA_TIMER_CLOCK_HZ
+#define PICO_HOST_DMA_TIMER_CLOCK_HZ 125000000
+#endif
+
+// PICO_CONFIG: PICO_HOST_DMA_BURST_TRANSFERS, The maximum number of transfers the host DMA performs for a channel before moving on to the next channel, min=1, default=256, group=hardware_dma
+#ifndef PICO_HOST_DMA_BURST_TRANSFERS
+#define PICO_HOST_DMA_BURST_TRANSFERS 256
+#endif
+
+#ifndef NUM_DMA_TIMERS
+#define NUM_DMA_TIMERS 4u
+#endif
+
+#ifndef NUM_DMA_IRQS
+#define NUM_DMA_IRQS 2u
+#endif
+
+#ifndef DMA_IRQ_0
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+#endif
+
+#ifndef DREQ_DMA_TIMER0
+#define DREQ_DMA_TIMER0 0x3b
+#define DREQ_DMA_TIMER1 0x3c
+#define DREQ_DMA_TIMER2 0x3d
+#define DREQ_DMA_TIMER3 0x3e
+#define DREQ_FORCE 0x3f
+#endif
+
+// The CTRL register layout matches that of the RP2350
+#define DMA_CH0_CTRL_TRIG_EN_LSB 0u
+#define DMA_CH0_CTRL_TRIG_EN_BITS 0x00000001u
+#define DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_LSB 1u
+#define DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS 0x00000002u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB 2u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS 0x0000000cu
+#define DMA_CH0_CTRL_TRIG_INCR_READ_LSB 4u
+#define DMA_CH0_CTRL_TRIG_INCR_READ_BITS 0x00000010u
+#define DMA_CH0_CTRL_TRIG_INCR_READ_REV_LSB 5u
+#define DMA_CH0_CTRL_TRIG_INCR_READ_REV_BITS 0x00000020u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_LSB 6u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS 0x00000040u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_REV_LSB 7u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_REV_BITS 0x00000080u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_LSB 8u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_BITS 0x00000f00u
+#define DMA_CH0_CTRL_TRIG_RING_SEL_LSB 12u
+#define DMA_CH0_CTRL_TRIG_RING_SEL_BITS 0x00001000u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB 13u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS 0x0001e000u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB 17u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS 0x007e0000u
+#define DMA_CH0_CTRL_TRIG_IRQ_QUIET_LSB 23u
+#define DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS 0x00800000u
+#define DMA_CH0_CTRL_TRIG_BSWAP_LSB 24u
+#define DMA_CH0_CTRL_TRIG_BSWAP_BITS 0x01000000u
+#define DMA_CH0_CTRL_TRIG_SNIFF_EN_LSB 25u
+#define DMA_CH0_CTRL_TRIG_SNIFF_EN_BITS 0x02000000u
+#define DMA_CH0_CTRL_TRIG_BUSY_LSB 26u
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS 0x04000000u
+
+#define DMA_CH0_TRANS_COUNT_COUNT_BITS 0x0fffffffu
+#define DMA_CH0_TRANS_COUNT_MODE_LSB 28u
+#define DMA_CH0_TRANS_COUNT_MODE_BITS 0xf0000000u
+#define DMA_CH0_TRANS_COUNT_MODE_VALUE_NORMAL 0x0u
+#define DMA_CH0_TRANS_COUNT_MODE_VALUE_TRIGGER_SELF 0x1u
+#define DMA_CH0_TRANS_COUNT_MODE_VALUE_ENDLESS 0xfu
+
+/**
+ * \def DMA_IRQ_NUM(n)
+ * \ingroup hardware_dma
+ * \hideinitializer
+ * \brief Returns the \ref irq_num_t for the nth DMA interrupt
+ */
+#ifndef DMA_IRQ_NUM
+#define DMA_IRQ_NUM(irq_index) (DMA_IRQ_0 + (irq_index))
+#endif
+
+static inline void check_dma_channel_param(__unused uint channel) {
+    valid_params_if(HARDWARE_DMA, channel < NUM_DMA_CHANNELS);
+}
+
+static inline void check_dma_timer_param(__unused uint timer_num) {
+    valid_params_if(HARDWARE_DMA, timer_num < NUM_DMA_TIMERS);
+}
+
+// ----------------------------------------------------------------------------
+// Claiming
+
+void dma_channel_claim(uint channel);
+
+void dma_claim_mask(uint32_t channel_mask);
+
+void dma_channel_unclaim(uint channel);
+
+void dma_unclaim_mask(uint32_t channel_mask);
+
+int dma_claim_unused_channel(bool required);
+
+bool dma_channel_is_claimed(uint channel);
+
+// ----------------------------------------------------------------------------
+// Channel configuration
+
+typedef enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,    ///< Byte transfer (8 bits)
+    DMA_SIZE_16 = 1,   ///< Half word transfer (16 bits)
+    DMA_SIZE_32 = 2    ///< Word transfer (32 bits)
+} dma_channel_transfer_size_t;
+
+typedef enum dma_address_update_type {
+    DMA_ADDRESS_UPDATE_NONE = 0,                ///< The address remains the same after each transfer
+    DMA_ADDRESS_UPDATE_INCREMENT = 1,           ///< The address is incremented by the transfer size after each transfer
+    DMA_ADDRESS_UPDATE_INCREMENT_BY_TWO = 2,    ///< The address is incremented by twice the transfer size after each transfer
+    DMA_ADDRESS_UPDATE_DECREMENT = 3,           ///< The address is decremented by the transfer size after each transfer
+} dma_address_update_type_t;
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config_t;
+
+// backwards compatibility
+typedef dma_channel_config_t dma_channel_config;
+
+#define DMA_ADDRESS_UPDATE_TYPE_TO_DMA_CH_CTRL_READ_BITS(u) \
+    ((((u)&1) << DMA_CH0_CTRL_TRIG_INCR_READ_LSB) | \
+    (((u)&2) << (DMA_CH0_CTRL_TRIG_INCR_READ_REV_LSB - 1)))
+#define DMA_ADDRESS_UPDATE_TYPE_TO_DMA_CH_CTRL_WRITE_BITS(u) \
+    ((((u)&1) << DMA_CH0_CTRL_TRIG_INCR_WRITE_LSB) | \
+    (((u)&2) << (DMA_CH0_CTRL_TRIG_INCR_WRITE_REV_LSB - 1)))
+#define DMA_CH_CTRL_ALL_ADDRESS_UPDATE_READ_BITS (DMA_CH0_CTRL_TRIG_INCR_READ_BITS | DMA_CH0_CTRL_TRIG_INCR_READ_REV_BITS)
+#define DMA_CH_CTRL_ALL_ADDRESS_UPDATE_WRITE_BITS (DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS | DMA_CH0_CTRL_TRIG_INCR_WRITE_REV_BITS)
+
+static inline void channel_config_set_read_address_update_type(dma_channel_config_t *c, dma_address_update_type_t update_type) {
+    c->ctrl = (c->ctrl & ~DMA_CH_CTRL_ALL_ADDRESS_UPDATE_READ_BITS) |
+        DMA_ADDRESS_UPDATE_TYPE_TO_DMA_CH_CTRL_READ_BITS(update_type);
+}
+
+static inline void channel_config_set_write_address_update_type(dma_channel_config_t *c, dma_address_update_type_t update_type) {
+    c->ctrl = (c->ctrl & ~DMA_CH_CTRL_ALL_ADDRESS_UPDATE_WRITE_BITS) |
+        DMA_ADDRESS_UPDATE_TYPE_TO_DMA_CH_CTRL_WRITE_BITS(update_type);
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config_t *c, bool incr) {
+    channel_config_set_read_address_update_type(c, incr ? DMA_ADDRESS_UPDATE_INCREMENT : DMA_ADDRESS_UPDATE_NONE);
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config_t *c, bool incr) {
+    channel_config_set_write_address_update_type(c, incr ? DMA_ADDRESS_UPDATE_INCREMENT : DMA_ADDRESS_UPDATE_NONE);
+}
+
+static inline void channel_config_set_dreq(dma_channel_config_t *c, uint dreq) {
+    assert(dreq <= DREQ_FORCE);
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS) | (dreq << DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB);
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config_t *c, uint chain_to) {
+    assert(chain_to <= NUM_DMA_CHANNELS);
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) | (chain_to << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config_t *c, dma_channel_transfer_size_t size) {
+    assert(size == DMA_SIZE_8 || size == DMA_SIZE_16 || size == DMA_SIZE_32);
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS) | (((uint)size) << DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+}
+
+static inline void channel_config_set_ring(dma_channel_config_t *c, bool write, uint size_bits) {
+    assert(size_bits < 32);
+    c->ctrl = (c->ctrl & ~(DMA_CH0_CTRL_TRIG_RING_SIZE_BITS | DMA_CH0_CTRL_TRIG_RING_SEL_BITS)) |
+              (size_bits << DMA_CH0_CTRL_TRIG_RING_SIZE_LSB) |
+              (write ? DMA_CH0_CTRL_TRIG_RING_SEL_BITS : 0);
+}
+
+static inline void channel_config_set_bswap(dma_channel_config_t *c, bool bswap) {
+    c->ctrl = bswap ? (c->ctrl | DMA_CH0_CTRL_TRIG_BSWAP_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_BSWAP_BITS);
+}
+
+static inline void channel_config_set_irq_quiet(dma_channel_config_t *c, bool irq_quiet) {
+    c->ctrl = irq_quiet ? (c->ctrl | DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS);
+}
+
+static inline void channel_config_set_high_priority(dma_channel_config_t *c, bool high_priority) {
+    c->ctrl = high_priority ? (c->ctrl | DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS);
+}
+
+static inline void channel_config_set_enable(dma_channel_config_t *c, bool enable) {
+    c->ctrl = enable ? (c->ctrl | DMA_CH0_CTRL_TRIG_EN_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_EN_BITS);
+}
+
+static inline void channel_config_set_sniff_enable(dma_channel_config_t *c, bool sniff_enable) {
+    c->ctrl = sniff_enable ? (c->ctrl | DMA_CH0_CTRL_TRIG_SNIFF_EN_BITS) : (c->ctrl &
+                                                                             ~DMA_CH0_CTRL_TRIG_SNIFF_EN_BITS);
+}
+
+static inline dma_channel_config_t dma_channel_get_default_config(uint channel) {
+    dma_channel_config_t c = {0};
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, DREQ_FORCE);
+    channel_config_set_chain_to(&c, channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_ring(&c, false, 0);
+    channel_config_set_bswap(&c, false);
+    channel_config_set_irq_quiet(&c, false);
+    channel_config_set_enable(&c, true);
+    channel_config_set_sniff_enable(&c, false);
+    channel_config_set_high_priority( &c, false);
+    return c;
+}
+
+dma_channel_config_t dma_get_channel_config(uint channel);
+
+static inline uint32_t channel_config_get_ctrl_value(const dma_channel_config_t *config) {
+    return config->ctrl;
+}
+
+// ----------------------------------------------------------------------------
+// Channel control
+
+void dma_channel_set_config(uint channel, const dma_channel_config_t *config, bool trigger);
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger);
+
+static inline uint32_t dma_encode_transfer_count(uint transfer_count) {
+    invalid_params_if(HARDWARE_DMA, transfer_count & DMA_CH0_TRANS_COUNT_MODE_BITS);
+    return transfer_count & DMA_CH0_TRANS_COUNT_COUNT_BITS;
+}
+
+static inline uint32_t dma_encode_transfer_count_with_self_trigger(uint transfer_count) {
+    return dma_encode_transfer_count(transfer_count) | (DMA_CH0_TRANS_COUNT_MODE_VALUE_TRIGGER_SELF << DMA_CH0_TRANS_COUNT_MODE_LSB);
+}
+
+static inline uint32_t dma_encode_endless_transfer_count(void) {
+    return 0xffffffffu;
+}
+
+void dma_channel_set_transfer_count(uint channel, uint32_t encoded_transfer_count, bool trigger);
+
+// backwards compatibility with SDK < 2.2.0
+static inline void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    dma_channel_set_transfer_count(channel, trans_count, trigger);
+}
+
+static inline void dma_channel_configure(uint channel, const dma_channel_config_t *config, volatile void *write_addr,
+                                         const volatile void *read_addr,
+                                         uint32_t encoded_transfer_count, bool trigger) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_transfer_count(channel, encoded_transfer_count, false);
+    dma_channel_set_config(channel, config, trigger);
+}
+
+static inline void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr,
+                                                        uint32_t encoded_transfer_count) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_transfer_count(channel, encoded_transfer_count, true);
+}
+
+static inline void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t encoded_transfer_count) {
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_transfer_count(channel, encoded_transfer_count, true);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask);
+
+static inline void dma_channel_start(uint channel) {
+    dma_start_channel_mask(1u << channel);
+}
+
+void dma_channel_abort(uint channel);
+
+bool dma_channel_is_busy(uint channel);
+
+void dma_channel_wait_for_finish_blocking(uint channel);
+
+// ----------------------------------------------------------------------------
+// Interrupts
+
+void dma_irqn_set_channel_mask_enabled(uint irq_index, uint32_t channel_mask, bool enabled);
+
+static inline void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled) {
+    check_dma_channel_param(channel);
+    dma_irqn_set_channel_mask_enabled(irq_index, 1u << channel, enabled);
+}
+
+static inline void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    dma_irqn_set_channel_enabled(0, channel, enabled);
+}
+
+static inline void dma_set_irq0_channel_mask_enabled(uint32_t channel_mask, bool enabled) {
+    dma_irqn_set_channel_mask_enabled(0, channel_mask, enabled);
+}
+
+static inline void dma_channel_set_irq1_enabled(uint channel, bool enabled) {
+    dma_irqn_set_channel_enabled(1, channel, enabled);
+}
+
+static inline void dma_set_irq1_channel_mask_enabled(uint32_t channel_mask, bool enabled) {
+    dma_irqn_set_channel_mask_enabled(1, channel_mask, enabled);
+}
+
+bool dma_irqn_get_channel_status(uint irq_index, uint channel);
+
+static inline bool dma_channel_get_irq0_status(uint channel) {
+    return dma_irqn_get_channel_status(0, channel);
+}
+
+static inline bool dma_channel_get_irq1_status(uint channel) {
+    return dma_irqn_get_channel_status(1, channel);
+}
+
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel);
+
+static inline void dma_channel_acknowledge_irq0(uint channel) {
+    dma_irqn_acknowledge_channel(0, channel);
+}
+
+static inline void dma_channel_acknowledge_irq1(uint channel) {
+    dma_irqn_acknowledge_channel(1, channel);
+}
+
+static inline int dma_get_irq_num(uint irq_index) {
+    valid_params_if(HARDWARE_DMA, irq_index < NUM_DMA_IRQS);
+    return DMA_IRQ_NUM(irq_index);
+}
+
+// ----------------------------------------------------------------------------
+// Timers
+
+void dma_timer_claim(uint timer);
+
+void dma_timer_unclaim(uint timer);
+
+int dma_claim_unused_timer(bool required);
+
+bool dma_timer_is_claimed(uint timer);
+
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator);
+
+static inline uint dma_get_timer_dreq(uint timer_num) {
+    check_dma_timer_param(timer_num);
+    return DREQ_DMA_TIMER0 + timer_num;
+}
+
+void dma_channel_cleanup(uint channel);
+
+// ----------------------------------------------------------------------------
+// Host specific
+
+/*! \brief Signal that a simulated peripheral is ready for more DMA transfers
+ *  \ingroup hardware_dma
+ *
+ * A channel whose transfers are paced by a DREQ other than a DMA timer or DREQ_FORCE only performs a
+ * transfer when its DREQ has been signalled. Each call permits a further count transfers by channels using
+ * the DREQ; e.g. a simulated UART would call this with the number of characters of space in its TX FIFO.
+ *
+ * \note this method may be called from any thread
+ *
+ * \param dreq the DREQ number
+ * \param count the number of additional transfers permitted
+ */
+void dma_host_dreq_signal(uint dreq, uint count);
+
+/*! \brief Return the number of bytes a DMA channel has transferred
+ *  \ingroup hardware_dma
+ *
+ * This is a running total since the start of the program (or the last call to \ref dma_host_reset_bytes_transferred),
+ * which is useful for measuring throughput.
+ *
+ * \param channel DMA channel
+ * \return the number of bytes written by the channel
+ */
+uint64_t dma_host_get_bytes_transferred(uint channel);
+
+/*! \brief Reset the count returned by \ref dma_host_get_bytes_transferred for a DMA channel
+ *  \ingroup hardware_dma
+ *
+ * \param channel DMA channel
+ */
+void dma_host_reset_bytes_transferred(uint channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE // for MAP_FIXED_NOREPLACE
+#endif
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hardware/flash.h"
+#include "hardware/timer.h"
+
+#define FLASH_NUM_SECTORS (PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE)
+static_assert(!(PICO_FLASH_SIZE_BYTES % FLASH_BLOCK_SIZE), "");
+
+#define FLASH_CMD_PAGE_PROGRAM 0x02
+#define FLASH_CMD_READ 0x03
+#define FLASH_CMD_WRITE_DISABLE 0x04
+#define FLASH_CMD_READ_STATUS 0x05
+#define FLASH_CMD_WRITE_ENABLE 0x06
+#define FLASH_CMD_FAST_READ 0x0b
+#define FLASH_CMD_READ_STATUS3 0x15
+#define FLASH_CMD_SECTOR_ERASE 0x20
+#define FLASH_CMD_READ_STATUS2 0x35
+#define FLASH_CMD_UNIQUE_ID 0x4b
+#define FLASH_CMD_BLOCK32_ERASE 0x52
+#define FLASH_CMD_CHIP_ERASE 0x60
+#define FLASH_CMD_JEDEC_ID 0x9f
+#define FLASH_CMD_CHIP_ERASE_ALT 0xc7
+#define FLASH_CMD_BLOCK64_ERASE 0xd8
+
+#define FLASH_STATUS_WEL_BITS 0x02
+
+#define FLASH_JEDEC_MANUFACTURER_WINBOND 0xef
+#define FLASH_JEDEC_MEMORY_TYPE 0x40
+
+static uint8_t *const flash_mem = (uint8_t *)(uintptr_t)XIP_BASE;
+static pthread_mutex_t flash_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t sector_erase_counts[FLASH_NUM_SECTORS];
+static flash_host_stats_t stats;
+static bool latency_enabled;
+static bool write_enabled; // the WEL status bit, for flash_do_cmd
+static uint8_t unique_id[FLASH_UNIQUE_ID_SIZE_BYTES];
+
+static void derive_unique_id(const char *name) {
+    // FNV-1a, so that different backing files have different IDs
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char *p = name; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 0x100000001b3ull;
+    }
+    for (uint i = 0; i < FLASH_UNIQUE_ID_SIZE_BYTES; i++) {
+        unique_id[i] = (uint8_t)(hash >> (8 * (i % 8)));
+    }
+}
+
+// Map the flash before main(), so it can be read via XIP_BASE at any time
+static void __attribute__((constructor)) flash_host_init(void) {
+    const char *path = getenv("PICO_HOST_FLASH_FILE");
+    int fd = -1;
+    off_t existing_size = 0;
+    int flags = MAP_SHARED;
+    if (path) {
+        fd = open(path, O_RDWR | O_CREAT, 0666);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st)) {
+            panic("Cannot open flash file %s", path);
+        }
+        existing_size = st.st_size;
+        if (existing_size < PICO_FLASH_SIZE_BYTES && ftruncate(fd, PICO_FLASH_SIZE_BYTES)) {
+            panic("Cannot resize flash file %s", path);
+        }
+    } else {
+        flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    }
+#ifdef MAP_FIXED_NOREPLACE
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    void *mem = mmap(flash_mem, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (mem != flash_mem) {
+        panic("Cannot map flash at XIP_BASE (%p)", flash_mem);
+    }
+    if (fd >= 0) close(fd);
+    if (existing_size < PICO_FLASH_SIZE_BYTES) {
+        // new flash is erased
+        memset(flash_mem + existing_size, 0xff, (size_t)(PICO_FLASH_SIZE_BYTES - existing_size));
+    }
+    mprotect(flash_mem, PICO_FLASH_SIZE_BYTES, PROT_READ);
+    derive_unique_id(path ? path : "");
+    const char *latency = getenv("PICO_HOST_FLASH_LATENCY");
+    latency_enabled = latency ? atoi(latency) != 0 : PICO_HOST_FLASH_MODEL_LATENCY;
+}
+
+static void flash_unprotect(void) {
+    pthread_mutex_lock(&flash_mutex);
+    mprotect(flash_mem, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE);
+}
+
+static void flash_protect(void) {
+    mprotect(flash_mem, PICO_FLASH_SIZE_BYTES, PROT_READ);
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+static void model_busy_time(uint32_t us) {
+    stats.modelled_busy_time_us += us;
+    if (latency_enabled) busy_wait_us_32(us);
+}
+
+// erase whole sectors, with flash_mutex held; erase_unit is the size of the erase command used
+static void do_erase(uint32_t flash_offs, size_t count, uint32_t erase_unit) {
+    invalid_params_if(HARDWARE_FLASH, flash_offs & (erase_unit - 1));
+    invalid_params_if(HARDWARE_FLASH, flash_offs + count > PICO_FLASH_SIZE_BYTES);
+    if (flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        panic("Flash erase of 0x%x + 0x%x is out of range", flash_offs, (uint)count);
+    }
+    memset(flash_mem + flash_offs, 0xff, count);
+    for (uint s = flash_offs / FLASH_SECTOR_SIZE; s < (flash_offs + count) / FLASH_SECTOR_SIZE; s++) {
+        uint32_t erase_count = ++sector_erase_counts[s];
+        stats.max_sector_erase_count = MAX(stats.max_sector_erase_count, erase_count);
+    }
+    stats.sectors_erased += count / FLASH_SECTOR_SIZE;
+    stats.erase_operations++;
+}
+
+// program bytes, with flash_mutex held
+static void do_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if (flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        panic("Flash program of 0x%x + 0x%x is out of range", flash_offs, (uint)count);
+    }
+    uint8_t *dst = flash_mem + flash_offs;
+    for (size_t i = 0; i < count; i++) {
+#if PICO_HOST_FLASH_CHECK_PROGRAM
+        if (data[i] & ~dst[i]) {
+            panic("Flash program at 0x%x would change 0x%02x to 0x%02x; the sector must be erased first",
+                  (uint)(flash_offs + i), dst[i], data[i]);
+        }
+#endif
+        // programming can only clear bits
+        dst[i] &= data[i];
+    }
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    invalid_params_if(HARDWARE_FLASH, flash_offs & (FLASH_SECTOR_SIZE - 1));
+    invalid_params_if(HARDWARE_FLASH, count & (FLASH_SECTOR_SIZE - 1));
+    flash_unprotect();
+    while (count) {
+        // as the bootrom does, use a 64K block erase where possible, as it is faster
+        if (!(flash_offs & (FLASH_BLOCK_SIZE - 1)) && count >= FLASH_BLOCK_SIZE) {
+            do_erase(flash_offs, FLASH_BLOCK_SIZE, FLASH_BLOCK_SIZE);
+            model_busy_time(PICO_HOST_FLASH_BLOCK_ERASE_TIME_US);
+            flash_offs += FLASH_BLOCK_SIZE;
+            count -= FLASH_BLOCK_SIZE;
+        } else {
+            size_t n = MIN(count, FLASH_SECTOR_SIZE);
+            do_erase(flash_offs, n, FLASH_SECTOR_SIZE);
+            model_busy_time(PICO_HOST_FLASH_SECTOR_ERASE_TIME_US);
+            flash_offs += (uint32_t)n;
+            count -= n;
+        }
+    }
+    flash_protect();
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    invalid_params_if(HARDWARE_FLASH, flash_offs & (FLASH_PAGE_SIZE - 1));
+    invalid_params_if(HARDWARE_FLASH, count & (FLASH_PAGE_SIZE - 1));
+    flash_unprotect();
+    do_program(flash_offs, data, count);
+    uint pages = (uint)((count + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE);
+    stats.pages_programmed += pages;
+    stats.program_operations++;
+    model_busy_time(pages * PICO_HOST_FLASH_PAGE_PROGRAM_TIME_US);
+    flash_protect();
+}
+
+void flash_get_unique_id(uint8_t *id_out) {
+    uint8_t buf[1 + 4 + FLASH_UNIQUE_ID_SIZE_BYTES] = { FLASH_CMD_UNIQUE_ID };
+    flash_do_cmd(buf, buf, sizeof(buf));
+    memcpy(id_out, buf + 5, FLASH_UNIQUE_ID_SIZE_BYTES);
+}
+
+static uint32_t cmd_address(const uint8_t *txbuf, size_t count) {
+    if (count < 4) return 0;
+    return ((uint32_t)txbuf[1] << 16 | (uint32_t)txbuf[2] << 8 | txbuf[3]) % PICO_FLASH_SIZE_BYTES;
+}
+
+// read flash into rx, wrapping at the end of the flash as a real device does
+static void cmd_read(uint32_t addr, uint8_t *rx, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        rx[i] = flash_mem[(addr + i) % PICO_FLASH_SIZE_BYTES];
+    }
+}
+
+void flash_do_cmd(const uint8_t *txbuf, uint8_t *rxbuf, size_t count) {
+    if (!count) return;
+    // txbuf and rxbuf may be the same buffer
+    uint8_t *tx = malloc(count);
+    memcpy(tx, txbuf, count);
+    memset(rxbuf, 0xff, count);
+    uint32_t addr = cmd_address(tx, count);
+    switch (tx[0]) {
+        case FLASH_CMD_JEDEC_ID: {
+            const uint8_t id[3] = { FLASH_JEDEC_MANUFACTURER_WINBOND, FLASH_JEDEC_MEMORY_TYPE,
+                                    (uint8_t)__builtin_ctz(PICO_FLASH_SIZE_BYTES) };
+            memcpy(rxbuf + 1, id, MIN(count - 1, sizeof(id)));
+            break;
+        }
+        case FLASH_CMD_UNIQUE_ID:
+            // command, 4 dummy bytes, then the ID
+            if (count > 5) memcpy(rxbuf + 5, unique_id, MIN(count - 5, FLASH_UNIQUE_ID_SIZE_BYTES));
+            break;
+        case FLASH_CMD_READ:
+            if (count > 4) cmd_read(addr, rxbuf + 4, count - 4);
+            break;
+        case FLASH_CMD_FAST_READ:
+            // command, address, 1 dummy byte, then data
+            if (count > 5) cmd_read(addr, rxbuf + 5, count - 5);
+            break;
+        case FLASH_CMD_READ_STATUS:
+            // the device is never busy, as operations complete synchronously
+            memset(rxbuf + 1, write_enabled ? FLASH_STATUS_WEL_BITS : 0, count - 1);
+            break;
+        case FLASH_CMD_READ_STATUS2:
+        case FLASH_CMD_READ_STATUS3:
+            memset(rxbuf + 1, 0, count - 1);
+            break;
+        case FLASH_CMD_WRITE_ENABLE:
+            write_enabled = true;
+            break;
+        case FLASH_CMD_WRITE_DISABLE:
+            write_enabled = false;
+            break;
+        case FLASH_CMD_PAGE_PROGRAM:
+            if (write_enabled && count > 4) {
+                flash_unprotect();
+                // as on a real device, the address wraps within the page
+                uint32_t page = addr & ~(FLASH_PAGE_SIZE - 1);
+                for (size_t i = 4; i < count; i++) {
+                    do_program(page + ((addr + (uint32_t)(i - 4)) & (FLASH_PAGE_SIZE - 1)), tx + i, 1);
+                }
+                stats.pages_programmed++;
+                stats.program_operations++;
+                model_busy_time(PICO_HOST_FLASH_PAGE_PROGRAM_TIME_US);
+                flash_protect();
+            }
+            write_enabled = false;
+            break;
+        case FLASH_CMD_SECTOR_ERASE:
+        case FLASH_CMD_BLOCK32_ERASE:
+        case FLASH_CMD_BLOCK64_ERASE:
+        case FLASH_CMD_CHIP_ERASE:
+        case FLASH_CMD_CHIP_ERASE_ALT:
+            if (write_enabled) {
+                flash_unprotect();
+                if (tx[0] == FLASH_CMD_SECTOR_ERASE) {
+                    do_erase(addr & ~(FLASH_SECTOR_SIZE - 1), FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+                    model_busy_time(PICO_HOST_FLASH_SECTOR_ERASE_TIME_US);
+                } else if (tx[0] == FLASH_CMD_BLOCK32_ERASE) {
+                    do_erase(addr & ~(FLASH_BLOCK_SIZE / 2 - 1), FLASH_BLOCK_SIZE / 2, FLASH_BLOCK_SIZE / 2);
+                    model_busy_time(PICO_HOST_FLASH_BLOCK_ERASE_TIME_US);
+                } else if (tx[0] == FLASH_CMD_BLOCK64_ERASE) {
+                    do_erase(addr & ~(FLASH_BLOCK_SIZE - 1), FLASH_BLOCK_SIZE, FLASH_BLOCK_SIZE);
+                    model_busy_time(PICO_HOST_FLASH_BLOCK_ERASE_TIME_US);
+                } else {
+                    do_erase(0, PICO_FLASH_SIZE_BYTES, FLASH_SECTOR_SIZE);
+                    model_busy_time((PICO_FLASH_SIZE_BYTES / FLASH_BLOCK_SIZE) * PICO_HOST_FLASH_BLOCK_ERASE_TIME_US);
+                }
+                flash_protect();
+            }
+            write_enabled = false;
+            break;
+        default:
+            break;
+    }
+    free(tx);
+}
+
+void flash_start_xip(void) {
+}
+
+void flash_flush_cache(void) {
+}
+
+void flash_host_get_stats(flash_host_stats_t *stats_out) {
+    pthread_mutex_lock(&flash_mutex);
+    *stats_out = stats;
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+uint32_t flash_host_get_sector_erase_count(uint sector) {
+    invalid_params_if(HARDWARE_FLASH, sector >= FLASH_NUM_SECTORS);
+    return sector < FLASH_NUM_SECTORS ? sector_erase_counts[sector] : 0;
+}
+
+void flash_host_reset_stats(void) {
+    pthread_mutex_lock(&flash_mutex);
+    memset(&stats, 0, sizeof(stats));
+    memset(sector_erase_counts, 0, sizeof(sector_erase_counts));
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+void flash_host_set_latency_enabled(bool enabled) {
+    latency_enabled = enabled;
+}
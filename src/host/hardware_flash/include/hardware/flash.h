@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_FLASH_H
+#define _HARDWARE_FLASH_H
+
+#include "pico.h"
+
+/** \file flash.h
+ *  \defgroup hardware_flash hardware_flash
+ *
+ * \brief Host model of the low level flash programming and erase API
+ *
+ * The simulated flash is PICO_FLASH_SIZE_BYTES of memory mapped at \ref XIP_BASE (as on device), so that code which
+ * reads flash contents via XIP_BASE works unchanged. The mapping is read-only except during flash operations.
+ *
+ * By default the flash is anonymous memory which starts out erased; if the environment variable
+ * PICO_HOST_FLASH_FILE is set, the flash is instead backed by (a shared mapping of) that file, so that its contents
+ * persist between runs.
+ *
+ * As with NOR flash, programming can only change bits from one to zero. By default (see PICO_HOST_FLASH_CHECK_PROGRAM),
+ * programming a zero bit back to one, i.e. programming a page which has not been erased since it was last programmed
+ * with different data, causes a panic.
+ *
+ * The number of times each sector has been erased is recorded, along with other statistics (see \ref flash_host_get_stats),
+ * and the latency of erase and program operations may optionally be modelled (see \ref flash_host_set_latency_enabled).
+ */
+
+// PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_HARDWARE_FLASH, Enable/disable assertions in the hardware_flash module, type=bool, default=0, group=hardware_flash
+#ifndef PARAM_ASSERTIONS_ENABLED_HARDWARE_FLASH
+#ifdef PARAM_ASSERTIONS_ENABLED_FLASH // backwards compatibility with SDK < 2.0.0
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_FLASH PARAM_ASSERTIONS_ENABLED_FLASH
+#else
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_FLASH 0
+#endif
+#endif
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define FLASH_BLOCK_SIZE (1u << 16)
+
+#ifndef FLASH_UNIQUE_ID_SIZE_BYTES
+#define FLASH_UNIQUE_ID_SIZE_BYTES 8
+#endif
+
+// PICO_CONFIG: PICO_FLASH_SIZE_BYTES, size of primary flash in bytes, type=int, default=2097152, group=hardware_flash
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+
+// PICO_CONFIG: PICO_HOST_FLASH_XIP_BASE, Host address at which the simulated flash is mapped, default=0x10000000 (0x200000000 on macOS), group=hardware_flash
+#ifndef PICO_HOST_FLASH_XIP_BASE
+#ifdef __APPLE__
+// the bottom 4GB of the address space is reserved on macOS
+#define PICO_HOST_FLASH_XIP_BASE 0x200000000ull
+#else
+#define PICO_HOST_FLASH_XIP_BASE 0x10000000u
+#endif
+#endif
+
+#ifndef XIP_BASE
+#define XIP_BASE PICO_HOST_FLASH_XIP_BASE
+#endif
+
+// PICO_CONFIG: PICO_HOST_FLASH_CHECK_PROGRAM, Panic if programming flash would change a zero bit to one (otherwise the result is the bitwise AND of the old and new data as on a real device), type=bool, default=1, group=hardware_flash
+#ifndef PICO_HOST_FLASH_CHECK_PROGRAM
+#define PICO_HOST_FLASH_CHECK_PROGRAM 1
+#endif
+
+// PICO_CONFIG: PICO_HOST_FLASH_MODEL_LATENCY, Default for whether the latency of flash erase and program operations is modelled (this may also be enabled at runtime by setting the environment variable PICO_HOST_FLASH_LATENCY=1), type=bool, default=0, group=hardware_flash
+#ifndef PICO_HOST_FLASH_MODEL_LATENCY
+#define PICO_HOST_FLASH_MODEL_LATENCY 0
+#endif
+
+// PICO_CONFIG: PICO_HOST_FLASH_SECTOR_ERASE_TIME_US, Modelled time to erase a 4K sector, default=45000, group=hardware_flash
+#ifndef PICO_HOST_FLASH_SECTOR_ERASE_TIME_US
+#define PICO_HOST_FLASH_SECTOR_ERASE_TIME_US 45000
+#endif
+
+// PICO_CONFIG: PICO_HOST_FLASH_BLOCK_ERASE_TIME_US, Modelled time to erase a 64K block, default=150000, group=hardware_flash
+#ifndef PICO_HOST_FLASH_BLOCK_ERASE_TIME_US
+#define PICO_HOST_FLASH_BLOCK_ERASE_TIME_US 150000
+#endif
+
+// PICO_CONFIG: PICO_HOST_FLASH_PAGE_PROGRAM_TIME_US, Modelled time to program a 256 byte page, default=700, group=hardware_flash
+#ifndef PICO_HOST_FLASH_PAGE_PROGRAM_TIME_US
+#define PICO_HOST_FLASH_PAGE_PROGRAM_TIME_US 700
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief  Initialise QSPI interface and external QSPI devices for execute-in-place
+ *  \ingroup hardware_flash
+ *
+ * This does nothing on the host.
+ */
+void flash_start_xip(void);
+
+/*! \brief  Erase areas of flash
+ *  \ingroup hardware_flash
+ *
+ * \param flash_offs Offset into flash, in bytes, to start the erase. Must be aligned to a 4096-byte flash sector.
+ * \param count Number of bytes to be erased. Must be a multiple of 4096 bytes (one sector).
+ */
+void flash_range_erase(uint32_t flash_offs, size_t count);
+
+/*! \brief  Program flash
+ *  \ingroup hardware_flash
+ *
+ * \param flash_offs Flash address of the first byte to be programmed. Must be aligned to a 256-byte flash page.
+ * \param data Pointer to the data to program into flash
+ * \param count Number of bytes to program. Must be a multiple of 256 bytes (one page).
+ */
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+/*! \brief Get flash unique 64 bit identifier
+ *  \ingroup hardware_flash
+ *
+ * On the host, this is derived from the name of the file backing the flash (if any).
+ *
+ *  \param id_out Pointer to an 8-byte buffer to which the ID will be written
+ */
+void flash_get_unique_id(uint8_t *id_out);
+
+/*! \brief Execute bidirectional flash command
+ *  \ingroup hardware_flash
+ *
+ * The host models the common commands of a Winbond W25Q series device: JEDEC ID (9Fh), unique ID (4Bh),
+ * read (03h, 0Bh), read status (05h, 35h, 15h), write enable/disable (06h, 04h), page program (02h) and
+ * sector, block and chip erase (20h, 52h, D8h, C7h, 60h). Other commands receive 0xff bytes.
+ *
+ *  \param txbuf Pointer to a byte buffer which will be transmitted to the flash
+ *  \param rxbuf Pointer to a byte buffer where data received from the flash will be written. txbuf and rxbuf may be the same buffer.
+ *  \param count Length in bytes of txbuf and of rxbuf
+ */
+void flash_do_cmd(const uint8_t *txbuf, uint8_t *rxbuf, size_t count);
+
+void flash_flush_cache(void);
+
+// ----------------------------------------------------------------------------
+// Host specific
+
+/*! \brief Statistics about the use of the simulated flash
+ *  \ingroup hardware_flash
+ */
+typedef struct {
+    uint64_t erase_operations;     ///< number of erase operations
+    uint64_t sectors_erased;       ///< number of 4K sectors erased
+    uint64_t program_operations;   ///< number of program operations
+    uint64_t pages_programmed;     ///< number of 256 byte pages programmed
+    uint64_t modelled_busy_time_us; ///< total modelled erase and program time (whether or not latency is enabled)
+    uint32_t max_sector_erase_count; ///< the highest erase count of any sector
+} flash_host_stats_t;
+
+/*! \brief Return statistics about the use of the simulated flash
+ *  \ingroup hardware_flash
+ *
+ * \param stats the structure to fill in
+ */
+void flash_host_get_stats(flash_host_stats_t *stats);
+
+/*! \brief Return the number of times a flash sector has been erased
+ *  \ingroup hardware_flash
+ *
+ * \param sector the sector number (i.e. the flash offset / FLASH_SECTOR_SIZE)
+ * \return the erase count
+ */
+uint32_t flash_host_get_sector_erase_count(uint sector);
+
+/*! \brief Reset the statistics and sector erase counts of the simulated flash
+ *  \ingroup hardware_flash
+ */
+void flash_host_reset_stats(void);
+
+/*! \brief Enable or disable modelling of the latency of flash erase and program operations
+ *  \ingroup hardware_flash
+ *
+ * When enabled, erase and program operations take (at least) the time specified by PICO_HOST_FLASH_SECTOR_ERASE_TIME_US,
+ * PICO_HOST_FLASH_BLOCK_ERASE_TIME_US and PICO_HOST_FLASH_PAGE_PROGRAM_TIME_US.
+ *
+ * \param enabled true to model latency
+ */
+void flash_host_set_latency_enabled(bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,27 +4,615 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+// The GPIO fabric (see hardware/gpio.h) holds the contribution of each attached process (node) to each net, and the
+// resulting net levels. It is protected by a process shared mutex, and the sequence number is incremented (and
+// waited on by the IRQ thread of each node) whenever the net levels change. Edges are accumulated for each node as
+// the levels change, so that short pulses are not missed.
+
+#define FABRIC_MAGIC 0x4f495047u // "GPIO"
+#define FABRIC_VERSION 1u
+
+// the net of a GPIO which isn't connected to anything
+#define NET_NONE 0xffu
+
+// the IRQ thread polls at this interval where futexes are not available
+#define FABRIC_POLL_US 1000
+
+typedef struct {
+    atomic_int pid;           // the process which owns the node, or 0 if free
+    uint64_t out;             // the nets driven by this node, and the levels they are driven to
+    uint64_t oe;
+    uint64_t pull_up;         // the nets pulled up or down by this node
+    uint64_t pull_down;
+    _Atomic uint64_t rose;    // the nets which have risen or fallen since the node last checked
+    _Atomic uint64_t fell;
+} gpio_fabric_node_t;
+
+typedef struct {
+    atomic_uint magic;
+    uint32_t version;
+    pthread_mutex_t mutex;
+    atomic_uint seq;
+    _Atomic uint64_t levels;
+    gpio_fabric_node_t nodes[PICO_HOST_GPIO_FABRIC_MAX_NODES];
+} gpio_fabric_t;
+
+static_assert(NUM_BANK0_GPIOS <= 32, "");
+
+static gpio_fabric_t *fabric;
+static gpio_fabric_node_t *node;
+static pthread_once_t fabric_once = PTHREAD_ONCE_INIT;
+
+// per GPIO configuration
+typedef struct {
+    uint8_t net;
+    uint8_t function;
+    uint8_t outover;
+    uint8_t oeover;
+    uint8_t inover;
+    bool input_enabled;
+    bool pull_up;
+    bool pull_down;
+} gpio_config_t;
+
+static struct {
+    pthread_mutex_t mutex;
+    gpio_config_t gpio[NUM_BANK0_GPIOS];
+    uint32_t sio_out;
+    uint32_t sio_oe;
+    uint32_t function_out[2];  // for GPIO_FUNC_PIO0 and GPIO_FUNC_PIO1
+    uint32_t function_oe[2];
+    // input processing, derived from the pad configuration
+    bool identity_map;
+    uint32_t in_enabled;
+    uint32_t in_invert;
+    uint32_t in_low;
+    uint32_t in_high;
+    // interrupts
+    uint32_t edge_rise;       // latched edge events
+    uint32_t edge_fall;
+    uint32_t irq_enabled[NUM_CORES][4]; // for each core, the GPIOs with each event (GPIO_IRQ_LEVEL_LOW etc.) enabled
+    gpio_irq_callback_t callbacks[NUM_CORES];
+} gpio_state = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static pthread_once_t irq_thread_once = PTHREAD_ONCE_INIT;
+static atomic_bool irq_thread_started;
+
+static void fabric_lock(void) {
+#if defined(__linux__)
+    if (pthread_mutex_lock(&fabric->mutex) == EOWNERDEAD) {
+        // a process died while holding the mutex; the node state is always consistent, so carry on
+        pthread_mutex_consistent(&fabric->mutex);
+    }
+#else
+    pthread_mutex_lock(&fabric->mutex);
+#endif
+}
+
+static void fabric_unlock(void) {
+    pthread_mutex_unlock(&fabric->mutex);
+}
+
+static void fabric_wake(void) {
+#if defined(__linux__)
+    syscall(SYS_futex, &fabric->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+static void fabric_wait(uint seq) {
+#if defined(__linux__)
+    syscall(SYS_futex, &fabric->seq, FUTEX_WAIT, seq, NULL, NULL, 0);
+#else
+    ((void)seq);
+    usleep(FABRIC_POLL_US);
+#endif
+}
+
+// recompute the net levels from the contributions of all nodes; must be called with the fabric locked
+static void fabric_resolve(void) {
+    uint64_t driven = 0, driven_low = 0;
+    uint8_t pull_ups[NUM_HOST_GPIO_NETS] = {0};
+    uint8_t pull_downs[NUM_HOST_GPIO_NETS] = {0};
+    uint64_t pulled = 0;
+    for (uint i = 0; i < PICO_HOST_GPIO_FABRIC_MAX_NODES; i++) {
+        gpio_fabric_node_t *n = &fabric->nodes[i];
+        if (!atomic_load(&n->pid)) continue;
+        driven |= n->oe;
+        driven_low |= n->oe & ~n->out;
+        // both pulls enabled is a bus keeper, which doesn't pull either way
+        uint64_t up = n->pull_up & ~n->pull_down;
+        uint64_t down = n->pull_down & ~n->pull_up;
+        pulled |= up | down;
+        for (uint64_t m = up; m; m &= m - 1) pull_ups[__builtin_ctzll(m)]++;
+        for (uint64_t m = down; m; m &= m - 1) pull_downs[__builtin_ctzll(m)]++;
+    }
+    uint64_t old_levels = atomic_load(&fabric->levels);
+    uint64_t levels = old_levels;
+    for (uint64_t m = pulled & ~driven; m; m &= m - 1) {
+        uint net = (uint)__builtin_ctzll(m);
+        if (pull_ups[net] > pull_downs[net]) levels |= 1ull << net;
+        if (pull_downs[net] > pull_ups[net]) levels &= ~(1ull << net);
+    }
+    levels = (levels & ~driven) | (driven & ~driven_low);
+    if (levels == old_levels) return;
+    atomic_store(&fabric->levels, levels);
+    for (uint i = 0; i < PICO_HOST_GPIO_FABRIC_MAX_NODES; i++) {
+        gpio_fabric_node_t *n = &fabric->nodes[i];
+        if (!atomic_load(&n->pid)) continue;
+        atomic_fetch_or(&n->rose, levels & ~old_levels);
+        atomic_fetch_or(&n->fell, old_levels & ~levels);
+    }
+    atomic_fetch_add(&fabric->seq, 1);
+    fabric_wake();
+}
+
+static void fabric_detach(void) {
+    fabric_lock();
+    node->out = node->oe = node->pull_up = node->pull_down = 0;
+    atomic_store(&node->pid, 0);
+    fabric_resolve();
+    fabric_unlock();
+}
+
+static gpio_fabric_t *fabric_map(void) {
+    const char *name = getenv("PICO_HOST_GPIO_FABRIC");
+    if (!name || !*name) {
+        // a private fabric
+        void *mem = mmap(NULL, sizeof(gpio_fabric_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) panic("Failed to allocate GPIO fabric");
+        return (gpio_fabric_t *)mem;
+    }
+    bool created = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name, O_RDWR, 0666);
+    }
+    if (fd < 0) panic("Failed to open GPIO fabric %s: %s", name, strerror(errno));
+    if (created) {
+        if (ftruncate(fd, sizeof(gpio_fabric_t))) panic("Failed to size GPIO fabric %s", name);
+    } else {
+        // wait for the creator to size it
+        struct stat st;
+        while (!fstat(fd, &st) && st.st_size < (off_t)sizeof(gpio_fabric_t)) usleep(1000);
+    }
+    void *mem = mmap(NULL, sizeof(gpio_fabric_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) panic("Failed to map GPIO fabric %s", name);
+    gpio_fabric_t *f = (gpio_fabric_t *)mem;
+    if (!created) {
+        // wait for the creator to initialize it
+        for (int i = 0; atomic_load(&f->magic) != FABRIC_MAGIC; i++) {
+            if (i == 5000) panic("GPIO fabric %s was not initialized", name);
+            usleep(1000);
+        }
+        if (f->version != FABRIC_VERSION || atomic_load(&f->magic) != FABRIC_MAGIC) {
+            panic("GPIO fabric %s is incompatible", name);
+        }
+    }
+    return f;
+}
+
+static void update_input_masks(void);
+static void update_node(void);
+
+// GPIOs which are explicitly mapped to a net replace (i.e. disconnect) any GPIO which is wired to it by default
+static void parse_gpio_map(void) {
+    uint8_t nets[NUM_BANK0_GPIOS];
+    uint32_t mapped = 0;
+    uint64_t mapped_nets = 0;
+    const char *map = getenv("PICO_HOST_GPIO_MAP");
+    while (map && *map) {
+        char *end;
+        unsigned long gpio = strtoul(map, &end, 0);
+        if (end == map || *end != '=') panic("Invalid PICO_HOST_GPIO_MAP");
+        map = end + 1;
+        unsigned long net = strtoul(map, &end, 0);
+        if (end == map || (*end && *end != ',') || gpio >= NUM_BANK0_GPIOS || net >= NUM_HOST_GPIO_NETS) {
+            panic("Invalid PICO_HOST_GPIO_MAP");
+        }
+        map = *end ? end + 1 : end;
+        nets[gpio] = (uint8_t)net;
+        mapped |= 1u << gpio;
+        mapped_nets |= 1ull << net;
+    }
+    gpio_state.identity_map = true;
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++) {
+        if (mapped & (1u << i)) {
+            gpio_state.gpio[i].net = nets[i];
+        } else {
+            gpio_state.gpio[i].net = mapped_nets & (1ull << i) ? NET_NONE : (uint8_t)i;
+        }
+        if (gpio_state.gpio[i].net != i) gpio_state.identity_map = false;
+    }
+}
+
+static void fabric_init(void) {
+    parse_gpio_map();
+    // as at reset; pads are pulled down, and have their inputs enabled
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++) {
+        gpio_config_t *g = &gpio_state.gpio[i];
+        g->function = GPIO_FUNC_NULL;
+        g->input_enabled = true;
+        g->pull_down = true;
+    }
+    fabric = fabric_map();
+    if (atomic_load(&fabric->magic) != FABRIC_MAGIC) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#if defined(__linux__)
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+        pthread_mutex_init(&fabric->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        fabric->version = FABRIC_VERSION;
+        atomic_store(&fabric->magic, FABRIC_MAGIC);
+    }
+
+    fabric_lock();
+    int pid = getpid();
+    for (uint i = 0; i < PICO_HOST_GPIO_FABRIC_MAX_NODES && !node; i++) {
+        gpio_fabric_node_t *n = &fabric->nodes[i];
+        int owner = atomic_load(&n->pid);
+        // reclaim the nodes of processes which exited without detaching
+        if (!owner || (kill(owner, 0) && errno == ESRCH)) {
+            n->out = n->oe = n->pull_up = n->pull_down = 0;
+            atomic_store(&n->rose, 0);
+            atomic_store(&n->fell, 0);
+            atomic_store(&n->pid, pid);
+            node = n;
+        }
+    }
+    fabric_unlock();
+    if (!node) panic("Too many processes are attached to the GPIO fabric");
+    atexit(fabric_detach);
+    update_input_masks();
+    update_node();
+}
+
+static inline void ensure_fabric(void) {
+    pthread_once(&fabric_once, fabric_init);
+}
+
+static uint32_t gpio_lock(void) {
+    uint32_t save = save_and_disable_interrupts();
+    ensure_fabric();
+    pthread_mutex_lock(&gpio_state.mutex);
+    return save;
+}
+
+static void gpio_unlock(uint32_t save) {
+    pthread_mutex_unlock(&gpio_state.mutex);
+    restore_interrupts(save);
+}
+
+// ----------------------------------------------------------------------------
+// Pad state
+
+static void update_input_masks(void) {
+    gpio_state.in_enabled = gpio_state.in_invert = gpio_state.in_low = gpio_state.in_high = 0;
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++) {
+        const gpio_config_t *g = &gpio_state.gpio[i];
+        if (g->input_enabled) gpio_state.in_enabled |= 1u << i;
+        switch (g->inover) {
+            case GPIO_OVERRIDE_INVERT: gpio_state.in_invert |= 1u << i; break;
+            case GPIO_OVERRIDE_LOW: gpio_state.in_low |= 1u << i; break;
+            case GPIO_OVERRIDE_HIGH: gpio_state.in_high |= 1u << i; break;
+            default: break;
+        }
+    }
+}
+
+static uint override(uint value, uint over) {
+    switch (over) {
+        case GPIO_OVERRIDE_INVERT: return !value;
+        case GPIO_OVERRIDE_LOW: return 0;
+        case GPIO_OVERRIDE_HIGH: return 1;
+        default: return value;
+    }
+}
+
+// publish this process's contribution to the fabric; must be called with the gpio state locked
+static void update_node(void) {
+    uint64_t out = 0, oe = 0, pull_up = 0, pull_down = 0;
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++) {
+        const gpio_config_t *g = &gpio_state.gpio[i];
+        uint pin_out = 0, pin_oe = 0;
+        if (g->function == GPIO_FUNC_SIO) {
+            pin_out = (gpio_state.sio_out >> i) & 1u;
+            pin_oe = (gpio_state.sio_oe >> i) & 1u;
+        } else if (g->function == GPIO_FUNC_PIO0 || g->function == GPIO_FUNC_PIO1) {
+            uint index = g->function - GPIO_FUNC_PIO0;
+            pin_out = (gpio_state.function_out[index] >> i) & 1u;
+            pin_oe = (gpio_state.function_oe[index] >> i) & 1u;
+        }
+        if (g->net == NET_NONE) continue;
+        uint64_t net = 1ull << g->net;
+        if (override(pin_oe, g->oeover)) {
+            oe |= net;
+            if (override(pin_out, g->outover)) out |= net;
+        }
+        if (g->pull_up) pull_up |= net;
+        if (g->pull_down) pull_down |= net;
+    }
+    fabric_lock();
+    if (out != node->out || oe != node->oe || pull_up != node->pull_up || pull_down != node->pull_down) {
+        node->out = out;
+        node->oe = oe;
+        node->pull_up = pull_up;
+        node->pull_down = pull_down;
+        fabric_resolve();
+    }
+    fabric_unlock();
+}
+
+// map a set of nets to the GPIOs wired to them
+static uint32_t nets_to_gpios(uint64_t nets) {
+    if (gpio_state.identity_map) return (uint32_t)nets & ((1u << NUM_BANK0_GPIOS) - 1);
+    uint32_t gpios = 0;
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++) {
+        uint net = gpio_state.gpio[i].net;
+        if (net != NET_NONE && (nets & (1ull << net))) gpios |= 1u << i;
+    }
+    return gpios;
+}
+
+static uint32_t read_inputs(void) {
+    uint32_t values = nets_to_gpios(atomic_load(&fabric->levels)) & gpio_state.in_enabled;
+    return ((values ^ gpio_state.in_invert) & ~gpio_state.in_low) | gpio_state.in_high;
+}
+
+// ----------------------------------------------------------------------------
+// Interrupts
+
+// latch any edges since we last checked; must be called with the gpio state locked
+static void latch_edges(void) {
+    uint32_t rose = nets_to_gpios(atomic_exchange(&node->rose, 0));
+    uint32_t fell = nets_to_gpios(atomic_exchange(&node->fell, 0));
+    // an inverted input swaps the edges
+    uint32_t invert = gpio_state.in_invert;
+    rose &= gpio_state.in_enabled;
+    fell &= gpio_state.in_enabled;
+    gpio_state.edge_rise |= (rose & ~invert) | (fell & invert);
+    gpio_state.edge_fall |= (fell & ~invert) | (rose & invert);
+}
+
+static uint32_t event_mask(uint gpio, uint32_t inputs) {
+    uint32_t bit = 1u << gpio;
+    uint32_t events = inputs & bit ? GPIO_IRQ_LEVEL_HIGH : GPIO_IRQ_LEVEL_LOW;
+    if (gpio_state.edge_fall & bit) events |= GPIO_IRQ_EDGE_FALL;
+    if (gpio_state.edge_rise & bit) events |= GPIO_IRQ_EDGE_RISE;
+    return events;
+}
+
+static bool core_has_events(uint core, uint32_t inputs) {
+    const uint32_t *enabled = gpio_state.irq_enabled[core];
+    return (~inputs & enabled[0]) | (inputs & enabled[1]) | (gpio_state.edge_fall & enabled[2]) |
+           (gpio_state.edge_rise & enabled[3]);
+}
+
+// latch new edges, and raise IO_IRQ_BANK0 on the cores with enabled events
+static void check_irqs(void) {
+    uint32_t save = gpio_lock();
+    latch_edges();
+    uint32_t inputs = read_inputs();
+    uint32_t pending_cores = 0;
+    for (uint core = 0; core < NUM_CORES; core++) {
+        if (core_has_events(core, inputs)) pending_cores |= 1u << core;
+    }
+    gpio_unlock(save);
+    for (uint core = 0; core < NUM_CORES; core++) {
+        if (pending_cores & (1u << core)) irq_set_pending_on_core(core, IO_IRQ_BANK0);
+    }
+}
+
+static void *gpio_irq_thread(__unused void *arg) {
+    while (true) {
+        uint seq = atomic_load(&fabric->seq);
+        check_irqs();
+        fabric_wait(seq);
+    }
+    return NULL;
+}
+
+static void start_irq_thread(void) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, gpio_irq_thread, NULL);
+    pthread_detach(thread);
+    atomic_store(&irq_thread_started, true);
+}
+
+// when interrupts are in use, changes made by this process are checked for events immediately (rather than
+// waiting for the IRQ thread to notice them)
+static void changed(void) {
+    if (atomic_load(&irq_thread_started)) check_irqs();
+}
+
+static void gpio_default_irq_handler(void) {
+    uint core = get_core_num();
+    gpio_irq_callback_t callback = gpio_state.callbacks[core];
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        uint32_t save = gpio_lock();
+        latch_edges();
+        uint32_t events = event_mask(gpio, read_inputs());
+        uint32_t enabled = 0;
+        for (uint i = 0; i < 4; i++) {
+            if (gpio_state.irq_enabled[core][i] & (1u << gpio)) enabled |= 1u << i;
+        }
+        events &= enabled;
+        gpio_unlock(save);
+        if (events) {
+            gpio_acknowledge_irq(gpio, events);
+            if (callback) callback(gpio, events);
+        }
+    }
+    // level events which are still asserted re-raise the IRQ, as on device
+    changed();
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) {
+    check_gpio_param(gpio);
+    // Clear stale events which might cause immediate spurious handler entry
+    gpio_acknowledge_irq(gpio, events);
+    uint32_t save = gpio_lock();
+    uint core = get_core_num();
+    for (uint i = 0; i < 4; i++) {
+        if (events & (1u << i)) {
+            if (enabled) {
+                gpio_state.irq_enabled[core][i] |= 1u << gpio;
+            } else {
+                gpio_state.irq_enabled[core][i] &= ~(1u << gpio);
+            }
+        }
+    }
+    gpio_unlock(save);
+    if (enabled) pthread_once(&irq_thread_once, start_irq_thread);
+    changed();
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback) {
+    // first set callback, then enable the interrupt
+    gpio_set_irq_callback(callback);
+    gpio_set_irq_enabled(gpio, events, enabled);
+    if (enabled) irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+void gpio_set_irq_callback(gpio_irq_callback_t callback) {
+    uint core = get_core_num();
+    if (gpio_state.callbacks[core]) {
+        if (!callback) {
+            irq_remove_handler(IO_IRQ_BANK0, gpio_default_irq_handler);
+        }
+        gpio_state.callbacks[core] = callback;
+    } else if (callback) {
+        gpio_state.callbacks[core] = callback;
+        irq_add_shared_handler(IO_IRQ_BANK0, gpio_default_irq_handler, GPIO_IRQ_CALLBACK_ORDER_PRIORITY);
+    }
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    latch_edges();
+    uint32_t events = event_mask(gpio, read_inputs());
+    gpio_unlock(save);
+    return events;
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t events) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    latch_edges();
+    if (events & GPIO_IRQ_EDGE_FALL) gpio_state.edge_fall &= ~(1u << gpio);
+    if (events & GPIO_IRQ_EDGE_RISE) gpio_state.edge_rise &= ~(1u << gpio);
+    gpio_unlock(save);
+}
+
+// ----------------------------------------------------------------------------
+// Pad Controls + IO Muxing
+
+static void update_config(uint gpio, void (*update)(gpio_config_t *g, uint value), uint value) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    update(&gpio_state.gpio[gpio], value);
+    update_input_masks();
+    update_node();
+    gpio_unlock(save);
+    changed();
+}
+
+static void set_function(gpio_config_t *g, uint fn) {
+    g->function = (uint8_t)fn;
+    // as on device, selecting a function enables the input
+    g->input_enabled = true;
+}
+
+static void set_pulls(gpio_config_t *g, uint pulls) {
+    g->pull_up = pulls & 1u;
+    g->pull_down = pulls & 2u;
+}
+
+static void set_outover(gpio_config_t *g, uint value) {
+    g->outover = (uint8_t)value;
+}
+
+static void set_oeover(gpio_config_t *g, uint value) {
+    g->oeover = (uint8_t)value;
+}
+
+static void set_inover(gpio_config_t *g, uint value) {
+    g->inover = (uint8_t)value;
+}
+
+static void set_input_enabled(gpio_config_t *g, uint enabled) {
+    g->input_enabled = enabled;
+}
 
-// todo weak or replace? probably weak
 void gpio_set_function(uint gpio, enum gpio_function fn) {
+    update_config(gpio, set_function, fn);
+}
 
+enum gpio_function gpio_get_function(uint gpio) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    enum gpio_function fn = (enum gpio_function)gpio_state.gpio[gpio].function;
+    gpio_unlock(save);
+    return fn;
 }
 
 void gpio_pull_up(uint gpio) {
-
+    gpio_set_pulls(gpio, true, false);
 }
 
 void gpio_pull_down(uint gpio) {
-
+    gpio_set_pulls(gpio, false, true);
 }
 
 void gpio_disable_pulls(uint gpio) {
-
+    gpio_set_pulls(gpio, false, false);
 }
 
+// Note that, as on RP2040, setting both pulls enables a "bus keep" function
 void gpio_set_pulls(uint gpio, bool up, bool down) {
+    update_config(gpio, set_pulls, (up ? 1u : 0u) | (down ? 2u : 0u));
+}
+
+bool gpio_is_pulled_up(uint gpio) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    bool pulled = gpio_state.gpio[gpio].pull_up;
+    gpio_unlock(save);
+    return pulled;
+}
 
+bool gpio_is_pulled_down(uint gpio) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    bool pulled = gpio_state.gpio[gpio].pull_down;
+    gpio_unlock(save);
+    return pulled;
 }
 
 void gpio_set_irqover(uint gpio, uint value) {
@@ -32,15 +620,15 @@ void gpio_set_irqover(uint gpio, uint value) {
 }
 
 void gpio_set_outover(uint gpio, uint value) {
-
+    update_config(gpio, set_outover, value);
 }
 
 void gpio_set_inover(uint gpio, uint value) {
-
+    update_config(gpio, set_inover, value);
 }
 
 void gpio_set_oeover(uint gpio, uint value) {
-
+    update_config(gpio, set_oeover, value);
 }
 
 void gpio_set_input_hysteresis_enabled(uint gpio, bool enabled){
@@ -67,81 +655,137 @@ enum gpio_drive_strength gpio_get_drive_strength(uint gpio){
     return GPIO_DRIVE_STRENGTH_4MA;
 }
 
-
-void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enable) {
-
+void gpio_init(uint gpio) {
+    gpio_set_dir(gpio, GPIO_IN);
+    gpio_put(gpio, 0);
+    gpio_set_function(gpio, GPIO_FUNC_SIO);
 }
 
-void gpio_acknowledge_irq(uint gpio, uint32_t events) {
-
+void gpio_init_mask(uint gpio_mask) {
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++) {
+        if (gpio_mask & 1) {
+            gpio_init(i);
+        }
+        gpio_mask >>= 1;
+    }
 }
 
-void gpio_init(uint gpio) {
-
+void gpio_set_input_enabled(uint gpio, bool enable) {
+    update_config(gpio, set_input_enabled, enable);
 }
 
+// ----------------------------------------------------------------------------
+// Input
+
 PICO_WEAK_FUNCTION_DEF(gpio_get)
 
 bool PICO_WEAK_FUNCTION_IMPL_NAME(gpio_get)(uint gpio) {
-    return 0;
+    return gpio_get_all() & (1u << gpio);
 }
 
 uint32_t gpio_get_all() {
-    return 0;
+    ensure_fabric();
+    // the input masks are only updated under the lock, but reading them without it is no worse than a racing update
+    return read_inputs();
 }
 
-void gpio_set_mask(uint32_t mask) {
+// ----------------------------------------------------------------------------
+// Output
 
+static void update_sio(uint32_t out_mask, uint32_t out_values, uint32_t oe_mask, uint32_t oe_values) {
+    uint32_t save = gpio_lock();
+    gpio_state.sio_out = (gpio_state.sio_out & ~out_mask) | (out_values & out_mask);
+    gpio_state.sio_oe = (gpio_state.sio_oe & ~oe_mask) | (oe_values & oe_mask);
+    update_node();
+    gpio_unlock(save);
+    changed();
 }
 
-void gpio_clr_mask(uint32_t mask) {
+void gpio_set_mask(uint32_t mask) {
+    update_sio(mask, mask, 0, 0);
+}
 
+void gpio_clr_mask(uint32_t mask) {
+    update_sio(mask, 0, 0, 0);
 }
 
 void gpio_xor_mask(uint32_t mask) {
-
+    uint32_t save = gpio_lock();
+    gpio_state.sio_out ^= mask;
+    update_node();
+    gpio_unlock(save);
+    changed();
 }
 
 void gpio_put_masked(uint32_t mask, uint32_t value) {
-
+    update_sio(mask, value, 0, 0);
 }
 
 void gpio_put_all(uint32_t value) {
-
+    update_sio(0xffffffffu, value, 0, 0);
 }
 
 void gpio_put(uint gpio, int value) {
+    update_sio(1u << gpio, value ? 1u << gpio : 0, 0, 0);
+}
 
+bool gpio_get_out_level(uint gpio) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    bool level = gpio_state.sio_out & (1u << gpio);
+    gpio_unlock(save);
+    return level;
 }
 
-void gpio_set_dir_out_masked(uint32_t mask) {
+// ----------------------------------------------------------------------------
+// Direction
 
+void gpio_set_dir_out_masked(uint32_t mask) {
+    update_sio(0, 0, mask, mask);
 }
 
 void gpio_set_dir_in_masked(uint32_t mask) {
-
+    update_sio(0, 0, mask, 0);
 }
 
 void gpio_set_dir_masked(uint32_t mask, uint32_t value) {
-
+    update_sio(0, 0, mask, value);
 }
 
 void gpio_set_dir_all_bits(uint32_t value) {
-
+    update_sio(0, 0, 0xffffffffu, value);
 }
 
 void gpio_set_dir(uint gpio, bool out) {
-
+    update_sio(0, 0, 1u << gpio, out ? 1u << gpio : 0);
 }
 
-void gpio_debug_pins_init() {
+bool gpio_is_dir_out(uint gpio) {
+    check_gpio_param(gpio);
+    uint32_t save = gpio_lock();
+    bool out = gpio_state.sio_oe & (1u << gpio);
+    gpio_unlock(save);
+    return out;
+}
 
+uint gpio_get_dir(uint gpio) {
+    return gpio_is_dir_out(gpio);
 }
 
-void gpio_set_input_enabled(uint gpio, bool enable) {
+void gpio_debug_pins_init() {
 
 }
 
-void gpio_init_mask(uint gpio_mask) {
+// ----------------------------------------------------------------------------
+// Host specific
 
+void gpio_host_set_function_outputs(enum gpio_function fn, uint32_t values, uint32_t oes) {
+    invalid_params_if(HARDWARE_GPIO, fn != GPIO_FUNC_PIO0 && fn != GPIO_FUNC_PIO1);
+    uint index = fn - GPIO_FUNC_PIO0;
+    uint32_t save = gpio_lock();
+    gpio_state.function_out[index] = values;
+    gpio_state.function_oe[index] = oes;
+    update_node();
+    gpio_unlock(save);
+    changed();
 }
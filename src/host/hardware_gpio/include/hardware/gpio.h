@@ -13,6 +13,47 @@ extern "C" {
 
 #include "pico.h"
 
+// PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_HARDWARE_GPIO, Enable/disable assertions in the hardware_gpio module, type=bool, default=0, group=hardware_gpio
+#ifndef PARAM_ASSERTIONS_ENABLED_HARDWARE_GPIO
+#ifdef PARAM_ASSERTIONS_ENABLED_GPIO // backwards compatibility with SDK < 2.0.0
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_GPIO PARAM_ASSERTIONS_ENABLED_GPIO
+#else
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_GPIO 0
+#endif
+#endif
+
+/*
+ * On the host, GPIO pins are simulated by a "GPIO fabric" of NUM_HOST_GPIO_NETS nets (wires). Each GPIO is wired to a
+ * net (by default GPIO n is wired to net n), and the level of each net is determined by whatever drives it:
+ *
+ *  - if any attached process drives the net low, it is low; otherwise if any drives it high, it is high
+ *  - an undriven net is pulled high if more pads on it have pull-ups than pull-downs (and vice versa); otherwise it
+ *    keeps its previous level
+ *
+ * By default the fabric is private to the process, but if the environment variable PICO_HOST_GPIO_FABRIC is set to the
+ * name of a POSIX shared memory object (e.g. "/my_test_rig"), the fabric lives in that shared memory, and is shared
+ * by every process (up to PICO_HOST_GPIO_FABRIC_MAX_NODES) using the same name. Several host builds, e.g. a controller
+ * and some simulated peripherals, can thus be wired together. The shared memory object persists until it is removed
+ * (e.g. from /dev/shm on Linux). The environment variable PICO_HOST_GPIO_MAP may be used to rewire GPIOs of a process
+ * to other nets, as a comma separated list of gpio=net pairs (e.g. "0=1,1=0" to cross over a UART); a GPIO whose
+ * default net is taken by another GPIO is left unconnected.
+ *
+ * A GPIO drives its net according to its function; GPIO_FUNC_SIO pins are controlled by gpio_put etc., and
+ * GPIO_FUNC_PIO0/GPIO_FUNC_PIO1 pins by the host hardware_pio simulation. The pad output/output enable/input
+ * overrides are honored. GPIO interrupts are delivered via IO_IRQ_BANK0 of the simulated hardware_irq.
+ */
+
+// PICO_CONFIG: PICO_HOST_GPIO_FABRIC_MAX_NODES, Maximum number of processes which can share a GPIO fabric, type=int, default=16, group=hardware_gpio
+#ifndef PICO_HOST_GPIO_FABRIC_MAX_NODES
+#define PICO_HOST_GPIO_FABRIC_MAX_NODES 16
+#endif
+
+#define NUM_HOST_GPIO_NETS 64u
+
+#ifndef IO_IRQ_BANK0
+#define IO_IRQ_BANK0 13
+#endif
+
 enum gpio_function {
     GPIO_FUNC_XIP = 0,
     GPIO_FUNC_SPI = 1,
@@ -39,9 +80,34 @@ enum gpio_drive_strength {
     GPIO_DRIVE_STRENGTH_12MA = 3 ///< 12 mA nominal drive strength
 };
 
+enum gpio_override {
+    GPIO_OVERRIDE_NORMAL = 0,      ///< peripheral signal selected via \ref gpio_set_function
+    GPIO_OVERRIDE_INVERT = 1,      ///< invert peripheral signal selected via \ref gpio_set_function
+    GPIO_OVERRIDE_LOW = 2,         ///< drive low/disable output
+    GPIO_OVERRIDE_HIGH = 3,        ///< drive high/enable output
+};
+
 #define GPIO_OUT 1
 #define GPIO_IN 0
 
+enum gpio_irq_level {
+    GPIO_IRQ_LEVEL_LOW = 0x1u,  ///< IRQ when the GPIO pin is a logical 0
+    GPIO_IRQ_LEVEL_HIGH = 0x2u, ///< IRQ when the GPIO pin is a logical 1
+    GPIO_IRQ_EDGE_FALL = 0x4u,  ///< IRQ when the GPIO has transitioned from a logical 1 to a logical 0
+    GPIO_IRQ_EDGE_RISE = 0x8u,  ///< IRQ when the GPIO has transitioned from a logical 0 to a logical 1
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+// PICO_CONFIG: GPIO_IRQ_CALLBACK_ORDER_PRIORITY, IRQ priority order of the default IRQ callback, min=0, max=255, default=PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY, group=hardware_gpio
+#ifndef GPIO_IRQ_CALLBACK_ORDER_PRIORITY
+#define GPIO_IRQ_CALLBACK_ORDER_PRIORITY PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY
+#endif
+
+static inline void check_gpio_param(__unused uint gpio) {
+    invalid_params_if(HARDWARE_GPIO, gpio >= NUM_BANK0_GPIOS);
+}
+
 // ----------------------------------------------------------------------------
 // Pad Controls + IO Muxing
 // ----------------------------------------------------------------------------
@@ -59,6 +125,10 @@ void gpio_disable_pulls(uint gpio);
 
 void gpio_set_pulls(uint gpio, bool up, bool down);
 
+bool gpio_is_pulled_up(uint gpio);
+
+bool gpio_is_pulled_down(uint gpio);
+
 void gpio_set_irqover(uint gpio, uint value);
 
 void gpio_set_outover(uint gpio, uint value);
@@ -81,6 +151,24 @@ void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive);
 
 enum gpio_drive_strength gpio_get_drive_strength(uint gpio);
 
+// ----------------------------------------------------------------------------
+// Interrupts
+// ----------------------------------------------------------------------------
+
+// Enable or disable interrupts for the given events on a GPIO, for the calling core
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+
+// Set the generic callback used for GPIO IRQ events for the calling core
+void gpio_set_irq_callback(gpio_irq_callback_t callback);
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback);
+
+// Return the events that are currently pending (whether or not enabled) for a GPIO
+uint32_t gpio_get_irq_event_mask(uint gpio);
+
+// Acknowledge (clear) latched edge events for a GPIO
+void gpio_acknowledge_irq(uint gpio, uint32_t events);
+
 // Configure a GPIO for direct input/output from software
 void gpio_init(uint gpio);
 
@@ -149,6 +237,21 @@ void gpio_set_dir_all_bits(uint32_t value);
 // 0 = in
 void gpio_set_dir(uint gpio, bool out);
 
+bool gpio_is_dir_out(uint gpio);
+
+uint gpio_get_dir(uint gpio);
+
+// Get the level a single GPIO is being driven to by software (whether or not it is an output)
+bool gpio_get_out_level(uint gpio);
+
+// ----------------------------------------------------------------------------
+// Host specific
+// ----------------------------------------------------------------------------
+
+// Set the output values and output enables with which a (simulated) peripheral drives the GPIOs assigned to
+// its function; this is used by the host hardware_pio implementation
+void gpio_host_set_function_outputs(enum gpio_function fn, uint32_t values, uint32_t oes);
+
 // debugging
 #ifndef PICO_DEBUG_PIN_BASE
 #define PICO_DEBUG_PIN_BASE 19u
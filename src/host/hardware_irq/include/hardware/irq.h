@@ -24,9 +24,19 @@
 #endif
 
 #include "pico.h"
+#include "hardware/platform_defs.h"
 // TODO: No hardware/regs/intctrl.h for host yet.
 // #include "hardware/regs/intctrl.h"
 
+#ifndef PICO_NUM_VTABLE_IRQS
+#define PICO_NUM_VTABLE_IRQS NUM_IRQS
+#endif
+
+// PICO_CONFIG: PICO_HOST_IRQ_SIGNAL, Signal used to deliver simulated IRQs to the thread of a core on the host platform, type=int, default=SIGUSR1, group=hardware_irq
+#ifndef PICO_HOST_IRQ_SIGNAL
+#define PICO_HOST_IRQ_SIGNAL SIGUSR1
+#endif
+
 /** \file irq.h
  *  \defgroup hardware_irq hardware_irq
  *
@@ -304,6 +314,32 @@ void irq_clear(uint int_num);
  */
 void irq_set_pending(uint num);
 
+/*! \brief Force an interrupt to be pending on the specified core (host only)
+ *  \ingroup hardware_irq
+ *
+ * On the host platform, IRQs are simulated: each core has a set of enabled and pending IRQs, and a pending,
+ * enabled IRQ is delivered to the thread for that core (the thread which last enabled an IRQ on that core) via
+ * \ref PICO_HOST_IRQ_SIGNAL. The handler runs on that thread, interrupting whatever it was doing, unless interrupts
+ * are disabled on that thread (see save_and_disable_interrupts()), or a handler of the same or higher priority is
+ * already running there, in which case it remains pending until they are not.
+ *
+ * This method is intended for simulated hardware which runs on its own thread.
+ *
+ * \param core_num the core
+ * \param num Interrupt number
+ */
+void irq_set_pending_on_core(uint core_num, uint num);
+
+/*! \brief Force an interrupt to be pending on every core which has it enabled (host only)
+ *  \ingroup hardware_irq
+ *
+ * This is equivalent to a hardware peripheral raising its IRQ line, and is intended for simulated hardware
+ * which runs on its own thread.
+ *
+ * \param num Interrupt number
+ */
+void irq_set_pending_on_enabled_cores(uint num);
+
 
 /*! \brief Perform IRQ priority initialization for the current core
  *
@@ -4,10 +4,75 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+
 #include "hardware/irq.h"
 #include "hardware/claim.h"
+#include "hardware/sync.h"
+
+// IRQs are simulated per core. Each core has its own enabled and pending IRQs and priorities (as
+// with the per core NVIC on device). A pending, enabled IRQ is delivered to the thread currently acting
+// as that core (the last thread which enabled an IRQ on it) via a signal, and the handler is run from
+// the signal handler, so it interrupts the thread just like a real IRQ. The handler is deferred while
+// interrupts are disabled on the thread (see hardware_sync), or while a handler of the same or higher
+// priority is already active on it.
+
+#define THREAD_MODE_PRIORITY 0x100u
+
+typedef struct {
+    pthread_t thread;
+    atomic_bool has_thread;
+    atomic_uint_least32_t enabled;
+    atomic_uint_least32_t pending;
+    uint8_t priority[PICO_NUM_VTABLE_IRQS];
+} host_irq_core_t;
+
+static host_irq_core_t cores[NUM_CORES];
+
+static_assert(PICO_NUM_VTABLE_IRQS <= 32, "");
+
+#if PICO_VTABLE_PER_CORE
+static irq_handler_t vtable[NUM_CORES][PICO_NUM_VTABLE_IRQS];
+static inline irq_handler_t *vtable_ptr(void) {
+    return vtable[get_core_num()];
+}
+#else
+static irq_handler_t vtable[PICO_NUM_VTABLE_IRQS];
+static inline irq_handler_t *vtable_ptr(void) {
+    return vtable;
+}
+#endif
 
-// totally non-functional IRQ
+#if !PICO_DISABLE_SHARED_IRQ_HANDLERS
+typedef struct {
+    irq_handler_t handler;
+    uint8_t order_priority;
+} shared_irq_handler_t;
+
+// kept sorted by descending order_priority
+#if PICO_VTABLE_PER_CORE
+static shared_irq_handler_t shared_handlers[NUM_CORES][PICO_NUM_VTABLE_IRQS][PICO_MAX_SHARED_IRQ_HANDLERS];
+static inline shared_irq_handler_t *shared_handlers_ptr(uint num) {
+    return shared_handlers[get_core_num()][num];
+}
+#else
+static shared_irq_handler_t shared_handlers[PICO_NUM_VTABLE_IRQS][PICO_MAX_SHARED_IRQ_HANDLERS];
+static inline shared_irq_handler_t *shared_handlers_ptr(uint num) {
+    return shared_handlers[num];
+}
+#endif
+#endif
+
+// protects the handler tables
+static pthread_mutex_t handler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t irq_once = PTHREAD_ONCE_INIT;
+
+// the exception number of the handler running on this thread (0 if none), and its priority
+static __thread volatile uint current_exception;
+static __thread volatile uint current_priority = THREAD_MODE_PRIORITY;
 
 #if PICO_VTABLE_PER_CORE
 static uint8_t user_irq_claimed[NUM_CORES];
@@ -21,78 +86,291 @@ static inline uint8_t *user_irq_claimed_ptr(void) {
 }
 #endif
 
+static void irq_signal_handler(__unused int sig) {
+    int saved_errno = errno;
+    irq_dispatch_pending();
+    // the signal does not interrupt a wait in __wfe()/__wfi() (the wait is restarted), however, as on
+    // device, an exception should wake the core, so we generate an event
+    __sev();
+    errno = saved_errno;
+}
+
+static void irq_init_once(void) {
+    for (uint core = 0; core < NUM_CORES; core++) {
+        for (uint i = 0; i < PICO_NUM_VTABLE_IRQS; i++) {
+            cores[core].priority[i] = PICO_DEFAULT_IRQ_PRIORITY;
+        }
+    }
+    struct sigaction sa = {0};
+    sa.sa_handler = irq_signal_handler;
+    // SA_NODEFER allows a higher priority IRQ to preempt a running handler
+    sa.sa_flags = SA_RESTART | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(PICO_HOST_IRQ_SIGNAL, &sa, NULL);
+}
+
+static host_irq_core_t *this_core(void) {
+    pthread_once(&irq_once, irq_init_once);
+    return &cores[get_core_num()];
+}
+
+// make the calling thread the one which IRQs for its core are delivered to
+static void claim_core_thread(host_irq_core_t *core) {
+    if (!atomic_load(&core->has_thread) || !pthread_equal(core->thread, pthread_self())) {
+        core->thread = pthread_self();
+        atomic_store(&core->has_thread, true);
+    }
+}
+
+static void signal_core(host_irq_core_t *core) {
+    if (atomic_load(&core->has_thread)) {
+        pthread_kill(core->thread, PICO_HOST_IRQ_SIGNAL);
+    }
+}
+
+uint __get_current_exception(void) {
+    return current_exception;
+}
+
+static void call_handler(uint num) {
+    irq_handler_t handler = vtable_ptr()[num];
+    if (!handler) {
+        panic("Unhandled IRQ %d", num);
+    }
+    handler();
+}
+
+// returns the highest priority IRQ which is ready to preempt the current priority on this thread, or -1
+static int next_ready_irq(host_irq_core_t *core) {
+    uint32_t ready = atomic_load(&core->pending) & atomic_load(&core->enabled);
+    int best = -1;
+    uint best_priority = current_priority;
+    for (uint num = 0; ready; num++, ready >>= 1) {
+        // ties are resolved in favor of the lowest IRQ number, as on device
+        if ((ready & 1) && core->priority[num] < best_priority) {
+            best = (int)num;
+            best_priority = core->priority[num];
+        }
+    }
+    return best;
+}
+
+// true while irq_dispatch_pending is manipulating the interrupt mask (other than when calling a handler)
+static __thread volatile bool dispatching;
+
+void irq_dispatch_pending(void) {
+    // we re-enable interrupts ourselves below, which would otherwise call us recursively
+    if (dispatching) return;
+    // if interrupts are disabled on this thread, we will be called again when they are re-enabled
+    if (save_and_disable_interrupts()) return;
+    dispatching = true;
+    host_irq_core_t *core = this_core();
+    int num;
+    while ((num = next_ready_irq(core)) >= 0) {
+        atomic_fetch_and(&core->pending, ~(1u << num));
+        uint saved_exception = current_exception;
+        uint saved_priority = current_priority;
+        current_exception = VTABLE_FIRST_IRQ + (uint)num;
+        current_priority = core->priority[num];
+        // handlers run with interrupts enabled, so may be preempted by higher priority IRQs
+        dispatching = false;
+        restore_interrupts(0);
+        call_handler((uint)num);
+        save_and_disable_interrupts();
+        dispatching = true;
+        current_exception = saved_exception;
+        current_priority = saved_priority;
+    }
+    restore_interrupts(0);
+    dispatching = false;
+    // an IRQ signalled between the above two lines would have been ignored
+    if (next_ready_irq(core) >= 0) irq_dispatch_pending();
+}
+
 PICO_WEAK_FUNCTION_DEF(irq_set_enabled)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_set_enabled)(uint num, bool enabled) {
-    panic_unsupported();
+    check_irq_param(num);
+    irq_set_mask_enabled(1u << num, enabled);
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_is_enabled)
 bool PICO_WEAK_FUNCTION_IMPL_NAME(irq_is_enabled)(uint num) {
-    return false;
+    check_irq_param(num);
+    return atomic_load(&this_core()->enabled) & (1u << num);
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_set_mask_enabled)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_set_mask_enabled)(uint32_t mask, bool enabled) {
-    panic_unsupported();
+    host_irq_core_t *core = this_core();
+    if (enabled) {
+        claim_core_thread(core);
+        atomic_fetch_or(&core->enabled, mask);
+        // an IRQ may already be pending
+        irq_dispatch_pending();
+    } else {
+        atomic_fetch_and(&core->enabled, ~mask);
+    }
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_set_mask_n_enabled)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_set_mask_n_enabled)(uint n, uint32_t mask, bool enabled) {
-    panic_unsupported();
+    // there are only 32 IRQs on the host
+    if (!n) irq_set_mask_enabled(mask, enabled);
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_set_pending)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_set_pending)(uint num) {
-    panic_unsupported();
+    check_irq_param(num);
+    host_irq_core_t *core = this_core();
+    atomic_fetch_or(&core->pending, 1u << num);
+    // taken immediately if enabled, unless masked (in which case it will be taken when unmasked)
+    irq_dispatch_pending();
 }
 
+void irq_set_pending_on_core(uint core_num, uint num) {
+    check_irq_param(num);
+    assert(core_num < NUM_CORES);
+    pthread_once(&irq_once, irq_init_once);
+    host_irq_core_t *core = &cores[core_num];
+    atomic_fetch_or(&core->pending, 1u << num);
+    if (atomic_load(&core->enabled) & (1u << num)) {
+        signal_core(core);
+    }
+}
+
+void irq_set_pending_on_enabled_cores(uint num) {
+    check_irq_param(num);
+    pthread_once(&irq_once, irq_init_once);
+    for (uint core_num = 0; core_num < NUM_CORES; core_num++) {
+        if (atomic_load(&cores[core_num].enabled) & (1u << num)) {
+            irq_set_pending_on_core(core_num, num);
+        }
+    }
+}
+
+#if !PICO_DISABLE_SHARED_IRQ_HANDLERS
+// the vtable entry for an IRQ with shared handlers; calls each in turn
+static void irq_shared_handler_chain(void) {
+    uint num = __get_current_exception() - VTABLE_FIRST_IRQ;
+    shared_irq_handler_t *handlers = shared_handlers_ptr(num);
+    for (uint i = 0; i < PICO_MAX_SHARED_IRQ_HANDLERS && handlers[i].handler; i++) {
+        handlers[i].handler();
+    }
+}
+#endif
+
 PICO_WEAK_FUNCTION_DEF(irq_has_shared_handler)
 bool PICO_WEAK_FUNCTION_IMPL_NAME(irq_has_shared_handler)(uint irq_num) {
+    check_irq_param(irq_num);
+#if !PICO_DISABLE_SHARED_IRQ_HANDLERS
+    return vtable_ptr()[irq_num] == irq_shared_handler_chain;
+#else
     return false;
+#endif
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_get_vtable_handler)
 irq_handler_t PICO_WEAK_FUNCTION_IMPL_NAME(irq_get_vtable_handler)(uint num) {
-    panic_unsupported();
+    check_irq_param(num);
+    return vtable_ptr()[num];
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_set_exclusive_handler)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_set_exclusive_handler)(uint num, irq_handler_t handler) {
-    panic_unsupported();
+    check_irq_param(num);
+    pthread_mutex_lock(&handler_mutex);
+    irq_handler_t current = vtable_ptr()[num];
+    hard_assert(!current || current == handler);
+    vtable_ptr()[num] = handler;
+    pthread_mutex_unlock(&handler_mutex);
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_get_exclusive_handler)
 irq_handler_t PICO_WEAK_FUNCTION_IMPL_NAME(irq_get_exclusive_handler)(uint num) {
-    panic_unsupported();
+    check_irq_param(num);
+    irq_handler_t handler = vtable_ptr()[num];
+#if !PICO_DISABLE_SHARED_IRQ_HANDLERS
+    if (handler == irq_shared_handler_chain) return NULL;
+#endif
+    return handler;
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_add_shared_handler)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_add_shared_handler)(uint num, irq_handler_t handler, uint8_t order_priority) {
-    panic_unsupported();
+    check_irq_param(num);
+#if PICO_DISABLE_SHARED_IRQ_HANDLERS
+    irq_set_exclusive_handler(num, handler);
+#else
+    pthread_mutex_lock(&handler_mutex);
+    irq_handler_t current = vtable_ptr()[num];
+    hard_assert(!current || current == irq_shared_handler_chain); // an exclusive handler is already installed
+    shared_irq_handler_t *handlers = shared_handlers_ptr(num);
+    if (handlers[PICO_MAX_SHARED_IRQ_HANDLERS - 1].handler) {
+        panic("IRQ handlers are full");
+    }
+    // insert after any handlers of the same or higher order priority
+    uint i = 0;
+    while (handlers[i].handler && handlers[i].order_priority >= order_priority) i++;
+    for (uint j = PICO_MAX_SHARED_IRQ_HANDLERS - 1; j > i; j--) {
+        handlers[j] = handlers[j - 1];
+    }
+    handlers[i].handler = handler;
+    handlers[i].order_priority = order_priority;
+    vtable_ptr()[num] = irq_shared_handler_chain;
+    pthread_mutex_unlock(&handler_mutex);
+#endif
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_remove_handler)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_remove_handler)(uint num, irq_handler_t handler) {
-    panic_unsupported();
+    check_irq_param(num);
+    pthread_mutex_lock(&handler_mutex);
+    irq_handler_t current = vtable_ptr()[num];
+#if !PICO_DISABLE_SHARED_IRQ_HANDLERS
+    if (current == irq_shared_handler_chain) {
+        shared_irq_handler_t *handlers = shared_handlers_ptr(num);
+        for (uint i = 0; i < PICO_MAX_SHARED_IRQ_HANDLERS && handlers[i].handler; i++) {
+            if (handlers[i].handler == handler) {
+                for (; i < PICO_MAX_SHARED_IRQ_HANDLERS - 1; i++) {
+                    handlers[i] = handlers[i + 1];
+                }
+                handlers[PICO_MAX_SHARED_IRQ_HANDLERS - 1].handler = NULL;
+                break;
+            }
+        }
+        if (!handlers[0].handler) vtable_ptr()[num] = NULL;
+    } else
+#endif
+    if (current == handler) {
+        vtable_ptr()[num] = NULL;
+    }
+    pthread_mutex_unlock(&handler_mutex);
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_set_priority)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_set_priority)(uint num, uint8_t hardware_priority) {
-    panic_unsupported();
+    check_irq_param(num);
+    this_core()->priority[num] = hardware_priority;
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_get_priority)
 uint PICO_WEAK_FUNCTION_IMPL_NAME(irq_get_priority)(uint num) {
-    panic_unsupported();
+    check_irq_param(num);
+    return this_core()->priority[num];
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_clear)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_clear)(uint int_num) {
-    panic_unsupported();
+    check_irq_param(int_num);
+    atomic_fetch_and(&this_core()->pending, ~(1u << int_num));
 }
 
 PICO_WEAK_FUNCTION_DEF(irq_init_priorities)
 void PICO_WEAK_FUNCTION_IMPL_NAME(irq_init_priorities)() {
+    host_irq_core_t *core = this_core();
+    for (uint i = 0; i < PICO_NUM_VTABLE_IRQS; i++) {
+        core->priority[i] = PICO_DEFAULT_IRQ_PRIORITY;
+    }
 }
 
 static uint get_user_irq_claim_index(uint irq_num) {
@@ -0,0 +1,713 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_PIO_H
+#define _HARDWARE_PIO_H
+
+#include "pico.h"
+#include "hardware/gpio.h"
+#include "hardware/pio_instructions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file hardware/pio.h
+ *  \defgroup hardware_pio hardware_pio
+ *
+ * \brief Host model of the Programmable I/O (PIO) blocks
+ *
+ * This provides the same API as the device, with the state machines run by a PIO simulator on a background
+ * thread, so that PIO-based drivers can run end-to-end on the host. The simulator implements the full (RP2040, i.e.
+ * PIO version 0) instruction set, including side-set, delays, autopush/autopull, FIFO joining, wrapping, `mov status`,
+ * `out`/`mov exec`, and the PIO IRQ flags (which may be routed to the simulated system IRQs PIO0_IRQ_0 etc. as on device).
+ *
+ * State machines are clocked at PICO_HOST_PIO_CLOCK_HZ divided by their clock divider, so that a program takes
+ * (roughly) the same wall clock time as on device. Alternatively, the simulator may be made free running (see
+ * \ref pio_host_set_free_running), in which case the state machines run as fast as the simulator can execute them.
+ * This allows the CPU overhead of a driver to be measured independently of the speed of the PIO program it drives;
+ * the number of cycles each state machine has executed (and spent stalled) is available via \ref pio_host_get_sm_cycles
+ * and \ref pio_host_get_sm_stall_cycles.
+ *
+ * Pins driven by a PIO (i.e. those with the output enable set) read back as the value driven; other pins read the value
+ * returned by gpio_get_all(). The pin values and directions driven by each PIO are available via \ref pio_host_get_pins
+ * and \ref pio_host_get_pindirs, and are passed on to the GPIOs whose function is set to the PIO (see \ref pio_gpio_init)
+ * at the end of each batch of PICO_HOST_PIO_BATCH_CYCLES cycles.
+ *
+ * Unlike the device, the PIO registers are not memory mapped, so the FIFOs cannot be accessed by DMA.
+ */
+
+// PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_HARDWARE_PIO, Enable/disable assertions in the hardware_pio module, type=bool, default=0, group=hardware_pio
+#ifndef PARAM_ASSERTIONS_ENABLED_HARDWARE_PIO
+#ifdef PARAM_ASSERTIONS_ENABLED_PIO // backwards compatibility with SDK < 2.0.0
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_PIO PARAM_ASSERTIONS_ENABLED_PIO
+#else
+#define PARAM_ASSERTIONS_ENABLED_HARDWARE_PIO 0
+#endif
+#endif
+
+// PICO_CONFIG: PICO_HOST_PIO_CLOCK_HZ, The simulated system clock frequency from which the host PIO state machine clocks are divided, default=125000000, group=hardware_pio
+#ifndef PICO_HOST_PIO_CLOCK_HZ
+#define PICO_HOST_PIO_CLOCK_HZ 125000000
+#endif
+
+// PICO_CONFIG: PICO_HOST_PIO_FREE_RUNNING, Whether the host PIO state machines initially run as fast as possible rather than at their configured clock rate, type=bool, default=0, group=hardware_pio
+#ifndef PICO_HOST_PIO_FREE_RUNNING
+#define PICO_HOST_PIO_FREE_RUNNING 0
+#endif
+
+// PICO_CONFIG: PICO_HOST_PIO_MAX_LAG_US, The maximum time the host PIO simulator will try to catch up by if it falls behind the system clock, after which simulated time slips, default=1000, group=hardware_pio
+#ifndef PICO_HOST_PIO_MAX_LAG_US
+#define PICO_HOST_PIO_MAX_LAG_US 1000
+#endif
+
+// PICO_CONFIG: PICO_HOST_PIO_BATCH_CYCLES, The number of system clock cycles the host PIO simulator runs between releasing its lock, default=4096, group=hardware_pio
+#ifndef PICO_HOST_PIO_BATCH_CYCLES
+#define PICO_HOST_PIO_BATCH_CYCLES 4096
+#endif
+
+// PICO_CONFIG: PICO_PIO_VERSION, PIO hardware version, type=int, default=0 on the host, group=hardware_pio
+#ifndef PICO_PIO_VERSION
+#define PICO_PIO_VERSION 0
+#endif
+static_assert(PICO_PIO_VERSION == 0, "only PIO version 0 is simulated on the host");
+
+#ifndef NUM_PIOS
+#define NUM_PIOS 2u
+#endif
+
+#ifndef NUM_PIO_STATE_MACHINES
+#define NUM_PIO_STATE_MACHINES 4u
+#endif
+
+#ifndef NUM_PIO_IRQS
+#define NUM_PIO_IRQS 2u
+#endif
+
+#ifndef PIO_INSTRUCTION_COUNT
+#define PIO_INSTRUCTION_COUNT 32u
+#endif
+
+#ifndef PIO0_IRQ_0
+#define PIO0_IRQ_0 7
+#define PIO0_IRQ_1 8
+#define PIO1_IRQ_0 9
+#define PIO1_IRQ_1 10
+#endif
+
+#ifndef DREQ_PIO0_TX0
+#define DREQ_PIO0_TX0 0
+#define DREQ_PIO0_RX0 4
+#define DREQ_PIO1_TX0 8
+#define DREQ_PIO1_RX0 12
+#endif
+
+// The register layouts match those of the RP2040
+#define PIO_SM0_CLKDIV_INT_BITS 0xffff0000u
+#define PIO_SM0_CLKDIV_INT_LSB 16u
+#define PIO_SM0_CLKDIV_FRAC_BITS 0x0000ff00u
+#define PIO_SM0_CLKDIV_FRAC_LSB 8u
+#define PIO_SM0_EXECCTRL_EXEC_STALLED_BITS 0x80000000u
+#define PIO_SM0_EXECCTRL_EXEC_STALLED_LSB 31u
+#define PIO_SM0_EXECCTRL_SIDE_EN_BITS 0x40000000u
+#define PIO_SM0_EXECCTRL_SIDE_EN_LSB 30u
+#define PIO_SM0_EXECCTRL_SIDE_PINDIR_BITS 0x20000000u
+#define PIO_SM0_EXECCTRL_SIDE_PINDIR_LSB 29u
+#define PIO_SM0_EXECCTRL_JMP_PIN_BITS 0x1f000000u
+#define PIO_SM0_EXECCTRL_JMP_PIN_LSB 24u
+#define PIO_SM0_EXECCTRL_OUT_EN_SEL_BITS 0x00f80000u
+#define PIO_SM0_EXECCTRL_OUT_EN_SEL_LSB 19u
+#define PIO_SM0_EXECCTRL_INLINE_OUT_EN_BITS 0x00040000u
+#define PIO_SM0_EXECCTRL_INLINE_OUT_EN_LSB 18u
+#define PIO_SM0_EXECCTRL_OUT_STICKY_BITS 0x00020000u
+#define PIO_SM0_EXECCTRL_OUT_STICKY_LSB 17u
+#define PIO_SM0_EXECCTRL_WRAP_TOP_BITS 0x0001f000u
+#define PIO_SM0_EXECCTRL_WRAP_TOP_LSB 12u
+#define PIO_SM0_EXECCTRL_WRAP_BOTTOM_BITS 0x00000f80u
+#define PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB 7u
+#define PIO_SM0_EXECCTRL_STATUS_SEL_BITS 0x00000010u
+#define PIO_SM0_EXECCTRL_STATUS_SEL_LSB 4u
+#define PIO_SM0_EXECCTRL_STATUS_N_BITS 0x0000000fu
+#define PIO_SM0_EXECCTRL_STATUS_N_LSB 0u
+#define PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS 0x80000000u
+#define PIO_SM0_SHIFTCTRL_FJOIN_RX_LSB 31u
+#define PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS 0x40000000u
+#define PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB 30u
+#define PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS 0x3e000000u
+#define PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB 25u
+#define PIO_SM0_SHIFTCTRL_PUSH_THRESH_BITS 0x01f00000u
+#define PIO_SM0_SHIFTCTRL_PUSH_THRESH_LSB 20u
+#define PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_BITS 0x00080000u
+#define PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_LSB 19u
+#define PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_BITS 0x00040000u
+#define PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_LSB 18u
+#define PIO_SM0_SHIFTCTRL_AUTOPULL_BITS 0x00020000u
+#define PIO_SM0_SHIFTCTRL_AUTOPULL_LSB 17u
+#define PIO_SM0_SHIFTCTRL_AUTOPUSH_BITS 0x00010000u
+#define PIO_SM0_SHIFTCTRL_AUTOPUSH_LSB 16u
+#define PIO_SM0_PINCTRL_SIDESET_COUNT_BITS 0xe0000000u
+#define PIO_SM0_PINCTRL_SIDESET_COUNT_LSB 29u
+#define PIO_SM0_PINCTRL_SET_COUNT_BITS 0x1c000000u
+#define PIO_SM0_PINCTRL_SET_COUNT_LSB 26u
+#define PIO_SM0_PINCTRL_OUT_COUNT_BITS 0x03f00000u
+#define PIO_SM0_PINCTRL_OUT_COUNT_LSB 20u
+#define PIO_SM0_PINCTRL_IN_BASE_BITS 0x000f8000u
+#define PIO_SM0_PINCTRL_IN_BASE_LSB 15u
+#define PIO_SM0_PINCTRL_SIDESET_BASE_BITS 0x00007c00u
+#define PIO_SM0_PINCTRL_SIDESET_BASE_LSB 10u
+#define PIO_SM0_PINCTRL_SET_BASE_BITS 0x000003e0u
+#define PIO_SM0_PINCTRL_SET_BASE_LSB 5u
+#define PIO_SM0_PINCTRL_OUT_BASE_BITS 0x0000001fu
+#define PIO_SM0_PINCTRL_OUT_BASE_LSB 0u
+#define PIO_INTR_BITS 0x00000fffu
+#define PIO_INTR_SM0_LSB 8u
+#define PIO_INTR_SM0_TXNFULL_LSB 4u
+#define PIO_INTR_SM0_RXNEMPTY_LSB 0u
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,    ///< TX FIFO length=4 is used for transmit, RX FIFO length=4 is used for receive
+    PIO_FIFO_JOIN_TX = 1,      ///< TX FIFO length=8 is used for transmit, RX FIFO is disabled
+    PIO_FIFO_JOIN_RX = 2,      ///< RX FIFO length=8 is used for receive, TX FIFO is disabled
+};
+
+enum pio_mov_status_type {
+    STATUS_TX_LESSTHAN = 0,
+    STATUS_RX_LESSTHAN = 1,
+};
+
+typedef struct pio_host_hw pio_hw_t;
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t pio_host_pio0_hw;
+extern pio_hw_t pio_host_pio1_hw;
+
+#define pio0 (&pio_host_pio0_hw)
+#define pio1 (&pio_host_pio1_hw)
+
+uint pio_get_index(PIO pio);
+
+PIO pio_get_instance(uint instance);
+
+#ifndef PIO_NUM
+#define PIO_NUM(pio) pio_get_index(pio)
+#endif
+
+#ifndef PIO_INSTANCE
+#define PIO_INSTANCE(instance) pio_get_instance(instance)
+#endif
+
+#ifndef PIO_FUNCSEL_NUM
+#define PIO_FUNCSEL_NUM(pio, gpio) ((enum gpio_function) (GPIO_FUNC_PIO0 + PIO_NUM(pio)))
+#endif
+
+#ifndef PIO_DREQ_NUM
+#define PIO_DREQ_NUM(pio, sm, is_tx) (DREQ_PIO0_TX0 + (sm) + (((is_tx) ? 0 : NUM_PIO_STATE_MACHINES) + PIO_NUM(pio) * (DREQ_PIO1_TX0 - DREQ_PIO0_TX0)))
+#endif
+
+#ifndef PIO_IRQ_NUM
+#define PIO_IRQ_NUM(pio, irqn) (PIO0_IRQ_0 + NUM_PIO_IRQS * PIO_NUM(pio) + (irqn))
+#endif
+
+static inline void check_sm_param(__unused uint sm) {
+    valid_params_if(HARDWARE_PIO, sm < NUM_PIO_STATE_MACHINES);
+}
+
+static inline void check_sm_mask(__unused uint mask) {
+    valid_params_if(HARDWARE_PIO, mask < (1u << NUM_PIO_STATE_MACHINES));
+}
+
+static inline void check_pio_param(__unused PIO pio) {
+    valid_params_if(HARDWARE_PIO, pio == pio0 || pio == pio1);
+}
+
+static inline void check_pio_pin_param(__unused uint pin) {
+    invalid_params_if(HARDWARE_PIO, pin >= 32);
+}
+
+// ----------------------------------------------------------------------------
+// State machine configuration
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+} pio_sm_config;
+
+static inline void sm_config_set_out_pin_base(pio_sm_config *c, uint out_base) {
+    check_pio_pin_param(out_base);
+    c->pinctrl = (c->pinctrl & ~PIO_SM0_PINCTRL_OUT_BASE_BITS) |
+                 ((out_base & 31) << PIO_SM0_PINCTRL_OUT_BASE_LSB);
+}
+
+static inline void sm_config_set_out_pin_count(pio_sm_config *c, uint out_count) {
+    valid_params_if(HARDWARE_PIO, out_count <= 32);
+    c->pinctrl = (c->pinctrl & ~PIO_SM0_PINCTRL_OUT_COUNT_BITS) |
+                 (out_count << PIO_SM0_PINCTRL_OUT_COUNT_LSB);
+}
+
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) {
+    sm_config_set_out_pin_base(c, out_base);
+    sm_config_set_out_pin_count(c, out_count);
+}
+
+static inline void sm_config_set_set_pin_base(pio_sm_config *c, uint set_base) {
+    check_pio_pin_param(set_base);
+    c->pinctrl = (c->pinctrl & ~PIO_SM0_PINCTRL_SET_BASE_BITS) |
+                 ((set_base & 31) << PIO_SM0_PINCTRL_SET_BASE_LSB);
+}
+
+static inline void sm_config_set_set_pin_count(pio_sm_config *c, uint set_count) {
+    valid_params_if(HARDWARE_PIO, set_count <= 5);
+    c->pinctrl = (c->pinctrl & ~PIO_SM0_PINCTRL_SET_COUNT_BITS) |
+                 (set_count << PIO_SM0_PINCTRL_SET_COUNT_LSB);
+}
+
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count) {
+    sm_config_set_set_pin_base(c, set_base);
+    sm_config_set_set_pin_count(c, set_count);
+}
+
+static inline void sm_config_set_in_pin_base(pio_sm_config *c, uint in_base) {
+    check_pio_pin_param(in_base);
+    c->pinctrl = (c->pinctrl & ~PIO_SM0_PINCTRL_IN_BASE_BITS) |
+                 ((in_base & 31) << PIO_SM0_PINCTRL_IN_BASE_LSB);
+}
+
+static inline void sm_config_set_in_pins(pio_sm_config *c, uint in_base) {
+    sm_config_set_in_pin_base(c, in_base);
+}
+
+static inline void sm_config_set_in_pin_count(pio_sm_config *c, uint in_count) {
+    // can't be changed from 32 on PIO v0
+    ((void)c);
+    valid_params_if(HARDWARE_PIO, in_count == 32);
+}
+
+static inline void sm_config_set_sideset_pin_base(pio_sm_config *c, uint sideset_base) {
+    check_pio_pin_param(sideset_base);
+    c->pinctrl = (c->pinctrl & ~PIO_SM0_PINCTRL_SIDESET_BASE_BITS) |
+                 ((sideset_base & 31) << PIO_SM0_PINCTRL_SIDESET_BASE_LSB);
+}
+
+static inline void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base) {
+    sm_config_set_sideset_pin_base(c, sideset_base);
+}
+
+static inline void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs) {
+    valid_params_if(HARDWARE_PIO, bit_count <= 5);
+    valid_params_if(HARDWARE_PIO, !optional || bit_count >= 1);
+    c->pinctrl = (c->pinctrl & ~PIO_SM0_PINCTRL_SIDESET_COUNT_BITS) |
+                 (bit_count << PIO_SM0_PINCTRL_SIDESET_COUNT_LSB);
+    c->execctrl = (c->execctrl & ~(PIO_SM0_EXECCTRL_SIDE_EN_BITS | PIO_SM0_EXECCTRL_SIDE_PINDIR_BITS)) |
+                  (bool_to_bit(optional) << PIO_SM0_EXECCTRL_SIDE_EN_LSB) |
+                  (bool_to_bit(pindirs) << PIO_SM0_EXECCTRL_SIDE_PINDIR_LSB);
+}
+
+static inline void sm_config_set_clkdiv_int_frac8(pio_sm_config *c, uint32_t div_int, uint8_t div_frac8) {
+    invalid_params_if(HARDWARE_PIO, div_int >> 16);
+    invalid_params_if(HARDWARE_PIO, div_int == 0 && div_frac8 != 0);
+    c->clkdiv =
+            (((uint)div_frac8) << PIO_SM0_CLKDIV_FRAC_LSB) |
+            (((uint)div_int) << PIO_SM0_CLKDIV_INT_LSB);
+}
+
+// backwards compatibility
+static inline void sm_config_set_clkdiv_int_frac(pio_sm_config *c, uint16_t div_int, uint8_t div_frac8) {
+    sm_config_set_clkdiv_int_frac8(c, div_int, div_frac8);
+}
+
+static inline void pio_calculate_clkdiv8_from_float(float div, uint32_t *div_int, uint8_t *div_frac8) {
+    valid_params_if(HARDWARE_PIO, div >= 1 && div <= 65536);
+    const int frac_bit_count = 8;
+#if PICO_PIO_CLKDIV_ROUND_NEAREST
+    div += 0.5f / (1 << frac_bit_count); // round to the nearest 1/256
+#endif
+    *div_int = (uint16_t)div;
+    if (*div_int == 0) {
+        *div_frac8 = 0;
+    } else {
+        *div_frac8 = (uint8_t)((div - (float)*div_int) * (1u << frac_bit_count));
+    }
+}
+
+// backwards compatibility
+static inline void pio_calculate_clkdiv_from_float(float div, uint16_t *div_int16, uint8_t *div_frac8) {
+    uint32_t div_int;
+    pio_calculate_clkdiv8_from_float(div, &div_int, div_frac8);
+    *div_int16 = (uint16_t) div_int;
+}
+
+static inline void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+    uint32_t div_int;
+    uint8_t div_frac8;
+    pio_calculate_clkdiv8_from_float(div, &div_int, &div_frac8);
+    sm_config_set_clkdiv_int_frac8(c, div_int, div_frac8);
+}
+
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+    valid_params_if(HARDWARE_PIO, wrap < PIO_INSTRUCTION_COUNT);
+    valid_params_if(HARDWARE_PIO, wrap_target < PIO_INSTRUCTION_COUNT);
+    c->execctrl = (c->execctrl & ~(PIO_SM0_EXECCTRL_WRAP_TOP_BITS | PIO_SM0_EXECCTRL_WRAP_BOTTOM_BITS)) |
+                  (wrap_target << PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB) |
+                  (wrap << PIO_SM0_EXECCTRL_WRAP_TOP_LSB);
+}
+
+static inline void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) {
+    check_pio_pin_param(pin);
+    c->execctrl = (c->execctrl & ~PIO_SM0_EXECCTRL_JMP_PIN_BITS) |
+                  ((pin & 31) << PIO_SM0_EXECCTRL_JMP_PIN_LSB);
+}
+
+static inline void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold) {
+    valid_params_if(HARDWARE_PIO, push_threshold <= 32);
+    c->shiftctrl = (c->shiftctrl &
+                    ~(PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_BITS |
+                      PIO_SM0_SHIFTCTRL_AUTOPUSH_BITS |
+                      PIO_SM0_SHIFTCTRL_PUSH_THRESH_BITS)) |
+                   (bool_to_bit(shift_right) << PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_LSB) |
+                   (bool_to_bit(autopush) << PIO_SM0_SHIFTCTRL_AUTOPUSH_LSB) |
+                   ((push_threshold & 0x1fu) << PIO_SM0_SHIFTCTRL_PUSH_THRESH_LSB);
+}
+
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+    valid_params_if(HARDWARE_PIO, pull_threshold <= 32);
+    c->shiftctrl = (c->shiftctrl &
+                    ~(PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_BITS |
+                      PIO_SM0_SHIFTCTRL_AUTOPULL_BITS |
+                      PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS)) |
+                   (bool_to_bit(shift_right) << PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_LSB) |
+                   (bool_to_bit(autopull) << PIO_SM0_SHIFTCTRL_AUTOPULL_LSB) |
+                   ((pull_threshold & 0x1fu) << PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB);
+}
+
+static inline void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) {
+    valid_params_if(HARDWARE_PIO, join == PIO_FIFO_JOIN_NONE || join == PIO_FIFO_JOIN_TX || join == PIO_FIFO_JOIN_RX);
+    c->shiftctrl = (c->shiftctrl & (uint)~(PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS | PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS)) |
+                   (((uint)join) << PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB);
+}
+
+static inline void sm_config_set_out_special(pio_sm_config *c, bool sticky, bool has_enable_pin, uint enable_bit_index) {
+    c->execctrl = (c->execctrl &
+                   (uint)~(PIO_SM0_EXECCTRL_OUT_STICKY_BITS | PIO_SM0_EXECCTRL_INLINE_OUT_EN_BITS |
+                     PIO_SM0_EXECCTRL_OUT_EN_SEL_BITS)) |
+                  (bool_to_bit(sticky) << PIO_SM0_EXECCTRL_OUT_STICKY_LSB) |
+                  (bool_to_bit(has_enable_pin) << PIO_SM0_EXECCTRL_INLINE_OUT_EN_LSB) |
+                  ((enable_bit_index << PIO_SM0_EXECCTRL_OUT_EN_SEL_LSB) & PIO_SM0_EXECCTRL_OUT_EN_SEL_BITS);
+}
+
+static inline void sm_config_set_mov_status(pio_sm_config *c, enum pio_mov_status_type status_sel, uint status_n) {
+    valid_params_if(HARDWARE_PIO, status_sel == STATUS_TX_LESSTHAN || status_sel == STATUS_RX_LESSTHAN);
+    c->execctrl = (c->execctrl
+                  & ~(PIO_SM0_EXECCTRL_STATUS_SEL_BITS | PIO_SM0_EXECCTRL_STATUS_N_BITS))
+                  | ((((uint)status_sel) << PIO_SM0_EXECCTRL_STATUS_SEL_LSB) & PIO_SM0_EXECCTRL_STATUS_SEL_BITS)
+                  | ((status_n << PIO_SM0_EXECCTRL_STATUS_N_LSB) & PIO_SM0_EXECCTRL_STATUS_N_BITS);
+}
+
+static inline pio_sm_config pio_get_default_sm_config(void) {
+    pio_sm_config c = {0};
+    sm_config_set_clkdiv_int_frac8(&c, 1, 0);
+    sm_config_set_wrap(&c, 0, 31);
+    sm_config_set_in_shift(&c, true, false, 32);
+    sm_config_set_out_shift(&c, true, false, 32);
+    return c;
+}
+
+static inline uint pio_get_gpio_base(PIO pio) {
+    ((void)pio);
+    return 0;
+}
+
+int pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config);
+
+static inline uint pio_get_funcsel(PIO pio) {
+    check_pio_param(pio);
+    return PIO_FUNCSEL_NUM(pio, 0);
+}
+
+static inline void pio_gpio_init(PIO pio, uint pin) {
+    check_pio_param(pio);
+    valid_params_if(HARDWARE_PIO, pin < NUM_BANK0_GPIOS);
+    gpio_set_function(pin, PIO_FUNCSEL_NUM(pio, pin));
+}
+
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    return PIO_DREQ_NUM(pio, sm, is_tx);
+}
+
+// ----------------------------------------------------------------------------
+// Programs
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin; // required instruction memory origin or -1
+    uint8_t pio_version;
+} pio_program_t;
+
+int pio_set_gpio_base(PIO pio, uint gpio_base);
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset);
+
+int pio_add_program(PIO pio, const pio_program_t *program);
+
+int pio_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset);
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+
+void pio_clear_instruction_memory(PIO pio);
+
+// ----------------------------------------------------------------------------
+// State machine control
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled);
+
+static inline void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+    check_sm_param(sm);
+    pio_set_sm_mask_enabled(pio, 1u << sm, enabled);
+}
+
+void pio_restart_sm_mask(PIO pio, uint32_t mask);
+
+static inline void pio_sm_restart(PIO pio, uint sm) {
+    check_sm_param(sm);
+    pio_restart_sm_mask(pio, 1u << sm);
+}
+
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask);
+
+static inline void pio_sm_clkdiv_restart(PIO pio, uint sm) {
+    check_sm_param(sm);
+    pio_clkdiv_restart_sm_mask(pio, 1u << sm);
+}
+
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask);
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm);
+
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+
+bool pio_sm_is_exec_stalled(PIO pio, uint sm);
+
+void pio_sm_exec_wait_blocking(PIO pio, uint sm, uint instr);
+
+void pio_sm_set_wrap(PIO pio, uint sm, uint wrap_target, uint wrap);
+
+void pio_sm_set_out_pins(PIO pio, uint sm, uint out_base, uint out_count);
+
+void pio_sm_set_set_pins(PIO pio, uint sm, uint set_base, uint set_count);
+
+void pio_sm_set_in_pins(PIO pio, uint sm, uint in_base);
+
+void pio_sm_set_sideset_pins(PIO pio, uint sm, uint sideset_base);
+
+void pio_sm_set_jmp_pin(PIO pio, uint sm, uint pin);
+
+void pio_sm_set_clkdiv_int_frac8(PIO pio, uint sm, uint32_t div_int, uint8_t div_frac8);
+
+// backwards compatibility
+static inline void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac8) {
+    pio_sm_set_clkdiv_int_frac8(pio, sm, div_int, div_frac8);
+}
+
+static inline void pio_sm_set_clkdiv(PIO pio, uint sm, float div) {
+    uint32_t div_int;
+    uint8_t div_frac8;
+    pio_calculate_clkdiv8_from_float(div, &div_int, &div_frac8);
+    pio_sm_set_clkdiv_int_frac8(pio, sm, div_int, div_frac8);
+}
+
+// ----------------------------------------------------------------------------
+// FIFOs
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+
+uint32_t pio_sm_get(PIO pio, uint sm);
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm);
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm);
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm);
+
+void pio_sm_clear_fifos(PIO pio, uint sm);
+
+// ----------------------------------------------------------------------------
+// Pins
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values);
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask);
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask);
+
+static inline void pio_sm_set_pins64(PIO pio, uint sm, uint64_t pin_values) {
+    pio_sm_set_pins(pio, sm, (uint32_t)pin_values);
+}
+
+static inline void pio_sm_set_pins_with_mask64(PIO pio, uint sm, uint64_t pin_values, uint64_t pin_mask) {
+    pio_sm_set_pins_with_mask(pio, sm, (uint32_t)pin_values, (uint32_t)pin_mask);
+}
+
+static inline void pio_sm_set_pindirs_with_mask64(PIO pio, uint sm, uint64_t pin_dirs, uint64_t pin_mask) {
+    pio_sm_set_pindirs_with_mask(pio, sm, (uint32_t)pin_dirs, (uint32_t)pin_mask);
+}
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pins_base, uint pin_count, bool is_out);
+
+// ----------------------------------------------------------------------------
+// Claiming
+
+void pio_sm_claim(PIO pio, uint sm);
+
+void pio_claim_sm_mask(PIO pio, uint sm_mask);
+
+void pio_sm_unclaim(PIO pio, uint sm);
+
+int pio_claim_unused_sm(PIO pio, bool required);
+
+bool pio_sm_is_claimed(PIO pio, uint sm);
+
+bool pio_claim_free_sm_and_add_program(const pio_program_t *program, PIO *pio, uint *sm, uint *offset);
+
+bool pio_claim_free_sm_and_add_program_for_gpio_range(const pio_program_t *program, PIO *pio, uint *sm, uint *offset, uint gpio_base, uint gpio_count, bool set_gpio_base);
+
+void pio_remove_program_and_unclaim_sm(const pio_program_t *program, PIO pio, uint sm, uint offset);
+
+// ----------------------------------------------------------------------------
+// Interrupts
+
+typedef enum pio_interrupt_source {
+    pis_interrupt0 = PIO_INTR_SM0_LSB,                        ///< PIO interrupt 0 is raised
+    pis_interrupt1 = PIO_INTR_SM0_LSB + 1,                    ///< PIO interrupt 1 is raised
+    pis_interrupt2 = PIO_INTR_SM0_LSB + 2,                    ///< PIO interrupt 2 is raised
+    pis_interrupt3 = PIO_INTR_SM0_LSB + 3,                    ///< PIO interrupt 3 is raised
+    pis_sm0_tx_fifo_not_full = PIO_INTR_SM0_TXNFULL_LSB,      ///< State machine 0 TX FIFO is not full
+    pis_sm1_tx_fifo_not_full = PIO_INTR_SM0_TXNFULL_LSB + 1,  ///< State machine 1 TX FIFO is not full
+    pis_sm2_tx_fifo_not_full = PIO_INTR_SM0_TXNFULL_LSB + 2,  ///< State machine 2 TX FIFO is not full
+    pis_sm3_tx_fifo_not_full = PIO_INTR_SM0_TXNFULL_LSB + 3,  ///< State machine 3 TX FIFO is not full
+    pis_sm0_rx_fifo_not_empty = PIO_INTR_SM0_RXNEMPTY_LSB,    ///< State machine 0 RX FIFO is not empty
+    pis_sm1_rx_fifo_not_empty = PIO_INTR_SM0_RXNEMPTY_LSB + 1,///< State machine 1 RX FIFO is not empty
+    pis_sm2_rx_fifo_not_empty = PIO_INTR_SM0_RXNEMPTY_LSB + 2,///< State machine 2 RX FIFO is not empty
+    pis_sm3_rx_fifo_not_empty = PIO_INTR_SM0_RXNEMPTY_LSB + 3,///< State machine 3 RX FIFO is not empty
+} pio_interrupt_source_t;
+
+void pio_set_irqn_source_mask_enabled(PIO pio, uint irq_index, uint32_t source_mask, bool enabled);
+
+static inline void pio_set_irqn_source_enabled(PIO pio, uint irq_index, pio_interrupt_source_t source, bool enabled) {
+    invalid_params_if(HARDWARE_PIO, source >= 32 || (1u << source) > PIO_INTR_BITS);
+    pio_set_irqn_source_mask_enabled(pio, irq_index, 1u << source, enabled);
+}
+
+static inline void pio_set_irq0_source_enabled(PIO pio, pio_interrupt_source_t source, bool enabled) {
+    pio_set_irqn_source_enabled(pio, 0, source, enabled);
+}
+
+static inline void pio_set_irq1_source_enabled(PIO pio, pio_interrupt_source_t source, bool enabled) {
+    pio_set_irqn_source_enabled(pio, 1, source, enabled);
+}
+
+static inline void pio_set_irq0_source_mask_enabled(PIO pio, uint32_t source_mask, bool enabled) {
+    pio_set_irqn_source_mask_enabled(pio, 0, source_mask, enabled);
+}
+
+static inline void pio_set_irq1_source_mask_enabled(PIO pio, uint32_t source_mask, bool enabled) {
+    pio_set_irqn_source_mask_enabled(pio, 1, source_mask, enabled);
+}
+
+bool pio_interrupt_get(PIO pio, uint pio_interrupt_num);
+
+void pio_interrupt_clear(PIO pio, uint pio_interrupt_num);
+
+static inline int pio_get_irq_num(PIO pio, uint irqn) {
+    check_pio_param(pio);
+    valid_params_if(HARDWARE_PIO, irqn < NUM_PIO_IRQS);
+    return PIO_IRQ_NUM(pio, irqn);
+}
+
+static inline pio_interrupt_source_t pio_get_tx_fifo_not_full_interrupt_source(uint sm) {
+    check_sm_param(sm);
+    return ((pio_interrupt_source_t)(pis_sm0_tx_fifo_not_full + sm));
+}
+
+static inline pio_interrupt_source_t pio_get_rx_fifo_not_empty_interrupt_source(uint sm) {
+    check_sm_param(sm);
+    return ((pio_interrupt_source_t)(pis_sm0_rx_fifo_not_empty + sm));
+}
+
+// ----------------------------------------------------------------------------
+// Host specific
+
+/*! \brief Set whether the simulated state machines run as fast as possible
+ *  \ingroup hardware_pio
+ *
+ * By default (see PICO_HOST_PIO_FREE_RUNNING) state machines are paced so that they execute at
+ * PICO_HOST_PIO_CLOCK_HZ divided by their clock divider.
+ *
+ * \param free_running true to run the state machines as fast as possible, false to pace them in real time
+ */
+void pio_host_set_free_running(bool free_running);
+
+/*! \brief Return the number of clock cycles a state machine has executed
+ *  \ingroup hardware_pio
+ *
+ * This counts the (divided) state machine clock cycles for which the state machine has been enabled, including
+ * those spent in delays or stalled
+ *
+ * \param pio The PIO instance; e.g. \ref pio0 or \ref pio1
+ * \param sm State machine index (0..3)
+ * \return the number of cycles executed
+ */
+uint64_t pio_host_get_sm_cycles(PIO pio, uint sm);
+
+/*! \brief Return the number of clock cycles for which a state machine has been stalled
+ *  \ingroup hardware_pio
+ *
+ * \param pio The PIO instance; e.g. \ref pio0 or \ref pio1
+ * \param sm State machine index (0..3)
+ * \return the number of cycles stalled, e.g. waiting for a FIFO, IRQ or pin
+ */
+uint64_t pio_host_get_sm_stall_cycles(PIO pio, uint sm);
+
+/*! \brief Return the pin values output by a PIO instance
+ *  \ingroup hardware_pio
+ *
+ * \param pio The PIO instance; e.g. \ref pio0 or \ref pio1
+ * \return a bit mask of the output value of pins 0-31
+ */
+uint32_t pio_host_get_pins(PIO pio);
+
+/*! \brief Return the pin directions output by a PIO instance
+ *  \ingroup hardware_pio
+ *
+ * \param pio The PIO instance; e.g. \ref pio0 or \ref pio1
+ * \return a bit mask of the output enable of pins 0-31
+ */
+uint32_t pio_host_get_pindirs(PIO pio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,8 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// the instruction encoding helpers are not hardware specific, so are shared with rp2_common
+#include "../../../../rp2_common/hardware_pio/include/hardware/pio_instructions.h"
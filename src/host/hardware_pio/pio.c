@@ -0,0 +1,1372 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "hardware/pio.h"
+#include "hardware/claim.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+// The state machines of both PIO blocks are run by a single simulator thread, which advances a simulated system
+// clock. Each enabled state machine is clocked when the system clock reaches its next divided clock edge, and
+// state machines clocked on the same system cycle run in order (so the highest numbered state machine wins when
+// several write the same pin, as on device). In real time mode, the system clock tracks the host clock (at
+// PICO_HOST_PIO_CLOCK_HZ), slipping if the simulator falls more than PICO_HOST_PIO_MAX_LAG_US behind; when every
+// enabled state machine is stalled, the thread sleeps until something changes. All state is protected by a mutex;
+// callers on a (simulated) core also disable interrupts while holding it, so that a PIO IRQ handler which calls
+// back into this API cannot deadlock. An event (__sev) is generated whenever a FIFO changes, so the blocking FIFO
+// functions wait with __wfe.
+
+#define FIFO_DEPTH 4
+#define JOINED_FIFO_DEPTH 8
+
+// maximum time the simulator sleeps when idle, so that changes to input pins are noticed
+#define IDLE_POLL_US 1000
+// minimum time the simulator sleeps when ahead of real time, to avoid running lots of tiny batches
+#define MIN_SLEEP_US 50
+
+typedef struct {
+    uint32_t entries[JOINED_FIFO_DEPTH];
+    uint8_t head;
+    uint8_t level;
+} pio_host_fifo_t;
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+    uint32_t x;
+    uint32_t y;
+    uint32_t isr;
+    uint32_t osr;
+    uint8_t isr_count;
+    uint8_t osr_count;
+    uint8_t pc;
+    uint8_t delay;              // delay cycles remaining before the next instruction
+    bool exec_pending;          // an instruction from pio_sm_exec, OUT EXEC or MOV EXEC is waiting to execute
+    bool irq_waiting;           // the current instruction is an IRQ wait whose flag has been set
+    bool parked;                // stalled, and not being clocked until something changes (see run_until)
+    uint16_t exec_instr;
+    pio_host_fifo_t tx;
+    pio_host_fifo_t rx;
+    uint32_t park_generation;
+    uint64_t next_clock;        // system clock (in 1/256ths of a cycle) of the state machine's next clock edge
+    uint64_t cycles;
+    uint64_t stall_cycles;
+} pio_host_sm_t;
+
+struct pio_host_hw {
+    uint16_t instr_mem[PIO_INSTRUCTION_COUNT];
+    uint32_t ctrl;              // enabled state machines
+    uint32_t irq;               // the 8 PIO IRQ flags
+    uint32_t inte[NUM_PIO_IRQS];
+    uint32_t raised[NUM_PIO_IRQS]; // the interrupt status for which a system IRQ has been raised
+    uint32_t pin_values;
+    uint32_t pin_dirs;
+    uint32_t published_pin_values; // the pin state last passed to hardware_gpio
+    uint32_t published_pin_dirs;
+    pio_host_sm_t sm[NUM_PIO_STATE_MACHINES];
+};
+
+pio_hw_t pio_host_pio0_hw;
+pio_hw_t pio_host_pio1_hw;
+
+static pio_hw_t *const pio_instances[NUM_PIOS] = { pio0, pio1 };
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond; // signalled when there may be new work for the simulator thread
+    uint64_t now;             // the simulated system clock, in cycles
+    uint32_t generation;      // incremented whenever the PIO IRQ flags or pin outputs change
+    uint64_t sync_cycle;      // the simulated system clock at the host time sync_us
+    uint64_t sync_us;
+    bool free_running;
+} sim = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .work_cond = PTHREAD_COND_INITIALIZER,
+    .free_running = PICO_HOST_PIO_FREE_RUNNING,
+};
+
+static pthread_once_t sim_thread_once = PTHREAD_ONCE_INIT;
+
+static uint32_t pio_lock(void) {
+    uint32_t save = save_and_disable_interrupts();
+    pthread_mutex_lock(&sim.mutex);
+    return save;
+}
+
+static void pio_unlock(uint32_t save) {
+    pthread_mutex_unlock(&sim.mutex);
+    restore_interrupts(save);
+}
+
+static inline uint field(uint32_t reg, uint32_t bits, uint lsb) {
+    return (reg & bits) >> lsb;
+}
+
+// a threshold or bit count of 0 means 32
+static inline uint count_or_32(uint n) {
+    return n ? n : 32;
+}
+
+static inline uint32_t rotate_right(uint32_t v, uint n) {
+    n &= 31;
+    return n ? (v >> n) | (v << (32 - n)) : v;
+}
+
+static uint32_t bit_reverse(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    return __builtin_bswap32(v);
+}
+
+static inline uint32_t bit_mask(uint n) {
+    return n >= 32 ? 0xffffffffu : (1u << n) - 1;
+}
+
+// ----------------------------------------------------------------------------
+// FIFOs
+
+static uint tx_fifo_depth(const pio_host_sm_t *sm) {
+    if (sm->shiftctrl & PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS) return 0;
+    return sm->shiftctrl & PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS ? JOINED_FIFO_DEPTH : FIFO_DEPTH;
+}
+
+static uint rx_fifo_depth(const pio_host_sm_t *sm) {
+    if (sm->shiftctrl & PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS) return 0;
+    return sm->shiftctrl & PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS ? JOINED_FIFO_DEPTH : FIFO_DEPTH;
+}
+
+static void fifo_push(pio_host_fifo_t *fifo, uint32_t data) {
+    fifo->entries[(fifo->head + fifo->level++) % JOINED_FIFO_DEPTH] = data;
+}
+
+static uint32_t fifo_pop(pio_host_fifo_t *fifo) {
+    uint32_t data = fifo->entries[fifo->head];
+    fifo->head = (fifo->head + 1) % JOINED_FIFO_DEPTH;
+    fifo->level--;
+    return data;
+}
+
+static void fifo_clear(pio_host_fifo_t *fifo) {
+    fifo->head = fifo->level = 0;
+}
+
+// ----------------------------------------------------------------------------
+// IRQs
+
+static uint32_t interrupt_status(pio_hw_t *pio) {
+    uint32_t intr = (pio->irq & 0xfu) << PIO_INTR_SM0_LSB;
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+        const pio_host_sm_t *sm = &pio->sm[i];
+        if (sm->rx.level) intr |= 1u << (PIO_INTR_SM0_RXNEMPTY_LSB + i);
+        if (sm->tx.level < tx_fifo_depth(sm)) intr |= 1u << (PIO_INTR_SM0_TXNFULL_LSB + i);
+    }
+    return intr;
+}
+
+// The PIO interrupts are level sensitive; a system IRQ is raised when the (enabled) interrupt status changes, and
+// again after the status is acted upon (see consume_irqs) if it is still asserted.
+static void update_irqs(pio_hw_t *pio) {
+    uint32_t intr = interrupt_status(pio);
+    for (uint i = 0; i < NUM_PIO_IRQS; i++) {
+        uint32_t ints = intr & pio->inte[i];
+        if (ints && ints != pio->raised[i]) {
+            irq_set_pending_on_enabled_cores(PIO_IRQ_NUM(pio, i));
+        }
+        pio->raised[i] = ints;
+    }
+}
+
+static void consume_irqs(pio_hw_t *pio) {
+    memset(pio->raised, 0, sizeof(pio->raised));
+    update_irqs(pio);
+}
+
+static void notify_simulator(void) {
+    pthread_cond_signal(&sim.work_cond);
+}
+
+// ----------------------------------------------------------------------------
+// Pins
+
+static uint32_t read_pins(void) {
+    uint32_t values = 0;
+    uint32_t dirs = 0;
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        values |= pio_instances[i]->pin_values & pio_instances[i]->pin_dirs;
+        dirs |= pio_instances[i]->pin_dirs;
+    }
+    return (gpio_get_all() & ~dirs) | values;
+}
+
+// write count pins starting at base (wrapping at 32) from the low bits of data
+static void write_pin_field(uint32_t *reg, uint base, uint count, uint32_t data) {
+    uint32_t mask = rotate_right(bit_mask(count), 32 - base);
+    uint32_t value = (*reg & ~mask) | (rotate_right(data, 32 - base) & mask);
+    if (value != *reg) {
+        *reg = value;
+        sim.generation++;
+    }
+}
+
+static void write_pins(pio_hw_t *pio, uint base, uint count, uint32_t data, bool pindirs) {
+    write_pin_field(pindirs ? &pio->pin_dirs : &pio->pin_values, base, count, data);
+}
+
+// pass changes to the pin outputs on to the GPIOs (which use them if their function is this PIO); this is done at
+// the end of each batch rather than for every change, as the GPIO fabric may be shared with other processes
+static void publish_pins(pio_hw_t *pio) {
+    if (pio->pin_values != pio->published_pin_values || pio->pin_dirs != pio->published_pin_dirs) {
+        pio->published_pin_values = pio->pin_values;
+        pio->published_pin_dirs = pio->pin_dirs;
+        gpio_host_set_function_outputs(PIO_FUNCSEL_NUM(pio, 0), pio->pin_values, pio->pin_dirs);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Instruction execution
+
+enum exec_result {
+    EXEC_DONE,        // the instruction completed, and the PC should advance
+    EXEC_JUMPED,      // the instruction completed, and set the PC (or latched an instruction to execute)
+    EXEC_STALLED,     // the instruction could not complete, and will be re-executed
+};
+
+static inline uint push_threshold(const pio_host_sm_t *sm) {
+    return count_or_32(field(sm->shiftctrl, PIO_SM0_SHIFTCTRL_PUSH_THRESH_BITS, PIO_SM0_SHIFTCTRL_PUSH_THRESH_LSB));
+}
+
+static inline uint pull_threshold(const pio_host_sm_t *sm) {
+    return count_or_32(field(sm->shiftctrl, PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS, PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB));
+}
+
+static void set_irq_flags(pio_hw_t *pio, uint32_t irq) {
+    if (irq != pio->irq) {
+        pio->irq = irq;
+        sim.generation++;
+    }
+}
+
+static uint irq_index(uint sm_num, uint index) {
+    // the 0x10 bit selects an index relative to the state machine number
+    if (index & 0x10) return (index & 4u) | ((index + sm_num) & 3u);
+    return index & 7u;
+}
+
+static uint32_t read_source(pio_host_sm_t *sm, uint source) {
+    switch (source) {
+        case 0: return rotate_right(read_pins(), field(sm->pinctrl, PIO_SM0_PINCTRL_IN_BASE_BITS, PIO_SM0_PINCTRL_IN_BASE_LSB));
+        case 1: return sm->x;
+        case 2: return sm->y;
+        case 5: { // STATUS
+            uint n = field(sm->execctrl, PIO_SM0_EXECCTRL_STATUS_N_BITS, PIO_SM0_EXECCTRL_STATUS_N_LSB);
+            uint level = sm->execctrl & PIO_SM0_EXECCTRL_STATUS_SEL_BITS ? sm->rx.level : sm->tx.level;
+            return level < n ? 0xffffffffu : 0;
+        }
+        case 6: return sm->isr;
+        case 7: return sm->osr;
+        default: return 0;
+    }
+}
+
+static void write_out_pins(pio_hw_t *pio, pio_host_sm_t *sm, uint32_t data, bool pindirs) {
+    if (sm->execctrl & PIO_SM0_EXECCTRL_INLINE_OUT_EN_BITS) {
+        uint sel = field(sm->execctrl, PIO_SM0_EXECCTRL_OUT_EN_SEL_BITS, PIO_SM0_EXECCTRL_OUT_EN_SEL_LSB);
+        if (!(data & (1u << sel))) return;
+    }
+    write_pins(pio, field(sm->pinctrl, PIO_SM0_PINCTRL_OUT_BASE_BITS, PIO_SM0_PINCTRL_OUT_BASE_LSB),
+               field(sm->pinctrl, PIO_SM0_PINCTRL_OUT_COUNT_BITS, PIO_SM0_PINCTRL_OUT_COUNT_LSB), data, pindirs);
+}
+
+static void write_set_pins(pio_hw_t *pio, pio_host_sm_t *sm, uint32_t data, bool pindirs) {
+    write_pins(pio, field(sm->pinctrl, PIO_SM0_PINCTRL_SET_BASE_BITS, PIO_SM0_PINCTRL_SET_BASE_LSB),
+               field(sm->pinctrl, PIO_SM0_PINCTRL_SET_COUNT_BITS, PIO_SM0_PINCTRL_SET_COUNT_LSB), data, pindirs);
+}
+
+static void latch_exec(pio_host_sm_t *sm, uint32_t instr) {
+    sm->exec_instr = (uint16_t)instr;
+    sm->exec_pending = true;
+}
+
+static enum exec_result exec_jmp(pio_host_sm_t *sm, uint instr) {
+    bool jump;
+    switch ((instr >> 5) & 7u) {
+        case 0: jump = true; break;
+        case 1: jump = !sm->x; break;
+        case 2: jump = sm->x--; break;
+        case 3: jump = !sm->y; break;
+        case 4: jump = sm->y--; break;
+        case 5: jump = sm->x != sm->y; break;
+        case 6: jump = read_pins() & (1u << field(sm->execctrl, PIO_SM0_EXECCTRL_JMP_PIN_BITS, PIO_SM0_EXECCTRL_JMP_PIN_LSB)); break;
+        default: jump = sm->osr_count < pull_threshold(sm); break;
+    }
+    if (!jump) return EXEC_DONE;
+    sm->pc = instr & 0x1fu;
+    return EXEC_JUMPED;
+}
+
+static enum exec_result exec_wait(pio_hw_t *pio, pio_host_sm_t *sm, uint sm_num, uint instr) {
+    bool polarity = instr & 0x80u;
+    uint index = instr & 0x1fu;
+    bool value;
+    switch ((instr >> 5) & 3u) {
+        case 0: // GPIO
+            value = read_pins() & (1u << index);
+            break;
+        case 1: // PIN
+            value = read_source(sm, 0) & (1u << index);
+            break;
+        case 2: { // IRQ
+            uint irq = irq_index(sm_num, index);
+            value = pio->irq & (1u << irq);
+            if (polarity && value) {
+                // waiting for an IRQ flag to be set also clears it
+                set_irq_flags(pio, pio->irq & ~(1u << irq));
+            }
+            break;
+        }
+        default:
+            return EXEC_DONE;
+    }
+    return value == polarity ? EXEC_DONE : EXEC_STALLED;
+}
+
+static void shift_in(pio_host_sm_t *sm, uint32_t data, uint n) {
+    data &= bit_mask(n);
+    if (sm->shiftctrl & PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_BITS) {
+        sm->isr = n == 32 ? data : (sm->isr >> n) | (data << (32 - n));
+    } else {
+        sm->isr = n == 32 ? data : (sm->isr << n) | data;
+    }
+    sm->isr_count = (uint8_t)MIN(32u, sm->isr_count + n);
+}
+
+static uint32_t shift_out(pio_host_sm_t *sm, uint n) {
+    uint32_t data;
+    if (sm->shiftctrl & PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_BITS) {
+        data = sm->osr & bit_mask(n);
+        sm->osr = n == 32 ? 0 : sm->osr >> n;
+    } else {
+        data = n == 32 ? sm->osr : sm->osr >> (32 - n);
+        sm->osr = n == 32 ? 0 : sm->osr << n;
+    }
+    sm->osr_count = (uint8_t)MIN(32u, sm->osr_count + n);
+    return data;
+}
+
+static bool push(pio_host_sm_t *sm) {
+    if (sm->rx.level >= rx_fifo_depth(sm)) return false;
+    fifo_push(&sm->rx, sm->isr);
+    sm->isr = 0;
+    sm->isr_count = 0;
+    __sev();
+    return true;
+}
+
+static bool pull(pio_host_sm_t *sm) {
+    if (!sm->tx.level) return false;
+    sm->osr = fifo_pop(&sm->tx);
+    sm->osr_count = 0;
+    __sev();
+    return true;
+}
+
+static enum exec_result exec_in(pio_host_sm_t *sm, uint instr) {
+    uint n = count_or_32(instr & 0x1fu);
+    bool autopush = sm->shiftctrl & PIO_SM0_SHIFTCTRL_AUTOPUSH_BITS;
+    if (autopush && sm->isr_count + n >= push_threshold(sm) && sm->rx.level >= rx_fifo_depth(sm)) {
+        // the autopush would stall, and the shift only happens once the stall clears
+        return EXEC_STALLED;
+    }
+    shift_in(sm, read_source(sm, (instr >> 5) & 7u), n);
+    if (autopush && sm->isr_count >= push_threshold(sm)) push(sm);
+    return EXEC_DONE;
+}
+
+static enum exec_result exec_out(pio_hw_t *pio, pio_host_sm_t *sm, uint instr) {
+    uint n = count_or_32(instr & 0x1fu);
+    if ((sm->shiftctrl & PIO_SM0_SHIFTCTRL_AUTOPULL_BITS) && sm->osr_count >= pull_threshold(sm)) {
+        if (!pull(sm)) return EXEC_STALLED;
+    }
+    uint32_t data = shift_out(sm, n);
+    switch ((instr >> 5) & 7u) {
+        case 0: write_out_pins(pio, sm, data, false); break;
+        case 1: sm->x = data; break;
+        case 2: sm->y = data; break;
+        case 4: write_out_pins(pio, sm, data, true); break;
+        case 5: sm->pc = data & 0x1fu; return EXEC_JUMPED;
+        case 6: sm->isr = data; sm->isr_count = (uint8_t)n; break;
+        case 7: latch_exec(sm, data); return EXEC_JUMPED;
+        default: break;
+    }
+    return EXEC_DONE;
+}
+
+static enum exec_result exec_push_pull(pio_host_sm_t *sm, uint instr) {
+    bool if_full_empty = instr & 0x40u;
+    bool block = instr & 0x20u;
+    if (instr & 0x80u) {
+        // PULL; when autopull is enabled, a PULL of a non-empty OSR does nothing
+        if ((if_full_empty || (sm->shiftctrl & PIO_SM0_SHIFTCTRL_AUTOPULL_BITS)) &&
+            sm->osr_count < pull_threshold(sm)) {
+            return EXEC_DONE;
+        }
+        if (!pull(sm)) {
+            if (block) return EXEC_STALLED;
+            // a non-blocking pull from an empty FIFO copies X
+            sm->osr = sm->x;
+            sm->osr_count = 0;
+        }
+    } else {
+        if (if_full_empty && sm->isr_count < push_threshold(sm)) return EXEC_DONE;
+        if (!push(sm)) {
+            if (block) return EXEC_STALLED;
+            // a non-blocking push to a full FIFO loses the data
+            sm->isr = 0;
+            sm->isr_count = 0;
+        }
+    }
+    return EXEC_DONE;
+}
+
+static enum exec_result exec_mov(pio_hw_t *pio, pio_host_sm_t *sm, uint instr) {
+    uint32_t data = read_source(sm, instr & 7u);
+    switch ((instr >> 3) & 3u) {
+        case 1: data = ~data; break;
+        case 2: data = bit_reverse(data); break;
+        default: break;
+    }
+    switch ((instr >> 5) & 7u) {
+        case 0: write_out_pins(pio, sm, data, false); break;
+        case 1: sm->x = data; break;
+        case 2: sm->y = data; break;
+        case 4: latch_exec(sm, data); return EXEC_JUMPED;
+        case 5: sm->pc = data & 0x1fu; return EXEC_JUMPED;
+        case 6: sm->isr = data; sm->isr_count = 0; break;
+        case 7: sm->osr = data; sm->osr_count = 0; break;
+        default: break;
+    }
+    return EXEC_DONE;
+}
+
+static enum exec_result exec_irq(pio_hw_t *pio, pio_host_sm_t *sm, uint sm_num, uint instr) {
+    uint32_t bit = 1u << irq_index(sm_num, instr & 0x1fu);
+    if (instr & 0x40u) {
+        set_irq_flags(pio, pio->irq & ~bit);
+        return EXEC_DONE;
+    }
+    if (!sm->irq_waiting) {
+        set_irq_flags(pio, pio->irq | bit);
+        if (!(instr & 0x20u)) return EXEC_DONE;
+        sm->irq_waiting = true;
+    }
+    // wait for the flag to be cleared (e.g. by another state machine, or the processor)
+    if (pio->irq & bit) return EXEC_STALLED;
+    sm->irq_waiting = false;
+    return EXEC_DONE;
+}
+
+static enum exec_result exec_set(pio_hw_t *pio, pio_host_sm_t *sm, uint instr) {
+    uint32_t data = instr & 0x1fu;
+    switch ((instr >> 5) & 7u) {
+        case 0: write_set_pins(pio, sm, data, false); break;
+        case 1: sm->x = data; break;
+        case 2: sm->y = data; break;
+        case 4: write_set_pins(pio, sm, data, true); break;
+        default: break;
+    }
+    return EXEC_DONE;
+}
+
+static void apply_sideset(pio_hw_t *pio, pio_host_sm_t *sm, uint instr, uint *delay) {
+    uint sideset_count = field(sm->pinctrl, PIO_SM0_PINCTRL_SIDESET_COUNT_BITS, PIO_SM0_PINCTRL_SIDESET_COUNT_LSB);
+    uint delay_side = (instr >> 8) & 0x1fu;
+    *delay = delay_side & bit_mask(5 - sideset_count);
+    if (!sideset_count) return;
+    uint side = delay_side >> (5 - sideset_count);
+    uint data_bits = sideset_count;
+    if (sm->execctrl & PIO_SM0_EXECCTRL_SIDE_EN_BITS) {
+        // the top bit enables the side-set (which is optional)
+        data_bits--;
+        if (!(side & (1u << data_bits))) return;
+    }
+    write_pins(pio, field(sm->pinctrl, PIO_SM0_PINCTRL_SIDESET_BASE_BITS, PIO_SM0_PINCTRL_SIDESET_BASE_LSB), data_bits,
+               side, sm->execctrl & PIO_SM0_EXECCTRL_SIDE_PINDIR_BITS);
+}
+
+// execute an instruction for one cycle, returning false if it stalled
+static bool execute(pio_hw_t *pio, uint sm_num, uint instr, bool from_exec) {
+    pio_host_sm_t *sm = &pio->sm[sm_num];
+    enum exec_result result;
+    switch (instr >> 13) {
+        case 0: result = exec_jmp(sm, instr); break;
+        case 1: result = exec_wait(pio, sm, sm_num, instr); break;
+        case 2: result = exec_in(sm, instr); break;
+        case 3: result = exec_out(pio, sm, instr); break;
+        case 4: result = exec_push_pull(sm, instr); break;
+        case 5: result = exec_mov(pio, sm, instr); break;
+        case 6: result = exec_irq(pio, sm, sm_num, instr); break;
+        default: result = exec_set(pio, sm, instr); break;
+    }
+    // side-set happens even if the instruction stalls, and takes priority over OUT/SET to the same pins
+    uint delay;
+    apply_sideset(pio, sm, instr, &delay);
+    if (result == EXEC_STALLED) return false;
+    if (result == EXEC_DONE && !from_exec) {
+        uint wrap_top = field(sm->execctrl, PIO_SM0_EXECCTRL_WRAP_TOP_BITS, PIO_SM0_EXECCTRL_WRAP_TOP_LSB);
+        uint wrap_bottom = field(sm->execctrl, PIO_SM0_EXECCTRL_WRAP_BOTTOM_BITS, PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB);
+        sm->pc = sm->pc == wrap_top ? (uint8_t)wrap_bottom : (uint8_t)((sm->pc + 1) % PIO_INSTRUCTION_COUNT);
+    }
+    sm->delay = (uint8_t)delay;
+    return true;
+}
+
+// clock a state machine for one cycle, returning false if it stalled
+static bool clock_sm(pio_hw_t *pio, uint sm_num) {
+    pio_host_sm_t *sm = &pio->sm[sm_num];
+    sm->cycles++;
+    if (sm->delay) {
+        sm->delay--;
+        return true;
+    }
+    bool executed;
+    if (sm->exec_pending) {
+        // an instruction executed via EXEC doesn't advance the PC
+        executed = execute(pio, sm_num, sm->exec_instr, true);
+        if (executed) sm->exec_pending = false;
+    } else {
+        executed = execute(pio, sm_num, pio->instr_mem[sm->pc], false);
+    }
+    if (!executed) sm->stall_cycles++;
+    return executed;
+}
+
+static uint64_t clock_divisor(const pio_host_sm_t *sm) {
+    uint div_int = field(sm->clkdiv, PIO_SM0_CLKDIV_INT_BITS, PIO_SM0_CLKDIV_INT_LSB);
+    uint div_frac = field(sm->clkdiv, PIO_SM0_CLKDIV_FRAC_BITS, PIO_SM0_CLKDIV_FRAC_LSB);
+    // an integer divisor of 0 means 65536
+    return ((uint64_t)(div_int ? div_int : 65536) << 8) + div_frac;
+}
+
+// ----------------------------------------------------------------------------
+// Simulator thread
+
+static uint64_t realtime_target(uint64_t now_us) {
+    return sim.sync_cycle + (now_us - sim.sync_us) * (uint64_t)PICO_HOST_PIO_CLOCK_HZ / 1000000;
+}
+
+static void sync_clock(uint64_t now_us) {
+    sim.sync_cycle = sim.now;
+    sim.sync_us = now_us;
+}
+
+// advance a state machine's clock edge to the first one at or after the system clock cycle now (in 1/256ths of a
+// cycle), optionally counting the skipped edges as stalled cycles
+static void catch_up(pio_host_sm_t *sm, uint64_t now, bool count_stalls) {
+    if (sm->next_clock < now) {
+        uint64_t div = clock_divisor(sm);
+        uint64_t skipped = (now - sm->next_clock + div - 1) / div;
+        if (count_stalls) {
+            sm->cycles += skipped;
+            sm->stall_cycles += skipped;
+        }
+        sm->next_clock += skipped * div;
+    }
+    sm->parked = false;
+}
+
+// Run the enabled state machines up to (but not including) the system clock cycle end, returning false if they are
+// all stalled. A stalled state machine can only be unblocked by a change to its FIFOs (which only happens via the
+// API), the IRQ flags or the pins, so it is parked (not clocked) until the IRQ flags or PIO pin outputs change;
+// state machines are also unparked at the start of each batch, so that API calls and changes to input pins
+// are noticed.
+static bool run_until(uint64_t end) {
+    pio_host_sm_t *sms[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    pio_hw_t *sm_pios[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    uint sm_nums[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    uint count = 0;
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+            if (pio_instances[p]->ctrl & (1u << i)) {
+                sm_pios[count] = pio_instances[p];
+                sm_nums[count] = i;
+                sms[count++] = &pio_instances[p]->sm[i];
+            }
+        }
+    }
+    sim.generation++;
+    uint active;
+    while (true) {
+        uint64_t edge = UINT64_MAX;
+        uint last_active = 0;
+        active = 0;
+        for (uint k = 0; k < count; k++) {
+            pio_host_sm_t *sm = sms[k];
+            if (sm->parked) {
+                if (sm->park_generation == sim.generation) continue;
+                catch_up(sm, sim.now << 8, true);
+            }
+            active++;
+            last_active = k;
+            edge = MIN(edge, sm->next_clock);
+        }
+        if (edge >= end << 8) break;
+        if (active == 1) {
+            // fast path for a single running state machine, which runs until it stalls or may have unblocked another
+            pio_host_sm_t *sm = sms[last_active];
+            uint64_t div = clock_divisor(sm);
+            uint32_t generation = sim.generation;
+            while (sm->next_clock < end << 8) {
+                sim.now = MAX(sim.now, sm->next_clock >> 8);
+                if (sm->delay) {
+                    // skip the delay cycles in one go
+                    uint64_t n = MIN(sm->delay, ((end << 8) - sm->next_clock + div - 1) / div);
+                    sm->delay = (uint8_t)(sm->delay - n);
+                    sm->cycles += n;
+                    sm->next_clock += n * div;
+                    continue;
+                }
+                bool executed = clock_sm(sm_pios[last_active], sm_nums[last_active]);
+                sm->next_clock += div;
+                if (!executed) {
+                    sm->parked = true;
+                    sm->park_generation = sim.generation;
+                    break;
+                }
+                if (sim.generation != generation) break;
+            }
+            continue;
+        }
+        sim.now = MAX(sim.now, edge >> 8);
+        for (uint k = 0; k < count; k++) {
+            pio_host_sm_t *sm = sms[k];
+            if (!sm->parked && sm->next_clock == edge) {
+                if (!clock_sm(sm_pios[k], sm_nums[k])) {
+                    sm->parked = true;
+                    sm->park_generation = sim.generation;
+                }
+                sm->next_clock += clock_divisor(sm);
+            }
+        }
+    }
+    sim.now = MAX(sim.now, end);
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        update_irqs(pio_instances[p]);
+        publish_pins(pio_instances[p]);
+    }
+    return active != 0;
+}
+
+static void wait_for_work(uint64_t wait_us) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = (uint64_t)ts.tv_nsec + wait_us * 1000;
+    ts.tv_sec += (time_t)(ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    pthread_cond_timedwait(&sim.work_cond, &sim.mutex, &ts);
+}
+
+static bool any_enabled(void) {
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        if (pio_instances[p]->ctrl) return true;
+    }
+    return false;
+}
+
+// the earliest next clock edge (in 1/256ths of a cycle) of any enabled state machine
+static uint64_t next_clock_edge(void) {
+    uint64_t next = UINT64_MAX;
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        pio_hw_t *pio = pio_instances[p];
+        for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+            if (pio->ctrl & (1u << i)) next = MIN(next, pio->sm[i].next_clock);
+        }
+    }
+    return next;
+}
+
+static void *pio_thread(__unused void *arg) {
+    pthread_mutex_lock(&sim.mutex);
+    sync_clock(time_us_64());
+    while (true) {
+        if (!any_enabled()) {
+            pthread_cond_wait(&sim.work_cond, &sim.mutex);
+            sync_clock(time_us_64());
+            continue;
+        }
+        uint64_t end = sim.now + PICO_HOST_PIO_BATCH_CYCLES;
+        if (!sim.free_running) {
+            uint64_t now_us = time_us_64();
+            uint64_t target = realtime_target(now_us);
+            if (target > sim.now + (uint64_t)PICO_HOST_PIO_MAX_LAG_US * PICO_HOST_PIO_CLOCK_HZ / 1000000) {
+                // we have fallen too far behind, so let simulated time slip
+                sync_clock(now_us);
+                target = sim.now;
+            }
+            if (target <= sim.now) {
+                // ahead of real time; wait until the next clock edge is due
+                uint64_t edge = next_clock_edge() >> 8;
+                uint64_t cycles = edge > sim.now ? edge - sim.now : 1;
+                wait_for_work(MAX(cycles * 1000000 / PICO_HOST_PIO_CLOCK_HZ, MIN_SLEEP_US));
+                continue;
+            }
+            end = MIN(end, target);
+        }
+        if (run_until(end)) {
+            // give API callers a chance to acquire the mutex between batches
+            pthread_mutex_unlock(&sim.mutex);
+            pthread_mutex_lock(&sim.mutex);
+        } else {
+            // every state machine is stalled, so nothing changes until an API call (or an input pin) does
+            wait_for_work(IDLE_POLL_US);
+            if (!sim.free_running) {
+                sim.now = MAX(sim.now, realtime_target(time_us_64()));
+            }
+        }
+    }
+    return NULL;
+}
+
+static void start_pio_thread(void) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, pio_thread, NULL);
+    pthread_detach(thread);
+}
+
+// ----------------------------------------------------------------------------
+// API
+
+uint pio_get_index(PIO pio) {
+    check_pio_param(pio);
+    return pio == pio1 ? 1 : 0;
+}
+
+PIO pio_get_instance(uint instance) {
+    invalid_params_if(HARDWARE_PIO, instance >= NUM_PIOS);
+    return pio_instances[instance];
+}
+
+int pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    pio_host_sm_t *s = &pio->sm[sm];
+    s->clkdiv = config->clkdiv;
+    s->execctrl = config->execctrl & ~PIO_SM0_EXECCTRL_EXEC_STALLED_BITS;
+    s->shiftctrl = config->shiftctrl;
+    s->pinctrl = config->pinctrl;
+    pio_unlock(save);
+    return PICO_OK;
+}
+
+// ----------------------------------------------------------------------------
+// Programs
+
+static uint8_t claimed[(NUM_PIO_STATE_MACHINES * NUM_PIOS + 7) >> 3];
+
+void pio_sm_claim(PIO pio, uint sm) {
+    check_sm_param(sm);
+    uint which = pio_get_index(pio);
+    hw_claim_or_assert(&claimed[0], which * NUM_PIO_STATE_MACHINES + sm,
+                       which ? "PIO 1 SM (%d - 4) already claimed" : "PIO 0 SM %d already claimed");
+}
+
+void pio_claim_sm_mask(PIO pio, uint sm_mask) {
+    for(uint i = 0; sm_mask; i++, sm_mask >>= 1u) {
+        if (sm_mask & 1u) pio_sm_claim(pio, i);
+    }
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+    check_sm_param(sm);
+    uint which = pio_get_index(pio);
+    hw_claim_clear(&claimed[0], which * NUM_PIO_STATE_MACHINES + sm);
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+    uint which = pio_get_index(pio);
+    uint base = which * NUM_PIO_STATE_MACHINES;
+    int index = hw_claim_unused_from_range((uint8_t*)&claimed[0], required, base,
+                                      base + NUM_PIO_STATE_MACHINES - 1, "No PIO state machines are available");
+    return index >= (int)base ? index - (int)base : -1;
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm) {
+    check_sm_param(sm);
+    uint which = pio_get_index(pio);
+    return hw_is_claimed(&claimed[0], which * NUM_PIO_STATE_MACHINES + sm);
+}
+
+static_assert(PIO_INSTRUCTION_COUNT <= 32, "");
+static uint32_t _used_instruction_space[NUM_PIOS];
+
+static int find_offset_for_program(PIO pio, const pio_program_t *program) {
+    assert(program->length <= PIO_INSTRUCTION_COUNT);
+    uint32_t used_mask = _used_instruction_space[pio_get_index(pio)];
+    uint32_t program_mask = (1u << program->length) - 1;
+    if (program->origin >= 0) {
+        if (program->origin > 32 - program->length) return PICO_ERROR_GENERIC;
+        return used_mask & (program_mask << program->origin) ? -1 : program->origin;
+    } else {
+        // work down from the top always
+        for (int i = 32 - program->length; i >= 0; i--) {
+            if (!(used_mask & (program_mask << (uint) i))) {
+                return i;
+            }
+        }
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+}
+
+int pio_set_gpio_base(PIO pio, uint gpio_base) {
+    ((void)pio);
+    invalid_params_if_and_return(PIO, gpio_base != 0, PICO_ERROR_BAD_ALIGNMENT);
+    return PICO_OK;
+}
+
+static int add_program_at_offset_check(PIO pio, const pio_program_t *program, uint offset) {
+    valid_params_if(HARDWARE_PIO, offset < PIO_INSTRUCTION_COUNT);
+    valid_params_if(HARDWARE_PIO, offset + program->length <= PIO_INSTRUCTION_COUNT);
+    if (program->pio_version) return PICO_ERROR_VERSION_MISMATCH;
+    if (program->origin >= 0 && (uint)program->origin != offset) return PICO_ERROR_BAD_ALIGNMENT; // todo better error?
+    uint32_t used_mask = _used_instruction_space[pio_get_index(pio)];
+    uint32_t program_mask = (1u << program->length) - 1;
+    return (used_mask & (program_mask << offset)) ? PICO_ERROR_INSUFFICIENT_RESOURCES : PICO_OK;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+    uint32_t save = hw_claim_lock();
+    int rc = find_offset_for_program(pio, program);
+    if (rc >= 0) rc = add_program_at_offset_check(pio, program, (uint)rc);
+    hw_claim_unlock(save);
+    return rc == 0;
+}
+
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset) {
+    uint32_t save = hw_claim_lock();
+    bool rc = add_program_at_offset_check(pio, program, offset) == 0;
+    hw_claim_unlock(save);
+    return rc;
+}
+
+static int add_program_at_offset(PIO pio, const pio_program_t *program, uint offset) {
+    int rc = add_program_at_offset_check(pio, program, offset);
+    if (rc != 0) return rc;
+    uint32_t save = pio_lock();
+    for (uint i = 0; i < program->length; ++i) {
+        uint16_t instr = program->instructions[i];
+        pio->instr_mem[offset + i] = pio_instr_bits_jmp != _pio_major_instr_bits(instr) ? instr : (uint16_t)(instr + offset);
+    }
+    pio_unlock(save);
+    uint32_t program_mask = (1u << program->length) - 1;
+    _used_instruction_space[pio_get_index(pio)] |= program_mask << offset;
+    return (int)offset;
+}
+
+// these assert if unable
+int pio_add_program(PIO pio, const pio_program_t *program) {
+    uint32_t save = hw_claim_lock();
+    int offset = find_offset_for_program(pio, program);
+    if (offset >= 0) {
+        offset = add_program_at_offset(pio, program, (uint) offset);
+    }
+    hw_claim_unlock(save);
+    return offset;
+}
+
+int pio_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset) {
+    uint32_t save = hw_claim_lock();
+    int rc = add_program_at_offset(pio, program, offset);
+    hw_claim_unlock(save);
+    return rc;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+    uint32_t program_mask = (1u << program->length) - 1;
+    program_mask <<= loaded_offset;
+    uint32_t save = hw_claim_lock();
+    assert(program_mask == (_used_instruction_space[pio_get_index(pio)] & program_mask));
+    _used_instruction_space[pio_get_index(pio)] &= ~program_mask;
+    hw_claim_unlock(save);
+}
+
+void pio_clear_instruction_memory(PIO pio) {
+    uint32_t save = hw_claim_lock();
+    _used_instruction_space[pio_get_index(pio)] = 0;
+    uint32_t save2 = pio_lock();
+    for(uint i=0;i<PIO_INSTRUCTION_COUNT;i++) {
+        pio->instr_mem[i] = (uint16_t)pio_encode_jmp(i);
+    }
+    pio_unlock(save2);
+    hw_claim_unlock(save);
+}
+
+bool pio_claim_free_sm_and_add_program(const pio_program_t *program, PIO *pio, uint *sm, uint *offset) {
+    return pio_claim_free_sm_and_add_program_for_gpio_range(program, pio, sm, offset, 0, 0, false);
+}
+
+bool pio_claim_free_sm_and_add_program_for_gpio_range(const pio_program_t *program, PIO *pio, uint *sm, uint *offset, uint gpio_base, uint gpio_count, __unused bool set_gpio_base) {
+    invalid_params_if(HARDWARE_PIO, (gpio_base + gpio_count) > NUM_BANK0_GPIOS);
+    int pio_num = NUM_PIOS;
+    while (pio_num--) {
+        *pio = pio_get_instance((uint)pio_num);
+        int sm_index = pio_claim_unused_sm(*pio, false);
+        if (sm_index < 0) continue;
+        uint32_t save = hw_claim_lock();
+        int rc = find_offset_for_program(*pio, program);
+        if (rc >= 0) rc = add_program_at_offset(*pio, program, (uint)rc);
+        hw_claim_unlock(save);
+        if (rc >= 0) {
+            *sm = (uint)sm_index;
+            *offset = (uint)rc;
+            return true;
+        }
+        pio_sm_unclaim(*pio, (uint)sm_index);
+    }
+    *pio = NULL;
+    return false;
+}
+
+void pio_remove_program_and_unclaim_sm(const pio_program_t *program, PIO pio, uint sm, uint offset) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    pio_remove_program(pio, program, offset);
+    pio_sm_unclaim(pio, sm);
+}
+
+// ----------------------------------------------------------------------------
+// State machine control
+
+static void restart_sm(pio_host_sm_t *sm) {
+    sm->isr = 0;
+    sm->isr_count = 0;
+    sm->osr = 0;
+    sm->osr_count = 32; // the OSR starts empty
+    sm->delay = 0;
+    sm->exec_pending = false;
+    sm->irq_waiting = false;
+}
+
+static void clkdiv_restart_sm(pio_host_sm_t *sm) {
+    sm->next_clock = (sim.now + 1) << 8;
+    sm->parked = false;
+}
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    valid_params_if(HARDWARE_PIO, initial_pc < PIO_INSTRUCTION_COUNT);
+    // Halt the machine, set some sensible defaults
+    pio_sm_set_enabled(pio, sm, false);
+
+    int rc;
+    if (config) {
+        rc = pio_sm_set_config(pio, sm, config);
+    } else {
+        pio_sm_config c = pio_get_default_sm_config();
+        rc = pio_sm_set_config(pio, sm, &c);
+    }
+    if (rc) return rc;
+
+    pio_sm_clear_fifos(pio, sm);
+    pio_sm_restart(pio, sm);
+    pio_sm_clkdiv_restart(pio, sm);
+    pio_sm_exec(pio, sm, pio_encode_jmp(initial_pc));
+    return PICO_OK;
+}
+
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled) {
+    check_pio_param(pio);
+    check_sm_mask(mask);
+    uint32_t save = pio_lock();
+    pthread_once(&sim_thread_once, start_pio_thread);
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+        // as on device, the clock divider keeps running while a state machine is disabled
+        if (enabled && (mask & ~pio->ctrl & (1u << i))) catch_up(&pio->sm[i], sim.now << 8, false);
+    }
+    pio->ctrl = (pio->ctrl & ~mask) | (enabled ? mask : 0u);
+    notify_simulator();
+    pio_unlock(save);
+}
+
+void pio_restart_sm_mask(PIO pio, uint32_t mask) {
+    check_pio_param(pio);
+    check_sm_mask(mask);
+    uint32_t save = pio_lock();
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+        if (mask & (1u << i)) restart_sm(&pio->sm[i]);
+    }
+    pio_unlock(save);
+}
+
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask) {
+    check_pio_param(pio);
+    check_sm_mask(mask);
+    uint32_t save = pio_lock();
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+        if (mask & (1u << i)) clkdiv_restart_sm(&pio->sm[i]);
+    }
+    pio_unlock(save);
+}
+
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask) {
+    check_pio_param(pio);
+    check_sm_mask(mask);
+    uint32_t save = pio_lock();
+    pthread_once(&sim_thread_once, start_pio_thread);
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+        if (mask & (1u << i)) clkdiv_restart_sm(&pio->sm[i]);
+    }
+    pio->ctrl |= mask;
+    notify_simulator();
+    pio_unlock(save);
+}
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    uint8_t pc = pio->sm[sm].pc;
+    pio_unlock(save);
+    return pc;
+}
+
+// as on device, an instruction is executed immediately (whether or not the state machine is enabled); if it
+// stalls, it is latched and completes once the state machine is able to run it
+static void exec_locked(PIO pio, uint sm, uint instr) {
+    pio_host_sm_t *s = &pio->sm[sm];
+    s->irq_waiting = false;
+    latch_exec(s, instr);
+    if (execute(pio, sm, instr, true)) s->exec_pending = false;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    exec_locked(pio, sm, instr);
+    update_irqs(pio);
+    publish_pins(pio);
+    notify_simulator();
+    pio_unlock(save);
+}
+
+bool pio_sm_is_exec_stalled(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    bool stalled = pio->sm[sm].exec_pending;
+    pio_unlock(save);
+    return stalled;
+}
+
+void pio_sm_exec_wait_blocking(PIO pio, uint sm, uint instr) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    pio_sm_exec(pio, sm, instr);
+    while (pio_sm_is_exec_stalled(pio, sm)) __wfe();
+}
+
+static void update_execctrl(PIO pio, uint sm, uint32_t bits, uint32_t value) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    pio->sm[sm].execctrl = (pio->sm[sm].execctrl & ~bits) | value;
+    pio_unlock(save);
+}
+
+static void update_pinctrl(PIO pio, uint sm, uint32_t bits, uint32_t value) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    pio->sm[sm].pinctrl = (pio->sm[sm].pinctrl & ~bits) | value;
+    pio_unlock(save);
+}
+
+void pio_sm_set_wrap(PIO pio, uint sm, uint wrap_target, uint wrap) {
+    valid_params_if(HARDWARE_PIO, wrap < PIO_INSTRUCTION_COUNT);
+    valid_params_if(HARDWARE_PIO, wrap_target < PIO_INSTRUCTION_COUNT);
+    update_execctrl(pio, sm, PIO_SM0_EXECCTRL_WRAP_TOP_BITS | PIO_SM0_EXECCTRL_WRAP_BOTTOM_BITS,
+                    (wrap_target << PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB) | (wrap << PIO_SM0_EXECCTRL_WRAP_TOP_LSB));
+}
+
+void pio_sm_set_out_pins(PIO pio, uint sm, uint out_base, uint out_count) {
+    valid_params_if(HARDWARE_PIO, out_base < 32);
+    valid_params_if(HARDWARE_PIO, out_count <= 32);
+    update_pinctrl(pio, sm, PIO_SM0_PINCTRL_OUT_BASE_BITS | PIO_SM0_PINCTRL_OUT_COUNT_BITS,
+                   (out_base << PIO_SM0_PINCTRL_OUT_BASE_LSB) | (out_count << PIO_SM0_PINCTRL_OUT_COUNT_LSB));
+}
+
+void pio_sm_set_set_pins(PIO pio, uint sm, uint set_base, uint set_count) {
+    valid_params_if(HARDWARE_PIO, set_base < 32);
+    valid_params_if(HARDWARE_PIO, set_count <= 5);
+    update_pinctrl(pio, sm, PIO_SM0_PINCTRL_SET_BASE_BITS | PIO_SM0_PINCTRL_SET_COUNT_BITS,
+                   (set_base << PIO_SM0_PINCTRL_SET_BASE_LSB) | (set_count << PIO_SM0_PINCTRL_SET_COUNT_LSB));
+}
+
+void pio_sm_set_in_pins(PIO pio, uint sm, uint in_base) {
+    valid_params_if(HARDWARE_PIO, in_base < 32);
+    update_pinctrl(pio, sm, PIO_SM0_PINCTRL_IN_BASE_BITS, in_base << PIO_SM0_PINCTRL_IN_BASE_LSB);
+}
+
+void pio_sm_set_sideset_pins(PIO pio, uint sm, uint sideset_base) {
+    valid_params_if(HARDWARE_PIO, sideset_base < 32);
+    update_pinctrl(pio, sm, PIO_SM0_PINCTRL_SIDESET_BASE_BITS, sideset_base << PIO_SM0_PINCTRL_SIDESET_BASE_LSB);
+}
+
+void pio_sm_set_jmp_pin(PIO pio, uint sm, uint pin) {
+    valid_params_if(HARDWARE_PIO, pin < 32);
+    update_execctrl(pio, sm, PIO_SM0_EXECCTRL_JMP_PIN_BITS, pin << PIO_SM0_EXECCTRL_JMP_PIN_LSB);
+}
+
+void pio_sm_set_clkdiv_int_frac8(PIO pio, uint sm, uint32_t div_int, uint8_t div_frac8) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    invalid_params_if(HARDWARE_PIO, div_int >> 16);
+    invalid_params_if(HARDWARE_PIO, div_int == 0 && div_frac8 != 0);
+    uint32_t save = pio_lock();
+    pio->sm[sm].clkdiv = (((uint)div_frac8) << PIO_SM0_CLKDIV_FRAC_LSB) | (((uint)div_int) << PIO_SM0_CLKDIV_INT_LSB);
+    pio_unlock(save);
+}
+
+// ----------------------------------------------------------------------------
+// FIFOs
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    pio_host_sm_t *s = &pio->sm[sm];
+    // as on device, writing to a full FIFO has no effect
+    if (s->tx.level < tx_fifo_depth(s)) {
+        fifo_push(&s->tx, data);
+        notify_simulator();
+    }
+    consume_irqs(pio);
+    pio_unlock(save);
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    pio_host_sm_t *s = &pio->sm[sm];
+    // as on device, reading from an empty FIFO returns all ones
+    uint32_t data = 0xffffffffu;
+    if (s->rx.level) {
+        data = fifo_pop(&s->rx);
+        notify_simulator();
+    }
+    consume_irqs(pio);
+    pio_unlock(save);
+    return data;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    uint level = pio->sm[sm].rx.level;
+    pio_unlock(save);
+    return level;
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    uint level = pio->sm[sm].tx.level;
+    pio_unlock(save);
+    return level;
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    bool full = pio->sm[sm].rx.level >= rx_fifo_depth(&pio->sm[sm]);
+    pio_unlock(save);
+    return full;
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+    return !pio_sm_get_rx_fifo_level(pio, sm);
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    bool full = pio->sm[sm].tx.level >= tx_fifo_depth(&pio->sm[sm]);
+    pio_unlock(save);
+    return full;
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) {
+    return !pio_sm_get_tx_fifo_level(pio, sm);
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+    while (pio_sm_is_tx_fifo_full(pio, sm)) __wfe();
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm) {
+    while (pio_sm_is_rx_fifo_empty(pio, sm)) __wfe();
+    return pio_sm_get(pio, sm);
+}
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    pio_host_sm_t *s = &pio->sm[sm];
+    uint instr = (s->shiftctrl & PIO_SM0_SHIFTCTRL_AUTOPULL_BITS) ? pio_encode_out(pio_null, 32) :
+                 pio_encode_pull(false, false);
+    while (s->tx.level) {
+        exec_locked(pio, sm, instr);
+    }
+    consume_irqs(pio);
+    pio_unlock(save);
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    fifo_clear(&pio->sm[sm].tx);
+    fifo_clear(&pio->sm[sm].rx);
+    consume_irqs(pio);
+    notify_simulator();
+    pio_unlock(save);
+    __sev();
+}
+
+// ----------------------------------------------------------------------------
+// Pins
+
+// as on device, these (and pio_sm_set_consecutive_pindirs) work by forcibly executing SET instructions on the
+// given state machine, which should not be running a program
+static void set_pins_with_mask(PIO pio, uint sm, uint32_t values, uint32_t mask, bool pindirs) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    pio_host_sm_t *s = &pio->sm[sm];
+    uint32_t pinctrl_saved = s->pinctrl;
+    while (mask) {
+        uint base = (uint)__builtin_ctz(mask);
+        s->pinctrl = (1u << PIO_SM0_PINCTRL_SET_COUNT_LSB) | (base << PIO_SM0_PINCTRL_SET_BASE_LSB);
+        exec_locked(pio, sm, pio_encode_set(pindirs ? pio_pindirs : pio_pins, (values >> base) & 0x1u));
+        mask &= mask - 1;
+    }
+    s->pinctrl = pinctrl_saved;
+    publish_pins(pio);
+    pio_unlock(save);
+}
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values) {
+    set_pins_with_mask(pio, sm, pin_values, 0xffffffffu, false);
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask) {
+    set_pins_with_mask(pio, sm, pin_values, pin_mask, false);
+}
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask) {
+    set_pins_with_mask(pio, sm, pin_dirs, pin_mask, true);
+}
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pins_base, uint pin_count, bool is_out) {
+    invalid_params_if_and_return(PIO, pins_base >= 32u, PICO_ERROR_INVALID_ARG);
+    uint32_t mask = rotate_right(bit_mask(pin_count), 32 - pins_base);
+    set_pins_with_mask(pio, sm, is_out ? mask : 0, mask, true);
+    return PICO_OK;
+}
+
+// ----------------------------------------------------------------------------
+// Interrupts
+
+void pio_set_irqn_source_mask_enabled(PIO pio, uint irq_index, uint32_t source_mask, bool enabled) {
+    check_pio_param(pio);
+    invalid_params_if(HARDWARE_PIO, irq_index >= NUM_PIO_IRQS);
+    invalid_params_if(HARDWARE_PIO, source_mask > PIO_INTR_BITS);
+    uint32_t save = pio_lock();
+    if (enabled) {
+        pio->inte[irq_index] |= source_mask;
+    } else {
+        pio->inte[irq_index] &= ~source_mask;
+    }
+    consume_irqs(pio);
+    pio_unlock(save);
+}
+
+bool pio_interrupt_get(PIO pio, uint pio_interrupt_num) {
+    check_pio_param(pio);
+    invalid_params_if(HARDWARE_PIO, pio_interrupt_num >= 8);
+    uint32_t save = pio_lock();
+    bool set = pio->irq & (1u << pio_interrupt_num);
+    pio_unlock(save);
+    return set;
+}
+
+void pio_interrupt_clear(PIO pio, uint pio_interrupt_num) {
+    check_pio_param(pio);
+    invalid_params_if(HARDWARE_PIO, pio_interrupt_num >= 8);
+    uint32_t save = pio_lock();
+    pio->irq &= ~(1u << pio_interrupt_num);
+    consume_irqs(pio);
+    notify_simulator();
+    pio_unlock(save);
+}
+
+// ----------------------------------------------------------------------------
+// Host specific
+
+void pio_host_set_free_running(bool free_running) {
+    pthread_mutex_lock(&sim.mutex);
+    sim.free_running = free_running;
+    sync_clock(time_us_64());
+    notify_simulator();
+    pthread_mutex_unlock(&sim.mutex);
+}
+
+uint64_t pio_host_get_sm_cycles(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    uint64_t cycles = pio->sm[sm].cycles;
+    pio_unlock(save);
+    return cycles;
+}
+
+uint64_t pio_host_get_sm_stall_cycles(PIO pio, uint sm) {
+    check_pio_param(pio);
+    check_sm_param(sm);
+    uint32_t save = pio_lock();
+    uint64_t cycles = pio->sm[sm].stall_cycles;
+    pio_unlock(save);
+    return cycles;
+}
+
+uint32_t pio_host_get_pins(PIO pio) {
+    check_pio_param(pio);
+    uint32_t save = pio_lock();
+    uint32_t values = pio->pin_values;
+    pio_unlock(save);
+    return values;
+}
+
+uint32_t pio_host_get_pindirs(PIO pio) {
+    check_pio_param(pio);
+    uint32_t save = pio_lock();
+    uint32_t dirs = pio->pin_dirs;
+    pio_unlock(save);
+    return dirs;
+}
@@ -125,6 +125,10 @@ void disable_interrupts(void);
 
 void enable_interrupts(void);
 
+// called on a thread whose (simulated) interrupts have just been re-enabled, so that any IRQs which became
+// pending while they were disabled may be handled; this is implemented by the host hardware_irq
+void irq_dispatch_pending(void);
+
 uint spin_lock_get_num(spin_lock_t *lock);
 
 spin_lock_t *spin_lock_instance(uint lock_num);
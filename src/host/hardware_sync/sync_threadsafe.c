@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdatomic.h>
+#include <limits.h>
+#include <sched.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "hardware/sync.h"
+#include "hardware/platform_defs.h"
+
+// This is a thread-safe implementation, in which each spin lock is an atomic flag, and
+// __sev()/__wfe() behave like a per-thread event register, so that code written for
+// two cores behaves the same when the cores are simulated by threads.
+
+struct _spin_lock_t {
+    atomic_uint locked;
+};
+
+static spin_lock_t _spinlocks[NUM_SPIN_LOCKS];
+static atomic_uint claimed_spin_locks;
+static atomic_uint striped_spin_lock_num;
+
+// the simulated PRIMASK of the calling thread (1 if interrupts are disabled); volatile as it is also
+// checked by the simulated IRQ signal handler on the same thread
+static __thread volatile uint32_t irq_disabled;
+
+// number of spins on a held lock before yielding the processor to other threads
+#define SPIN_LOCK_SPINS_BEFORE_YIELD 64
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm volatile ("yield");
+#endif
+}
+
+PICO_WEAK_FUNCTION_DEF(irq_dispatch_pending)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(irq_dispatch_pending)(void) {
+    // there are no simulated IRQs unless hardware_irq is linked in
+}
+
+static inline void set_irq_disabled(uint32_t disabled) {
+    bool enabling = irq_disabled && !disabled;
+    irq_disabled = disabled;
+    if (enabling) irq_dispatch_pending();
+}
+
+PICO_WEAK_FUNCTION_DEF(save_and_disable_interrupts)
+
+uint32_t PICO_WEAK_FUNCTION_IMPL_NAME(save_and_disable_interrupts)() {
+    uint32_t status = irq_disabled;
+    irq_disabled = 1;
+    return status;
+}
+
+PICO_WEAK_FUNCTION_DEF(restore_interrupts)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(restore_interrupts)(uint32_t status) {
+    set_irq_disabled(status & 1);
+}
+
+PICO_WEAK_FUNCTION_DEF(restore_interrupts_from_disabled)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(restore_interrupts_from_disabled)(uint32_t status) {
+    assert(irq_disabled);
+    set_irq_disabled(status & 1);
+}
+
+PICO_WEAK_FUNCTION_DEF(disable_interrupts)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(disable_interrupts)(void) {
+    irq_disabled = 1;
+}
+
+PICO_WEAK_FUNCTION_DEF(enable_interrupts)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(enable_interrupts)(void) {
+    set_irq_disabled(0);
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_instance)
+
+spin_lock_t *PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_instance)(uint lock_num) {
+    assert(lock_num < NUM_SPIN_LOCKS);
+    return &_spinlocks[lock_num];
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_get_num)
+
+uint PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_get_num)(spin_lock_t *lock) {
+    return (uint)(lock - _spinlocks);
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_init)
+
+spin_lock_t *PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_init)(uint lock_num) {
+    spin_lock_t *lock = spin_lock_instance(lock_num);
+    spin_unlock_unsafe(lock);
+    return lock;
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_unsafe_blocking)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_unsafe_blocking)(spin_lock_t *lock) {
+    // test-and-test-and-set; we only attempt the (cache line invalidating) exchange when the lock looks free
+    while (atomic_exchange_explicit(&lock->locked, 1, memory_order_acquire)) {
+        uint spins = 0;
+        while (atomic_load_explicit(&lock->locked, memory_order_relaxed)) {
+            if (++spins < SPIN_LOCK_SPINS_BEFORE_YIELD) {
+                cpu_relax();
+            } else {
+                // the holder may not currently be running (there may be more threads than CPUs)
+                sched_yield();
+                spins = 0;
+            }
+        }
+    }
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_blocking)
+
+uint32_t PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_blocking)(spin_lock_t *lock) {
+    uint32_t save = save_and_disable_interrupts();
+    spin_lock_unsafe_blocking(lock);
+    return save;
+}
+
+PICO_WEAK_FUNCTION_DEF(is_spin_locked)
+
+bool PICO_WEAK_FUNCTION_IMPL_NAME(is_spin_locked)(const spin_lock_t *lock) {
+    return atomic_load_explicit(&((spin_lock_t *)lock)->locked, memory_order_relaxed);
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_unlock_unsafe)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(spin_unlock_unsafe)(spin_lock_t *lock) {
+    atomic_store_explicit(&lock->locked, 0, memory_order_release);
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_unlock)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(spin_unlock)(spin_lock_t *lock, uint32_t saved_irq) {
+    spin_unlock_unsafe(lock);
+    restore_interrupts_from_disabled(saved_irq);
+}
+
+// The event is a global sequence number which is incremented by __sev(); each thread remembers the
+// value it last saw, so that (like the per-core event register) an event sent since the last
+// __wfe() on the thread causes the next __wfe() to return immediately
+static atomic_uint event_seq;
+static __thread uint event_seq_seen;
+
+#if !defined(__linux__)
+static pthread_mutex_t event_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+PICO_WEAK_FUNCTION_DEF(__sev)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(__sev)() {
+#if defined(__linux__)
+    atomic_fetch_add_explicit(&event_seq, 1, memory_order_release);
+    syscall(SYS_futex, &event_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&event_mutex);
+    atomic_fetch_add_explicit(&event_seq, 1, memory_order_release);
+    pthread_cond_broadcast(&event_cond);
+    pthread_mutex_unlock(&event_mutex);
+#endif
+}
+
+PICO_WEAK_FUNCTION_DEF(__wfe)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(__wfe)() {
+    uint seq = atomic_load_explicit(&event_seq, memory_order_acquire);
+    if (seq == event_seq_seen) {
+#if defined(__linux__)
+        // returns immediately if event_seq has changed since we read it
+        syscall(SYS_futex, &event_seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+#else
+        pthread_mutex_lock(&event_mutex);
+        while (atomic_load_explicit(&event_seq, memory_order_relaxed) == seq) {
+            pthread_cond_wait(&event_cond, &event_mutex);
+        }
+        pthread_mutex_unlock(&event_mutex);
+#endif
+        seq = atomic_load_explicit(&event_seq, memory_order_acquire);
+    }
+    event_seq_seen = seq;
+}
+
+PICO_WEAK_FUNCTION_DEF(__wfi)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(__wfi)() {
+    // simulated IRQs are delivered by a signal, whose handler generates an event after running the IRQ
+    // handlers, so this wakes for an IRQ (it may additionally wake for an event, but spurious wakeups are permitted)
+    __wfe();
+}
+
+PICO_WEAK_FUNCTION_DEF(clear_spin_locks)
+
+void PICO_WEAK_FUNCTION_IMPL_NAME(clear_spin_locks)(void) {
+    for (uint i = 0; i < NUM_SPIN_LOCKS; i++) {
+        spin_unlock_unsafe(spin_lock_instance(i));
+    }
+}
+
+PICO_WEAK_FUNCTION_DEF(next_striped_spin_lock_num)
+uint PICO_WEAK_FUNCTION_IMPL_NAME(next_striped_spin_lock_num)() {
+    uint n = atomic_fetch_add_explicit(&striped_spin_lock_num, 1, memory_order_relaxed);
+    return PICO_SPINLOCK_ID_STRIPED_FIRST + n % (PICO_SPINLOCK_ID_STRIPED_LAST - PICO_SPINLOCK_ID_STRIPED_FIRST + 1);
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_claim)
+void PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_claim)(uint lock_num) {
+    assert(lock_num < NUM_SPIN_LOCKS);
+    uint prev = atomic_fetch_or_explicit(&claimed_spin_locks, 1u << lock_num, memory_order_relaxed);
+    if (prev & (1u << lock_num)) {
+        panic("Spinlock %d is already claimed", lock_num);
+    }
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_claim_mask)
+void PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_claim_mask)(uint32_t mask) {
+    for (uint i = 0; mask; i++, mask >>= 1u) {
+        if (mask & 1u) spin_lock_claim(i);
+    }
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_unclaim)
+void PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_unclaim)(uint lock_num) {
+    assert(lock_num < NUM_SPIN_LOCKS);
+    spin_unlock_unsafe(spin_lock_instance(lock_num));
+    atomic_fetch_and_explicit(&claimed_spin_locks, ~(1u << lock_num), memory_order_relaxed);
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_claim_unused)
+int PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_claim_unused)(bool required) {
+    for (uint i = PICO_SPINLOCK_ID_CLAIM_FREE_FIRST; i <= PICO_SPINLOCK_ID_CLAIM_FREE_LAST; i++) {
+        uint prev = atomic_fetch_or_explicit(&claimed_spin_locks, 1u << i, memory_order_relaxed);
+        if (!(prev & (1u << i))) return (int)i;
+    }
+    if (required) {
+        panic("No spinlocks are available");
+    }
+    return -1;
+}
+
+PICO_WEAK_FUNCTION_DEF(spin_lock_num)
+uint PICO_WEAK_FUNCTION_IMPL_NAME(spin_lock_num)(spin_lock_t *lock) {
+    return spin_lock_get_num(lock);
+}
@@ -6,6 +6,7 @@
 
 #include "hardware/timer.h"
 #if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
@@ -53,8 +54,8 @@ uint64_t PICO_WEAK_FUNCTION_IMPL_NAME(time_us_64)() {
 #endif
 }
 
-PICO_WEAK_FUNCTION_DEF(timer_us_32)
-uint32_t PICO_WEAK_FUNCTION_IMPL_NAME(timer_us_32)() {
+PICO_WEAK_FUNCTION_DEF(time_us_32)
+uint32_t PICO_WEAK_FUNCTION_IMPL_NAME(time_us_32)() {
     return (uint32_t) time_us_64();
 }
 
@@ -70,7 +71,9 @@ void PICO_WEAK_FUNCTION_IMPL_NAME(busy_wait_until)(absolute_time_t target) {
     struct timespec tspec;
     tspec.tv_sec = to_us_since_boot(target) / 1000000;
     tspec.tv_nsec = (to_us_since_boot(target) % 1000000) * 1000;
-    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tspec, NULL);
+    // may be interrupted by a signal (e.g. for multicore lockout) in which case we must go back to sleep
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tspec, NULL) == EINTR) {
+    }
 #else
     const int chunk = 1u<<30u;
     uint64_t target_us = to_us_since_boot(target);
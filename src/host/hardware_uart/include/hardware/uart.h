@@ -8,6 +8,7 @@
 #define _HARDWARE_UART_H
 
 #include "pico.h"
+#include "hardware/platform_defs.h"
 
 // PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_HARDWARE_UART, Enable/disable assertions in the hardware_uart module, type=bool, default=0, group=hardware_uart
 #ifndef PARAM_ASSERTIONS_ENABLED_HARDWARE_UART
@@ -18,16 +19,76 @@
 #endif
 #endif
 
+// PICO_CONFIG: PICO_HOST_UART_RX_BUFFER_SIZE, Size of the receive buffer of each host UART, min=1, default=256, group=hardware_uart
+#ifndef PICO_HOST_UART_RX_BUFFER_SIZE
+#define PICO_HOST_UART_RX_BUFFER_SIZE 256
+#endif
+
+// PICO_CONFIG: PICO_HOST_UART_FIFO_DEPTH, Depth of the simulated TX FIFO used for baud rate pacing, min=1, default=32, group=hardware_uart
+#ifndef PICO_HOST_UART_FIFO_DEPTH
+#define PICO_HOST_UART_FIFO_DEPTH 32
+#endif
+
+// PICO_CONFIG: PICO_HOST_UART_PACED, Default for whether host UARTs limit their data rate to the baud rate (this may also be enabled at runtime by setting the environment variable PICO_HOST_UART_PACED=1), type=bool, default=0, group=hardware_uart
+#ifndef PICO_HOST_UART_PACED
+#define PICO_HOST_UART_PACED 0
+#endif
+
+/** \file hardware/uart.h
+ *  \defgroup hardware_uart hardware_uart
+ *
+ * \brief Host implementation of the UART API
+ *
+ * By default, each UART transmits to stdout and receives from stdin. A UART may instead be bound to another
+ * endpoint, either by calling \ref uart_host_bind, or by setting the environment variable PICO_HOST_UART0
+ * (or PICO_HOST_UART1) before the UART is initialized. The binding is described by one of the following strings:
+ *
+ * - `stdio` - stdout and stdin (the default)
+ * - `none` - transmitted data is discarded and nothing is ever received
+ * - `pty` - a newly created pseudo-terminal, e.g. for use with minicom or pyserial; its name is returned by
+ *    \ref uart_host_get_pty_name, and is printed to stderr if the binding was made by the environment variable
+ * - `unix:<path>` - a connection to an existing Unix domain stream socket
+ * - `unix-listen:<path>` - a Unix domain stream socket which is listened on; a single peer may be connected at a time,
+ *    and data transmitted while no peer is connected is discarded
+ * - `file:<rx path>,<tx path>` - data is read from, and written to a pair of files (or FIFOs); either path may be empty
+ *
+ * Received data is buffered (see PICO_HOST_UART_RX_BUFFER_SIZE); data is only read from the endpoint when there
+ * is room in the buffer, so a fast sender is held back rather than data being lost.
+ *
+ * When a UART is paced (see \ref uart_host_set_paced), data is transmitted and received no faster than
+ * the configured baud rate and format allow, and \ref uart_is_writable reports whether there is space in a
+ * simulated TX FIFO of PICO_HOST_UART_FIFO_DEPTH entries. Otherwise it reports whether the endpoint can accept data
+ * without blocking.
+ */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef NUM_UARTS
+#define NUM_UARTS 2u
+#endif
+
 typedef struct uart_inst uart_inst_t;
 
 extern uart_inst_t * const uart0;
 extern uart_inst_t * const uart1;
 #define uart_default uart0
 
+#ifndef UART_NUM
+#define UART_NUM(uart) uart_get_index(uart)
+#endif
+
+#ifndef UART_INSTANCE
+#define UART_INSTANCE(num) uart_get_instance(num)
+#endif
+
+// Convert UART instance to hardware instance number, 0 or 1.
+uint uart_get_index(uart_inst_t *uart);
+
+// Get the UART instance from an instance number, 0 or 1.
+uart_inst_t *uart_get_instance(uint num);
+
 typedef enum {
     UART_PARITY_NONE,
     UART_PARITY_EVEN,
@@ -86,11 +147,48 @@ void uart_puts(uart_inst_t *uart, const char *s);
 
 char uart_getc(uart_inst_t *uart);
 
+// Wait for up to us microseconds for data to be available to read.
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us);
+
+// Wait until all data written to the UART has been transmitted.
+void uart_tx_wait_blocking(uart_inst_t *uart);
+
 // en: assert break condition (TX held low) if true. Clear break condition if false.
 void uart_set_break(uart_inst_t *uart, bool en);
 
 void uart_default_tx_wait_blocking();
 
+// ----------------------------------------------------------------------------
+// Host specific
+
+/*! \brief Bind a UART to a host endpoint
+ *  \ingroup hardware_uart
+ *
+ * Any previous binding of the UART is closed. This may be called before or after \ref uart_init; if it is not
+ * called, the binding is taken from the PICO_HOST_UARTn environment variable at initialization.
+ *
+ * \param uart UART instance. \ref uart0 or \ref uart1
+ * \param spec the binding, as described in the \ref hardware_uart documentation, or NULL for the default
+ * \return true if the binding was made, false if the spec was invalid or the endpoint could not be opened
+ */
+bool uart_host_bind(uart_inst_t *uart, const char *spec);
+
+/*! \brief Enable or disable pacing of the UART's data rate to its baud rate
+ *  \ingroup hardware_uart
+ *
+ * \param uart UART instance. \ref uart0 or \ref uart1
+ * \param paced true to transmit and receive no faster than the baud rate allows
+ */
+void uart_host_set_paced(uart_inst_t *uart, bool paced);
+
+/*! \brief Return the name of the pseudo-terminal a UART is bound to
+ *  \ingroup hardware_uart
+ *
+ * \param uart UART instance. \ref uart0 or \ref uart1
+ * \return the device path of the pseudo-terminal, or NULL if the UART is not bound to one
+ */
+const char *uart_host_get_pty_name(uart_inst_t *uart);
+
 #define UART_FUNCSEL_NUM(uart, gpio) 0
 
 #ifdef __cplusplus
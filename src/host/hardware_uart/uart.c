@@ -4,22 +4,37 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#if defined(__unix) || defined(__APPLE__)
+#define _GNU_SOURCE /* for posix_openpt, cfmakeraw and strndup */
+#define UART_HOST_POSIX 1
+#else
+#define UART_HOST_POSIX 0
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "hardware/uart.h"
+#include "hardware/timer.h"
 
-#if defined(__unix) || defined(__APPLE__)
-#define _XOPEN_SOURCE 600 /* for ONLCR */
-#define __BSD_VISIBLE 1 /* for ONLCR in *BSD */
-
+#if UART_HOST_POSIX
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
-#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #ifndef FNONBLOCK
 #define FNONBLOCK O_NONBLOCK
 #endif
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 struct termios _tty;
 static tcflag_t _res_oflg = 0;
 static tcflag_t _res_lflg = 0;
@@ -35,8 +50,10 @@ void _resettty(void) {
 }
 
 void _inittty(void) {
-    if (!isatty(STDIN_FILENO))
+    static bool initialized;
+    if (initialized || !isatty(STDIN_FILENO))
         return;
+    initialized = true;
 
     /* save tty: */
     tcgetattr(STDIN_FILENO, &_tty);
@@ -56,75 +73,524 @@ void _inittty(void) {
 void _inittty() {}
 #endif
 
-typedef struct {
-    bool dummy;
-} uart_hw_t;
+typedef enum {
+    UART_BINDING_NONE,
+    UART_BINDING_STDIO,
+    UART_BINDING_PTY,
+    UART_BINDING_UNIX,
+    UART_BINDING_UNIX_LISTEN,
+    UART_BINDING_FILE,
+} uart_binding_t;
+
+struct uart_inst {
+    uart_binding_t binding;
+    bool bound;
+    bool defaults_set;
+    bool paced;
+    bool rx_eof;
+    int rx_fd; // -1 if there is nothing to receive from (e.g. no peer is connected)
+    int tx_fd; // -1 if there is nothing to transmit to
+    int listen_fd; // the socket listened on for UART_BINDING_UNIX_LISTEN
+    int pty_slave_fd; // held open so that reading the master doesn't fail while no peer has the pty open
+    char *path; // the socket path for UART_BINDING_UNIX_LISTEN, or the pty name for UART_BINDING_PTY
+    uint baudrate;
+    uint bits_per_char;
+    uint64_t tx_idle_at_ns; // when paced, the time at which all data written so far has been transmitted
+    uint64_t rx_arrived_at_ns; // when paced, the time at which the most recently received data arrived
+    uint rx_head;
+    uint rx_count;
+    uint8_t rx_buf[PICO_HOST_UART_RX_BUFFER_SIZE];
+};
+
+static uart_inst_t uart_instances[NUM_UARTS];
 
-uart_inst_t *const uart0;
-uart_inst_t *const uart1;
+uart_inst_t *const uart0 = &uart_instances[0];
+uart_inst_t *const uart1 = &uart_instances[1];
 
-static int _nextchar = EOF;
+static inline uint64_t now_ns(void) {
+    return time_us_64() * 1000;
+}
+
+static void sleep_ns(uint64_t ns) {
+    busy_wait_us((ns + 999) / 1000);
+}
 
-static bool _peekchar() {
-    if (_nextchar == EOF) {
-        _nextchar = getchar();
+// the time taken to transmit one character on the wire, or 0 if the UART is not paced
+static uint64_t char_time_ns(uart_inst_t *uart) {
+    if (!uart->paced || !uart->baudrate) return 0;
+    return (uart->bits_per_char * 1000000000ull) / uart->baudrate;
+}
+
+uint uart_get_index(uart_inst_t *uart) {
+    assert(uart >= uart_instances && uart < uart_instances + NUM_UARTS);
+    return (uint)(uart - uart_instances);
+}
+
+uart_inst_t *uart_get_instance(uint num) {
+    assert(num < NUM_UARTS);
+    return &uart_instances[num];
+}
+
+// ----------------------------------------------------------------------------
+// Endpoints
+
+#if UART_HOST_POSIX
+static void close_fd(int *fd) {
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+}
+#endif
+
+static void unbind(uart_inst_t *uart) {
+    if (!uart->bound) return;
+    if (uart->binding == UART_BINDING_STDIO) {
+        fflush(stdout);
+    } else {
+#if UART_HOST_POSIX
+        if (uart->tx_fd != uart->rx_fd) close_fd(&uart->tx_fd);
+        close_fd(&uart->rx_fd);
+        close_fd(&uart->listen_fd);
+        close_fd(&uart->pty_slave_fd);
+        if (uart->binding == UART_BINDING_UNIX_LISTEN && uart->path) unlink(uart->path);
+#endif
     }
-    return _nextchar != EOF;
+    free(uart->path);
+    uart->path = NULL;
+    uart->binding = UART_BINDING_NONE;
+    uart->rx_fd = uart->tx_fd = -1;
+    uart->rx_head = uart->rx_count = 0;
+    uart->rx_eof = false;
+    uart->bound = false;
 }
 
-uint uart_init(uart_inst_t *uart, uint baud_rate) {
-    _inittty();
-    return baud_rate;
+#if UART_HOST_POSIX
+static void disconnect_peer(uart_inst_t *uart) {
+    // the socket is used in both directions
+    close_fd(&uart->rx_fd);
+    uart->tx_fd = -1;
 }
 
-bool uart_is_writable(uart_inst_t *uart) {
-    return 1;
+// accept a peer for UART_BINDING_UNIX_LISTEN if there is not currently one connected
+static void accept_peer(uart_inst_t *uart) {
+    if (uart->binding != UART_BINDING_UNIX_LISTEN || uart->rx_fd >= 0) return;
+    int fd = accept(uart->listen_fd, NULL, NULL);
+    if (fd >= 0) {
+        // accepted sockets don't inherit O_NONBLOCK on all platforms
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        uart->rx_fd = uart->tx_fd = fd;
+        uart->rx_eof = false;
+    }
+}
+
+static bool unix_socket_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return false;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+static bool bind_unix(uart_inst_t *uart, const char *path) {
+    struct sockaddr_un addr;
+    if (!unix_socket_address(path, &addr)) return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(fd);
+        return false;
+    }
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    uart->rx_fd = uart->tx_fd = fd;
+    return true;
+}
+
+static bool bind_unix_listen(uart_inst_t *uart, const char *path) {
+    struct sockaddr_un addr;
+    if (!unix_socket_address(path, &addr)) return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    // remove any stale socket left behind by a previous run
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+        close(fd);
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    uart->listen_fd = fd;
+    uart->path = strdup(path);
+    return true;
+}
+
+static bool bind_pty(uart_inst_t *uart) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0) return false;
+    const char *name = NULL;
+    if (!grantpt(fd) && !unlockpt(fd)) name = ptsname(fd);
+    int slave_fd = name ? open(name, O_RDWR | O_NOCTTY) : -1;
+    if (slave_fd < 0) {
+        close(fd);
+        return false;
+    }
+    // the peer sees a raw serial port
+    struct termios tio;
+    if (!tcgetattr(slave_fd, &tio)) {
+        cfmakeraw(&tio);
+        tcsetattr(slave_fd, TCSANOW, &tio);
+    }
+    uart->rx_fd = uart->tx_fd = fd;
+    uart->pty_slave_fd = slave_fd;
+    uart->path = strdup(name);
+    return true;
+}
+
+static bool bind_files(uart_inst_t *uart, const char *paths) {
+    const char *comma = strchr(paths, ',');
+    if (!comma) return false;
+    if (comma != paths) {
+        char *rx_path = strndup(paths, (size_t)(comma - paths));
+        // O_NONBLOCK so that opening a FIFO doesn't wait for a writer
+        uart->rx_fd = open(rx_path, O_RDONLY | O_NONBLOCK);
+        free(rx_path);
+        if (uart->rx_fd < 0) return false;
+    }
+    if (comma[1]) {
+        uart->tx_fd = open(comma + 1, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (uart->tx_fd < 0) {
+            close_fd(&uart->rx_fd);
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+static void set_defaults(uart_inst_t *uart) {
+    if (uart->defaults_set) return;
+    uart->defaults_set = true;
+    uart->bits_per_char = 10; // 8N1
+    const char *paced = getenv("PICO_HOST_UART_PACED");
+    uart->paced = paced ? atoi(paced) != 0 : PICO_HOST_UART_PACED;
+}
+
+bool uart_host_bind(uart_inst_t *uart, const char *spec) {
+    set_defaults(uart);
+    unbind(uart);
+    if (!spec) spec = "stdio";
+    bool ok = true;
+    uart->rx_fd = uart->tx_fd = uart->listen_fd = uart->pty_slave_fd = -1;
+    if (!strcmp(spec, "stdio")) {
+        uart->binding = UART_BINDING_STDIO;
+        _inittty();
+#if UART_HOST_POSIX
+        uart->rx_fd = STDIN_FILENO;
+#endif
+    } else if (!strcmp(spec, "none")) {
+        uart->binding = UART_BINDING_NONE;
+#if UART_HOST_POSIX
+    } else if (!strcmp(spec, "pty")) {
+        uart->binding = UART_BINDING_PTY;
+        ok = bind_pty(uart);
+    } else if (!strncmp(spec, "unix:", 5)) {
+        uart->binding = UART_BINDING_UNIX;
+        ok = bind_unix(uart, spec + 5);
+    } else if (!strncmp(spec, "unix-listen:", 12)) {
+        uart->binding = UART_BINDING_UNIX_LISTEN;
+        ok = bind_unix_listen(uart, spec + 12);
+    } else if (!strncmp(spec, "file:", 5)) {
+        uart->binding = UART_BINDING_FILE;
+        ok = bind_files(uart, spec + 5);
+#endif
+    } else {
+        ok = false;
+    }
+    if (!ok) {
+        uart->binding = UART_BINDING_NONE;
+        uart->rx_fd = uart->tx_fd = -1;
+        return false;
+    }
+    uart->bound = true;
+    return true;
+}
+
+// bind the UART as specified by the environment, if it has not yet been bound
+static void ensure_bound(uart_inst_t *uart) {
+    if (uart->bound) return;
+    char name[] = "PICO_HOST_UART0";
+    name[sizeof(name) - 2] = (char)('0' + uart_get_index(uart));
+    const char *spec = getenv(name);
+    if (!uart_host_bind(uart, spec)) {
+        panic("uart%d: cannot bind to '%s'", uart_get_index(uart), spec);
+    }
+    // the program didn't ask for a pty, so may not report its name
+    if (uart->binding == UART_BINDING_PTY) {
+        fprintf(stderr, "uart%d: bound to %s\n", uart_get_index(uart), uart->path);
+    }
+}
+
+void uart_host_set_paced(uart_inst_t *uart, bool paced) {
+    ensure_bound(uart);
+    uart->paced = paced;
+    uart->tx_idle_at_ns = uart->rx_arrived_at_ns = 0;
+}
+
+const char *uart_host_get_pty_name(uart_inst_t *uart) {
+    ensure_bound(uart);
+    return uart->binding == UART_BINDING_PTY ? uart->path : NULL;
+}
+
+// ----------------------------------------------------------------------------
+// RX
+
+// move as much data as is available (and, when paced, has had time to arrive) from the endpoint into the RX buffer
+static void rx_fill(uart_inst_t *uart) {
+    uint space = PICO_HOST_UART_RX_BUFFER_SIZE - uart->rx_count;
+    if (!space) return;
+    uint64_t char_ns = char_time_ns(uart);
+    if (char_ns) {
+        uint64_t now = now_ns();
+        // a full FIFO's worth of data may have arrived while we weren't looking
+        uint64_t fifo_ns = PICO_HOST_UART_FIFO_DEPTH * char_ns;
+        if (uart->rx_arrived_at_ns + fifo_ns < now) uart->rx_arrived_at_ns = now - fifo_ns;
+        uint64_t arrived = (now - uart->rx_arrived_at_ns) / char_ns;
+        if (arrived < space) space = (uint)arrived;
+        if (!space) return;
+    }
+    uint tail = (uart->rx_head + uart->rx_count) % PICO_HOST_UART_RX_BUFFER_SIZE;
+    if (space > PICO_HOST_UART_RX_BUFFER_SIZE - tail) space = PICO_HOST_UART_RX_BUFFER_SIZE - tail;
+#if UART_HOST_POSIX
+    accept_peer(uart);
+    if (uart->rx_fd < 0) return;
+    struct pollfd pfd = { .fd = uart->rx_fd, .events = POLLIN };
+    if (poll(&pfd, 1, 0) <= 0) return;
+    ssize_t n = read(uart->rx_fd, uart->rx_buf + tail, space);
+    if (n > 0) {
+        uart->rx_count += (uint)n;
+        uart->rx_arrived_at_ns += (uint64_t)n * char_ns;
+        uart->rx_eof = false;
+    } else if (!n || errno == EIO) {
+        if (uart->binding == UART_BINDING_UNIX || uart->binding == UART_BINDING_UNIX_LISTEN) {
+            disconnect_peer(uart);
+        } else {
+            // stdin or a file may have more data later
+            uart->rx_eof = true;
+        }
+    }
+#else
+    if (uart->binding == UART_BINDING_STDIO) {
+        int c = getchar();
+        if (c != EOF) {
+            uart->rx_buf[tail] = (uint8_t)c;
+            uart->rx_count++;
+            uart->rx_arrived_at_ns += char_ns;
+        }
+    }
+#endif
+}
+
+// wait for up to max_us for more data to be available from the endpoint
+static void rx_wait(uart_inst_t *uart, uint64_t max_us) {
+#if UART_HOST_POSIX
+    int fd = uart->rx_fd >= 0 ? uart->rx_fd : uart->listen_fd;
+    if (fd >= 0 && !uart->rx_eof) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int timeout_ms = max_us >= INT_MAX / 2 * 1000ull ? INT_MAX / 2 : (int)((max_us + 999) / 1000);
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            uint64_t char_ns = char_time_ns(uart);
+            if (char_ns) {
+                // the data is available, but (as it is paced) may not yet have arrived
+                uint64_t now = now_ns();
+                uint64_t next = uart->rx_arrived_at_ns + char_ns;
+                if (next > now) sleep_ns(MIN(next - now, max_us * 1000));
+            }
+        }
+        return;
+    }
+#endif
+    // nothing to wait on, or at end of file, so check back later
+    busy_wait_us(MIN(max_us, 1000));
 }
 
-// If returns 0, no data is available to be read from UART.
-// If returns nonzero, at least that many bytes can be written without blocking.
 bool uart_is_readable(uart_inst_t *uart) {
-    return _peekchar() ? 1 : 0;
+    ensure_bound(uart);
+    if (!uart->rx_count) rx_fill(uart);
+    return uart->rx_count != 0;
 }
 
-// Write len bytes directly from src to the UART
-void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        uart_putc(uart, src[i]);
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us) {
+    uint64_t deadline = time_us_64() + us;
+    while (!uart_is_readable(uart)) {
+        uint64_t now = time_us_64();
+        if (now >= deadline) return false;
+        rx_wait(uart, deadline - now);
     }
+    return true;
 }
 
 // Read len bytes directly from the UART to dst
 void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        dst[i] = uart_getc(uart);
+    while (len) {
+        while (!uart_is_readable_within_us(uart, UINT32_MAX)) {
+            tight_loop_contents();
+        }
+        while (len && uart->rx_count) {
+            uint n = MIN(uart->rx_count, PICO_HOST_UART_RX_BUFFER_SIZE - uart->rx_head);
+            if (n > len) n = (uint)len;
+            memcpy(dst, uart->rx_buf + uart->rx_head, n);
+            uart->rx_head = (uart->rx_head + n) % PICO_HOST_UART_RX_BUFFER_SIZE;
+            uart->rx_count -= n;
+            dst += n;
+            len -= n;
+            if (len) rx_fill(uart);
+        }
+    }
+}
+
+char uart_getc(uart_inst_t *uart) {
+    uint8_t c;
+    uart_read_blocking(uart, &c, 1);
+    return (char)c;
+}
+
+// ----------------------------------------------------------------------------
+// TX
+
+// number of characters which may be written before the (paced) TX FIFO is full
+static uint tx_fifo_space(uart_inst_t *uart, uint64_t char_ns) {
+    uint64_t now = now_ns();
+    if (uart->tx_idle_at_ns <= now) return PICO_HOST_UART_FIFO_DEPTH;
+    uint64_t queued = (uart->tx_idle_at_ns - now + char_ns - 1) / char_ns;
+    return queued >= PICO_HOST_UART_FIFO_DEPTH ? 0 : PICO_HOST_UART_FIFO_DEPTH - (uint)queued;
+}
+
+static void endpoint_write(uart_inst_t *uart, const uint8_t *src, size_t len) {
+    if (uart->binding == UART_BINDING_STDIO) {
+        // use stdout (rather than its fd) so the output is ordered with that of printf
+        fwrite(src, 1, len, stdout);
+        return;
+    }
+#if UART_HOST_POSIX
+    accept_peer(uart);
+    bool is_socket = uart->binding == UART_BINDING_UNIX || uart->binding == UART_BINDING_UNIX_LISTEN;
+    while (len && uart->tx_fd >= 0) {
+        // this blocks while the endpoint isn't accepting data, like a UART with CTS flow control
+        ssize_t n = is_socket ? send(uart->tx_fd, src, len, MSG_NOSIGNAL) : write(uart->tx_fd, src, len);
+        if (n > 0) {
+            src += n;
+            len -= (size_t)n;
+        } else if (n < 0 && errno != EINTR) {
+            // the peer has gone away, so the remaining data is lost
+            if (is_socket) disconnect_peer(uart);
+            break;
+        }
+    }
+#endif
+}
+
+bool uart_is_writable(uart_inst_t *uart) {
+    ensure_bound(uart);
+    uint64_t char_ns = char_time_ns(uart);
+    if (char_ns) return tx_fifo_space(uart, char_ns) != 0;
+#if UART_HOST_POSIX
+    if (uart->binding != UART_BINDING_STDIO && uart->tx_fd >= 0) {
+        struct pollfd pfd = { .fd = uart->tx_fd, .events = POLLOUT };
+        return poll(&pfd, 1, 0) > 0;
+    }
+#endif
+    // otherwise we never block
+    return true;
+}
+
+// Write len bytes directly from src to the UART
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len) {
+    ensure_bound(uart);
+    uint64_t char_ns = char_time_ns(uart);
+    if (!char_ns) {
+        endpoint_write(uart, src, len);
+        return;
+    }
+    while (len) {
+        uint space;
+        while (!(space = tx_fifo_space(uart, char_ns))) {
+            // wait for the oldest character in the FIFO to be transmitted
+            sleep_ns(char_ns);
+        }
+        size_t n = MIN(len, space);
+        uint64_t now = now_ns();
+        uart->tx_idle_at_ns = MAX(uart->tx_idle_at_ns, now) + n * char_ns;
+        endpoint_write(uart, src, n);
+        src += n;
+        len -= n;
     }
 }
 
+void uart_tx_wait_blocking(uart_inst_t *uart) {
+    ensure_bound(uart);
+    uint64_t now = now_ns();
+    if (uart->paced && uart->tx_idle_at_ns > now) {
+        sleep_ns(uart->tx_idle_at_ns - now);
+    }
+    if (uart->binding == UART_BINDING_STDIO) fflush(stdout);
+}
+
+// ----------------------------------------------------------------------------
+// Setup
+
+uint uart_init(uart_inst_t *uart, uint baud_rate) {
+    ensure_bound(uart);
+    uart->bits_per_char = 10; // 8N1
+    uart->baudrate = baud_rate;
+    uart->tx_idle_at_ns = uart->rx_arrived_at_ns = 0;
+    return baud_rate;
+}
+
+void uart_deinit(uart_inst_t *uart) {
+    // the binding is kept, so that the UART may be reinitialized
+    uart_tx_wait_blocking(uart);
+}
+
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate) {
+    ensure_bound(uart);
+    uart->baudrate = baudrate;
+    return baudrate;
+}
+
+void uart_set_hw_flow(__unused uart_inst_t *uart, __unused bool cts, __unused bool rts) {
+    // writes always block while the endpoint isn't accepting data
+}
+
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity) {
+    assert(data_bits >= 5 && data_bits <= 8);
+    assert(stop_bits == 1 || stop_bits == 2);
+    ensure_bound(uart);
+    uart->bits_per_char = 1 + data_bits + stop_bits + (parity != UART_PARITY_NONE);
+}
+
+void uart_set_break(__unused uart_inst_t *uart, __unused bool en) {
+    // not simulated
+}
+
 // ----------------------------------------------------------------------------
 // UART-specific operations and aliases
 
 void uart_putc(uart_inst_t *uart, char c) {
-    putchar(c);
+    uart_putc_raw(uart, c);
 }
 
 void uart_putc_raw(uart_inst_t *uart, char c) {
-    putchar(c);
+    uart_write_blocking(uart, (const uint8_t *)&c, 1);
 }
 
 void uart_puts(uart_inst_t *uart, const char *s) {
-    puts(s);
-}
-
-char uart_getc(uart_inst_t *uart) {
-    while (!_peekchar()) {
-        tight_loop_contents();
-    }
-    char rc = (char) _nextchar;
-    _nextchar = EOF;
-    return rc;
+    uart_write_blocking(uart, (const uint8_t *)s, strlen(s));
 }
 
 void uart_default_tx_wait_blocking() {
-
+    uart_tx_wait_blocking(uart_default);
 }
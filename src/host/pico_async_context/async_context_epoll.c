@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "pico/async_context_epoll.h"
+#include "pico/async_context_base.h"
+
+static const async_context_type_t template;
+
+static void async_context_epoll_acquire_lock_blocking(async_context_t *self_base);
+static void async_context_epoll_release_lock(async_context_t *self_base);
+
+static inline bool is_context_thread(async_context_epoll_t *self) {
+    return pthread_equal(pthread_self(), self->context_thread);
+}
+
+static void async_context_epoll_wake_up(async_context_t *self_base) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    uint64_t one = 1;
+    // if the eventfd counter is somehow saturated, it is still readable, so there is nothing to do on failure
+    ssize_t __unused rc = write(self->event_fd, &one, sizeof(one));
+    pthread_mutex_lock(&self->work_needed_mutex);
+    self->work_needed = true;
+    pthread_cond_broadcast(&self->work_needed_cond);
+    pthread_mutex_unlock(&self->work_needed_mutex);
+}
+
+static void set_timer(async_context_epoll_t *self, absolute_time_t next_time) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (!is_at_the_end_of_time(next_time)) {
+        // the host time_us_64() is CLOCK_MONOTONIC, so we can use an absolute timer
+        uint64_t us = to_us_since_boot(next_time);
+        if (!us) us = 1; // a zero time would disarm the timer
+        its.it_value.tv_sec = (time_t)(us / 1000000);
+        its.it_value.tv_nsec = (long)(us % 1000000) * 1000;
+    }
+    timerfd_settime(self->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void process_under_lock(async_context_epoll_t *self) {
+    absolute_time_t next_time;
+    do {
+        next_time = async_context_base_execute_once(&self->core);
+        // if the next wakeup time is in the past then loop
+    } while (!is_at_the_end_of_time(next_time) && absolute_time_diff_us(get_absolute_time(), next_time) <= 0);
+    set_timer(self, next_time);
+}
+
+static int timeout_ms_until(absolute_time_t until) {
+    if (is_at_the_end_of_time(until)) return -1;
+    int64_t delay_us = absolute_time_diff_us(get_absolute_time(), until);
+    if (delay_us <= 0) return 0;
+    // round up, as we don't want to wake up, and then realize there is no work to do yet!
+    int64_t delay_ms = (delay_us + 999) / 1000;
+    return delay_ms > INT_MAX ? INT_MAX : (int)delay_ms;
+}
+
+// wait up to timeout_ms for events, and mark any "when pending" workers whose file descriptors are ready
+static void handle_events(async_context_epoll_t *self, int timeout_ms) {
+    struct epoll_event events[ASYNC_CONTEXT_EPOLL_MAX_EVENTS];
+    int count = epoll_wait(self->epoll_fd, events, ASYNC_CONTEXT_EPOLL_MAX_EVENTS, timeout_ms);
+    for (int i = 0; i < count; i++) {
+        void *ptr = events[i].data.ptr;
+        if (ptr == &self->event_fd || ptr == &self->timer_fd) {
+            // just consume the event; processing happens regardless
+            uint64_t value;
+            ssize_t __unused rc = read(*(int *)ptr, &value, sizeof(value));
+        } else {
+            async_context_base_mark_work_pending(&self->core, (async_when_pending_worker_t *)ptr);
+        }
+    }
+}
+
+static void *async_context_thread(void *vself) {
+    async_context_epoll_t *self = (async_context_epoll_t *)vself;
+    while (!self->thread_should_exit) {
+        handle_events(self, -1);
+        if (self->thread_should_exit) break;
+        // processing is performed on the outermost release of the lock
+        async_context_epoll_acquire_lock_blocking(&self->core);
+        async_context_epoll_release_lock(&self->core);
+    }
+    return NULL;
+}
+
+static bool add_internal_fd(async_context_epoll_t *self, int *fd) {
+    struct epoll_event event = {
+            .events = EPOLLIN,
+            .data.ptr = fd,
+    };
+    return *fd >= 0 && !epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, *fd, &event);
+}
+
+bool async_context_epoll_init(async_context_epoll_t *self, async_context_epoll_config_t *config) {
+    memset(self, 0, sizeof(*self));
+    self->core.type = &template;
+    self->core.flags = ASYNC_CONTEXT_FLAG_CALLBACK_FROM_NON_IRQ;
+    if (!config->create_thread) self->core.flags |= ASYNC_CONTEXT_FLAG_POLLED;
+    self->core.core_num = (uint8_t)get_core_num();
+    async_context_base_init(&self->core);
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&self->lock_mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+    pthread_mutex_init(&self->work_needed_mutex, NULL);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&self->work_needed_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    self->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    self->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    self->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    self->context_thread = pthread_self();
+    if (self->epoll_fd < 0 ||
+        !add_internal_fd(self, &self->event_fd) ||
+        !add_internal_fd(self, &self->timer_fd)) {
+        async_context_deinit(&self->core);
+        return false;
+    }
+    if (config->create_thread) {
+        if (pthread_create(&self->context_thread, NULL, async_context_thread, self)) {
+            async_context_deinit(&self->core);
+            return false;
+        }
+        self->thread_created = true;
+    }
+    return true;
+}
+
+static void async_context_epoll_deinit(async_context_t *self_base) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    if (self->thread_created) {
+        assert(!is_context_thread(self));
+        self->thread_should_exit = true;
+        async_context_epoll_wake_up(self_base);
+        pthread_join(self->context_thread, NULL);
+    }
+    if (self->timer_fd >= 0) close(self->timer_fd);
+    if (self->event_fd >= 0) close(self->event_fd);
+    if (self->epoll_fd >= 0) close(self->epoll_fd);
+    pthread_cond_destroy(&self->work_needed_cond);
+    pthread_mutex_destroy(&self->work_needed_mutex);
+    pthread_mutex_destroy(&self->lock_mutex);
+    async_context_base_deinit(self_base);
+    memset(self, 0, sizeof(*self));
+}
+
+bool async_context_epoll_add_fd(async_context_epoll_t *self, int fd, uint32_t events, async_when_pending_worker_t *worker) {
+    struct epoll_event event = {
+            .events = events,
+            .data.ptr = worker,
+    };
+    return !epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+bool async_context_epoll_remove_fd(async_context_epoll_t *self, int fd) {
+    return !epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static void async_context_epoll_acquire_lock_blocking(async_context_t *self_base) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    pthread_mutex_lock(&self->lock_mutex);
+    if (!self->nesting++) {
+        self->lock_owner = pthread_self();
+    }
+}
+
+static void async_context_epoll_release_lock(async_context_t *self_base) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    bool do_wakeup = false;
+    if (self->nesting == 1) {
+        // note that we always do a processing on outermost lock exit, to facilitate cases
+        // like lwIP where we have no notification when lwIP timers are added.
+        //
+        // this operation must be done from the right thread
+        if (is_context_thread(self)) {
+            process_under_lock(self);
+        } else {
+            // note we defer the wakeup until after we release the lock, otherwise it can be wasteful
+            // (waking up the thread, but then having it block immediately on us)
+            do_wakeup = true;
+        }
+    }
+    --self->nesting;
+    pthread_mutex_unlock(&self->lock_mutex);
+    if (do_wakeup) {
+        async_context_epoll_wake_up(self_base);
+    }
+}
+
+static void async_context_epoll_lock_check(async_context_t *self_base) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    if (!self->nesting || !pthread_equal(self->lock_owner, pthread_self())) {
+        panic("async_context lock_check failed");
+    }
+}
+
+typedef struct sync_func_call {
+    async_when_pending_worker_t worker;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t (*func)(void *param);
+    void *param;
+    uint32_t rc;
+    bool done;
+} sync_func_call_t;
+
+static void handle_sync_func_call(__unused async_context_t *context, async_when_pending_worker_t *worker) {
+    sync_func_call_t *call = (sync_func_call_t *)worker;
+    call->rc = call->func(call->param);
+    pthread_mutex_lock(&call->mutex);
+    call->done = true;
+    pthread_cond_signal(&call->cond);
+    pthread_mutex_unlock(&call->mutex);
+}
+
+static uint32_t async_context_epoll_execute_sync(async_context_t *self_base, uint32_t (*func)(void *param), void *param) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    if (is_context_thread(self)) {
+        async_context_epoll_acquire_lock_blocking(self_base);
+        uint32_t rc = func(param);
+        async_context_epoll_release_lock(self_base);
+        return rc;
+    }
+    // This thread must not hold the lock, or this cross-thread execute would deadlock
+    hard_assert(!self->nesting || !pthread_equal(self->lock_owner, pthread_self()));
+    sync_func_call_t call;
+    memset(&call, 0, sizeof(call));
+    call.worker.do_work = handle_sync_func_call;
+    call.func = func;
+    call.param = param;
+    pthread_mutex_init(&call.mutex, NULL);
+    pthread_cond_init(&call.cond, NULL);
+    async_context_add_when_pending_worker(self_base, &call.worker);
+    async_context_set_work_pending(self_base, &call.worker);
+    pthread_mutex_lock(&call.mutex);
+    while (!call.done) {
+        pthread_cond_wait(&call.cond, &call.mutex);
+    }
+    pthread_mutex_unlock(&call.mutex);
+    async_context_remove_when_pending_worker(self_base, &call.worker);
+    pthread_cond_destroy(&call.cond);
+    pthread_mutex_destroy(&call.mutex);
+    return call.rc;
+}
+
+static void async_context_epoll_set_work_pending(async_context_t *self_base, async_when_pending_worker_t *worker) {
+    async_context_base_mark_work_pending(self_base, worker);
+    async_context_epoll_wake_up(self_base);
+}
+
+static void async_context_epoll_poll(async_context_t *self_base) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    // work is performed by our own thread if we have one
+    if (self->thread_created) return;
+    assert(is_context_thread(self));
+    handle_events(self, 0);
+    // processing is performed on the outermost release of the lock
+    async_context_epoll_acquire_lock_blocking(self_base);
+    async_context_epoll_release_lock(self_base);
+}
+
+static void async_context_epoll_wait_until(__unused async_context_t *self_base, absolute_time_t until) {
+    sleep_until(until);
+}
+
+static void async_context_epoll_wait_for_work_until(async_context_t *self_base, absolute_time_t until) {
+    async_context_epoll_t *self = (async_context_epoll_t *)self_base;
+    if (!self->thread_created) {
+        // we are the thread performing the work, so we can wait for the events directly; note the timerfd
+        // will wake us for the next "at time" worker
+        assert(is_context_thread(self));
+        handle_events(self, timeout_ms_until(until));
+        return;
+    }
+    pthread_mutex_lock(&self->work_needed_mutex);
+    if (!self->work_needed && !is_at_the_end_of_time(until)) {
+        uint64_t us = to_us_since_boot(until);
+        struct timespec ts = {
+                .tv_sec = (time_t)(us / 1000000),
+                .tv_nsec = (long)(us % 1000000) * 1000,
+        };
+        pthread_cond_timedwait(&self->work_needed_cond, &self->work_needed_mutex, &ts);
+    } else {
+        while (!self->work_needed) {
+            pthread_cond_wait(&self->work_needed_cond, &self->work_needed_mutex);
+        }
+    }
+    self->work_needed = false;
+    pthread_mutex_unlock(&self->work_needed_mutex);
+}
+
+static bool async_context_epoll_add_at_time_worker(async_context_t *self_base, async_at_time_worker_t *worker) {
+    async_context_epoll_acquire_lock_blocking(self_base);
+    bool rc = async_context_base_add_at_time_worker(self_base, worker);
+    async_context_epoll_release_lock(self_base);
+    return rc;
+}
+
+static bool async_context_epoll_remove_at_time_worker(async_context_t *self_base, async_at_time_worker_t *worker) {
+    async_context_epoll_acquire_lock_blocking(self_base);
+    bool rc = async_context_base_remove_at_time_worker(self_base, worker);
+    async_context_epoll_release_lock(self_base);
+    return rc;
+}
+
+static bool async_context_epoll_add_when_pending_worker(async_context_t *self_base, async_when_pending_worker_t *worker) {
+    async_context_epoll_acquire_lock_blocking(self_base);
+    bool rc = async_context_base_add_when_pending_worker(self_base, worker);
+    async_context_epoll_release_lock(self_base);
+    return rc;
+}
+
+static bool async_context_epoll_remove_when_pending_worker(async_context_t *self_base, async_when_pending_worker_t *worker) {
+    async_context_epoll_acquire_lock_blocking(self_base);
+    bool rc = async_context_base_remove_when_pending_worker(self_base, worker);
+    async_context_epoll_release_lock(self_base);
+    return rc;
+}
+
+static const async_context_type_t template = {
+        .type = ASYNC_CONTEXT_EPOLL,
+        .acquire_lock_blocking = async_context_epoll_acquire_lock_blocking,
+        .release_lock = async_context_epoll_release_lock,
+        .lock_check = async_context_epoll_lock_check,
+        .execute_sync = async_context_epoll_execute_sync,
+        .add_at_time_worker = async_context_epoll_add_at_time_worker,
+        .remove_at_time_worker = async_context_epoll_remove_at_time_worker,
+        .add_when_pending_worker = async_context_epoll_add_when_pending_worker,
+        .remove_when_pending_worker = async_context_epoll_remove_when_pending_worker,
+        .set_work_pending = async_context_epoll_set_work_pending,
+        .poll = async_context_epoll_poll,
+        .wait_until = async_context_epoll_wait_until,
+        .wait_for_work_until = async_context_epoll_wait_for_work_until,
+        .deinit = async_context_epoll_deinit,
+};
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_ASYNC_CONTEXT_EPOLL_H
+#define _PICO_ASYNC_CONTEXT_EPOLL_H
+
+/** \file pico/async_context_epoll.h
+ *  \defgroup async_context_epoll async_context_epoll
+ *  \ingroup pico_async_context
+ *
+ * \brief async_context_epoll provides an event driven implementation of \ref async_context for Linux host builds.
+ *
+ * The async_context waits in epoll_wait(), using an eventfd to be woken when work is marked pending (which may be
+ * done from any thread), and a timerfd for the next "at time" worker, so no CPU is used while there is no work to do.
+ * Additionally, any file descriptor can be associated with a "when pending" worker via \ref async_context_epoll_add_fd,
+ * and the worker is then marked pending whenever the file descriptor is ready.
+ *
+ * Work is either performed from a dedicated thread created during initialization (the default), or, if
+ * \ref async_context_epoll_config_t::create_thread is false, from the thread which initialized the async_context
+ * when it calls \ref async_context_poll(). In the latter case, \ref async_context_epoll_get_fd returns a file descriptor
+ * which becomes readable when the async_context has work to do, so that many async_context instances can be serviced
+ * from a single thread by an outer epoll (or poll/select) loop.
+ *
+ * The async_context implements async_context locking, and is thus safe to call from any thread, according to the
+ * specific notes on each API.
+ */
+
+#include "pico/async_context.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef ASYNC_CONTEXT_EPOLL_MAX_EVENTS
+#define ASYNC_CONTEXT_EPOLL_MAX_EVENTS 16
+#endif
+
+typedef struct async_context_epoll async_context_epoll_t;
+
+/**
+ * \brief Configuration object for async_context_epoll instances.
+ */
+typedef struct async_context_epoll_config {
+    /**
+     * \brief true to create a dedicated thread to perform work, false to perform work from the initializing thread
+     * when it calls async_context_poll()
+     */
+    bool create_thread;
+} async_context_epoll_config_t;
+
+struct async_context_epoll {
+    async_context_t core;
+    pthread_mutex_t lock_mutex;
+    pthread_mutex_t work_needed_mutex;
+    pthread_cond_t work_needed_cond;
+    pthread_t lock_owner;
+    pthread_t context_thread; // the thread which performs work
+    int epoll_fd;
+    int event_fd;
+    int timer_fd;
+    uint nesting;
+    bool work_needed;
+    bool thread_created;
+    volatile bool thread_should_exit;
+};
+
+/*!
+ * \brief Initialize an async_context_epoll instance using the specified configuration
+ * \ingroup async_context_epoll
+ *
+ * If this method succeeds (returns true), then the async_context is available for use
+ * and can be de-initialized by calling async_context_deinit().
+ *
+ * \param self a pointer to async_context_epoll structure to initialize
+ * \param config the configuration object specifying characteristics for the async_context
+ * \return true if initialization is successful, false otherwise
+ */
+bool async_context_epoll_init(async_context_epoll_t *self, async_context_epoll_config_t *config);
+
+/*!
+ * \brief Return a copy of the default configuration object used by \ref async_context_epoll_init_with_defaults()
+ * \ingroup async_context_epoll
+ *
+ * The caller can then modify just the settings it cares about, and call \ref async_context_epoll_init()
+ * \return the default configuration object
+ */
+static inline async_context_epoll_config_t async_context_epoll_default_config(void) {
+    async_context_epoll_config_t config = {
+            .create_thread = true,
+    };
+    return config;
+}
+
+/*!
+ * \brief Initialize an async_context_epoll instance with default values
+ * \ingroup async_context_epoll
+ *
+ * If this method succeeds (returns true), then the async_context is available for use
+ * and can be de-initialized by calling async_context_deinit().
+ *
+ * \param self a pointer to async_context_epoll structure to initialize
+ * \return true if initialization is successful, false otherwise
+ */
+static inline bool async_context_epoll_init_with_defaults(async_context_epoll_t *self) {
+    async_context_epoll_config_t config = async_context_epoll_default_config();
+    return async_context_epoll_init(self, &config);
+}
+
+/*!
+ * \brief Mark a "when pending" worker as having work pending whenever a file descriptor is ready
+ * \ingroup async_context_epoll
+ *
+ * The worker should be added to the async_context via \ref async_context_add_when_pending_worker, and is
+ * responsible for consuming the readiness of the file descriptor (e.g. by reading from it); with the default
+ * level-triggered behavior, the worker will otherwise be called repeatedly.
+ *
+ * \note this method is threadsafe
+ *
+ * \param self the async_context_epoll
+ * \param fd the file descriptor
+ * \param events the epoll events of interest (e.g. EPOLLIN)
+ * \param worker the "when pending" worker to mark pending
+ * \return true if the file descriptor was added, false otherwise (e.g. it was already added)
+ */
+bool async_context_epoll_add_fd(async_context_epoll_t *self, int fd, uint32_t events, async_when_pending_worker_t *worker);
+
+/*!
+ * \brief Stop monitoring a file descriptor previously added via \ref async_context_epoll_add_fd
+ * \ingroup async_context_epoll
+ *
+ * \note this method is threadsafe
+ *
+ * \param self the async_context_epoll
+ * \param fd the file descriptor
+ * \return true if the file descriptor was removed, false if it was not present
+ */
+bool async_context_epoll_remove_fd(async_context_epoll_t *self, int fd);
+
+/*!
+ * \brief Return a file descriptor which becomes readable when the async_context has events to handle
+ * \ingroup async_context_epoll
+ *
+ * This is intended for async_context instances initialized without their own thread, so that an application can
+ * wait on many instances at once, calling \ref async_context_poll() on each one that becomes ready.
+ *
+ * \param self the async_context_epoll
+ * \return the file descriptor
+ */
+static inline int async_context_epoll_get_fd(const async_context_epoll_t *self) {
+    return self->epoll_fd;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
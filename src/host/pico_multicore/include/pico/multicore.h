@@ -9,10 +9,41 @@
 
 #include "pico/types.h"
 
+/** \file pico/multicore.h
+ *
+ * On the host platform, core 1 is simulated by a separate thread, started by \ref multicore_launch_core1, and
+ * \ref get_core_num returns 1 when called from that thread. The inter-core FIFOs are bounded, blocking queues of the
+ * same depth as on device, and lockout is implemented by signalling the victim thread, which then blocks until
+ * released.
+ *
+ * \note Resetting core 1 via \ref multicore_reset_core1 cancels the core 1 thread, which only takes effect when that
+ * thread reaches a cancellation point (e.g. blocking on a FIFO, or sleeping).
+ */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// PICO_CONFIG: PICO_HOST_MULTICORE_FIFO_DEPTH, Depth of each simulated inter-core FIFO on the host platform, type=int, default=4 for RP2350 or 8 otherwise, group=pico_multicore
+#ifndef PICO_HOST_MULTICORE_FIFO_DEPTH
+#if PICO_RP2350
+#define PICO_HOST_MULTICORE_FIFO_DEPTH 4
+#else
+#define PICO_HOST_MULTICORE_FIFO_DEPTH 8
+#endif
+#endif
+
+// PICO_CONFIG: PICO_HOST_MULTICORE_LOCKOUT_SIGNAL, Signal used to interrupt the lockout victim thread on the host platform, type=int, default=SIGUSR2, group=pico_multicore
+#ifndef PICO_HOST_MULTICORE_LOCKOUT_SIGNAL
+#define PICO_HOST_MULTICORE_LOCKOUT_SIGNAL SIGUSR2
+#endif
+
+// as on device, the FIFO status bits returned by multicore_fifo_get_status()
+#define SIO_FIFO_ST_VLD_BITS 0x00000001u
+#define SIO_FIFO_ST_RDY_BITS 0x00000002u
+#define SIO_FIFO_ST_WOF_BITS 0x00000004u
+#define SIO_FIFO_ST_ROE_BITS 0x00000008u
+
 void multicore_reset_core1(void);
 void multicore_launch_core1(void (*entry)(void));
 void multicore_launch_core1_with_stack(void (*entry)(void), uint32_t *stack_bottom, size_t stack_size_bytes);
@@ -30,6 +61,8 @@ uint32_t multicore_fifo_get_status(void);
 
 // call this from the lockout victim thread
 void multicore_lockout_victim_init(void);
+void multicore_lockout_victim_deinit(void);
+bool multicore_lockout_victim_is_initialized(uint core_num);
 
 // start locking out the other core (it will be
 bool multicore_lockout_start_timeout_us(uint64_t timeout_us);
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pico/multicore.h"
+#include "hardware/timer.h"
+
+// the core number of the calling thread; threads other than the simulated core 1 are core 0
+static __thread uint8_t host_core_num;
+
+uint get_core_num(void) {
+    return host_core_num;
+}
+
+// fifos[n] is the FIFO read by core n (and written by the other core)
+typedef struct {
+    uint32_t data[PICO_HOST_MULTICORE_FIFO_DEPTH];
+    uint read_index;
+    uint count;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} host_fifo_t;
+
+static pthread_mutex_t fifo_mutex = PTHREAD_MUTEX_INITIALIZER;
+static host_fifo_t fifos[NUM_CORES];
+static pthread_once_t fifo_once = PTHREAD_ONCE_INIT;
+
+static pthread_t core1_thread;
+static bool core1_running;
+
+static void fifo_init(void) {
+    for (uint i = 0; i < NUM_CORES; i++) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+#ifdef __linux__
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+        pthread_cond_init(&fifos[i].not_empty, &attr);
+        pthread_cond_init(&fifos[i].not_full, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+}
+
+static inline host_fifo_t *read_fifo(void) {
+    return &fifos[host_core_num];
+}
+
+static inline host_fifo_t *write_fifo(void) {
+    return &fifos[host_core_num ^ 1];
+}
+
+static void fifo_lock(void) {
+    pthread_once(&fifo_once, fifo_init);
+    pthread_mutex_lock(&fifo_mutex);
+}
+
+static void fifo_unlock(void) {
+    pthread_mutex_unlock(&fifo_mutex);
+}
+
+// used as a cancellation cleanup handler, as the core 1 thread may be cancelled while waiting on a FIFO
+static void fifo_unlock_cleanup(__unused void *arg) {
+    fifo_unlock();
+}
+
+static uint64_t time_us_64_after(uint64_t timeout_us) {
+    uint64_t now = time_us_64();
+    return timeout_us > UINT64_MAX - now ? UINT64_MAX : now + timeout_us;
+}
+
+// wait on cond (with fifo_mutex held) until the time_us_64() based time until_us; returns false on timeout
+static bool fifo_cond_wait_until(pthread_cond_t *cond, uint64_t until_us) {
+    struct timespec ts;
+#ifdef __linux__
+    // the cond is using CLOCK_MONOTONIC which is also the basis of time_us_64()
+    uint64_t abs_us = until_us;
+#else
+    uint64_t now_us = time_us_64();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t abs_us = ts.tv_sec * (uint64_t) 1000000 + ts.tv_nsec / 1000 + (until_us > now_us ? until_us - now_us : 0);
+#endif
+    ts.tv_sec = (time_t)(abs_us / 1000000);
+    ts.tv_nsec = (long)(abs_us % 1000000) * 1000;
+    return pthread_cond_timedwait(cond, &fifo_mutex, &ts) != ETIMEDOUT;
+}
+
+static void fifo_push_locked(host_fifo_t *fifo, uint32_t data) {
+    fifo->data[(fifo->read_index + fifo->count) % PICO_HOST_MULTICORE_FIFO_DEPTH] = data;
+    fifo->count++;
+    pthread_cond_signal(&fifo->not_empty);
+}
+
+static uint32_t fifo_pop_locked(host_fifo_t *fifo) {
+    uint32_t data = fifo->data[fifo->read_index];
+    fifo->read_index = (fifo->read_index + 1) % PICO_HOST_MULTICORE_FIFO_DEPTH;
+    fifo->count--;
+    pthread_cond_signal(&fifo->not_full);
+    return data;
+}
+
+bool multicore_fifo_rvalid(void) {
+    fifo_lock();
+    bool rc = read_fifo()->count != 0;
+    fifo_unlock();
+    return rc;
+}
+
+bool multicore_fifo_wready(void) {
+    fifo_lock();
+    bool rc = write_fifo()->count < PICO_HOST_MULTICORE_FIFO_DEPTH;
+    fifo_unlock();
+    return rc;
+}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+    host_fifo_t *fifo = write_fifo();
+    fifo_lock();
+    pthread_cleanup_push(fifo_unlock_cleanup, NULL);
+    while (fifo->count == PICO_HOST_MULTICORE_FIFO_DEPTH) {
+        pthread_cond_wait(&fifo->not_full, &fifo_mutex);
+    }
+    fifo_push_locked(fifo, data);
+    pthread_cleanup_pop(1);
+}
+
+bool multicore_fifo_push_timeout_us(uint32_t data, uint64_t timeout_us) {
+    host_fifo_t *fifo = write_fifo();
+    uint64_t until_us = time_us_64_after(timeout_us);
+    bool rc = true;
+    fifo_lock();
+    pthread_cleanup_push(fifo_unlock_cleanup, NULL);
+    while (fifo->count == PICO_HOST_MULTICORE_FIFO_DEPTH && rc) {
+        rc = fifo_cond_wait_until(&fifo->not_full, until_us);
+    }
+    rc = fifo->count < PICO_HOST_MULTICORE_FIFO_DEPTH;
+    if (rc) fifo_push_locked(fifo, data);
+    pthread_cleanup_pop(1);
+    return rc;
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+    host_fifo_t *fifo = read_fifo();
+    uint32_t data;
+    fifo_lock();
+    pthread_cleanup_push(fifo_unlock_cleanup, NULL);
+    while (!fifo->count) {
+        pthread_cond_wait(&fifo->not_empty, &fifo_mutex);
+    }
+    data = fifo_pop_locked(fifo);
+    pthread_cleanup_pop(1);
+    return data;
+}
+
+bool multicore_fifo_pop_timeout_us(uint64_t timeout_us, uint32_t *out) {
+    host_fifo_t *fifo = read_fifo();
+    uint64_t until_us = time_us_64_after(timeout_us);
+    bool rc = true;
+    fifo_lock();
+    pthread_cleanup_push(fifo_unlock_cleanup, NULL);
+    while (!fifo->count && rc) {
+        rc = fifo_cond_wait_until(&fifo->not_empty, until_us);
+    }
+    rc = fifo->count != 0;
+    if (rc) *out = fifo_pop_locked(fifo);
+    pthread_cleanup_pop(1);
+    return rc;
+}
+
+void multicore_fifo_drain(void) {
+    host_fifo_t *fifo = read_fifo();
+    fifo_lock();
+    while (fifo->count) {
+        fifo_pop_locked(fifo);
+    }
+    fifo_unlock();
+}
+
+void multicore_fifo_clear_irq(void) {
+    // the host FIFOs can't overflow or underflow, so there are no sticky error bits to clear
+}
+
+uint32_t multicore_fifo_get_status(void) {
+    fifo_lock();
+    uint32_t status = 0;
+    if (read_fifo()->count) status |= SIO_FIFO_ST_VLD_BITS;
+    if (write_fifo()->count < PICO_HOST_MULTICORE_FIFO_DEPTH) status |= SIO_FIFO_ST_RDY_BITS;
+    fifo_unlock();
+    return status;
+}
+
+static void *core1_thread_entry(void *arg) {
+    host_core_num = 1;
+    void (*entry)(void) = (void (*)(void))arg;
+    entry();
+    return NULL;
+}
+
+void multicore_reset_core1(void) {
+    if (core1_running) {
+        assert(get_core_num() == 0);
+        pthread_cancel(core1_thread);
+        pthread_join(core1_thread, NULL);
+        core1_running = false;
+    }
+    // as on device, the FIFOs are left empty
+    fifo_lock();
+    for (uint i = 0; i < NUM_CORES; i++) {
+        fifos[i].count = 0;
+        fifos[i].read_index = 0;
+    }
+    fifo_unlock();
+}
+
+static void launch_core1(void (*entry)(void), size_t stack_size_bytes) {
+    multicore_reset_core1();
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // the host needs far more stack than a device core (e.g. for printf), so only ever increase the default
+    size_t default_size;
+    if (!pthread_attr_getstacksize(&attr, &default_size) && stack_size_bytes > default_size) {
+        pthread_attr_setstacksize(&attr, stack_size_bytes);
+    }
+    if (pthread_create(&core1_thread, &attr, core1_thread_entry, (void *)entry)) {
+        panic("Failed to create core 1 thread");
+    }
+    pthread_attr_destroy(&attr);
+    core1_running = true;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    launch_core1(entry, 0);
+}
+
+void multicore_launch_core1_with_stack(void (*entry)(void), __unused uint32_t *stack_bottom, size_t stack_size_bytes) {
+    launch_core1(entry, stack_size_bytes);
+}
+
+void multicore_launch_core1_raw(void (*entry)(void), __unused uint32_t *sp, __unused uint32_t vector_table) {
+    launch_core1(entry, 0);
+}
+
+// Lockout: the victim thread is interrupted by a signal, and its handler acknowledges via a pipe, then blocks reading
+// a second pipe until released. Pipes are used because these are async-signal-safe, unlike pthread primitives.
+//
+// A request which times out may still be seen by the victim later (or be merged with the next one, as signals are
+// not queued), so each request has a sequence number, and the pipes only wake the other side to check the sequence
+// numbers; a byte left in a pipe from an earlier request is harmless.
+typedef struct {
+    pthread_t thread;
+    int ack_pipe[2];
+    int release_pipe[2];
+    // the latest request, the latest request acknowledged by the victim, and the latest request it may return from
+    atomic_uint request_seq;
+    atomic_uint ack_seq;
+    atomic_uint release_seq;
+    bool initialized;
+} lockout_victim_t;
+
+static lockout_victim_t lockout_victims[NUM_CORES];
+static pthread_mutex_t lockout_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool lockout_in_progress;
+
+static void lockout_signal_handler(__unused int sig) {
+    int saved_errno = errno;
+    lockout_victim_t *victim = &lockout_victims[host_core_num];
+    uint seq = atomic_load(&victim->request_seq);
+    atomic_store(&victim->ack_seq, seq);
+    char c = 0;
+    ssize_t __unused rc = write(victim->ack_pipe[1], &c, 1);
+    while ((int)(atomic_load(&victim->release_seq) - seq) < 0) {
+        if (read(victim->release_pipe[0], &c, 1) < 0 && errno != EINTR) break;
+    }
+    errno = saved_errno;
+}
+
+void multicore_lockout_victim_init(void) {
+    lockout_victim_t *victim = &lockout_victims[get_core_num()];
+    if (victim->initialized) return;
+    if (pipe(victim->ack_pipe) || pipe(victim->release_pipe)) {
+        panic("Failed to create lockout pipes");
+    }
+    struct sigaction sa = {0};
+    sa.sa_handler = lockout_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(PICO_HOST_MULTICORE_LOCKOUT_SIGNAL, &sa, NULL);
+    victim->thread = pthread_self();
+    victim->initialized = true;
+}
+
+void multicore_lockout_victim_deinit(void) {
+    lockout_victim_t *victim = &lockout_victims[get_core_num()];
+    if (!victim->initialized) return;
+    victim->initialized = false;
+    close(victim->ack_pipe[0]);
+    close(victim->ack_pipe[1]);
+    close(victim->release_pipe[0]);
+    close(victim->release_pipe[1]);
+}
+
+bool multicore_lockout_victim_is_initialized(uint core_num) {
+    return lockout_victims[core_num].initialized;
+}
+
+static bool lockout_mutex_enter_until(uint64_t until_us) {
+    while (pthread_mutex_trylock(&lockout_mutex)) {
+        if (time_us_64() >= until_us) return false;
+        sched_yield();
+    }
+    return true;
+}
+
+static bool multicore_lockout_handshake(bool start, uint64_t until_us) {
+    lockout_victim_t *victim = &lockout_victims[get_core_num() ^ 1];
+    if (!victim->initialized) return false;
+    if (!lockout_mutex_enter_until(until_us)) return false;
+    bool rc = false;
+    if (start != lockout_in_progress) {
+        uint seq = atomic_load(&victim->request_seq);
+        if (start) {
+            atomic_store(&victim->request_seq, ++seq);
+            if (!pthread_kill(victim->thread, PICO_HOST_MULTICORE_LOCKOUT_SIGNAL)) {
+                struct pollfd pfd = {
+                        .fd = victim->ack_pipe[0],
+                        .events = POLLIN,
+                };
+                uint64_t now_us;
+                while (!(rc = atomic_load(&victim->ack_seq) == seq) && (now_us = time_us_64()) < until_us) {
+                    uint64_t remaining_ms = (until_us - now_us + 999) / 1000;
+                    if (poll(&pfd, 1, remaining_ms > INT32_MAX ? INT32_MAX : (int)remaining_ms) > 0) {
+                        char c;
+                        ssize_t __unused rrc = read(victim->ack_pipe[0], &c, 1);
+                    }
+                }
+            }
+            if (!rc) {
+                // the victim may yet see the signal, so make sure it won't stay locked out
+                atomic_store(&victim->release_seq, seq);
+                char c = 0;
+                ssize_t __unused wrc = write(victim->release_pipe[1], &c, 1);
+            }
+        } else {
+            atomic_store(&victim->release_seq, seq);
+            char c = 0;
+            rc = write(victim->release_pipe[1], &c, 1) == 1;
+        }
+        if (rc) lockout_in_progress = start;
+    }
+    pthread_mutex_unlock(&lockout_mutex);
+    return rc;
+}
+
+bool multicore_lockout_start_timeout_us(uint64_t timeout_us) {
+    return multicore_lockout_handshake(true, time_us_64_after(timeout_us));
+}
+
+void multicore_lockout_start_blocking(void) {
+    multicore_lockout_handshake(true, UINT64_MAX);
+}
+
+bool multicore_lockout_end_timeout_us(uint64_t timeout_us) {
+    return multicore_lockout_handshake(false, time_us_64_after(timeout_us));
+}
+
+void multicore_lockout_end_blocking(void) {
+    multicore_lockout_handshake(false, UINT64_MAX);
+}
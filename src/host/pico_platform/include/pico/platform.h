@@ -140,6 +140,10 @@ void *decode_host_safe_hw_ptr(uint32_t ptr);
 
 #define __fast_mul(a,b) ((a)*(b))
 
+// for functions replaced using pico_wrap_function
+#define WRAPPER_FUNC(x) __wrap_ ## x
+#define REAL_FUNC(x) __real_ ## x
+
 typedef unsigned int uint;
 
 static inline int32_t __mul_instruction(int32_t a,int32_t b)
@@ -152,10 +156,8 @@ static inline void __compiler_memory_barrier(void) {
 
 uint get_core_num();
 
-static inline uint __get_current_exception(void) {
-    return 0;
-
-}
+// the exception number of the currently executing (simulated) IRQ handler on the calling thread, or 0
+uint __get_current_exception(void);
 
 void busy_wait_at_least_cycles(uint32_t minimum_cycles);
 
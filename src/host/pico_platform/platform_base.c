@@ -20,6 +20,11 @@ uint PICO_WEAK_FUNCTION_IMPL_NAME(get_core_num)() {
     return 0;
 }
 
+PICO_WEAK_FUNCTION_DEF(__get_current_exception)
+uint PICO_WEAK_FUNCTION_IMPL_NAME(__get_current_exception)() {
+    return 0;
+}
+
 void __noreturn panic_unsupported() {
     panic("not supported");
 }
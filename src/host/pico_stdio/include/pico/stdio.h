@@ -18,6 +18,7 @@ static inline void stdio_filter_driver(stdio_driver_t *driver) {}
 static inline void stdio_set_translate_crlf(stdio_driver_t *driver, bool enabled) {}
 static inline bool stdio_usb_connected(void) { return true; }
 int getchar_timeout_us(uint32_t timeout_us);
+int stdio_put_string(const char *s, int len, bool newline, bool cr_translation);
 #define puts_raw puts
 #define putchar_raw putchar
 
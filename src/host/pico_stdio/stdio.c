@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include <stdio.h>
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
 
@@ -20,4 +21,11 @@ int getchar_timeout_us(uint32_t timeout_us) {
 
 void stdio_uart_init() {
     uart_init(uart_default, 0);
-}
\ No newline at end of file
+}
+
+int stdio_put_string(const char *s, int len, bool newline, __unused bool cr_translation) {
+    fwrite(s, 1, (size_t)len, stdout);
+    if (newline) putchar('\n');
+    fflush(stdout);
+    return len;
+}
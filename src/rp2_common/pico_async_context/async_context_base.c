@@ -6,72 +6,206 @@
 
 #include "pico/async_context_base.h"
 
-bool async_context_base_add_at_time_worker(async_context_t *self, async_at_time_worker_t *worker) {
+// The at_time_list is kept sorted by next_time (earliest first), so the next timeout, and the next
+// worker to run are always found at the head of the list.
+
+static bool at_time_list_unlink(async_context_t *self, async_at_time_worker_t *worker) {
     async_at_time_worker_t **prev = &self->at_time_list;
     while (*prev) {
         if (worker == *prev) {
-            return false;
+            *prev = worker->next;
+            return true;
         }
         prev = &(*prev)->next;
     }
+    return false;
+}
+
+static void at_time_list_insert(async_context_t *self, async_at_time_worker_t *worker) {
+    async_at_time_worker_t **prev = &self->at_time_list;
+    // insert after any workers with the same time, so they are run in the order they were added
+    while (*prev && absolute_time_diff_us((*prev)->next_time, worker->next_time) >= 0) {
+        prev = &(*prev)->next;
+    }
+    worker->next = *prev;
     *prev = worker;
-    worker->next = NULL;
-    return true;
+}
+
+bool async_context_base_add_at_time_worker(async_context_t *self, async_at_time_worker_t *worker) {
+    // it is common for callers to update next_time on a worker which is already present, and then
+    // re-add it (which has always caused the new time to take effect), so we must re-position
+    // the worker in that case, even though we return false
+    bool present = at_time_list_unlink(self, worker);
+    at_time_list_insert(self, worker);
+    return !present;
 }
 
 bool async_context_base_remove_at_time_worker(async_context_t *self, async_at_time_worker_t *worker) {
-    async_at_time_worker_t **prev = &self->at_time_list;
-    while (*prev) {
-        if (worker == *prev) {
-            *prev = worker->next;
-            return true;
+    return at_time_list_unlink(self, worker);
+}
+
+static_assert(ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS * sizeof(uint8_t) == sizeof(uint32_t), "");
+static_assert(ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGHEST - ASYNC_WHEN_PENDING_WORKER_PRIORITY_LOW == ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS - 1, "");
+
+void async_context_base_init(async_context_t *self) {
+    self->when_pending_spin_lock = spin_lock_init((uint)spin_lock_claim_unused(true));
+}
+
+void async_context_base_deinit(async_context_t *self) {
+    // may be called after a failed initialization, before the spin lock is claimed
+    if (self->when_pending_spin_lock) {
+        spin_lock_unclaim(spin_lock_get_num(self->when_pending_spin_lock));
+        self->when_pending_spin_lock = NULL;
+    }
+}
+
+// appends the worker to the queue for its level, unless it is queued already
+static void pending_queue_append(async_context_t *self, async_when_pending_worker_t *worker) {
+    uint level = async_context_base_when_pending_level(worker);
+    uint32_t save = spin_lock_blocking(self->when_pending_spin_lock);
+    if (!worker->pending_queued) {
+        worker->pending_queued = true;
+        worker->pending_next = NULL;
+        if (self->when_pending_queue_tails[level]) {
+            self->when_pending_queue_tails[level]->pending_next = worker;
+        } else {
+            self->when_pending_queue_heads[level] = worker;
         }
-        prev = &(*prev)->next;
+        self->when_pending_queue_tails[level] = worker;
+        self->when_pending_level_flags[level] = 1;
     }
-    return false;
+    spin_unlock(self->when_pending_spin_lock, save);
+}
+
+// takes the whole queue for a level, leaving it empty. the workers taken are still marked as queued, so their
+// pending_next links are left alone if they are marked pending again
+static async_when_pending_worker_t *pending_queue_take(async_context_t *self, uint level) {
+    uint32_t save = spin_lock_blocking(self->when_pending_spin_lock);
+    async_when_pending_worker_t *workers = self->when_pending_queue_heads[level];
+    self->when_pending_queue_heads[level] = NULL;
+    self->when_pending_queue_tails[level] = NULL;
+    self->when_pending_level_flags[level] = 0;
+    spin_unlock(self->when_pending_spin_lock, save);
+    return workers;
+}
+
+// puts workers taken by pending_queue_take back at the front of the queue for the level
+static void pending_queue_return(async_context_t *self, uint level, async_when_pending_worker_t *workers) {
+    async_when_pending_worker_t *last = workers;
+    while (last->pending_next) {
+        last = last->pending_next;
+    }
+    uint32_t save = spin_lock_blocking(self->when_pending_spin_lock);
+    last->pending_next = self->when_pending_queue_heads[level];
+    if (!last->pending_next) {
+        self->when_pending_queue_tails[level] = last;
+    }
+    self->when_pending_queue_heads[level] = workers;
+    self->when_pending_level_flags[level] = 1;
+    spin_unlock(self->when_pending_spin_lock, save);
+}
+
+// removes the first of the workers taken by the current pass, after which it may be queued again
+static async_when_pending_worker_t *pending_taken_pop(async_context_t *self) {
+    uint32_t save = spin_lock_blocking(self->when_pending_spin_lock);
+    async_when_pending_worker_t *worker = self->when_pending_taken;
+    self->when_pending_taken = worker->pending_next;
+    worker->pending_queued = false;
+    spin_unlock(self->when_pending_spin_lock, save);
+    return worker;
+}
+
+// removes the worker from its level's queue, or from the workers taken by the current pass
+static void pending_queue_unlink(async_context_t *self, async_when_pending_worker_t *worker) {
+    uint level = async_context_base_when_pending_level(worker);
+    uint32_t save = spin_lock_blocking(self->when_pending_spin_lock);
+    if (worker->pending_queued) {
+        async_when_pending_worker_t *prev = NULL;
+        async_when_pending_worker_t *other = self->when_pending_queue_heads[level];
+        while (other && other != worker) {
+            prev = other;
+            other = other->pending_next;
+        }
+        if (other) {
+            if (prev) {
+                prev->pending_next = worker->pending_next;
+            } else {
+                self->when_pending_queue_heads[level] = worker->pending_next;
+            }
+            if (self->when_pending_queue_tails[level] == worker) {
+                self->when_pending_queue_tails[level] = prev;
+            }
+            if (!self->when_pending_queue_heads[level]) {
+                self->when_pending_level_flags[level] = 0;
+            }
+        } else {
+            async_when_pending_worker_t **prev_next = &self->when_pending_taken;
+            while (*prev_next && *prev_next != worker) {
+                prev_next = &(*prev_next)->pending_next;
+            }
+            if (*prev_next) *prev_next = worker->pending_next;
+        }
+        worker->pending_queued = false;
+    }
+    spin_unlock(self->when_pending_spin_lock, save);
+}
+
+void async_context_base_mark_work_pending(async_context_t *self, async_when_pending_worker_t *worker) {
+#if PICO_ASYNC_CONTEXT_PROFILE
+    if (!worker->profile.pending_since_valid) {
+        worker->profile.pending_since = time_us_32();
+        worker->profile.pending_since_valid = true;
+    }
+#endif
+    worker->work_pending = true;
+    pending_queue_append(self, worker);
 }
 
 bool async_context_base_add_when_pending_worker(async_context_t *self, async_when_pending_worker_t *worker) {
-    async_when_pending_worker_t **prev = &self->when_pending_list;
-    while (*prev) {
-        if (worker == *prev) {
-            return false;
+    assert(worker->priority >= ASYNC_WHEN_PENDING_WORKER_PRIORITY_LOW && worker->priority <= ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGHEST);
+    for (uint level = 0; level < ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS; level++) {
+        for (async_when_pending_worker_t *other = self->when_pending_lists[level]; other; other = other->next) {
+            if (worker == other) {
+                return false;
+            }
         }
+    }
+    async_when_pending_worker_t **prev = &self->when_pending_lists[async_context_base_when_pending_level(worker)];
+    while (*prev) {
         prev = &(*prev)->next;
     }
     *prev = worker;
     worker->next = NULL;
+    // the worker may have been marked pending before it was added
+    if (worker->work_pending) {
+        async_context_base_mark_work_pending(self, worker);
+    }
     return true;
 }
 
 bool async_context_base_remove_when_pending_worker(async_context_t *self, async_when_pending_worker_t *worker) {
-    async_when_pending_worker_t **prev = &self->when_pending_list;
-    while (*prev) {
-        if (worker == *prev) {
-            *prev = worker->next;
-            return true;
+    for (uint level = 0; level < ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS; level++) {
+        async_when_pending_worker_t **prev = &self->when_pending_lists[level];
+        while (*prev) {
+            if (worker == *prev) {
+                *prev = worker->next;
+                pending_queue_unlink(self, worker);
+                if (self->when_pending_current == worker) {
+                    self->when_pending_current = NULL;
+                }
+                return true;
+            }
+            prev = &(*prev)->next;
         }
-        prev = &(*prev)->next;
     }
     return false;
 }
 
 async_at_time_worker_t *async_context_base_remove_ready_at_time_worker(async_context_t *self) {
-    async_at_time_worker_t **best_prev = NULL;
-    if (self->at_time_list) {
-        absolute_time_t earliest = get_absolute_time();
-        for (async_at_time_worker_t **prev = &self->at_time_list; *prev; prev = &(*prev)->next) {
-            if (absolute_time_diff_us((*prev)->next_time, earliest) >= 0) {
-                earliest = (*prev)->next_time;
-                assert(!is_at_the_end_of_time(earliest)); // should never be less than now
-                best_prev = prev;
-            }
-        }
-    }
-    async_at_time_worker_t *rc;
-    if (best_prev) {
-        rc = *best_prev;
-        *best_prev = rc->next;
+    async_at_time_worker_t *rc = self->at_time_list;
+    if (rc && absolute_time_diff_us(rc->next_time, get_absolute_time()) >= 0) {
+        assert(!is_at_the_end_of_time(rc->next_time)); // should never be less than now
+        self->at_time_list = rc->next;
     } else {
         rc = NULL;
     }
@@ -79,45 +213,205 @@ async_at_time_worker_t *async_context_base_remove_ready_at_time_worker(async_con
 }
 
 void async_context_base_refresh_next_timeout(async_context_t *self) {
-    absolute_time_t earliest = at_the_end_of_time;
-    for (async_at_time_worker_t *worker = self->at_time_list; worker; ) {
-        async_at_time_worker_t *next = worker->next;
-        if (absolute_time_diff_us(worker->next_time, earliest) > 0) {
-            earliest = worker->next_time;
+    self->next_time = self->at_time_list ? self->at_time_list->next_time : at_the_end_of_time;
+}
+
+#if PICO_ASYNC_CONTEXT_PROFILE
+static void profile_record_run(async_context_worker_profile_t *profile, uint32_t start_time, uint32_t wait_us, bool wait_valid) {
+    uint32_t run_us = time_us_32() - start_time;
+    profile->invocation_count++;
+    profile->total_run_us += run_us;
+    if (run_us > profile->max_run_us) profile->max_run_us = run_us;
+    if (wait_valid) {
+        profile->total_wait_us += wait_us;
+        if (wait_us > profile->max_wait_us) profile->max_wait_us = wait_us;
+    }
+}
+
+static void run_when_pending_worker(async_context_t *self, async_when_pending_worker_t *worker) {
+    async_context_worker_profile_t *profile = &worker->profile;
+    uint32_t start_time = time_us_32();
+    bool wait_valid = profile->pending_since_valid;
+    uint32_t wait_us = start_time - profile->pending_since;
+    // clear before calling the worker, so that any re-marking as pending during do_work is timed from then
+    profile->pending_since_valid = false;
+    worker->do_work(self, worker);
+    profile_record_run(profile, start_time, wait_us, wait_valid);
+}
+
+static void run_at_time_worker(async_context_t *self, async_at_time_worker_t *worker) {
+    uint32_t start_time = time_us_32();
+    int64_t late_us = absolute_time_diff_us(worker->next_time, get_absolute_time());
+    // the worker may change next_time, so we must record first
+    uint32_t wait_us = late_us > 0 ? (late_us > UINT32_MAX ? UINT32_MAX : (uint32_t)late_us) : 0;
+    worker->do_work(self, worker);
+    profile_record_run(&worker->profile, start_time, wait_us, true);
+}
+#else
+static inline void run_when_pending_worker(async_context_t *self, async_when_pending_worker_t *worker) {
+    worker->do_work(self, worker);
+}
+
+static inline void run_at_time_worker(async_context_t *self, async_at_time_worker_t *worker) {
+    worker->do_work(self, worker);
+}
+#endif
+
+static bool when_pending_budget_exceeded(async_context_t *self, uint level, uint32_t start_time) {
+    return self->when_pending_budget_us &&
+           level < (uint)(ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGH - ASYNC_WHEN_PENDING_WORKER_PRIORITY_LOW) &&
+           time_us_32() - start_time >= self->when_pending_budget_us;
+}
+
+// returns true if some pending work was deferred because the budget was exceeded. if core_bit is non zero, then only
+// workers whose core affinity includes that core are run, and the affinities of any others which are pending
+// are accumulated in skipped_core_mask
+static bool execute_when_pending_workers(async_context_t *self, uint core_bit, uint *skipped_core_mask) {
+    uint32_t start_time = self->when_pending_budget_us ? time_us_32() : 0;
+    // a worker may poll the async_context itself (with async_context_poll), which makes a nested pass
+    async_when_pending_worker_t *outer_taken = self->when_pending_taken;
+    async_when_pending_worker_t *outer_current = self->when_pending_current;
+    bool deferred = false;
+    // each level is processed at most once per pass (highest priority first), as some workers (e.g. lwIP) always
+    // mark themselves pending again. only the workers queued when the level is reached are run; any marked pending
+    // after that are queued for the next pass
+    for (int level = ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS - 1; level >= 0 && self->when_pending_levels && !deferred; level--) {
+        if (!self->when_pending_level_flags[level]) continue;
+        self->when_pending_taken = pending_queue_take(self, (uint)level);
+        while (self->when_pending_taken) {
+            if (when_pending_budget_exceeded(self, (uint)level, start_time)) {
+                pending_queue_return(self, (uint)level, self->when_pending_taken);
+                self->when_pending_taken = NULL;
+                deferred = true;
+                break;
+            }
+            async_when_pending_worker_t *when_pending_worker = pending_taken_pop(self);
+            // the worker may have been queued again while it was running earlier, and have nothing more to do
+            if (!when_pending_worker->work_pending) continue;
+            if (core_bit) {
+                uint core_mask = async_context_base_worker_core_mask(self, when_pending_worker);
+                if (!(core_mask & core_bit)) {
+                    *skipped_core_mask |= core_mask;
+                    pending_queue_append(self, when_pending_worker);
+                    continue;
+                }
+            }
+            when_pending_worker->work_pending = false;
+            self->when_pending_current = when_pending_worker;
+            run_when_pending_worker(self, when_pending_worker);
+            // the worker may have set work_pending on itself directly, unless it has removed itself
+            if (self->when_pending_current && when_pending_worker->work_pending) {
+                pending_queue_append(self, when_pending_worker);
+            }
         }
-        worker = next;
     }
-    self->next_time = earliest;
+    self->when_pending_taken = outer_taken;
+    self->when_pending_current = outer_current;
+    return deferred;
 }
 
-absolute_time_t async_context_base_execute_once(async_context_t *self) {
+static void execute_ready_at_time_workers(async_context_t *self) {
     async_at_time_worker_t *at_time_worker;
     while (NULL != (at_time_worker = async_context_base_remove_ready_at_time_worker(self))) {
-        at_time_worker->do_work(self, at_time_worker);
+        run_at_time_worker(self, at_time_worker);
     }
-    for(async_when_pending_worker_t *when_pending_worker = self->when_pending_list; when_pending_worker; when_pending_worker = when_pending_worker->next) {
-        if (when_pending_worker->work_pending) {
-            when_pending_worker->work_pending = false;
-            when_pending_worker->do_work(self, when_pending_worker);
-        }
+}
+
+absolute_time_t async_context_base_execute_once(async_context_t *self) {
+    execute_ready_at_time_workers(self);
+    bool deferred = execute_when_pending_workers(self, 0, NULL);
+    async_context_base_refresh_next_timeout(self);
+    if (deferred) {
+        // we want another pass as soon as possible
+        self->next_time = get_absolute_time();
+    }
+    return self->next_time;
+}
+
+absolute_time_t async_context_base_execute_once_on_core(async_context_t *self, uint core_num, uint *pending_core_mask) {
+    uint core_bit = 1u << core_num;
+    uint skipped_core_mask = 0;
+    if (core_num == self->core_num) {
+        execute_ready_at_time_workers(self);
+    } else if (self->at_time_list && absolute_time_diff_us(self->at_time_list->next_time, get_absolute_time()) >= 0) {
+        skipped_core_mask = 1u << self->core_num;
+    }
+    if (execute_when_pending_workers(self, core_bit, &skipped_core_mask)) {
+        skipped_core_mask |= core_bit;
     }
     async_context_base_refresh_next_timeout(self);
+    if (skipped_core_mask & core_bit) {
+        self->next_time = get_absolute_time();
+    }
+    *pending_core_mask = skipped_core_mask;
     return self->next_time;
 }
 
 bool async_context_base_needs_servicing(async_context_t *self) {
-    absolute_time_t now = get_absolute_time();
-    if (self->at_time_list) {
-        for (async_at_time_worker_t *worker = self->at_time_list; worker; worker = worker->next) {
-            if (absolute_time_diff_us(worker->next_time, now) >= 0) {
-                return true;
-            }
+    if (self->at_time_list && absolute_time_diff_us(self->at_time_list->next_time, get_absolute_time()) >= 0) {
+        return true;
+    }
+    return self->when_pending_levels != 0;
+}
+
+#if PICO_ASYNC_CONTEXT_PROFILE
+// note we use the type's lock methods directly, so that querying the profiles doesn't count as a lock acquisition
+
+void async_context_get_when_pending_worker_profile(async_context_t *context, const async_when_pending_worker_t *worker, async_context_worker_profile_t *profile) {
+    context->type->acquire_lock_blocking(context);
+    *profile = worker->profile;
+    context->type->release_lock(context);
+}
+
+void async_context_get_at_time_worker_profile(async_context_t *context, const async_at_time_worker_t *worker, async_context_worker_profile_t *profile) {
+    context->type->acquire_lock_blocking(context);
+    *profile = worker->profile;
+    context->type->release_lock(context);
+}
+
+void async_context_get_lock_profile(async_context_t *context, async_context_lock_profile_t *profile) {
+    context->type->acquire_lock_blocking(context);
+    *profile = context->lock_profile;
+    context->type->release_lock(context);
+}
+
+void async_context_visit_profiles(async_context_t *context, async_context_profile_visitor_t visitor, void *param) {
+    context->type->acquire_lock_blocking(context);
+    for (int level = ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS - 1; level >= 0; level--) {
+        for (async_when_pending_worker_t *worker = context->when_pending_lists[level]; worker; worker = worker->next) {
+            visitor(context, worker, NULL, &worker->profile, param);
         }
     }
-    for(async_when_pending_worker_t *when_pending_worker = self->when_pending_list; when_pending_worker; when_pending_worker = when_pending_worker->next) {
-        if (when_pending_worker->work_pending) {
-            return true;
+    for (async_at_time_worker_t *worker = context->at_time_list; worker; worker = worker->next) {
+        visitor(context, NULL, worker, &worker->profile, param);
+    }
+    context->type->release_lock(context);
+}
+
+static void reset_worker_profile(async_context_worker_profile_t *profile) {
+    // keep the pending state, as the worker may still be pending
+    uint32_t pending_since = profile->pending_since;
+    bool pending_since_valid = profile->pending_since_valid;
+    *profile = (async_context_worker_profile_t){
+        .pending_since = pending_since,
+        .pending_since_valid = pending_since_valid,
+    };
+}
+
+void async_context_reset_profiles(async_context_t *context) {
+    context->type->acquire_lock_blocking(context);
+    for (uint level = 0; level < ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS; level++) {
+        for (async_when_pending_worker_t *worker = context->when_pending_lists[level]; worker; worker = worker->next) {
+            reset_worker_profile(&worker->profile);
         }
     }
-    return false;
-}
\ No newline at end of file
+    for (async_at_time_worker_t *worker = context->at_time_list; worker; worker = worker->next) {
+        reset_worker_profile(&worker->profile);
+    }
+    // keep the state of any current holder of the lock
+    context->lock_profile.acquire_count = 0;
+    context->lock_profile.max_hold_us = 0;
+    context->lock_profile.total_hold_us = 0;
+    context->type->release_lock(context);
+}
+#endif
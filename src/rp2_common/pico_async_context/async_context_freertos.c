@@ -110,6 +110,7 @@ bool async_context_freertos_init(async_context_freertos_t *self, async_context_f
     self->core.type = &template;
     self->core.flags = ASYNC_CONTEXT_FLAG_CALLBACK_FROM_NON_IRQ;
     self->core.core_num = get_core_num();
+    async_context_base_init(&self->core);
 #if configSUPPORT_STATIC_ALLOCATION
     assert(config->task_stack);
     self->lock_mutex = xSemaphoreCreateRecursiveMutexStatic(&self->lock_mutex_buf);
@@ -190,6 +191,7 @@ void async_context_freertos_deinit(async_context_t *self_base) {
     if (self->task_complete_sem) {
         vSemaphoreDelete(self->task_complete_sem);
     }
+    async_context_base_deinit(self_base);
     memset(self, 0, sizeof(*self));
 }
 
@@ -298,7 +300,7 @@ static bool async_context_freertos_remove_when_pending_worker(async_context_t *s
 }
 
 static void async_context_freertos_set_work_pending(async_context_t *self_base, async_when_pending_worker_t *worker) {
-    worker->work_pending = true;
+    async_context_base_mark_work_pending(self_base, worker);
     async_context_freertos_wake_up(self_base);
 }
 
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/async_context_multicore.h"
+#include "pico/async_context_base.h"
+#include "pico/sync.h"
+#include "hardware/irq.h"
+
+static const async_context_type_t template;
+// note user IRQs are claimed per core
+static async_context_multicore_t *async_contexts_by_user_irq[NUM_CORES][NUM_USER_IRQS];
+
+static void low_priority_irq_handler(void);
+static uint process_under_lock(async_context_multicore_t *self);
+static int64_t alarm_handler(alarm_id_t id, void *user_data);
+static int64_t force_alarm_handler(alarm_id_t id, void *user_data);
+
+#ifndef ASYNC_CONTEXT_MULTICORE_DEFAULT_LOW_PRIORITY_IRQ_HANDLER_PRIORITY
+#define ASYNC_CONTEXT_MULTICORE_DEFAULT_LOW_PRIORITY_IRQ_HANDLER_PRIORITY PICO_LOWEST_IRQ_PRIORITY
+#endif
+
+#ifndef ASYNC_CONTEXT_MULTICORE_ALARM_POOL_MAX_ALARMS
+#define ASYNC_CONTEXT_MULTICORE_ALARM_POOL_MAX_ALARMS 4
+#endif
+
+#define ALL_CORES_MASK ((1u << NUM_CORES) - 1)
+
+async_context_multicore_config_t async_context_multicore_default_config(void) {
+    async_context_multicore_config_t config = {
+            .low_priority_irq_handler_priority = ASYNC_CONTEXT_MULTICORE_DEFAULT_LOW_PRIORITY_IRQ_HANDLER_PRIORITY,
+            .custom_alarm_pool = NULL,
+    };
+    return config;
+}
+
+static inline uint recursive_mutex_enter_count(recursive_mutex_t *mutex) {
+    return mutex->enter_count;
+}
+
+static inline lock_owner_id_t recursive_mutex_owner(recursive_mutex_t *mutex) {
+    return mutex->owner;
+}
+
+// wake up the low priority IRQ on each core in core_mask which is servicing this async_context
+static void wake_cores(async_context_multicore_t *self, uint core_mask) {
+    uint this_core_num = get_core_num();
+    for (uint core_num = 0; core_num < NUM_CORES; core_num++) {
+        async_context_multicore_per_core_t *per_core = &self->per_core[core_num];
+        if (!(core_mask & (1u << core_num)) || !per_core->low_priority_irq_num) continue;
+        if (core_num == this_core_num) {
+            // on same core, can dispatch directly
+            irq_set_pending(per_core->low_priority_irq_num);
+        } else {
+            // remove the existing alarm (it may have already fired) so we don't overflow the pool with repeats
+            //
+            // note that force_alarm_id is not protected here, however if we miss removing one, they will fire
+            // almost immediately anyway (since they were set in the past)
+            alarm_id_t force_alarm_id = per_core->force_alarm_id;
+            if (force_alarm_id > 0) {
+                alarm_pool_cancel_alarm(per_core->alarm_pool, force_alarm_id);
+            }
+            // we cause an early timeout (0 is always in the past) on the other core's alarm_pool.
+            // note that by the time this returns, the timer may already have fired, so we
+            // may end up setting force_alarm_id to a stale timer id, but that is fine as we
+            // will harmlessly cancel it again next time
+            per_core->force_alarm_id = alarm_pool_add_alarm_at_force_in_context(per_core->alarm_pool, from_us_since_boot(0),
+                                                                                force_alarm_handler, self);
+        }
+    }
+    sem_release(&self->work_needed_sem);
+}
+
+// Prevent background processing in the low priority IRQ and access by the other core
+// These methods are called in IRQ context and on either core
+// They can be called recursively
+static inline void lock_acquire(async_context_multicore_t *self) {
+    recursive_mutex_enter_blocking(&self->lock_mutex);
+}
+
+static void async_context_multicore_lock_check(async_context_t *self_base) {
+    async_context_multicore_t *self = (async_context_multicore_t *)self_base;
+    if (recursive_mutex_enter_count(&self->lock_mutex) < 1 || recursive_mutex_owner(&self->lock_mutex) != lock_get_caller_owner_id()) {
+        panic_compact("async_context lock_check failed");
+    }
+}
+
+typedef struct sync_func_call{
+    async_when_pending_worker_t worker;
+    semaphore_t sem;
+    uint32_t (*func)(void *param);
+    void *param;
+    uint32_t rc;
+} sync_func_call_t;
+
+static void handle_sync_func_call(async_context_t *context, async_when_pending_worker_t *worker) {
+    sync_func_call_t *call = (sync_func_call_t *)worker;
+    call->rc = call->func(call->param);
+    async_context_remove_when_pending_worker(context, worker);
+    sem_release(&call->sem);
+}
+
+static void lock_release(async_context_multicore_t *self) {
+    bool outermost = 1 == recursive_mutex_enter_count(&self->lock_mutex);
+    uint wake_core_mask = 0;
+    if (outermost) {
+        // note that we always do a processing on outermost lock exit, to facilitate cases
+        // like lwIP where we have no notification when lwIP timers are added.
+        if (self->per_core[get_core_num()].low_priority_irq_num) {
+            wake_core_mask = process_under_lock(self);
+        } else if (async_context_base_needs_servicing(&self->core)) {
+            // this core is not servicing the async_context, so have to wake up the ones that are
+            wake_core_mask = ALL_CORES_MASK;
+        }
+    }
+    recursive_mutex_exit(&self->lock_mutex);
+    if (wake_core_mask) {
+        wake_cores(self, wake_core_mask);
+    }
+}
+
+uint32_t async_context_multicore_execute_sync(async_context_t *self_base, uint32_t (*func)(void *param), void *param) {
+    async_context_multicore_t *self = (async_context_multicore_t*)self_base;
+    if (self_base->core_num != get_core_num()) {
+        // This core must not hold the lock mutex, or this cross-core execute would deadlock. It is fine if the other core holds it.
+        assert(recursive_mutex_owner(&self->lock_mutex) != lock_get_caller_owner_id());
+        sync_func_call_t call = {0};
+        call.worker.do_work = handle_sync_func_call;
+        // call.worker.core_affinity is zero, so the call is made on the owning core
+        call.func = func;
+        call.param = param;
+        sem_init(&call.sem, 0, 1);
+        async_context_add_when_pending_worker(self_base, &call.worker);
+        async_context_set_work_pending(self_base, &call.worker);
+        sem_acquire_blocking(&call.sem);
+        return call.rc;
+    }
+    // short-circuit if we are on the right core
+    lock_acquire(self);
+    uint32_t rc = func(param);
+    lock_release(self);
+    return rc;
+}
+
+// claim the per core resources for servicing the async_context on the calling core
+static bool init_core(async_context_multicore_t *self, async_context_multicore_config_t *config) {
+    uint core_num = get_core_num();
+    async_context_multicore_per_core_t *per_core = &self->per_core[core_num];
+    assert(!per_core->low_priority_irq_num);
+    if (config->custom_alarm_pool) {
+        per_core->alarm_pool = config->custom_alarm_pool;
+    } else {
+#if PICO_TIME_DEFAULT_ALARM_POOL_DISABLED
+        per_core->alarm_pool = alarm_pool_create_with_unused_hardware_alarm(ASYNC_CONTEXT_MULTICORE_ALARM_POOL_MAX_ALARMS);
+        per_core->alarm_pool_owned = true;
+#else
+        per_core->alarm_pool = alarm_pool_get_default();
+        if (core_num != alarm_pool_core_num(per_core->alarm_pool)) {
+            per_core->alarm_pool = alarm_pool_create_with_unused_hardware_alarm(ASYNC_CONTEXT_MULTICORE_ALARM_POOL_MAX_ALARMS);
+            per_core->alarm_pool_owned = true;
+        }
+#endif
+    }
+    assert(core_num == alarm_pool_core_num(per_core->alarm_pool));
+    int irq = user_irq_claim_unused(false);
+    if (irq < 0) {
+        if (per_core->alarm_pool_owned) {
+            alarm_pool_destroy(per_core->alarm_pool);
+            per_core->alarm_pool_owned = false;
+        }
+        per_core->alarm_pool = NULL;
+        return false;
+    }
+    uint index = (uint)irq - FIRST_USER_IRQ;
+    assert(index < NUM_USER_IRQS);
+    async_contexts_by_user_irq[core_num][index] = self;
+    irq_set_exclusive_handler((uint)irq, low_priority_irq_handler);
+    irq_set_priority((uint)irq, config->low_priority_irq_handler_priority);
+    irq_set_enabled((uint)irq, true);
+    // set last, as this is what tells the other core that this core is servicing the async_context
+    per_core->low_priority_irq_num = (uint8_t)irq;
+    // there may be work pending for this core already
+    irq_set_pending((uint)irq);
+    return true;
+}
+
+static void deinit_core(async_context_multicore_t *self) {
+    uint core_num = get_core_num();
+    async_context_multicore_per_core_t *per_core = &self->per_core[core_num];
+    uint irq = per_core->low_priority_irq_num;
+    if (irq) {
+        // note another core may concurrently be waking this one; this is only safe because the alarm pool
+        // is not destroyed until after we have waited for any processing in progress to complete
+        per_core->low_priority_irq_num = 0;
+        irq_set_enabled(irq, false);
+        irq_remove_handler(irq, low_priority_irq_handler);
+        user_irq_unclaim(irq);
+        async_contexts_by_user_irq[core_num][irq - FIRST_USER_IRQ] = NULL;
+    }
+    // acquire the lock to make sure the callback is not running
+    recursive_mutex_enter_blocking(&self->lock_mutex);
+    recursive_mutex_exit(&self->lock_mutex);
+    if (per_core->force_alarm_id > 0) {
+        alarm_pool_cancel_alarm(per_core->alarm_pool, per_core->force_alarm_id);
+        per_core->force_alarm_id = 0;
+    }
+    if (per_core->alarm_pool_owned) {
+        alarm_pool_destroy(per_core->alarm_pool);
+        per_core->alarm_pool_owned = false;
+    }
+    per_core->alarm_pool = NULL;
+}
+
+static int64_t alarm_handler(__unused alarm_id_t id, void *user_data) {
+    async_context_multicore_t *self = (async_context_multicore_t*)user_data;
+    self->alarm_pending = false;
+    wake_cores(self, 1u << self->core.core_num);
+    return 0;
+}
+
+static int64_t force_alarm_handler(__unused alarm_id_t id, void *user_data) {
+    async_context_multicore_t *self = (async_context_multicore_t*)user_data;
+    async_context_multicore_per_core_t *per_core = &self->per_core[get_core_num()];
+    per_core->force_alarm_id = 0;
+    uint irq = per_core->low_priority_irq_num;
+    if (irq) {
+        irq_set_pending(irq);
+    }
+    return 0;
+}
+
+bool async_context_multicore_init(async_context_multicore_t *self, async_context_multicore_config_t *config) {
+    memset(self, 0, sizeof(*self));
+    self->core.type = &template;
+    self->core.flags = ASYNC_CONTEXT_FLAG_CALLBACK_FROM_IRQ | ASYNC_CONTEXT_FLAG_CALLBACK_FROM_NON_IRQ;
+    self->core.core_num = (uint8_t)get_core_num();
+    async_context_base_init(&self->core);
+    sem_init(&self->work_needed_sem, 1, 1);
+    recursive_mutex_init(&self->lock_mutex);
+    return init_core(self, config);
+}
+
+bool async_context_multicore_add_core(async_context_multicore_t *self, async_context_multicore_config_t *config) {
+    assert(get_core_num() != self->core.core_num);
+    return init_core(self, config);
+}
+
+void async_context_multicore_remove_core(async_context_multicore_t *self) {
+    assert(get_core_num() != self->core.core_num);
+    deinit_core(self);
+}
+
+static void async_context_multicore_set_work_pending(async_context_t *self_base, async_when_pending_worker_t *worker) {
+    async_context_base_mark_work_pending(self_base, worker);
+    uint core_mask = async_context_base_worker_core_mask(self_base, worker);
+    uint this_core_bit = 1u << get_core_num();
+    // if this core may run the worker, and we are not in an IRQ (i.e. this core is not busy), then the low priority
+    // IRQ will run the work right away, so there is no need to disturb the other core
+    if ((core_mask & this_core_bit) && !__get_current_exception()) {
+        core_mask = this_core_bit;
+    }
+    wake_cores((async_context_multicore_t *)self_base, core_mask);
+}
+
+static void async_context_multicore_deinit(async_context_t *self_base) {
+    async_context_multicore_t *self = (async_context_multicore_t *)self_base;
+    assert(get_core_num() == self_base->core_num);
+#ifndef NDEBUG
+    // all other cores must have been removed first
+    for (uint core_num = 0; core_num < NUM_CORES; core_num++) {
+        assert(core_num == self_base->core_num || !self->per_core[core_num].low_priority_irq_num);
+    }
+#endif
+    if (self->alarm_id > 0) alarm_pool_cancel_alarm(self->per_core[self_base->core_num].alarm_pool, self->alarm_id);
+    deinit_core(self);
+    async_context_base_deinit(self_base);
+    memset(self, 0, sizeof(*self));
+}
+
+// returns the mask of other cores which need waking to perform remaining work
+static uint process_under_lock(async_context_multicore_t *self) {
+    uint core_num = get_core_num();
+    uint core_bit = 1u << core_num;
+#ifndef NDEBUG
+    async_context_multicore_lock_check(&self->core);
+#endif
+    uint other_core_mask = 0;
+    do {
+        uint pending_core_mask;
+        absolute_time_t next_time = async_context_base_execute_once_on_core(&self->core, core_num, &pending_core_mask);
+        other_core_mask |= pending_core_mask & ~core_bit;
+        // if work for this core was deferred, then loop
+        if (pending_core_mask & core_bit) continue;
+        // only the owning core runs "at time" workers, so only it needs to manage the alarm
+        if (core_num != self->core.core_num) break;
+        // if the next wakeup time is in the past then loop
+        if (absolute_time_diff_us(get_absolute_time(), next_time) <= 0) continue;
+        alarm_pool_t *alarm_pool = self->per_core[core_num].alarm_pool;
+        // if there is no next wakeup time, we're done
+        if (is_at_the_end_of_time(next_time)) {
+            // cancel the alarm early (we will have been called soon after an alarm wakeup), so that
+            // we don't risk alarm_id collision.
+            if (self->alarm_id > 0) {
+                alarm_pool_cancel_alarm(alarm_pool, self->alarm_id);
+                self->alarm_id = 0;
+            }
+            break;
+        }
+        // see async_context_threadsafe_background for the rationale behind not always re-setting the alarm
+        if (self->alarm_pending && absolute_time_diff_us(self->last_set_alarm_time, next_time) > 0) break;
+        // cancel the existing alarm (it may no longer exist)
+        if (self->alarm_id > 0) alarm_pool_cancel_alarm(alarm_pool, self->alarm_id);
+        self->last_set_alarm_time = next_time;
+        self->alarm_pending = true;
+        self->alarm_id = alarm_pool_add_alarm_at(alarm_pool, next_time, alarm_handler, self, false);
+        if (self->alarm_id > 0) break;
+        self->alarm_pending = false;
+    } while (true);
+    return other_core_mask;
+}
+
+// Low priority interrupt handler to perform background processing (on either core)
+static void low_priority_irq_handler(void) {
+    uint index = __get_current_exception() - VTABLE_FIRST_IRQ - FIRST_USER_IRQ;
+    assert(index < NUM_USER_IRQS);
+    async_context_multicore_t *self = async_contexts_by_user_irq[get_core_num()][index];
+    if (!self) return;
+    uint wake_core_mask = 0;
+    if (recursive_mutex_try_enter(&self->lock_mutex, NULL)) {
+        // if the recurse count is not 1 then we have pre-empted something which held the lock on the same core,
+        // so we cannot do processing here (however processing will be done when that lock is released). Similarly,
+        // if the other core holds the lock, then processing will be done (or this core re-woken) when it is released
+        if (recursive_mutex_enter_count(&self->lock_mutex) == 1) {
+            wake_core_mask = process_under_lock(self);
+        }
+        recursive_mutex_exit(&self->lock_mutex);
+    }
+    if (wake_core_mask) {
+        wake_cores(self, wake_core_mask);
+    }
+}
+
+static void async_context_multicore_wait_until(__unused async_context_t *self_base, absolute_time_t until) {
+    // can be called in IRQs, in which case we just have to wait
+    if (__get_current_exception()) {
+        busy_wait_until(until);
+    } else {
+        sleep_until(until);
+    }
+}
+
+static void async_context_multicore_wait_for_work_until(async_context_t *self_base, absolute_time_t until) {
+    async_context_multicore_t *self = (async_context_multicore_t *)self_base;
+    sem_acquire_block_until(&self->work_needed_sem, until);
+}
+
+static bool async_context_multicore_add_at_time_worker(async_context_t *self_base, async_at_time_worker_t *worker) {
+    async_context_multicore_t *self = (async_context_multicore_t *)self_base;
+    lock_acquire(self);
+    bool rc = async_context_base_add_at_time_worker(self_base, worker);
+    lock_release(self);
+    return rc;
+}
+
+static bool async_context_multicore_remove_at_time_worker(async_context_t *self_base, async_at_time_worker_t *worker) {
+    async_context_multicore_t *self = (async_context_multicore_t *)self_base;
+    lock_acquire(self);
+    bool rc = async_context_base_remove_at_time_worker(self_base, worker);
+    lock_release(self);
+    return rc;
+}
+
+static bool async_context_multicore_add_when_pending_worker(async_context_t *self_base, async_when_pending_worker_t *worker) {
+    async_context_multicore_t *self = (async_context_multicore_t *)self_base;
+    lock_acquire(self);
+    bool rc = async_context_base_add_when_pending_worker(self_base, worker);
+    lock_release(self);
+    return rc;
+}
+
+static bool async_context_multicore_remove_when_pending_worker(async_context_t *self_base, async_when_pending_worker_t *worker) {
+    async_context_multicore_t *self = (async_context_multicore_t *)self_base;
+    lock_acquire(self);
+    bool rc = async_context_base_remove_when_pending_worker(self_base, worker);
+    lock_release(self);
+    return rc;
+}
+
+static void async_context_multicore_acquire_lock_blocking(async_context_t *self_base) {
+    lock_acquire((async_context_multicore_t *) self_base);
+}
+
+static void async_context_multicore_release_lock(async_context_t *self_base) {
+    lock_release((async_context_multicore_t *)self_base);
+}
+
+static const async_context_type_t template = {
+        .type = ASYNC_CONTEXT_MULTICORE,
+        .acquire_lock_blocking = async_context_multicore_acquire_lock_blocking,
+        .release_lock = async_context_multicore_release_lock,
+        .lock_check = async_context_multicore_lock_check,
+        .execute_sync = async_context_multicore_execute_sync,
+        .add_at_time_worker = async_context_multicore_add_at_time_worker,
+        .remove_at_time_worker = async_context_multicore_remove_at_time_worker,
+        .add_when_pending_worker = async_context_multicore_add_when_pending_worker,
+        .remove_when_pending_worker = async_context_multicore_remove_when_pending_worker,
+        .set_work_pending = async_context_multicore_set_work_pending,
+        .poll = 0,
+        .wait_until = async_context_multicore_wait_until,
+        .wait_for_work_until = async_context_multicore_wait_for_work_until,
+        .deinit = async_context_multicore_deinit,
+};
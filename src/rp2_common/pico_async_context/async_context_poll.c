@@ -13,9 +13,14 @@ static void noop(__unused async_context_t *context) { }
 
 static const async_context_type_t template;
 
+static void async_context_poll_deinit(async_context_t *self_base) {
+    async_context_base_deinit(self_base);
+}
+
 bool async_context_poll_init_with_defaults(async_context_poll_t *self) {
     memset(self, 0, sizeof(*self));
     self->core.core_num = get_core_num();
+    async_context_base_init(&self->core);
     self->core.type = &template;
     self->core.flags = ASYNC_CONTEXT_FLAG_POLLED | ASYNC_CONTEXT_FLAG_CALLBACK_FROM_NON_IRQ;
     sem_init(&self->sem, 1, 1);
@@ -27,7 +32,7 @@ static void async_context_poll_wake_up(async_context_t *self_base) {
 }
 
 static void async_context_poll_requires_update(async_context_t *self_base, async_when_pending_worker_t *worker) {
-    worker->work_pending = true;
+    async_context_base_mark_work_pending(self_base, worker);
     async_context_poll_wake_up(self_base);
 }
 
@@ -69,5 +74,5 @@ static const async_context_type_t template = {
         .poll = async_context_poll_poll,
         .wait_until = async_context_poll_wait_until,
         .wait_for_work_until = async_context_poll_wait_for_work_until,
-        .deinit = noop,
+        .deinit = async_context_poll_deinit,
 };
@@ -203,6 +203,7 @@ bool async_context_threadsafe_background_init(async_context_threadsafe_backgroun
     self->core.type = &template;
     self->core.flags = ASYNC_CONTEXT_FLAG_CALLBACK_FROM_IRQ | ASYNC_CONTEXT_FLAG_CALLBACK_FROM_NON_IRQ;
     self->core.core_num = get_core_num();
+    async_context_base_init(&self->core);
     if (config->custom_alarm_pool) {
         self->alarm_pool = config->custom_alarm_pool;
     } else {
@@ -227,7 +228,7 @@ bool async_context_threadsafe_background_init(async_context_threadsafe_backgroun
 }
 
 static void async_context_threadsafe_background_set_work_pending(async_context_t *self_base, async_when_pending_worker_t *worker) {
-    worker->work_pending = true;
+    async_context_base_mark_work_pending(self_base, worker);
     async_context_threadsafe_background_wake_up(self_base);
 }
 
@@ -245,6 +246,7 @@ static void async_context_threadsafe_background_deinit(async_context_t *self_bas
     // acquire the lock to make sure the callback is not running (we have already disabled the IRQ
     recursive_mutex_enter_blocking(&self->lock_mutex);
     recursive_mutex_exit(&self->lock_mutex);
+    async_context_base_deinit(self_base);
     memset(self, 0, sizeof(*self));
 }
 
@@ -18,7 +18,8 @@
  * <li>That there is a single logical thread of execution; i.e. that the context does not call any worker
  * functions concurrently.
  * <li>That the context always calls workers from the same processor core, as most uses of async_context rely on interaction
- * with IRQs which are themselves core-specific.
+ * with IRQs which are themselves core-specific. The exception is async_context_multicore, which may call a
+ * "when pending" worker from any core in the worker's core_affinity.
  * </ol>
  *
  * THe async_context provides two mechanisms for asynchronous work:
@@ -30,6 +31,12 @@
  *
  * Note: "when pending" workers with work pending are executed before "at time" workers.
  *
+ * "when pending" workers may be given a priority (see \ref async_when_pending_worker_t::priority); pending workers
+ * of a higher priority are always run before those of a lower priority. A time budget may also be set for each
+ * execution pass via \ref async_context_set_when_pending_budget_us; once it is exceeded, remaining pending workers
+ * below \ref ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGH are deferred to a later pass, after any newly pending higher
+ * priority work has been run.
+ *
  * The async_context provides locking mechanisms, see \ref async_context_acquire_lock_blocking,
  * \ref async_context_release_lock and \ref async_context_lock_check which can be used by
  * external code to ensure execution of external code does not happen concurrently with worker code.
@@ -48,13 +55,26 @@
  * not required, and is a no-op. This context implements async_context locking and is thus safe to call
  * from either core, according to the specific notes on each API.
  *
+ * async_context_multicore - like async_context_threadsafe_background, but "when pending" workers may be given a core
+ * affinity, and are then run from a low priority IRQ on whichever of the permitted cores is available. This allows
+ * work to be spread across both cores while retaining a single logical thread of execution.
+ *
+ * async_context_epoll - (host builds on Linux only) Work is performed from a separate thread, or from calls to
+ * \ref async_context_poll() by the initializing thread, which block in epoll_wait() until there is work to do.
+ *
  * async_context_freertos - Work is performed from a separate "async_context" task, however once again, code may
  * also be invoked after a direct use of the async_context on the same core that the async_context belongs to. Calling
  * \ref async_context_poll() is not required, and is a no-op. This context implements async_context locking and is thus
  * safe to call from any task, and from either core, according to the specific notes on each API.
  *
+ * If \ref PICO_ASYNC_CONTEXT_PROFILE is set to 1, the async_context additionally records, for each worker, the number of
+ * times it has run, its run times, and how long it waited to be run, along with how long the async_context lock is held
+ * by callers of \ref async_context_acquire_lock_blocking. See \ref async_context_get_when_pending_worker_profile,
+ * \ref async_context_get_at_time_worker_profile, \ref async_context_get_lock_profile and
+ * \ref async_context_visit_profiles.
+ *
  * Each async_context provides bespoke methods of instantiation which are provided in the corresponding headers (e.g.
- * async_context_poll.h, async_context_threadsafe_background.h, asycn_context_freertos.h).
+ * async_context_poll.h, async_context_threadsafe_background.h, async_context_multicore.h, asycn_context_freertos.h).
  * async_contexts are de-initialized by the common async_context_deint() method.
  *
  * Multiple async_context instances can be used by a single application, and they will operate independently.
@@ -65,19 +85,65 @@
 
 #include "pico.h"
 #include "pico/time.h"
+#include "hardware/sync.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// PICO_CONFIG: PICO_ASYNC_CONTEXT_PROFILE, Enable recording of async_context worker run times and lock hold times, type=bool, default=0, group=pico_async_context
+#ifndef PICO_ASYNC_CONTEXT_PROFILE
+#define PICO_ASYNC_CONTEXT_PROFILE 0
+#endif
+
 enum {
     ASYNC_CONTEXT_POLL = 1,
     ASYNC_CONTEXT_THREADSAFE_BACKGROUND = 2,
     ASYNC_CONTEXT_FREERTOS = 3,
+    ASYNC_CONTEXT_MULTICORE = 4,
+    ASYNC_CONTEXT_EPOLL = 5,
 };
 
 typedef struct async_context async_context_t;
 
+#if PICO_ASYNC_CONTEXT_PROFILE
+/*! \brief Execution statistics for a worker, recorded when \ref PICO_ASYNC_CONTEXT_PROFILE is 1
+ *  \ingroup pico_async_context
+ *
+ * For a "when pending" worker, the wait time is measured from when the worker was first marked pending (since it last
+ * ran) until it was run. Workers whose work_pending flag is set directly, rather than via
+ * \ref async_context_set_work_pending, do not have a wait time recorded. For an "at time" worker, the wait time is
+ * how late the worker was run relative to its next_time.
+ */
+typedef struct async_context_worker_profile {
+    uint32_t invocation_count;
+    uint32_t max_run_us;
+    uint64_t total_run_us;
+    uint32_t max_wait_us;
+    uint64_t total_wait_us;
+    // private; the time the worker was first marked pending
+    uint32_t pending_since;
+    // private; true if pending_since is valid
+    bool pending_since_valid;
+} async_context_worker_profile_t;
+
+/*! \brief async_context lock statistics, recorded when \ref PICO_ASYNC_CONTEXT_PROFILE is 1
+ *  \ingroup pico_async_context
+ *
+ * Only outermost acquisitions via \ref async_context_acquire_lock_blocking are recorded; the lock is also held while
+ * workers run, but that time is recorded in the worker profiles instead.
+ */
+typedef struct async_context_lock_profile {
+    uint32_t acquire_count;
+    uint32_t max_hold_us;
+    uint64_t total_hold_us;
+    // private; the time of the outermost acquisition
+    uint32_t acquired_at;
+    // private; the nesting depth of async_context_acquire_lock_blocking calls
+    uint16_t depth;
+} async_context_lock_profile_t;
+#endif
+
 /*! \brief A "timeout" instance used by an async_context
  *  \ingroup pico_async_context
  *
@@ -104,12 +170,23 @@ typedef struct async_work_on_timeout {
     /*!
      * \brief The next timeout time; this should only be modified during the above methods
      * or via async_context methods
+     *
+     * \note at_time workers are kept ordered by this time, so if it is changed while the worker is
+     * already added to an async_context, the worker must be added again for the new time to take effect
      */
     absolute_time_t next_time;
     /*!
      * \brief User data associated with the timeout instance
      */
     void *user_data;
+#if PICO_ASYNC_CONTEXT_PROFILE
+    /*!
+     * \brief Execution statistics for the worker; the worker should be zero-initialized before first use
+     *
+     * \see async_context_get_at_time_worker_profile
+     */
+    async_context_worker_profile_t profile;
+#endif
 } async_at_time_worker_t;
 
 /*! \brief A "worker" instance used by an async_context
@@ -136,14 +213,67 @@ typedef struct async_when_pending_worker {
     void (*do_work)(async_context_t *context, struct async_when_pending_worker *worker);
     /**
      * \brief True if the worker need do_work called
+     *
+     * \note this should be set via \ref async_context_set_work_pending (or by the worker itself from within do_work,
+     * or before the worker is added), which also queues the worker to be run; setting it directly at other times does
+     * not cause the worker to be run
      */
     bool work_pending;
+    /**
+     * \brief The priority of the worker (one of the ASYNC_WHEN_PENDING_WORKER_PRIORITY_ values); this should not be
+     * modified while the worker is added to an async_context.
+     *
+     * Defaults to \ref ASYNC_WHEN_PENDING_WORKER_PRIORITY_NORMAL for a zero-initialized worker
+     */
+    int8_t priority;
+    /**
+     * \brief The set of cores the worker may be run on (bit n set for core n), for async_context types which support
+     * running work on more than one core (see \ref async_context_multicore). Other async_context types ignore this value.
+     *
+     * Defaults to just the core of the async_context for a zero-initialized worker
+     */
+    uint8_t core_affinity;
     /*!
      * \brief User data associated with the worker instance
      */
     void *user_data;
+    /*!
+     * \brief private link list pointer for the async_context's queue of workers with work pending
+     */
+    struct async_when_pending_worker *pending_next;
+    /*!
+     * \brief private; true if the worker is queued to be run by the async_context
+     */
+    bool pending_queued;
+#if PICO_ASYNC_CONTEXT_PROFILE
+    /*!
+     * \brief Execution statistics for the worker; the worker should be zero-initialized before first use
+     *
+     * \see async_context_get_when_pending_worker_profile
+     */
+    async_context_worker_profile_t profile;
+#endif
 } async_when_pending_worker_t;
 
+/*! \brief Priority for a "when pending" worker which may be deferred in favor of all other work
+ *  \ingroup pico_async_context
+ */
+#define ASYNC_WHEN_PENDING_WORKER_PRIORITY_LOW (-1)
+/*! \brief Default priority for a "when pending" worker
+ *  \ingroup pico_async_context
+ */
+#define ASYNC_WHEN_PENDING_WORKER_PRIORITY_NORMAL 0
+/*! \brief Priority for a latency-sensitive "when pending" worker; workers of this priority or higher are never deferred
+ *  \ingroup pico_async_context
+ */
+#define ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGH 1
+/*! \brief Highest priority for a "when pending" worker
+ *  \ingroup pico_async_context
+ */
+#define ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGHEST 2
+
+#define ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS 4
+
 #define ASYNC_CONTEXT_FLAG_CALLBACK_FROM_NON_IRQ 0x1
 #define ASYNC_CONTEXT_FLAG_CALLBACK_FROM_IRQ 0x2
 #define ASYNC_CONTEXT_FLAG_POLLED 0x4
@@ -178,9 +308,31 @@ typedef struct async_context_type {
  */
 struct async_context {
     const async_context_type_t *type;
-    async_when_pending_worker_t *when_pending_list;
+    // one list per priority level, indexed by (priority - ASYNC_WHEN_PENDING_WORKER_PRIORITY_LOW)
+    async_when_pending_worker_t *when_pending_lists[ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS];
+    // one queue per priority level of the workers marked as having work pending, in the order they were marked,
+    // so that a pass only visits those workers. the queues (and the pending_next and pending_queued fields of the
+    // workers on them) are protected by when_pending_spin_lock, as workers may be marked pending from IRQs or the
+    // other core
+    async_when_pending_worker_t *when_pending_queue_heads[ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS];
+    // claimed for this async_context alone by async_context_base_init
+    spin_lock_t *when_pending_spin_lock;
+    async_when_pending_worker_t *when_pending_queue_tails[ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS];
+    // set for each priority level whose queue is non empty; the flags are separate bytes, but can be tested
+    // together as a single bitmap without taking the spin lock
+    union {
+        volatile uint8_t when_pending_level_flags[ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS];
+        volatile uint32_t when_pending_levels;
+    };
+    // the workers taken from a level's queue by the current pass that are yet to be run, and the worker being run
+    async_when_pending_worker_t *when_pending_taken;
+    async_when_pending_worker_t *when_pending_current;
+    uint32_t when_pending_budget_us;
     async_at_time_worker_t *at_time_list;
     absolute_time_t next_time;
+#if PICO_ASYNC_CONTEXT_PROFILE
+    async_context_lock_profile_t lock_profile;
+#endif
     uint16_t flags;
     uint8_t  core_num;
 };
@@ -205,6 +357,11 @@ struct async_context {
  */
 static inline void async_context_acquire_lock_blocking(async_context_t *context) {
     context->type->acquire_lock_blocking(context);
+#if PICO_ASYNC_CONTEXT_PROFILE
+    if (!context->lock_profile.depth++) {
+        context->lock_profile.acquired_at = time_us_32();
+    }
+#endif
 }
 
 /*!
@@ -223,6 +380,14 @@ static inline void async_context_acquire_lock_blocking(async_context_t *context)
  * \see async_context_acquire_lock_blocking
  */
 static inline void async_context_release_lock(async_context_t *context) {
+#if PICO_ASYNC_CONTEXT_PROFILE
+    if (context->lock_profile.depth && !--context->lock_profile.depth) {
+        uint32_t hold_us = time_us_32() - context->lock_profile.acquired_at;
+        context->lock_profile.acquire_count++;
+        context->lock_profile.total_hold_us += hold_us;
+        if (hold_us > context->lock_profile.max_hold_us) context->lock_profile.max_hold_us = hold_us;
+    }
+#endif
     context->type->release_lock(context);
 }
 
@@ -269,7 +434,8 @@ static inline uint32_t async_context_execute_sync(async_context_t *context, uint
  *
  * \param context the async_context
  * \param worker the "at time" worker to add
- * \return true if the worker was added, false if the worker was already present.
+ * \return true if the worker was added, false if the worker was already present (in which case it is
+ * re-positioned according to its current next_time)
  */
 static inline bool async_context_add_at_time_worker(async_context_t *context, async_at_time_worker_t *worker) {
     return context->type->add_at_time_worker(context, worker);
@@ -382,6 +548,24 @@ static inline void async_context_set_work_pending(async_context_t *context, asyn
     context->type->set_work_pending(context, worker);
 }
 
+/*!
+ * \brief Set the time budget for running "when pending" workers in a single pass of the async_context
+ * \ingroup pico_async_context
+ *
+ * Once a pass has run for longer than the budget, any remaining pending workers with a priority below
+ * \ref ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGH are deferred until a subsequent pass, so that newly pending higher
+ * priority workers (and due "at time" workers) are run first. Deferred workers are not skipped; the async_context
+ * will run another pass as soon as possible.
+ *
+ * \note this method should be called while holding the async_context lock, or before any workers are added
+ *
+ * \param context the async_context
+ * \param budget_us the time budget in microseconds, or 0 for no limit (the default)
+ */
+static inline void async_context_set_when_pending_budget_us(async_context_t *context, uint32_t budget_us) {
+    context->when_pending_budget_us = budget_us;
+}
+
 /*!
  * \brief Perform any pending work for polling style async_context
  * \ingroup pico_async_context
@@ -448,6 +632,81 @@ static inline uint async_context_core_num(const async_context_t *context) {
     return context->core_num;
 }
 
+#if PICO_ASYNC_CONTEXT_PROFILE
+/*!
+ * \brief Get a copy of the execution statistics for a "when pending" worker
+ * \ingroup pico_async_context
+ *
+ * \note for async_contexts that provide locking (not async_context_poll), this method is threadsafe. and may be called from within any
+ * worker method called by the async_context or from any other non-IRQ context.
+ *
+ * \param context the async_context
+ * \param worker the "when pending" worker
+ * \param profile the structure to fill in
+ */
+void async_context_get_when_pending_worker_profile(async_context_t *context, const async_when_pending_worker_t *worker, async_context_worker_profile_t *profile);
+
+/*!
+ * \brief Get a copy of the execution statistics for an "at time" worker
+ * \ingroup pico_async_context
+ *
+ * \note for async_contexts that provide locking (not async_context_poll), this method is threadsafe. and may be called from within any
+ * worker method called by the async_context or from any other non-IRQ context.
+ *
+ * \param context the async_context
+ * \param worker the "at time" worker
+ * \param profile the structure to fill in
+ */
+void async_context_get_at_time_worker_profile(async_context_t *context, const async_at_time_worker_t *worker, async_context_worker_profile_t *profile);
+
+/*!
+ * \brief Get a copy of the async_context lock statistics
+ * \ingroup pico_async_context
+ *
+ * \note for async_contexts that provide locking (not async_context_poll), this method is threadsafe. and may be called from within any
+ * worker method called by the async_context or from any other non-IRQ context.
+ *
+ * \param context the async_context
+ * \param profile the structure to fill in
+ */
+void async_context_get_lock_profile(async_context_t *context, async_context_lock_profile_t *profile);
+
+/*!
+ * \brief Callback for \ref async_context_visit_profiles; exactly one of when_pending_worker and at_time_worker is non NULL
+ * \ingroup pico_async_context
+ */
+typedef void (*async_context_profile_visitor_t)(async_context_t *context, async_when_pending_worker_t *when_pending_worker,
+                                                async_at_time_worker_t *at_time_worker,
+                                                const async_context_worker_profile_t *profile, void *param);
+
+/*!
+ * \brief Call a function with the execution statistics of every worker currently added to the async_context
+ * \ingroup pico_async_context
+ *
+ * This is useful for finding which worker is responsible for delaying others, without needing to know about
+ * the workers added by libraries. The visitor is called with the async_context lock held.
+ *
+ * \note for async_contexts that provide locking (not async_context_poll), this method is threadsafe. and may be called from within any
+ * worker method called by the async_context or from any other non-IRQ context.
+ *
+ * \param context the async_context
+ * \param visitor the function to call for each worker
+ * \param param the parameter to pass to the visitor
+ */
+void async_context_visit_profiles(async_context_t *context, async_context_profile_visitor_t visitor, void *param);
+
+/*!
+ * \brief Reset the execution statistics of the async_context lock, and of every worker currently added to the async_context
+ * \ingroup pico_async_context
+ *
+ * \note for async_contexts that provide locking (not async_context_poll), this method is threadsafe. and may be called from within any
+ * worker method called by the async_context or from any other non-IRQ context.
+ *
+ * \param context the async_context
+ */
+void async_context_reset_profiles(async_context_t *context);
+#endif
+
 /*!
  * \brief End async_context processing, and free any resources
  * \ingroup pico_async_context
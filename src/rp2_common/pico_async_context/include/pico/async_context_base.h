@@ -14,16 +14,39 @@ extern "C" {
 #endif
 
 // common functions for async_context implementations to use
+
+// claims the async_context's own spin lock; to be called by the implementation's init once the async_context is zeroed
+void async_context_base_init(async_context_t *self);
+// releases what async_context_base_init claimed; safe to call on a zeroed async_context
+void async_context_base_deinit(async_context_t *self);
+
 bool async_context_base_add_at_time_worker(async_context_t *self, async_at_time_worker_t *worker);
 bool async_context_base_remove_at_time_worker(async_context_t *self, async_at_time_worker_t *worker);
 
 bool async_context_base_add_when_pending_worker(async_context_t *self, async_when_pending_worker_t *worker);
 bool async_context_base_remove_when_pending_worker(async_context_t *self, async_when_pending_worker_t *worker);
 
+static inline uint async_context_base_when_pending_level(const async_when_pending_worker_t *worker) {
+    // masked, so that an out of range priority can never index outside the per level arrays
+    return (uint)(worker->priority - ASYNC_WHEN_PENDING_WORKER_PRIORITY_LOW) & (ASYNC_WHEN_PENDING_WORKER_PRIORITY_LEVELS - 1);
+}
+
+static inline uint async_context_base_worker_core_mask(const async_context_t *self, const async_when_pending_worker_t *worker) {
+    return worker->core_affinity ? worker->core_affinity : 1u << self->core_num;
+}
+
+// mark the worker as having work pending, queueing it to be run if it is not already queued; may be called from any
+// context including IRQs
+void async_context_base_mark_work_pending(async_context_t *self, async_when_pending_worker_t *worker);
+
 async_at_time_worker_t *async_context_base_remove_ready_at_time_worker(async_context_t *self);
 void async_context_base_refresh_next_timeout(async_context_t *self);
 
 absolute_time_t async_context_base_execute_once(async_context_t *self);
+// like async_context_base_execute_once, but only runs "at time" workers if core_num is the core of the async_context,
+// and only runs "when pending" workers whose core affinity includes core_num. the cores which are required to run
+// any remaining work are returned in pending_core_mask
+absolute_time_t async_context_base_execute_once_on_core(async_context_t *self, uint core_num, uint *pending_core_mask);
 bool async_context_base_needs_servicing(async_context_t *self);
 
 #ifdef __cplusplus
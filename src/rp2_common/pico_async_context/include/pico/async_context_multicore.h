@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_ASYNC_CONTEXT_MULTICORE_H
+#define _PICO_ASYNC_CONTEXT_MULTICORE_H
+
+/** \file pico/async_context_multicore.h
+ *  \defgroup async_context_multicore async_context_multicore
+ *  \ingroup pico_async_context
+ *
+ * \brief async_context_multicore provides an implementation of \ref async_context that, like
+ * \ref async_context_threadsafe_background, handles asynchronous work in a low priority IRQ, but which can
+ * service "when pending" workers from either core.
+ *
+ * The async_context is initialized on one core (its "owning" core, see \ref async_context_core_num) by
+ * \ref async_context_multicore_init. The other core may then join in servicing work by calling
+ * \ref async_context_multicore_add_core from that core.
+ *
+ * Each "when pending" worker may specify a \ref async_when_pending_worker_t::core_affinity mask of the cores it may
+ * be run on; a worker with a zero core_affinity is only run on the owning core. When work is marked pending, each
+ * serviced core in the worker's affinity is woken, and the first to acquire the async_context lock runs the work.
+ * "At time" workers are always run on the owning core.
+ *
+ * Work is still performed under the single async_context lock, so workers are never called concurrently; i.e. the
+ * async_context remains a single logical thread of execution, however a worker with more than one core in its
+ * affinity must not rely on being called from a specific core.
+ *
+ * \note The workers used with this async_context MUST be safe to call from an IRQ.
+ */
+
+#include "pico/async_context.h"
+#include "pico/sem.h"
+#include "pico/mutex.h"
+#include "hardware/irq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct async_context_multicore async_context_multicore_t;
+
+/**
+ * \brief Configuration object for async_context_multicore instances, and for each additional core added via
+ * \ref async_context_multicore_add_core
+ */
+typedef struct async_context_multicore_config {
+    /**
+     * \brief the priority of the low priority IRQ on the core being initialized
+     */
+    uint8_t low_priority_irq_handler_priority;
+    /**
+     * \brief a specific alarm pool to use on the core being initialized (or NULL to use a default)
+     *
+     * \note this alarm pool MUST be on the core being initialized
+     *
+     * The default alarm pool used is the "default alarm pool" (see
+     * \ref alarm_pool_get_default()) if available, and if that is on the same
+     * core, otherwise a private alarm_pool instance created during
+     * initialization.
+     */
+    alarm_pool_t *custom_alarm_pool;
+} async_context_multicore_config_t;
+
+typedef struct async_context_multicore_per_core {
+    alarm_pool_t *alarm_pool; // this must be on the corresponding core
+    volatile alarm_id_t force_alarm_id;
+    uint8_t low_priority_irq_num; // non zero if the core is being serviced
+    bool alarm_pool_owned;
+} async_context_multicore_per_core_t;
+
+struct async_context_multicore {
+    async_context_t core;
+    async_context_multicore_per_core_t per_core[NUM_CORES];
+    absolute_time_t last_set_alarm_time;
+    recursive_mutex_t lock_mutex;
+    semaphore_t work_needed_sem;
+    volatile alarm_id_t alarm_id;
+    volatile bool alarm_pending;
+};
+
+/*!
+ * \brief Initialize an async_context_multicore instance on the calling core using the specified configuration
+ * \ingroup async_context_multicore
+ *
+ * If this method succeeds (returns true), then the async_context is available for use
+ * and can be de-initialized by calling async_context_deinit().
+ *
+ * \param self a pointer to async_context_multicore structure to initialize
+ * \param config the configuration object specifying characteristics for the async_context on this core
+ * \return true if initialization is successful, false otherwise
+ */
+bool async_context_multicore_init(async_context_multicore_t *self, async_context_multicore_config_t *config);
+
+/*!
+ * \brief Have the calling core also service "when pending" workers for an async_context_multicore
+ * \ingroup async_context_multicore
+ *
+ * This method must be called from a core other than the owning core of the async_context
+ *
+ * \param self the async_context_multicore previously initialized via \ref async_context_multicore_init
+ * \param config the configuration object specifying characteristics for the async_context on this core
+ * \return true if the calling core was added, false otherwise
+ */
+bool async_context_multicore_add_core(async_context_multicore_t *self, async_context_multicore_config_t *config);
+
+/*!
+ * \brief Stop the calling core servicing workers for an async_context_multicore
+ * \ingroup async_context_multicore
+ *
+ * This method must be called from a core previously added via \ref async_context_multicore_add_core, and must be called
+ * for every such core before calling async_context_deinit()
+ *
+ * \param self the async_context_multicore
+ */
+void async_context_multicore_remove_core(async_context_multicore_t *self);
+
+/*!
+ * \brief Return a copy of the default configuration object used by \ref async_context_multicore_init_with_defaults()
+ * \ingroup async_context_multicore
+ *
+ * The caller can then modify just the settings it cares about, and call \ref async_context_multicore_init()
+ * \return the default configuration object
+ */
+async_context_multicore_config_t async_context_multicore_default_config(void);
+
+/*!
+ * \brief Initialize an async_context_multicore instance on the calling core with default values
+ * \ingroup async_context_multicore
+ *
+ * If this method succeeds (returns true), then the async_context is available for use
+ * and can be de-initialized by calling async_context_deinit().
+ *
+ * \param self a pointer to async_context_multicore structure to initialize
+ * \return true if initialization is successful, false otherwise
+ */
+static inline bool async_context_multicore_init_with_defaults(async_context_multicore_t *self) {
+    async_context_multicore_config_t config = async_context_multicore_default_config();
+    return async_context_multicore_init(self, &config);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/binary_log.h"
+#include "pico/async_context.h"
+#include "pico/mutex.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+static_assert(!(PICO_BINARY_LOG_RING_WORDS & (PICO_BINARY_LOG_RING_WORDS - 1)), "PICO_BINARY_LOG_RING_WORDS must be a power of 2");
+static_assert(PICO_BINARY_LOG_MAX_STRING_LEN <= 64, "");
+
+// a record is: format id, info (with the record length in words in the top 8 bits), timestamp, arguments
+#define RECORD_HEADER_WORDS 3
+#define RECORD_MAX_WORDS (RECORD_HEADER_WORDS + PICO_BINARY_LOG_MAX_ARGS * (1 + (PICO_BINARY_LOG_MAX_STRING_LEN + 3) / 4))
+#define RECORD_LENGTH_LSB 24
+
+static_assert(RECORD_MAX_WORDS < PICO_BINARY_LOG_RING_WORDS, "");
+
+// on the wire: 0, COBS encoded core number and record, 0
+#define FRAME_MAX_BYTES (2 + 1 + (1 + RECORD_MAX_WORDS * 4) + (1 + RECORD_MAX_WORDS * 4) / 254 + 1)
+
+// each core's ring has a single producer (that core, with interrupts disabled), and a single consumer (the drain)
+typedef struct {
+    volatile uint32_t head; // written by the producer
+    volatile uint32_t tail; // written by the consumer
+    volatile uint32_t dropped; // written by the producer
+    uint32_t dropped_reported; // written by the consumer
+    uint32_t words[PICO_BINARY_LOG_RING_WORDS];
+} binary_log_ring_t;
+
+static binary_log_ring_t rings[NUM_CORES];
+
+// the format strings' IDs are their offsets in their section
+extern const char __start_pico_binary_log_formats[] __attribute__((weak));
+
+// pico_binary_log_drain may be called at any time, so this is initialized automatically
+auto_init_mutex(drain_mutex);
+#if !PICO_ON_DEVICE
+// there is no runtime initialization of auto_init_mutex mutexes on the host
+static void __attribute__((constructor)) drain_mutex_init(void) {
+    mutex_init(&drain_mutex);
+}
+#endif
+static void (*output_func)(const char *buf, int len);
+static async_context_t *drain_context;
+
+static void drain_worker_func(async_context_t *context, async_when_pending_worker_t *worker);
+
+static async_when_pending_worker_t drain_worker = {
+        .do_work = drain_worker_func
+};
+
+static inline void ring_put(binary_log_ring_t *ring, uint32_t pos, uint32_t word) {
+    ring->words[pos & (PICO_BINARY_LOG_RING_WORDS - 1)] = word;
+}
+
+static uint string_length(const char *s) {
+    uint len = 0;
+    if (s) {
+        while (len < PICO_BINARY_LOG_MAX_STRING_LEN && s[len]) len++;
+    }
+    return len;
+}
+
+void __not_in_flash_func(__pico_binary_log_write)(const char *fmt, uint32_t info, const uint64_t *args) {
+    args++; // skip the dummy entry
+    uint nargs = (info >> 16) & 0xfu;
+    uint32_t wide_mask = info & 0xffu;
+    uint32_t string_mask = (info >> 8) & 0xffu;
+    uint32_t length = RECORD_HEADER_WORDS;
+    for (uint i = 0; i < nargs; i++) {
+        if (string_mask & (1u << i)) {
+            length += 1 + (string_length((const char *)(uintptr_t)args[i]) + 3) / 4;
+        } else {
+            length += (wide_mask & (1u << i)) ? 2 : 1;
+        }
+    }
+    uint32_t save = save_and_disable_interrupts();
+    binary_log_ring_t *ring = &rings[get_core_num()];
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    __mem_fence_acquire();
+    if (PICO_BINARY_LOG_RING_WORDS - (head - tail) < length) {
+        ring->dropped++;
+        restore_interrupts(save);
+        return;
+    }
+    uint32_t pos = head;
+    ring_put(ring, pos++, (uint32_t)((uintptr_t)fmt - (uintptr_t)__start_pico_binary_log_formats));
+    ring_put(ring, pos++, (info & 0xfffffu) | (length << RECORD_LENGTH_LSB));
+    ring_put(ring, pos++, time_us_32());
+    for (uint i = 0; i < nargs; i++) {
+        if (string_mask & (1u << i)) {
+            const char *s = (const char *)(uintptr_t)args[i];
+            uint len = string_length(s);
+            ring_put(ring, pos++, len);
+            for (uint j = 0; j < len; j += 4) {
+                uint32_t word = 0;
+                memcpy(&word, s + j, MIN(4, len - j));
+                ring_put(ring, pos++, word);
+            }
+        } else {
+            ring_put(ring, pos++, (uint32_t)args[i]);
+            if (wide_mask & (1u << i)) ring_put(ring, pos++, (uint32_t)(args[i] >> 32));
+        }
+    }
+    __mem_fence_release();
+    ring->head = pos;
+    restore_interrupts(save);
+    // only need to wake the drain if the ring was previously empty
+    async_context_t *context = drain_context;
+    if (context && head == tail) {
+        async_context_set_work_pending(context, &drain_worker);
+    }
+}
+
+// COBS encode data into out (which must have room for len + len / 254 + 1 bytes), returning the encoded length
+static uint cobs_encode(const uint8_t *data, uint len, uint8_t *out) {
+    uint code_pos = 0;
+    uint out_pos = 1;
+    uint8_t code = 1;
+    for (uint i = 0; i < len; i++) {
+        if (data[i]) {
+            out[out_pos++] = data[i];
+            code++;
+        }
+        if (!data[i] || code == 0xff) {
+            out[code_pos] = code;
+            code = 1;
+            code_pos = out_pos++;
+        }
+    }
+    out[code_pos] = code;
+    return out_pos;
+}
+
+static void send_record(uint core, const uint32_t *words, uint count) {
+    static uint8_t record[1 + RECORD_MAX_WORDS * 4];
+    static uint8_t frame[FRAME_MAX_BYTES];
+    record[0] = (uint8_t)core;
+    for (uint i = 0; i < count; i++) {
+        record[1 + i * 4] = (uint8_t)words[i];
+        record[2 + i * 4] = (uint8_t)(words[i] >> 8);
+        record[3 + i * 4] = (uint8_t)(words[i] >> 16);
+        record[4 + i * 4] = (uint8_t)(words[i] >> 24);
+    }
+    frame[0] = 0;
+    uint len = 1 + cobs_encode(record, 1 + count * 4, frame + 1);
+    frame[len++] = 0;
+    if (output_func) {
+        output_func((const char *)frame, (int)len);
+    } else {
+        stdio_put_string((const char *)frame, (int)len, false, false);
+    }
+}
+
+uint pico_binary_log_drain(void) {
+    if (!mutex_try_enter(&drain_mutex, NULL)) return 0;
+    uint count = 0;
+    uint32_t words[RECORD_MAX_WORDS];
+    for (uint core = 0; core < NUM_CORES; core++) {
+        binary_log_ring_t *ring = &rings[core];
+        uint32_t dropped = ring->dropped;
+        if (dropped != ring->dropped_reported) {
+            words[0] = PICO_BINARY_LOG_DROPPED_ID;
+            words[1] = (1u << 16) | ((RECORD_HEADER_WORDS + 1) << RECORD_LENGTH_LSB);
+            words[2] = time_us_32();
+            words[3] = dropped - ring->dropped_reported;
+            ring->dropped_reported = dropped;
+            send_record(core, words, RECORD_HEADER_WORDS + 1);
+            count++;
+        }
+        uint32_t tail = ring->tail;
+        while (tail != ring->head) {
+            __mem_fence_acquire();
+            uint length = ring->words[(tail + 1) & (PICO_BINARY_LOG_RING_WORDS - 1)] >> RECORD_LENGTH_LSB;
+            assert(length >= RECORD_HEADER_WORDS && length <= RECORD_MAX_WORDS);
+            for (uint i = 0; i < length; i++) {
+                words[i] = ring->words[(tail + i) & (PICO_BINARY_LOG_RING_WORDS - 1)];
+            }
+            tail += length;
+            // free the space before sending, as that may be slow
+            __mem_fence_release();
+            ring->tail = tail;
+            send_record(core, words, length);
+            count++;
+        }
+    }
+    mutex_exit(&drain_mutex);
+    return count;
+}
+
+static void drain_worker_func(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    pico_binary_log_drain();
+}
+
+void pico_binary_log_init(void) {
+}
+
+void pico_binary_log_set_output(void (*out_chars)(const char *buf, int len)) {
+    output_func = out_chars;
+}
+
+void pico_binary_log_set_async_context(async_context_t *context) {
+    if (drain_context) {
+        async_context_remove_when_pending_worker(drain_context, &drain_worker);
+    }
+    drain_context = context;
+    if (context) {
+        async_context_add_when_pending_worker(context, &drain_worker);
+        // there may already be records waiting
+        async_context_set_work_pending(context, &drain_worker);
+    }
+}
+
+uint32_t pico_binary_log_get_dropped_count(void) {
+    uint32_t count = 0;
+    for (uint core = 0; core < NUM_CORES; core++) {
+        count += rings[core].dropped;
+    }
+    return count;
+}
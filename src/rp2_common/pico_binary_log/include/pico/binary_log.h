@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_BINARY_LOG_H
+#define _PICO_BINARY_LOG_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file pico/binary_log.h
+ * \defgroup pico_binary_log pico_binary_log
+ *
+ * \brief Deferred binary logging, with the text formatting done on the host
+ *
+ * Formatting log messages with printf is expensive, particularly from IRQ handlers. \ref pico_binary_log
+ * instead records just a format string ID and the raw argument values:
+ *
+ * ```c
+ * pico_binary_log("adc channel %d read %u after %f ms", channel, value, elapsed_ms);
+ * ```
+ *
+ * Each call site places its format string in a dedicated linker section (\c pico_binary_log_formats), which on
+ * device takes no space in the binary, as it is only read from the ELF file; the offset of the string in
+ * that section is its ID. A record (the ID, a timestamp and the arguments) is written to a lock-free ring
+ * buffer belonging to the calling core, so logging costs only a handful of stores.
+ *
+ * The rings are emptied by \ref pico_binary_log_drain, which may be called periodically, or from the background
+ * by an async_context (see \ref pico_binary_log_set_async_context). Records are sent by default via all stdio drivers
+ * (without CR/LF translation), though they may be directed elsewhere, e.g. to a single stdio driver, via
+ * \ref pico_binary_log_set_output.
+ *
+ * Each record is sent as a frame starting and ending with a zero byte, between which is the COBS encoding
+ * of the core number byte followed by the record's little-endian 32-bit words. Regular text output can thus be
+ * interleaved on the same stdio driver. The host tool \c tools/binary_log_decode.py reconstructs the text of the
+ * log messages using the format strings from the ELF file.
+ *
+ * Arguments may be of any integer, floating point or pointer type; up to 8 arguments are supported. \c char
+ * pointer arguments are treated as strings, and up to PICO_BINARY_LOG_MAX_STRING_LEN characters of them are copied
+ * into the record. The format string must be a string literal. If a ring is full, records are dropped,
+ * and the number of dropped records is reported by the host tool.
+ *
+ * \note pico_binary_log() is only available from C, as it uses _Generic to encode its arguments.
+ */
+
+// PICO_CONFIG: PICO_BINARY_LOG_RING_WORDS, Size of each core's binary log ring buffer in 32-bit words; must be a power of 2, type=int, default=512, group=pico_binary_log
+#ifndef PICO_BINARY_LOG_RING_WORDS
+#define PICO_BINARY_LOG_RING_WORDS 512
+#endif
+
+// PICO_CONFIG: PICO_BINARY_LOG_MAX_STRING_LEN, Maximum number of characters of a string argument copied into a binary log record, type=int, min=0, max=64, default=32, group=pico_binary_log
+#ifndef PICO_BINARY_LOG_MAX_STRING_LEN
+#define PICO_BINARY_LOG_MAX_STRING_LEN 32
+#endif
+
+#define PICO_BINARY_LOG_MAX_ARGS 8
+
+#define PICO_BINARY_LOG_FORMAT_SECTION "pico_binary_log_formats"
+
+/*! \brief The ID of the record sent in place of records that were dropped because a ring was full; its single
+ *  argument is the number of records dropped
+ *  \ingroup pico_binary_log
+ */
+#define PICO_BINARY_LOG_DROPPED_ID 0xffffffffu
+
+/*! \brief Initialize the binary log
+ *  \ingroup pico_binary_log
+ *
+ * The binary log needs no initialization, so this does nothing; records may be logged and drained at any time.
+ */
+void pico_binary_log_init(void);
+
+/*! \brief Send the records currently held in the ring buffers
+ *  \ingroup pico_binary_log
+ *
+ * This may be called from any core, and does nothing if a drain is already in progress.
+ *
+ * \return the number of records sent
+ */
+uint pico_binary_log_drain(void);
+
+/*! \brief Set the function used to send the encoded records
+ *  \ingroup pico_binary_log
+ *
+ * By default records are sent via all stdio drivers (without CR/LF translation); to use a single stdio driver,
+ * its \c out_chars function may be passed, e.g. \c pico_binary_log_set_output(stdio_uart.out_chars).
+ *
+ * \param out_chars the output function, or NULL to restore the default
+ */
+void pico_binary_log_set_output(void (*out_chars)(const char *buf, int len));
+
+typedef struct async_context async_context_t;
+
+/*! \brief Drain the binary log from the background, using an async_context
+ *  \ingroup pico_binary_log
+ *
+ * A "when pending" worker is added to the context, which is marked pending whenever a record is logged
+ * to an empty ring.
+ *
+ * \param context the async_context, or NULL to stop draining from the background
+ */
+void pico_binary_log_set_async_context(async_context_t *context);
+
+/*! \brief Return the number of records dropped so far because a ring buffer was full
+ *  \ingroup pico_binary_log
+ */
+uint32_t pico_binary_log_get_dropped_count(void);
+
+#ifndef __cplusplus
+
+// internal: write a record; info holds the argument count, the wide (2 word) and string argument masks, and
+// args[1..] the argument values
+void __pico_binary_log_write(const char *fmt, uint32_t info, const uint64_t *args);
+
+static inline uint64_t __pico_binary_log_signed(int64_t value) {
+    return (uint64_t)value;
+}
+
+static inline uint64_t __pico_binary_log_unsigned(uint64_t value) {
+    return value;
+}
+
+static inline uint64_t __pico_binary_log_double(double value) {
+    uint64_t bits;
+    __builtin_memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline uint64_t __pico_binary_log_pointer(const volatile void *value) {
+    return (uintptr_t)value;
+}
+
+#define __PICO_BINARY_LOG_VALUE(x) _Generic((x), \
+    float: __pico_binary_log_double, double: __pico_binary_log_double, long double: __pico_binary_log_double, \
+    char: __pico_binary_log_signed, signed char: __pico_binary_log_signed, short: __pico_binary_log_signed, \
+    int: __pico_binary_log_signed, long: __pico_binary_log_signed, long long: __pico_binary_log_signed, \
+    _Bool: __pico_binary_log_unsigned, unsigned char: __pico_binary_log_unsigned, \
+    unsigned short: __pico_binary_log_unsigned, unsigned int: __pico_binary_log_unsigned, \
+    unsigned long: __pico_binary_log_unsigned, unsigned long long: __pico_binary_log_unsigned, \
+    default: __pico_binary_log_pointer)(x)
+
+#define __PICO_BINARY_LOG_IS_WIDE(x) _Generic((x), \
+    float: 1u, double: 1u, long double: 1u, \
+    _Bool: 0u, char: 0u, signed char: 0u, unsigned char: 0u, short: 0u, unsigned short: 0u, int: 0u, unsigned int: 0u, \
+    long: (sizeof(long) > 4), unsigned long: (sizeof(long) > 4), long long: 1u, unsigned long long: 1u, \
+    default: (sizeof(void *) > 4))
+
+#define __PICO_BINARY_LOG_IS_STRING(x) _Generic((x), char *: 1u, const char *: 1u, default: 0u)
+
+#define __PICO_BINARY_LOG_NARGS(...) __PICO_BINARY_LOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __PICO_BINARY_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+#define __PICO_BINARY_LOG_CONCAT(a, b) __PICO_BINARY_LOG_CONCAT_(a, b)
+#define __PICO_BINARY_LOG_CONCAT_(a, b) a ## b
+
+// apply m(i, arg) to each argument, where i is the index of the argument
+#define __PICO_BINARY_LOG_MAP(m, ...) __PICO_BINARY_LOG_CONCAT(__PICO_BINARY_LOG_MAP_, __PICO_BINARY_LOG_NARGS(__VA_ARGS__))(m, 0, ##__VA_ARGS__)
+#define __PICO_BINARY_LOG_MAP_0(m, i)
+#define __PICO_BINARY_LOG_MAP_1(m, i, x) m(i, x)
+#define __PICO_BINARY_LOG_MAP_2(m, i, x, ...) m(i, x) __PICO_BINARY_LOG_MAP_1(m, i + 1, __VA_ARGS__)
+#define __PICO_BINARY_LOG_MAP_3(m, i, x, ...) m(i, x) __PICO_BINARY_LOG_MAP_2(m, i + 1, __VA_ARGS__)
+#define __PICO_BINARY_LOG_MAP_4(m, i, x, ...) m(i, x) __PICO_BINARY_LOG_MAP_3(m, i + 1, __VA_ARGS__)
+#define __PICO_BINARY_LOG_MAP_5(m, i, x, ...) m(i, x) __PICO_BINARY_LOG_MAP_4(m, i + 1, __VA_ARGS__)
+#define __PICO_BINARY_LOG_MAP_6(m, i, x, ...) m(i, x) __PICO_BINARY_LOG_MAP_5(m, i + 1, __VA_ARGS__)
+#define __PICO_BINARY_LOG_MAP_7(m, i, x, ...) m(i, x) __PICO_BINARY_LOG_MAP_6(m, i + 1, __VA_ARGS__)
+#define __PICO_BINARY_LOG_MAP_8(m, i, x, ...) m(i, x) __PICO_BINARY_LOG_MAP_7(m, i + 1, __VA_ARGS__)
+
+#define __PICO_BINARY_LOG_INFO_ARG(i, x) | (__PICO_BINARY_LOG_IS_WIDE(x) << (i)) | (__PICO_BINARY_LOG_IS_STRING(x) << (8 + (i)))
+#define __PICO_BINARY_LOG_VALUE_ARG(i, x) , __PICO_BINARY_LOG_VALUE(x)
+
+/*! \brief Log a message to the binary log
+ *  \ingroup pico_binary_log
+ *
+ * This may be called from any core, and from IRQ handlers.
+ *
+ * \param fmt a printf style format string literal
+ * \param ... up to 8 arguments for the format string
+ */
+#define pico_binary_log(fmt, ...) ({ \
+    static const char __pico_binary_log_fmt[] __attribute__((section(PICO_BINARY_LOG_FORMAT_SECTION), used)) = fmt; \
+    __pico_binary_log_write(__pico_binary_log_fmt, \
+        ((uint32_t)__PICO_BINARY_LOG_NARGS(__VA_ARGS__) << 16) __PICO_BINARY_LOG_MAP(__PICO_BINARY_LOG_INFO_ARG, ##__VA_ARGS__), \
+        (const uint64_t[]){ 0 __PICO_BINARY_LOG_MAP(__PICO_BINARY_LOG_VALUE_ARG, ##__VA_ARGS__) }); \
+})
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,12 +7,46 @@
 #ifndef _PICO_MALLOC_H
 #define _PICO_MALLOC_H
 
+#include "pico.h"
+
 /** \file malloc.h
 *  \defgroup pico_malloc pico_malloc
 *
 * \brief Multi-core safety for malloc, calloc and free
 *
-* This library does not provide any additional functions
+* This library does not provide any additional functions, other than \ref pico_malloc_add_region when
+* PICO_MALLOC_TLSF is set, and \ref pico_malloc_profile_dump when PICO_MALLOC_PROFILE is set
+*
+* If PICO_MALLOC_PER_CORE_ARENAS is set, small allocations (of up to PICO_MALLOC_ARENA_MAX_BLOCK_SIZE bytes) are
+* instead made from an arena of PICO_MALLOC_ARENA_SIZE bytes, which is itself allocated from the heap on first use.
+* The arena is divided into pages of PICO_MALLOC_ARENA_PAGE_SIZE bytes, each of which is split into blocks of a
+* single size class (a multiple of 16 bytes). Each core keeps its own free list of blocks for every size class, so
+* allocating and freeing small blocks only disables interrupts on the calling core, rather than taking the
+* malloc mutex shared with the other core. Blocks freed on one core go on that core's free lists. New pages are taken
+* from the arena (under the mutex) when a core's free list is empty, and once the arena is used up, further small
+* allocations are made from the heap as usual. Pages are never returned to the heap.
+*
+* If PICO_MALLOC_TLSF is set, the heap is managed by a Two-Level Segregated Fit allocator rather than by the C
+* library, so that malloc, calloc, free and realloc take a bounded time independent of the state of the heap (though
+* calloc must still clear the memory, and realloc may copy it). On first use, the allocator claims all of the C
+* library's heap (which the linker places between the program's data and the stack) that is still unused, apart from
+* PICO_MALLOC_TLSF_C_HEAP_RESERVE bytes left for allocations the C library makes internally (which may still be
+* freed with free as usual). On the host, a single block of PICO_MALLOC_TLSF_HOST_HEAP_SIZE bytes is claimed
+* instead. Further regions, such as spare SRAM banks or PSRAM, may be added with \ref pico_malloc_add_region. The
+* heap never grows otherwise, so allocation fails once both are used up.
+*
+* If PICO_MALLOC_PROFILE is set, every allocation is recorded against its call site (the return address of the call
+* to malloc, calloc or realloc) and its size class (a power of 2 from 8 bytes up). For each call site the number of
+* allocations and frees, the bytes currently live, the peak live bytes, and the live bytes when the total for the
+* whole program last reached its peak are kept; and for each size class the number of allocations, and the live
+* count, bytes and peak bytes. Up to PICO_MALLOC_PROFILE_MAX_SITES call sites are recorded separately, with any
+* others combined. The size of the heap, its free bytes and its largest free block (only known with PICO_MALLOC_TLSF)
+* give an estimate of fragmentation. \ref pico_malloc_profile_dump writes all of this in a compact binary form, which
+* \c tools/malloc_profile_decode.py can print with the call sites symbolized using the program's ELF file.
+*
+* Profiling adds a header of 8 bytes (16 on a 64-bit host) to every allocation, and takes the malloc mutex on every
+* call, even with PICO_MALLOC_PER_CORE_ARENAS. Note that allocations made via C++ `new`, or within the C library,
+* are all recorded against a call site in the library.
 */
 
 // PICO_CONFIG: PICO_USE_MALLOC_MUTEX, Whether to protect malloc etc with a mutex, type=bool, default=1 with pico_multicore, 0 otherwise, group=pico_malloc
@@ -20,6 +54,56 @@
 #define PICO_USE_MALLOC_MUTEX 1
 #endif
 
+// PICO_CONFIG: PICO_MALLOC_PER_CORE_ARENAS, Enable/disable per-core free lists for small allocations, which avoid taking the malloc mutex, type=bool, default=0, group=pico_malloc
+#ifndef PICO_MALLOC_PER_CORE_ARENAS
+#define PICO_MALLOC_PER_CORE_ARENAS 0
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_ARENA_SIZE, Size in bytes of the arena used for small allocations if PICO_MALLOC_PER_CORE_ARENAS is set; a multiple of PICO_MALLOC_ARENA_PAGE_SIZE, type=int, default=16384, group=pico_malloc
+#ifndef PICO_MALLOC_ARENA_SIZE
+#define PICO_MALLOC_ARENA_SIZE 16384
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_ARENA_PAGE_SIZE, Size in bytes of the pages into which the arena is divided, each holding blocks of a single size, if PICO_MALLOC_PER_CORE_ARENAS is set, type=int, default=1024, group=pico_malloc
+#ifndef PICO_MALLOC_ARENA_PAGE_SIZE
+#define PICO_MALLOC_ARENA_PAGE_SIZE 1024
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_ARENA_MAX_BLOCK_SIZE, Largest allocation in bytes made from the arena if PICO_MALLOC_PER_CORE_ARENAS is set; a multiple of 16, type=int, default=256, group=pico_malloc
+#ifndef PICO_MALLOC_ARENA_MAX_BLOCK_SIZE
+#define PICO_MALLOC_ARENA_MAX_BLOCK_SIZE 256
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_TLSF, Enable/disable the Two-Level Segregated Fit allocator, which has bounded allocation and free times, in place of the C library's allocator, type=bool, default=0, group=pico_malloc
+#ifndef PICO_MALLOC_TLSF
+#define PICO_MALLOC_TLSF 0
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_TLSF_C_HEAP_RESERVE, Size in bytes of the C library's heap left to the C library for its internal allocations if PICO_MALLOC_TLSF is set, type=int, min=0, default=4096, group=pico_malloc
+#ifndef PICO_MALLOC_TLSF_C_HEAP_RESERVE
+#define PICO_MALLOC_TLSF_C_HEAP_RESERVE 4096
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_TLSF_HOST_HEAP_SIZE, Size in bytes of the heap claimed from the C library on the host if PICO_MALLOC_TLSF is set, type=int, default=67108864, group=pico_malloc
+#ifndef PICO_MALLOC_TLSF_HOST_HEAP_SIZE
+#define PICO_MALLOC_TLSF_HOST_HEAP_SIZE (64 * 1024 * 1024)
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_TLSF_MAX_REGIONS, Maximum number of separate memory regions (the one claimed from the C library's heap, and those added with pico_malloc_add_region) if PICO_MALLOC_TLSF is set, type=int, min=1, default=8, group=pico_malloc
+#ifndef PICO_MALLOC_TLSF_MAX_REGIONS
+#define PICO_MALLOC_TLSF_MAX_REGIONS 8
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_PROFILE, Enable/disable recording of heap usage by call site and size class, for pico_malloc_profile_dump, type=bool, default=0, group=pico_malloc
+#ifndef PICO_MALLOC_PROFILE
+#define PICO_MALLOC_PROFILE 0
+#endif
+
+// PICO_CONFIG: PICO_MALLOC_PROFILE_MAX_SITES, Maximum number of call sites recorded separately if PICO_MALLOC_PROFILE is set, type=int, min=1, max=65534, default=64, group=pico_malloc
+#ifndef PICO_MALLOC_PROFILE_MAX_SITES
+#define PICO_MALLOC_PROFILE_MAX_SITES 64
+#endif
+
 // PICO_CONFIG: PICO_MALLOC_PANIC, Enable/disable panic when an allocation failure occurs, type=bool, default=1, group=pico_malloc
 #ifndef PICO_MALLOC_PANIC
 #define PICO_MALLOC_PANIC 1
@@ -35,4 +119,44 @@
 #define PICO_DEBUG_MALLOC_LOW_WATER 0
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if PICO_MALLOC_TLSF
+/*! \brief Add a region of memory to the heap used by malloc, calloc and realloc
+ *  \ingroup pico_malloc
+ *
+ * The memory, for example a spare SRAM bank or PSRAM, must not be used for anything else afterwards, and cannot be
+ * removed from the heap. A region which immediately follows one added earlier is joined to it. This is only
+ * available if PICO_MALLOC_TLSF is set.
+ *
+ * \param start the start of the region
+ * \param size the size of the region in bytes
+ * \return true if the region was added, false if it is too small or PICO_MALLOC_TLSF_MAX_REGIONS regions are
+ * already in use
+ */
+bool pico_malloc_add_region(void *start, size_t size);
+#endif
+
+#if PICO_MALLOC_PROFILE
+/*! \brief Write the heap profile recorded since startup to a buffer
+ *  \ingroup pico_malloc
+ *
+ * The dump is a compact binary snapshot of the statistics described above, to be decoded on the host by
+ * \c tools/malloc_profile_decode.py. The dump is incomplete if the buffer is too small, and the size needed can be
+ * found by calling this with a size of 0 (though the dump grows as new call sites are seen). This is only available
+ * if PICO_MALLOC_PROFILE is set.
+ *
+ * \param buf the buffer to write to
+ * \param buf_size the size of the buffer in bytes
+ * \return the size of the dump in bytes, which is complete only if no bigger than buf_size
+ */
+size_t pico_malloc_profile_dump(void *buf, size_t buf_size);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
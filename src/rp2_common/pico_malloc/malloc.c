@@ -11,18 +11,45 @@
 #if PICO_USE_MALLOC_MUTEX
 #include "pico/mutex.h"
 auto_init_mutex(malloc_mutex);
+#if !PICO_ON_DEVICE
+// there is no runtime initialization of auto_init_mutex mutexes on the host
+static void __attribute__((constructor)) malloc_mutex_init(void) {
+    mutex_init(&malloc_mutex);
+}
+#endif
 #endif
 
 #if PICO_DEBUG_MALLOC
 #include <stdio.h>
 #endif
 
+#if PICO_MALLOC_PER_CORE_ARENAS || PICO_MALLOC_TLSF || PICO_MALLOC_PROFILE
+#include <string.h>
+#endif
+
+#if PICO_MALLOC_PROFILE && !PICO_MALLOC_TLSF
+#include <malloc.h>
+#endif
+
+#if PICO_MALLOC_TLSF
+#include <stddef.h>
+#if PICO_ON_DEVICE
+#include <unistd.h>
+#endif
+#endif
+
+#if PICO_MALLOC_PER_CORE_ARENAS
+#include "hardware/sync.h"
+#endif
+
 extern void *REAL_FUNC(malloc)(size_t size);
 extern void *REAL_FUNC(calloc)(size_t count, size_t size);
 extern void *REAL_FUNC(realloc)(void *mem, size_t size);
 extern void REAL_FUNC(free)(void *mem);
 
+#if PICO_ON_DEVICE
 extern char __StackLimit; /* Set by linker.  */
+#endif
 
 #if !PICO_USE_MALLOC_MUTEX
 #define MALLOC_ENTER(outer) ((void)0);
@@ -59,15 +86,447 @@ static uint8_t mutex_exception_level_plus_one[NUM_CORES];
 
 static inline void check_alloc(__unused void *mem, __unused uint size) {
 #if PICO_MALLOC_PANIC
+// memory added with pico_malloc_add_region may lie beyond __StackLimit
+#if PICO_ON_DEVICE && !PICO_MALLOC_TLSF
     if (!mem || (((char *)mem) + size) > &__StackLimit) {
+#else
+    if (!mem) {
+#endif
         panic("Out of memory");
     }
 #endif
 }
 
-void *WRAPPER_FUNC(malloc)(size_t size) {
+#if PICO_MALLOC_TLSF
+// Two-Level Segregated Fit allocator. Free blocks are kept on one of FL_COUNT * SL_COUNT lists, chosen by the
+// position of the top bit of their size (the first level) and the next SL_COUNT_LOG2 bits (the second level), with
+// a bitmap of the non-empty lists at each level. A list holding blocks at least as big as a request is then found
+// with a couple of bit scans, and freed blocks are merged with their free physical neighbours immediately, so both
+// malloc and free take a bounded time, independent of the number of blocks in the heap.
+static_assert(PICO_MALLOC_TLSF_MAX_REGIONS > 0, "");
+
+#if __SIZEOF_POINTER__ == 8
+#define TLSF_ALIGN_LOG2 4
+#define TLSF_FL_INDEX_MAX 30
+#else
+#define TLSF_ALIGN_LOG2 3
+// blocks (and so regions) are limited to 16M on device
+#define TLSF_FL_INDEX_MAX 24
+#endif
+#define TLSF_ALIGN (1u << TLSF_ALIGN_LOG2)
+#define TLSF_SL_COUNT_LOG2 4
+#define TLSF_SL_COUNT (1u << TLSF_SL_COUNT_LOG2)
+#define TLSF_FL_INDEX_SHIFT (TLSF_SL_COUNT_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_FL_COUNT (TLSF_FL_INDEX_MAX - TLSF_FL_INDEX_SHIFT + 1)
+#define TLSF_SMALL_BLOCK_SIZE ((size_t)1 << TLSF_FL_INDEX_SHIFT)
+#define TLSF_BLOCK_SIZE_MAX (((size_t)1 << TLSF_FL_INDEX_MAX) - TLSF_ALIGN)
+
+typedef struct tlsf_block {
+    struct tlsf_block *prev_phys;
+    // size of the block's payload, which is a multiple of TLSF_ALIGN, in the bits above the TLSF_BLOCK_ flags
+    size_t size;
+    // these are only present in free blocks, at the start of the payload
+    struct tlsf_block *next_free;
+    struct tlsf_block *prev_free;
+} tlsf_block_t;
+
+#define TLSF_BLOCK_FREE 1u
+#define TLSF_BLOCK_PREV_FREE 2u
+#define TLSF_BLOCK_HEADER_SIZE offsetof(tlsf_block_t, next_free)
+#define TLSF_BLOCK_SIZE_MIN (sizeof(tlsf_block_t) - TLSF_BLOCK_HEADER_SIZE)
+static_assert(TLSF_BLOCK_HEADER_SIZE == TLSF_ALIGN && TLSF_BLOCK_SIZE_MIN == TLSF_ALIGN, "");
+
+static uint32_t tlsf_fl_bitmap;
+static uint32_t tlsf_sl_bitmap[TLSF_FL_COUNT];
+static tlsf_block_t *tlsf_free_lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+// the address ranges given to the allocator, so other pointers (e.g. from allocations made by the C library
+// internally) can be passed on to the C library's free
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+} tlsf_region_t;
+static tlsf_region_t tlsf_regions[PICO_MALLOC_TLSF_MAX_REGIONS];
+static uint tlsf_region_count;
+static size_t tlsf_heap_bytes;
+
+static inline uint tlsf_msb(size_t x) {
+#if __SIZEOF_POINTER__ == 8
+    return 63u - (uint)__builtin_clzll(x);
+#else
+    return 31u - (uint)__builtin_clz(x);
+#endif
+}
+
+static inline size_t tlsf_block_size(const tlsf_block_t *block) {
+    return block->size & ~(size_t)(TLSF_BLOCK_FREE | TLSF_BLOCK_PREV_FREE);
+}
+
+static inline tlsf_block_t *tlsf_block_next(const tlsf_block_t *block) {
+    return (tlsf_block_t *)((uintptr_t)block + TLSF_BLOCK_HEADER_SIZE + tlsf_block_size(block));
+}
+
+static inline void *tlsf_block_to_ptr(tlsf_block_t *block) {
+    return (uint8_t *)block + TLSF_BLOCK_HEADER_SIZE;
+}
+
+static inline tlsf_block_t *tlsf_block_from_ptr(void *mem) {
+    return (tlsf_block_t *)((uint8_t *)mem - TLSF_BLOCK_HEADER_SIZE);
+}
+
+// the payload size used for a request, or 0 if it is too big
+static inline size_t tlsf_adjust_size(size_t size) {
+    if (size > TLSF_BLOCK_SIZE_MAX) return 0;
+    size = (size + TLSF_ALIGN - 1) & ~(size_t)(TLSF_ALIGN - 1);
+    return MAX(size, TLSF_BLOCK_SIZE_MIN);
+}
+
+static void tlsf_mapping_insert(size_t size, uint *fl, uint *sl) {
+    if (size < TLSF_SMALL_BLOCK_SIZE) {
+        *fl = 0;
+        *sl = (uint)size >> TLSF_ALIGN_LOG2;
+    } else {
+        uint top = tlsf_msb(size);
+        *fl = top - TLSF_FL_INDEX_SHIFT + 1;
+        *sl = (uint)(size >> (top - TLSF_SL_COUNT_LOG2)) ^ TLSF_SL_COUNT;
+    }
+}
+
+// rounds the size up to the next list boundary, so that every block on the list found is big enough
+static size_t tlsf_round_size(size_t size) {
+    if (size >= TLSF_SMALL_BLOCK_SIZE) {
+        size += ((size_t)1 << (tlsf_msb(size) - TLSF_SL_COUNT_LOG2)) - 1;
+    }
+    return size;
+}
+
+static void tlsf_insert_free_block(tlsf_block_t *block) {
+    uint fl, sl;
+    tlsf_mapping_insert(tlsf_block_size(block), &fl, &sl);
+    tlsf_block_t *head = tlsf_free_lists[fl][sl];
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head) head->prev_free = block;
+    tlsf_free_lists[fl][sl] = block;
+    tlsf_fl_bitmap |= 1u << fl;
+    tlsf_sl_bitmap[fl] |= 1u << sl;
+}
+
+static void tlsf_remove_free_block(tlsf_block_t *block) {
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        uint fl, sl;
+        tlsf_mapping_insert(tlsf_block_size(block), &fl, &sl);
+        tlsf_free_lists[fl][sl] = block->next_free;
+        if (!block->next_free) {
+            tlsf_sl_bitmap[fl] &= ~(1u << sl);
+            if (!tlsf_sl_bitmap[fl]) tlsf_fl_bitmap &= ~(1u << fl);
+        }
+    }
+}
+
+static tlsf_block_t *tlsf_find_free_block(size_t size) {
+    uint fl, sl;
+    tlsf_mapping_insert(tlsf_round_size(size), &fl, &sl);
+    if (fl >= TLSF_FL_COUNT) return NULL;
+    uint32_t sl_map = tlsf_sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint32_t fl_map = tlsf_fl_bitmap & (~0u << (fl + 1));
+        if (!fl_map) return NULL;
+        fl = (uint)__builtin_ctz(fl_map);
+        sl_map = tlsf_sl_bitmap[fl];
+    }
+    return tlsf_free_lists[fl][__builtin_ctz(sl_map)];
+}
+
+// marks the block free, merging it with its free neighbours, and puts the result on its free list
+static void tlsf_release_block(tlsf_block_t *block) {
+    if (block->size & TLSF_BLOCK_PREV_FREE) {
+        tlsf_block_t *prev = block->prev_phys;
+        tlsf_remove_free_block(prev);
+        prev->size += TLSF_BLOCK_HEADER_SIZE + tlsf_block_size(block);
+        block = prev;
+    }
+    tlsf_block_t *next = tlsf_block_next(block);
+    if (next->size & TLSF_BLOCK_FREE) {
+        tlsf_remove_free_block(next);
+        block->size += TLSF_BLOCK_HEADER_SIZE + tlsf_block_size(next);
+        next = tlsf_block_next(block);
+    }
+    block->size |= TLSF_BLOCK_FREE;
+    next->prev_phys = block;
+    next->size |= TLSF_BLOCK_PREV_FREE;
+    tlsf_insert_free_block(block);
+}
+
+// shrinks a used block to the given payload size, releasing the remainder if it is big enough to be a block
+static void tlsf_trim_block(tlsf_block_t *block, size_t size) {
+    size_t block_size = tlsf_block_size(block);
+    if (block_size >= size + TLSF_BLOCK_HEADER_SIZE + TLSF_BLOCK_SIZE_MIN) {
+        tlsf_block_t *rest = (tlsf_block_t *)((uint8_t *)block + TLSF_BLOCK_HEADER_SIZE + size);
+        rest->prev_phys = block;
+        rest->size = block_size - size - TLSF_BLOCK_HEADER_SIZE;
+        block->size = size | (block->size & TLSF_BLOCK_PREV_FREE);
+        tlsf_release_block(rest);
+    }
+}
+
+// marks a block taken off its free list as used
+static void tlsf_use_block(tlsf_block_t *block) {
+    block->size &= ~(size_t)TLSF_BLOCK_FREE;
+    tlsf_block_t *next = tlsf_block_next(block);
+    next->prev_phys = block;
+    next->size &= ~(size_t)TLSF_BLOCK_PREV_FREE;
+}
+
+static bool tlsf_add_pool(uintptr_t start, uintptr_t end) {
+    start = (start + TLSF_ALIGN - 1) & ~(uintptr_t)(TLSF_ALIGN - 1);
+    end &= ~(uintptr_t)(TLSF_ALIGN - 1);
+    bool added = false;
+    // each pool is a single free block, followed by a zero sized used block so that it is never merged past the end;
+    // regions too big for a single block are split into several pools
+    while (end > start && end - start >= 2 * TLSF_BLOCK_HEADER_SIZE + TLSF_BLOCK_SIZE_MIN) {
+        tlsf_block_t *block = (tlsf_block_t *)start;
+        block->prev_phys = NULL;
+        block->size = MIN(end - start - 2 * TLSF_BLOCK_HEADER_SIZE, TLSF_BLOCK_SIZE_MAX);
+        tlsf_block_t *sentinel = tlsf_block_next(block);
+        sentinel->prev_phys = block;
+        sentinel->size = 0;
+        tlsf_heap_bytes += tlsf_block_size(block);
+        tlsf_release_block(block);
+        start = (uintptr_t)tlsf_block_to_ptr(sentinel);
+        added = true;
+    }
+    return added;
+}
+
+static bool tlsf_add_region(uintptr_t start, uintptr_t end) {
+    tlsf_region_t *region = NULL;
+    for (uint i = 0; i < tlsf_region_count; i++) {
+        if (tlsf_regions[i].end == start) region = &tlsf_regions[i];
+    }
+    if (!region && tlsf_region_count == PICO_MALLOC_TLSF_MAX_REGIONS) return false;
+    if (!tlsf_add_pool(start, end)) return false;
+    if (region) {
+        region->end = end;
+    } else {
+        region = &tlsf_regions[tlsf_region_count++];
+        region->start = start;
+        region->end = end;
+    }
+    return true;
+}
+
+static bool tlsf_contains(const void *mem) {
+    for (uint i = 0; i < tlsf_region_count; i++) {
+        if ((uintptr_t)mem >= tlsf_regions[i].start && (uintptr_t)mem < tlsf_regions[i].end) return true;
+    }
+    return false;
+}
+
+static bool tlsf_heap_claimed;
+
+// claims the memory for the heap from the C library, once, on first use. On device this is all of the C library's
+// heap that is still unused (between the current break and __StackLimit), apart from PICO_MALLOC_TLSF_C_HEAP_RESERVE
+// bytes left for allocations the C library makes internally. On the host it is a single block of
+// PICO_MALLOC_TLSF_HOST_HEAP_SIZE bytes
+static void tlsf_claim_heap(void) {
+    tlsf_heap_claimed = true;
+#if PICO_ON_DEVICE
+    char *start = sbrk(0);
+    if (start == (char *)-1 || &__StackLimit - start <= PICO_MALLOC_TLSF_C_HEAP_RESERVE) return;
+    ptrdiff_t size = &__StackLimit - start - PICO_MALLOC_TLSF_C_HEAP_RESERVE;
+    // the break only moves up, so the C library never reuses the memory claimed
+    if (sbrk(size) != start) return;
+    void *mem = start;
+#else
+    size_t size = PICO_MALLOC_TLSF_HOST_HEAP_SIZE;
+    void *mem = REAL_FUNC(malloc)(size);
+    if (!mem) return;
+#endif
+    tlsf_add_region((uintptr_t)mem, (uintptr_t)mem + (size_t)size);
+}
+
+static void *heap_malloc(size_t size) {
+    size_t adjusted = tlsf_adjust_size(size);
+    if (!adjusted) return NULL;
+    if (!tlsf_heap_claimed) tlsf_claim_heap();
+    tlsf_block_t *block = tlsf_find_free_block(adjusted);
+    if (!block) return NULL;
+    tlsf_remove_free_block(block);
+    tlsf_use_block(block);
+    tlsf_trim_block(block, adjusted);
+    return tlsf_block_to_ptr(block);
+}
+
+static void *heap_calloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void *rc = heap_malloc(count * size);
+    if (rc) memset(rc, 0, count * size);
+    return rc;
+}
+
+static void heap_free(void *mem) {
+    if (!mem) return;
+    if (!tlsf_contains(mem)) {
+        REAL_FUNC(free)(mem);
+        return;
+    }
+    tlsf_release_block(tlsf_block_from_ptr(mem));
+}
+
+static void *heap_realloc(void *mem, size_t size) {
+    if (!mem) return heap_malloc(size);
+    if (!tlsf_contains(mem)) return REAL_FUNC(realloc)(mem, size);
+    size_t adjusted = tlsf_adjust_size(size);
+    if (!adjusted) return NULL;
+    tlsf_block_t *block = tlsf_block_from_ptr(mem);
+    size_t block_size = tlsf_block_size(block);
+    if (adjusted > block_size) {
+        tlsf_block_t *next = tlsf_block_next(block);
+        if (!(next->size & TLSF_BLOCK_FREE) ||
+            block_size + TLSF_BLOCK_HEADER_SIZE + tlsf_block_size(next) < adjusted) {
+            void *rc = heap_malloc(size);
+            if (rc) {
+                memcpy(rc, mem, block_size);
+                tlsf_release_block(block);
+            }
+            return rc;
+        }
+        // grow in place into the following free block
+        tlsf_remove_free_block(next);
+        block->size += TLSF_BLOCK_HEADER_SIZE + tlsf_block_size(next);
+        tlsf_use_block(block);
+    }
+    tlsf_trim_block(block, adjusted);
+    return mem;
+}
+
+bool pico_malloc_add_region(void *start, size_t size) {
+    MALLOC_ENTER(false)
+    bool rc = tlsf_add_region((uintptr_t)start, (uintptr_t)start + size);
+    MALLOC_EXIT(false)
+    return rc;
+}
+#else
+static inline void *heap_malloc(size_t size) {
+    return REAL_FUNC(malloc)(size);
+}
+
+static inline void *heap_calloc(size_t count, size_t size) {
+    return REAL_FUNC(calloc)(count, size);
+}
+
+static inline void *heap_realloc(void *mem, size_t size) {
+    return REAL_FUNC(realloc)(mem, size);
+}
+
+static inline void heap_free(void *mem) {
+    REAL_FUNC(free)(mem);
+}
+#endif
+
+#if PICO_MALLOC_PER_CORE_ARENAS
+static_assert(!(PICO_MALLOC_ARENA_MAX_BLOCK_SIZE & 15) && PICO_MALLOC_ARENA_MAX_BLOCK_SIZE <= PICO_MALLOC_ARENA_PAGE_SIZE, "");
+static_assert(!(PICO_MALLOC_ARENA_SIZE % PICO_MALLOC_ARENA_PAGE_SIZE), "");
+
+#define ARENA_CLASS_COUNT (PICO_MALLOC_ARENA_MAX_BLOCK_SIZE / 16)
+#define ARENA_PAGE_COUNT (PICO_MALLOC_ARENA_SIZE / PICO_MALLOC_ARENA_PAGE_SIZE)
+
+typedef struct arena_block {
+    struct arena_block *next;
+} arena_block_t;
+
+static uint8_t *arena_base;
+static bool arena_unavailable;
+static uint arena_pages_used;
+// the size class of the blocks in each page that has been used
+static uint8_t arena_page_class[ARENA_PAGE_COUNT];
+// these are only accessed by their own core, with interrupts disabled
+static arena_block_t *arena_free_lists[NUM_CORES][ARENA_CLASS_COUNT];
+
+static inline uint arena_block_size(uint size_class) {
+    return (size_class + 1) * 16;
+}
+
+static inline bool arena_contains(const void *mem) {
+    const uint8_t *base = arena_base;
+    return base && (const uint8_t *)mem >= base && (const uint8_t *)mem < base + PICO_MALLOC_ARENA_SIZE;
+}
+
+static inline uint arena_class_of(const void *mem) {
+    return arena_page_class[(uint)((const uint8_t *)mem - arena_base) / PICO_MALLOC_ARENA_PAGE_SIZE];
+}
+
+// takes a new page from the arena, returning its first block and adding the rest to this core's free list, or
+// returns NULL if the arena is used up
+static void *arena_refill(uint core_num, uint size_class) {
+    uint8_t *page = NULL;
+    {
+        MALLOC_ENTER(false)
+        if (!arena_base && !arena_unavailable) {
+            arena_base = heap_malloc(PICO_MALLOC_ARENA_SIZE);
+            arena_unavailable = !arena_base;
+        }
+        if (arena_base && arena_pages_used < ARENA_PAGE_COUNT) {
+            arena_page_class[arena_pages_used] = (uint8_t)size_class;
+            page = arena_base + arena_pages_used++ * PICO_MALLOC_ARENA_PAGE_SIZE;
+        }
+        MALLOC_EXIT(false)
+    }
+    if (!page) return NULL;
+    uint block_size = arena_block_size(size_class);
+    arena_block_t *list = NULL;
+    arena_block_t *last = NULL;
+    for (uint offset = (PICO_MALLOC_ARENA_PAGE_SIZE / block_size - 1) * block_size; offset; offset -= block_size) {
+        arena_block_t *block = (arena_block_t *)(page + offset);
+        block->next = list;
+        if (!list) last = block;
+        list = block;
+    }
+    if (list) {
+        uint32_t save = save_and_disable_interrupts();
+        last->next = arena_free_lists[core_num][size_class];
+        arena_free_lists[core_num][size_class] = list;
+        restore_interrupts(save);
+    }
+    return page;
+}
+
+// returns NULL if the arena is used up, in which case the allocation should be made from the heap
+static void *arena_alloc(size_t size) {
+    uint size_class = size ? (uint)(size - 1) / 16 : 0;
+    uint core_num = get_core_num();
+    uint32_t save = save_and_disable_interrupts();
+    arena_block_t *block = arena_free_lists[core_num][size_class];
+    if (block) arena_free_lists[core_num][size_class] = block->next;
+    restore_interrupts(save);
+    if (!block) return arena_refill(core_num, size_class);
+    return block;
+}
+
+static void arena_free(void *mem) {
+    arena_block_t *block = (arena_block_t *)mem;
+    uint size_class = arena_class_of(mem);
+    uint core_num = get_core_num();
+    uint32_t save = save_and_disable_interrupts();
+    block->next = arena_free_lists[core_num][size_class];
+    arena_free_lists[core_num][size_class] = block;
+    restore_interrupts(save);
+}
+#endif
+
+static void *malloc_impl(size_t size) {
+#if PICO_MALLOC_PER_CORE_ARENAS
+    if (size <= PICO_MALLOC_ARENA_MAX_BLOCK_SIZE) {
+        void *block = arena_alloc(size);
+        if (block) return block;
+    }
+#endif
     MALLOC_ENTER(false)
-    void *rc = REAL_FUNC(malloc)(size);
+    void *rc = heap_malloc(size);
     MALLOC_EXIT(false)
 #if PICO_DEBUG_MALLOC
     if (!rc) {
@@ -80,9 +539,16 @@ void *WRAPPER_FUNC(malloc)(size_t size) {
     return rc;
 }
 
-void *WRAPPER_FUNC(calloc)(size_t count, size_t size) {
+// unused if PICO_MALLOC_PROFILE is set
+static __unused void *calloc_impl(size_t count, size_t size) {
+#if PICO_MALLOC_PER_CORE_ARENAS
+    if (size <= PICO_MALLOC_ARENA_MAX_BLOCK_SIZE && count <= PICO_MALLOC_ARENA_MAX_BLOCK_SIZE / (size ? size : 1)) {
+        void *block = arena_alloc(count * size);
+        if (block) return memset(block, 0, count * size);
+    }
+#endif
     MALLOC_ENTER(true)
-    void *rc = REAL_FUNC(calloc)(count, size);
+    void *rc = heap_calloc(count, size);
     MALLOC_EXIT(true)
 #if PICO_DEBUG_MALLOC
     if (!rc) {
@@ -95,9 +561,22 @@ void *WRAPPER_FUNC(calloc)(size_t count, size_t size) {
     return rc;
 }
 
-void *WRAPPER_FUNC(realloc)(void *mem, size_t size) {
+static void *realloc_impl(void *mem, size_t size) {
+#if PICO_MALLOC_PER_CORE_ARENAS
+    if (!mem) return malloc_impl(size);
+    if (arena_contains(mem)) {
+        uint block_size = arena_block_size(arena_class_of(mem));
+        if (size <= block_size) return mem;
+        void *rc = malloc_impl(size);
+        if (rc) {
+            memcpy(rc, mem, block_size);
+            arena_free(mem);
+        }
+        return rc;
+    }
+#endif
     MALLOC_ENTER(true)
-    void *rc = REAL_FUNC(realloc)(mem, size);
+    void *rc = heap_realloc(mem, size);
     MALLOC_EXIT(true)
 #if PICO_DEBUG_MALLOC
     if (!rc) {
@@ -110,8 +589,319 @@ void *WRAPPER_FUNC(realloc)(void *mem, size_t size) {
     return rc;
 }
 
-void WRAPPER_FUNC(free)(void *mem) {
+static void free_impl(void *mem) {
+#if PICO_MALLOC_PER_CORE_ARENAS
+    if (arena_contains(mem)) {
+        arena_free(mem);
+        return;
+    }
+#endif
     MALLOC_ENTER(false)
-    REAL_FUNC(free)(mem);
+    heap_free(mem);
+    MALLOC_EXIT(false)
+}
+
+#if PICO_MALLOC_PROFILE
+static_assert(PICO_MALLOC_PROFILE_MAX_SITES > 0 && PICO_MALLOC_PROFILE_MAX_SITES < 0xffff, "");
+
+// each profiled allocation is preceded by a header recording its size and call site; the magic number is in the top
+// half of the word before the allocation, which for memory allocated by the C library directly (and so without a
+// header) holds its chunk size, so such memory can still be freed correctly
+typedef struct {
+#if __SIZEOF_POINTER__ == 8
+    uint64_t unused;
+#endif
+    uint32_t size;
+    uint16_t site;
+    uint16_t magic;
+} profile_header_t;
+static_assert(sizeof(profile_header_t) == 2 * sizeof(void *), "");
+
+#define PROFILE_MAGIC 0xa110u
+#define PROFILE_DUMP_MAGIC 0x46504d50u // "PMPF"
+#define PROFILE_DUMP_VERSION 1
+#define PROFILE_SIZE_CLASS_COUNT 16
+// allocations from call sites which don't fit in the table are recorded against this extra one, with address 0
+#define PROFILE_OTHER_SITE PICO_MALLOC_PROFILE_MAX_SITES
+
+typedef struct {
+    uintptr_t address;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    // live_bytes as of the last time the total live bytes reached its peak
+    uint32_t bytes_at_peak;
+} profile_site_t;
+
+typedef struct {
+    uint32_t alloc_count;
+    uint32_t live_count;
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+} profile_size_class_t;
+
+static struct {
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    uint32_t live_count;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t failed_count;
+    uint site_count;
+    profile_site_t sites[PICO_MALLOC_PROFILE_MAX_SITES + 1];
+    profile_size_class_t size_classes[PROFILE_SIZE_CLASS_COUNT];
+} profile;
+
+// size class n holds allocations of up to 8 << n bytes, apart from the last which holds everything bigger
+static uint profile_size_class(uint32_t size) {
+    if (size <= 8) return 0;
+    return MIN((uint)(29 - __builtin_clz(size - 1)), PROFILE_SIZE_CLASS_COUNT - 1);
+}
+
+static uint profile_site_index(uintptr_t address) {
+    uint start = (uint)(((uint32_t)address >> 1) * 2654435761u) % PICO_MALLOC_PROFILE_MAX_SITES;
+    uint i = start;
+    do {
+        if (profile.sites[i].address == address) return i;
+        if (!profile.sites[i].address) {
+            if (profile.site_count == PICO_MALLOC_PROFILE_MAX_SITES) break;
+            profile.site_count++;
+            profile.sites[i].address = address;
+            return i;
+        }
+        i = i + 1 == PICO_MALLOC_PROFILE_MAX_SITES ? 0 : i + 1;
+    } while (i != start);
+    return PROFILE_OTHER_SITE;
+}
+
+static void profile_record_alloc(profile_header_t *header, size_t size, void *caller) {
+    MALLOC_ENTER(false)
+    profile_site_t *site = &profile.sites[profile_site_index((uintptr_t)caller)];
+    header->size = (uint32_t)size;
+    header->site = (uint16_t)(site - profile.sites);
+    header->magic = PROFILE_MAGIC;
+    site->alloc_count++;
+    site->live_bytes += (uint32_t)size;
+    site->peak_bytes = MAX(site->peak_bytes, site->live_bytes);
+    profile_size_class_t *size_class = &profile.size_classes[profile_size_class((uint32_t)size)];
+    size_class->alloc_count++;
+    size_class->live_count++;
+    size_class->live_bytes += (uint32_t)size;
+    size_class->peak_bytes = MAX(size_class->peak_bytes, size_class->live_bytes);
+    profile.alloc_count++;
+    profile.live_count++;
+    profile.live_bytes += (uint32_t)size;
+    if (profile.live_bytes > profile.peak_bytes) {
+        profile.peak_bytes = profile.live_bytes;
+        for (uint i = 0; i <= PICO_MALLOC_PROFILE_MAX_SITES; i++) {
+            profile.sites[i].bytes_at_peak = profile.sites[i].live_bytes;
+        }
+    }
+    MALLOC_EXIT(false)
+}
+
+static void profile_record_free(profile_header_t *header) {
+    MALLOC_ENTER(false)
+    profile_site_t *site = &profile.sites[header->site];
+    site->free_count++;
+    site->live_bytes -= header->size;
+    profile_size_class_t *size_class = &profile.size_classes[profile_size_class(header->size)];
+    size_class->live_count--;
+    size_class->live_bytes -= header->size;
+    profile.free_count++;
+    profile.live_count--;
+    profile.live_bytes -= header->size;
+    header->magic = 0;
     MALLOC_EXIT(false)
 }
+
+static void profile_record_failure(void) {
+    MALLOC_ENTER(false)
+    profile.failed_count++;
+    MALLOC_EXIT(false)
+}
+
+// returns the header of memory allocated with one, or NULL for memory allocated by the C library directly; for the
+// latter the word read is outside the allocation, which AddressSanitizer would report
+#ifdef __SANITIZE_ADDRESS__
+__attribute__((no_sanitize_address))
+#endif
+static inline profile_header_t *profile_header(void *mem) {
+    profile_header_t *header = (profile_header_t *)mem - 1;
+    return mem && header->magic == PROFILE_MAGIC ? header : NULL;
+}
+
+static void *profile_malloc(size_t size, void *caller) {
+    profile_header_t *header = size <= UINT32_MAX - sizeof(profile_header_t) ?
+                               malloc_impl(size + sizeof(profile_header_t)) : NULL;
+    if (!header) {
+        profile_record_failure();
+        return NULL;
+    }
+    profile_record_alloc(header, size, caller);
+    return header + 1;
+}
+
+// calloc and realloc are built on malloc, so that no nested calls from the C library (see MALLOC_ENTER) are profiled
+static void *profile_calloc(size_t count, size_t size, void *caller) {
+    if (size && count > SIZE_MAX / size) {
+        profile_record_failure();
+        return NULL;
+    }
+    void *rc = profile_malloc(count * size, caller);
+    if (rc) memset(rc, 0, count * size);
+    return rc;
+}
+
+static void profile_free(void *mem) {
+    profile_header_t *header = profile_header(mem);
+    if (!header) {
+        free_impl(mem);
+        return;
+    }
+    profile_record_free(header);
+    free_impl(header);
+}
+
+static void *profile_realloc(void *mem, size_t size, void *caller) {
+    if (!mem) return profile_malloc(size, caller);
+    profile_header_t *header = profile_header(mem);
+    if (!header) return realloc_impl(mem, size);
+    void *rc = profile_malloc(size, caller);
+    if (rc) {
+        memcpy(rc, mem, MIN(size, header->size));
+        profile_free(mem);
+    }
+    return rc;
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t buf_size;
+    size_t pos;
+} profile_writer_t;
+
+static void profile_write(profile_writer_t *writer, const void *data, size_t len) {
+    if (writer->pos + len <= writer->buf_size) {
+        memcpy(writer->buf + writer->pos, data, len);
+    }
+    writer->pos += len;
+}
+
+static void profile_write_u32(profile_writer_t *writer, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    profile_write(writer, bytes, sizeof(bytes));
+}
+
+static void profile_write_address(profile_writer_t *writer, uintptr_t address) {
+    profile_write_u32(writer, (uint32_t)address);
+#if __SIZEOF_POINTER__ == 8
+    profile_write_u32(writer, (uint32_t)(address >> 32));
+#endif
+}
+
+static void profile_heap_stats(uint32_t *heap_bytes, uint32_t *free_bytes, uint32_t *largest_free) {
+#if PICO_MALLOC_TLSF
+    size_t free_total = 0, largest = 0;
+    for (uint fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        for (uint sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            for (tlsf_block_t *block = tlsf_free_lists[fl][sl]; block; block = block->next_free) {
+                free_total += tlsf_block_size(block);
+                largest = MAX(largest, tlsf_block_size(block));
+            }
+        }
+    }
+    *heap_bytes = (uint32_t)tlsf_heap_bytes;
+    *free_bytes = (uint32_t)free_total;
+    *largest_free = (uint32_t)largest;
+#else
+    // the C library doesn't report its largest free block
+#if __GLIBC__ && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+    *heap_bytes = (uint32_t)info.arena;
+    *free_bytes = (uint32_t)info.fordblks;
+    *largest_free = 0;
+#endif
+}
+
+size_t pico_malloc_profile_dump(void *buf, size_t buf_size) {
+    profile_writer_t writer = {.buf = buf, .buf_size = buf_size};
+    MALLOC_ENTER(false)
+    uint32_t heap_bytes, free_bytes, largest_free;
+    profile_heap_stats(&heap_bytes, &free_bytes, &largest_free);
+    uint8_t info[4] = {PROFILE_DUMP_VERSION, (uint8_t)sizeof(void *), PROFILE_SIZE_CLASS_COUNT, 0};
+    profile_write_u32(&writer, PROFILE_DUMP_MAGIC);
+    profile_write(&writer, info, sizeof(info));
+    // lets addresses be symbolized for position independent (host) executables
+    profile_write_address(&writer, (uintptr_t)pico_malloc_profile_dump);
+    profile_write_u32(&writer, profile.live_bytes);
+    profile_write_u32(&writer, profile.peak_bytes);
+    profile_write_u32(&writer, profile.live_count);
+    profile_write_u32(&writer, profile.alloc_count);
+    profile_write_u32(&writer, profile.free_count);
+    profile_write_u32(&writer, profile.failed_count);
+    profile_write_u32(&writer, heap_bytes);
+    profile_write_u32(&writer, free_bytes);
+    profile_write_u32(&writer, largest_free);
+    for (uint i = 0; i < PROFILE_SIZE_CLASS_COUNT; i++) {
+        const profile_size_class_t *size_class = &profile.size_classes[i];
+        profile_write_u32(&writer, size_class->alloc_count);
+        profile_write_u32(&writer, size_class->live_count);
+        profile_write_u32(&writer, size_class->live_bytes);
+        profile_write_u32(&writer, size_class->peak_bytes);
+    }
+    uint site_count = 0;
+    for (uint i = 0; i <= PICO_MALLOC_PROFILE_MAX_SITES; i++) {
+        site_count += profile.sites[i].alloc_count != 0;
+    }
+    profile_write_u32(&writer, site_count);
+    for (uint i = 0; i <= PICO_MALLOC_PROFILE_MAX_SITES; i++) {
+        const profile_site_t *site = &profile.sites[i];
+        if (!site->alloc_count) continue;
+        profile_write_address(&writer, site->address);
+        profile_write_u32(&writer, site->alloc_count);
+        profile_write_u32(&writer, site->free_count);
+        profile_write_u32(&writer, site->live_bytes);
+        profile_write_u32(&writer, site->peak_bytes);
+        profile_write_u32(&writer, site->bytes_at_peak);
+    }
+    MALLOC_EXIT(false)
+    return writer.pos;
+}
+
+void *WRAPPER_FUNC(malloc)(size_t size) {
+    return profile_malloc(size, __builtin_return_address(0));
+}
+
+void *WRAPPER_FUNC(calloc)(size_t count, size_t size) {
+    return profile_calloc(count, size, __builtin_return_address(0));
+}
+
+void *WRAPPER_FUNC(realloc)(void *mem, size_t size) {
+    return profile_realloc(mem, size, __builtin_return_address(0));
+}
+
+void WRAPPER_FUNC(free)(void *mem) {
+    profile_free(mem);
+}
+#else
+void *WRAPPER_FUNC(malloc)(size_t size) {
+    return malloc_impl(size);
+}
+
+void *WRAPPER_FUNC(calloc)(size_t count, size_t size) {
+    return calloc_impl(count, size);
+}
+
+void *WRAPPER_FUNC(realloc)(void *mem, size_t size) {
+    return realloc_impl(mem, size);
+}
+
+void WRAPPER_FUNC(free)(void *mem) {
+    free_impl(mem);
+}
+#endif
@@ -79,6 +79,28 @@ bool weak_raw_vprintf(const char *fmt, va_list args);
  */
 int vfctprintf(void (*out)(char character, void *arg), void *arg, const char *format, va_list va);
 
+/**
+ * \brief Format a double as the shortest decimal string which converts back to exactly the same double
+ * The digits are laid out as by "%.17g", e.g. 0.1 is formatted as "0.1" and 1e100 as "1e+100"
+ * \param buf The buffer for the string, which is always null terminated (unless size is 0)
+ * \param size The size of the buffer; 25 characters is always sufficient
+ * \param value The value to format
+ * \return The length of the string, not counting the terminating null character, which would have been written had
+ * the buffer been large enough
+ */
+int pico_dtoa_shortest(char *buf, size_t size, double value);
+
+/**
+ * \brief Format a float as the shortest decimal string which converts back to exactly the same float
+ * The digits are laid out as by "%.9g", e.g. 0.1f is formatted as "0.1" and 1e10f as "1e+10"
+ * \param buf The buffer for the string, which is always null terminated (unless size is 0)
+ * \param size The size of the buffer; 16 characters is always sufficient
+ * \param value The value to format
+ * \return The length of the string, not counting the terminating null character, which would have been written had
+ * the buffer been large enough
+ */
+int pico_ftoa_shortest(char *buf, size_t size, float value);
+
 #else
 
 #define weak_raw_printf(...) ({printf(__VA_ARGS__); true;})
@@ -44,15 +44,8 @@
 #define PICO_PRINTF_NTOA_BUFFER_SIZE    32U
 #endif
 
-// PICO_CONFIG: PICO_PRINTF_FTOA_BUFFER_SIZE, Define printf ftoa buffer size, min=0, max=128, default=32, group=pico_printf
-// 'ftoa' conversion buffer size, this must be big enough to hold one converted
-// float number including padded zeros (dynamically created on stack)
-#ifndef PICO_PRINTF_FTOA_BUFFER_SIZE
-#define PICO_PRINTF_FTOA_BUFFER_SIZE    32U
-#endif
-
 // PICO_CONFIG: PICO_PRINTF_SUPPORT_FLOAT, Enable floating point printing, type=bool, default=1, group=pico_printf
-// support for the floating point type (%f)
+// support for the floating point type (%f); values are converted exactly, with the same rounding as glibc
 #ifndef PICO_PRINTF_SUPPORT_FLOAT
 #define PICO_PRINTF_SUPPORT_FLOAT 1
 #endif
@@ -68,11 +61,6 @@
 #define PICO_PRINTF_DEFAULT_FLOAT_PRECISION  6U
 #endif
 
-// PICO_CONFIG: PICO_PRINTF_MAX_FLOAT, Define the largest float suitable to print with %f, min=1, max=1e9, default=1e9, group=pico_printf
-#ifndef PICO_PRINTF_MAX_FLOAT
-#define PICO_PRINTF_MAX_FLOAT  1e9
-#endif
-
 // PICO_CONFIG: PICO_PRINTF_SUPPORT_LONG_LONG, Enable support for long long types (%llu or %p), type=bool, default=1, group=pico_printf
 #ifndef PICO_PRINTF_SUPPORT_LONG_LONG
 #define PICO_PRINTF_SUPPORT_LONG_LONG 1
@@ -99,8 +87,9 @@
 #define FLAGS_LONG_LONG (1U <<  9U)
 #define FLAGS_PRECISION (1U << 10U)
 #define FLAGS_ADAPT_EXP (1U << 11U)
+#define FLAGS_EXPONENT  (1U << 12U)
 
-// import float.h for DBL_MAX
+// import float.h for DBL_MANT_DIG
 #if PICO_PRINTF_SUPPORT_FLOAT
 
 #include <float.h>
@@ -255,6 +244,78 @@ static size_t _ntoa_format(out_fct_type out, char *buffer, size_t idx, size_t ma
 }
 
 
+// the two digit decimal strings "00" to "99", so that decimal conversion needs only one division per two digits
+static const char _digit_pairs[200] = {
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899"
+};
+
+// internal conversion of value to digits, least significant first, appended to buf at len
+// \return The new length
+static size_t _ntoa_digits(char *buf, size_t len, unsigned long value, unsigned int base, unsigned int flags) {
+    if (base == 10U) {
+        do {
+            if ((value >= 10U) && (len + 2U <= PICO_PRINTF_NTOA_BUFFER_SIZE)) {
+                const unsigned long q = value / 100U;
+                const char *pair = &_digit_pairs[(value - q * 100U) * 2U];
+                buf[len++] = pair[1];
+                buf[len++] = pair[0];
+                value = q;
+            } else {
+                buf[len++] = (char) ('0' + value % 10U);
+                value /= 10U;
+            }
+        } while (value && (len < PICO_PRINTF_NTOA_BUFFER_SIZE));
+    } else {
+        // the other bases are all powers of 2
+        const unsigned int shift = base == 16U ? 4U : (base == 8U ? 3U : 1U);
+        const char *digits = (flags & FLAGS_UPPERCASE) ? "0123456789ABCDEF" : "0123456789abcdef";
+        do {
+            buf[len++] = digits[value & (base - 1U)];
+            value >>= shift;
+        } while (value && (len < PICO_PRINTF_NTOA_BUFFER_SIZE));
+    }
+    return len;
+}
+
+#if PICO_PRINTF_SUPPORT_LONG_LONG || PICO_PRINTF_SUPPORT_FLOAT
+
+// internal division of a 64 bit value by 10^9, returning the remainder
+// 32 bit targets have no 64 bit divide instruction, so this divides by 2^9 and then by 5^9 (which is less
+// than 2^21) 11 bits at a time, so that each step is a 32 bit division
+static uint32_t _divmod_1e9(uint64_t *value) {
+    uint64_t v = *value;
+    const uint32_t low = (uint32_t) v & 0x1ffU;
+    v >>= 9U;
+    uint64_t q = 0U;
+    uint32_t rem = 0U;
+    for (int shift = 44; shift >= 0; shift -= 11) {
+        const uint32_t cur = (rem << 11U) | ((uint32_t) (v >> shift) & 0x7ffU);
+        const uint32_t digit = cur / 1953125U;
+        rem = cur - digit * 1953125U;
+        q = (q << 11U) | digit;
+    }
+    *value = q;
+    return (rem << 9U) | low;
+}
+
+// internal conversion of value (< 10^9) to exactly 9 decimal digits, least significant first
+static void _nine_digits_rev(char *buf, uint32_t value) {
+    for (unsigned int i = 0U; i < 8U; i += 2U) {
+        const uint32_t q = value / 100U;
+        const char *pair = &_digit_pairs[(value - q * 100U) * 2U];
+        buf[i] = pair[1];
+        buf[i + 1U] = pair[0];
+        value = q;
+    }
+    buf[8] = (char) ('0' + value);
+}
+
+#endif
+
 // internal itoa for 'long' type
 static size_t _ntoa_long(out_fct_type out, char *buffer, size_t idx, size_t maxlen, unsigned long value, bool negative,
                          unsigned long base, unsigned int prec, unsigned int width, unsigned int flags) {
@@ -268,11 +329,7 @@ static size_t _ntoa_long(out_fct_type out, char *buffer, size_t idx, size_t maxl
 
     // write if precision != 0 and value is != 0
     if (!(flags & FLAGS_PRECISION) || value) {
-        do {
-            const char digit = (char) (value % base);
-            buf[len++] = (char)(digit < 10 ? '0' + digit : (flags & FLAGS_UPPERCASE ? 'A' : 'a') + digit - 10);
-            value /= base;
-        } while (value && (len < PICO_PRINTF_NTOA_BUFFER_SIZE));
+        len = _ntoa_digits(buf, len, value, (unsigned int) base, flags);
     }
 
     return _ntoa_format(out, buffer, idx, maxlen, buf, len, negative, (unsigned int) base, prec, width, flags);
@@ -295,11 +352,23 @@ static size_t _ntoa_long_long(out_fct_type out, char *buffer, size_t idx, size_t
 
     // write if precision != 0 and value is != 0
     if (!(flags & FLAGS_PRECISION) || value) {
-        do {
-            const char digit = (char) (value % base);
-            buf[len++] = (char)(digit < 10 ? '0' + digit : (flags & FLAGS_UPPERCASE ? 'A' : 'a') + digit - 10);
-            value /= base;
-        } while (value && (len < PICO_PRINTF_NTOA_BUFFER_SIZE));
+        if (base == 10U) {
+            // split off 9 digits at a time while the value doesn't fit in 32 bits, to avoid 64 bit divisions
+            while ((value >> 32U) && (len + 9U <= PICO_PRINTF_NTOA_BUFFER_SIZE)) {
+                uint64_t q = value;
+                _nine_digits_rev(buf + len, _divmod_1e9(&q));
+                len += 9U;
+                value = q;
+            }
+            len = _ntoa_digits(buf, len, (unsigned long) value, 10U, flags);
+        } else {
+            const unsigned int shift = base == 16U ? 4U : (base == 8U ? 3U : 1U);
+            const char *digits = (flags & FLAGS_UPPERCASE) ? "0123456789ABCDEF" : "0123456789abcdef";
+            do {
+                buf[len++] = digits[value & (base - 1U)];
+                value >>= shift;
+            } while (value && (len < PICO_PRINTF_NTOA_BUFFER_SIZE));
+        }
     }
 
     return _ntoa_format(out, buffer, idx, maxlen, buf, len, negative, (unsigned int) base, prec, width, flags);
@@ -310,251 +379,554 @@ static size_t _ntoa_long_long(out_fct_type out, char *buffer, size_t idx, size_t
 
 #if PICO_PRINTF_SUPPORT_FLOAT
 
-#if PICO_PRINTF_SUPPORT_EXPONENTIAL
-// forward declaration so that _ftoa can switch to exp notation for values > PICO_PRINTF_MAX_FLOAT
-static size_t _etoa(out_fct_type out, char *buffer, size_t idx, size_t maxlen, double value, unsigned int prec,
-                    unsigned int width, unsigned int flags);
-#endif
-
-#define is_nan __builtin_isnan
+// Floating point values are converted exactly, much as by musl's printf: the binary value is converted to a decimal
+// held in base 10^9 "limbs", which is then rounded (half to even, as glibc does) at the requested digit. Digits far
+// beyond the requested precision are dropped as they are generated, so the common cases need only a few limbs.
 
-// internal ftoa for fixed decimal floating point
-static size_t _ftoa(out_fct_type out, char *buffer, size_t idx, size_t maxlen, double value, unsigned int prec,
-                    unsigned int width, unsigned int flags) {
-    char buf[PICO_PRINTF_FTOA_BUFFER_SIZE];
-    size_t len = 0U;
-    double diff = 0.0;
-
-    // powers of 10
-    static const double pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
-
-    // test for special values
-    if (is_nan(value))
-        return _out_rev(out, buffer, idx, maxlen, "nan", 3, width, flags);
-    if (value < -DBL_MAX)
-        return _out_rev(out, buffer, idx, maxlen, "fni-", 4, width, flags);
-    if (value > DBL_MAX)
-        return _out_rev(out, buffer, idx, maxlen, (flags & FLAGS_PLUS) ? "fni+" : "fni", (flags & FLAGS_PLUS) ? 4U : 3U,
-                        width, flags);
-
-    // test for very large values
-    // standard printf behavior is to print EVERY whole number digit -- which could be 100s of characters overflowing your buffers == bad
-    if ((value > PICO_PRINTF_MAX_FLOAT) || (value < -PICO_PRINTF_MAX_FLOAT)) {
-#if PICO_PRINTF_SUPPORT_EXPONENTIAL
-        return _etoa(out, buffer, idx, maxlen, value, prec, width, flags);
-#else
-        return 0U;
-#endif
+// a non-negative decimal value; any digits beyond those held are zero
+typedef struct {
+    uint32_t *limbs;    // base 10^9 digits, most significant first, with room for one more before limbs[0]
+    int count;          // the number of limbs held, which is 0 for the value 0
+    int limb_exp10;     // the decimal exponent of the units digit of limbs[0]
+    int first_digits;   // the number of decimal digits in limbs[0]
+    int exp10;          // the decimal exponent of the first digit, i.e. the value is d.ddd... x 10^exp10
+} _decimal_t;
+
+// enough limbs for the 309 integer digits of DBL_MAX, or for about 300 digits of precision; any further digits
+// requested are output as zeros
+#define DECIMAL_LIMBS 40
+
+// the digits held beyond those requested, so that they are rounded correctly
+#define DECIMAL_GUARD_DIGITS (DBL_MANT_DIG / 3 + 8)
+
+#define DECIMAL_ROUND_NEAREST 0
+#define DECIMAL_ROUND_DOWN    1
+#define DECIMAL_ROUND_UP      2
+
+static const uint32_t _pow10[] = {1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U,
+                                  1000000000U};
+
+// internal removal of trailing zero limbs, and update of the first digit's exponent
+static void _decimal_normalize(_decimal_t *d) {
+    while (d->count && !d->limbs[d->count - 1]) {
+        d->count--;
     }
-
-    // test for negative
-    bool negative = false;
-    if (value < 0) {
-        negative = true;
-        value = 0 - value;
+    int digits = 1;
+    while (d->count && (digits < 9) && (d->limbs[0] >= _pow10[digits])) {
+        digits++;
     }
+    d->first_digits = digits;
+    d->exp10 = d->count ? d->limb_exp10 + digits - 1 : 0;
+}
 
-    // set default precision, if not set explicitly
-    if (!(flags & FLAGS_PRECISION)) {
-        prec = PICO_PRINTF_DEFAULT_FLOAT_PRECISION;
-    }
-    // limit precision to 9, cause a prec >= 10 can lead to overflow errors
-    while ((len < PICO_PRINTF_FTOA_BUFFER_SIZE) && (prec > 9U)) {
-        buf[len++] = '0';
-        prec--;
+// internal conversion of m * 2^e2 to a decimal in buf (of DECIMAL_LIMBS limbs); digits more than need limbs beyond
+// the first limb, or beyond the decimal point if fixed is set, may be dropped
+static void _decimal_from_binary(_decimal_t *d, uint32_t *buf, uint64_t m, int e2, int need, bool fixed) {
+    d->limbs = buf + 1;
+    d->count = 0;
+    d->limb_exp10 = 0;
+    if (!m) {
+        _decimal_normalize(d);
+        return;
     }
-
-    int whole = (int) value;
-    double tmp = (value - whole) * pow10[prec];
-    unsigned long frac = (unsigned long) tmp;
-    diff = tmp - frac;
-
-    if (diff > 0.5) {
-        ++frac;
-        // handle rollover, e.g. case 0.99 with prec 1 is 1.0
-        if (frac >= pow10[prec]) {
-            frac = 0;
-            ++whole;
+    const int zeros = __builtin_ctzll(m);
+    m >>= zeros;
+    e2 += zeros;
+    if ((e2 < 0) && (e2 > -64)) {
+        // the common case of a fraction of less than 64 bits, each limb of which is generated by multiplying by 10^9
+        const int frac_bits = -e2;
+        const int r = 3;
+        uint64_t integer = m >> frac_bits;
+        uint64_t frac = m & ((1ULL << frac_bits) - 1U);
+        buf[r - 1] = _divmod_1e9(&integer);
+        buf[r - 2] = (uint32_t) integer;
+        int a = buf[r - 2] ? r - 2 : (buf[r - 1] ? r - 1 : r);
+        int z = r;
+        while (frac && (z < DECIMAL_LIMBS) && (z - (fixed ? r : a) < need)) {
+            uint32_t limb;
+            if (frac_bits < 32) {
+                const uint64_t x = frac * 1000000000U;
+                limb = (uint32_t) (x >> frac_bits);
+                frac = x & ((1ULL << frac_bits) - 1U);
+            } else {
+                // frac * 10^9 is up to 94 bits, so is calculated as two 32 x 32 bit products
+                const uint64_t lo = (uint64_t) (uint32_t) frac * 1000000000U;
+                const uint64_t hi = (frac >> 32U) * 1000000000U + (lo >> 32U);
+                limb = (uint32_t) (hi >> (frac_bits - 32));
+                frac = ((hi & ((1ULL << (frac_bits - 32)) - 1U)) << 32U) | (uint32_t) lo;
+            }
+            buf[z++] = limb;
+            if (!limb && (a == z - 1)) {
+                a = z;
+            }
         }
-    } else if (diff < 0.5) {
-    } else if ((frac == 0U) || (frac & 1U)) {
-        // if halfway, round up if odd OR if last digit is 0
-        ++frac;
+        d->limbs = buf + a;
+        d->count = z - a;
+        d->limb_exp10 = 9 * (r - 1 - a);
+        _decimal_normalize(d);
+        return;
     }
-
-    if (prec == 0U) {
-        diff = value - (double) whole;
-        if (!((diff < 0.5) || (diff > 0.5)) && (whole & 1)) {
-            // exactly 0.5 and ODD, then round up
-            // 1.5 -> 2, but 2.5 -> 2
-            ++whole;
-        }
-    } else {
-        unsigned int count = prec;
-        // now do fractional part, as an unsigned number
-        while (len < PICO_PRINTF_FTOA_BUFFER_SIZE) {
-            --count;
-            buf[len++] = (char) (48U + (frac % 10U));
-            if (!(frac /= 10U)) {
-                break;
-            }
+    const uint32_t low = _divmod_1e9(&m);
+
+    // the limbs held are buf[a] to buf[z - 1], and the decimal point is before buf[r]; an integer grows towards the
+    // start of buf as it is multiplied, and a fraction grows towards the end as it is divided
+    int r = e2 >= 0 ? DECIMAL_LIMBS : 3;
+    int z = r;
+    buf[z - 2] = (uint32_t) m;
+    buf[z - 1] = low;
+    int a = m ? z - 2 : z - 1;
+    while (e2 > 0) {
+        const int shift = MIN(29, e2);
+        uint32_t carry = 0U;
+        for (int i = z - 1; i >= a; i--) {
+            uint64_t x = ((uint64_t) buf[i] << shift) + carry;
+            buf[i] = _divmod_1e9(&x);
+            carry = (uint32_t) x;
         }
-        // add extra 0s
-        while ((len < PICO_PRINTF_FTOA_BUFFER_SIZE) && (count-- > 0U)) {
-            buf[len++] = '0';
+        if (carry) {
+            buf[--a] = carry;
         }
-        if (len < PICO_PRINTF_FTOA_BUFFER_SIZE) {
-            // add decimal
-            buf[len++] = '.';
+        while (!buf[z - 1]) {
+            z--;
         }
+        e2 -= shift;
     }
-
-    // do whole part, number is reversed
-    while (len < PICO_PRINTF_FTOA_BUFFER_SIZE) {
-        buf[len++] = (char) (48 + (whole % 10));
-        if (!(whole /= 10)) {
-            break;
+    while (e2 < 0 && a < z) {
+        const int shift = MIN(9, -e2);
+        uint32_t carry = 0U;
+        for (int i = a; i < z; i++) {
+            const uint32_t x = buf[i];
+            buf[i] = (x >> shift) + carry;
+            carry = (1000000000U >> shift) * (x & ((1U << shift) - 1U));
         }
-    }
-
-    // pad leading zeros
-    if (!(flags & FLAGS_LEFT) && (flags & FLAGS_ZEROPAD)) {
-        if (width && (negative || (flags & (FLAGS_PLUS | FLAGS_SPACE)))) {
-            width--;
+        if (!buf[a]) {
+            a++;
         }
-        while ((len < width) && (len < PICO_PRINTF_FTOA_BUFFER_SIZE)) {
-            buf[len++] = '0';
+        if (carry) {
+            if ((z == DECIMAL_LIMBS) && (a > 1)) {
+                // move the limbs back to the start of buf
+                for (int i = a; i < z; i++) {
+                    buf[i - a + 1] = buf[i];
+                }
+                r -= a - 1;
+                z -= a - 1;
+                a = 1;
+            }
+            if (z < DECIMAL_LIMBS) {
+                buf[z++] = carry;
+            }
+        }
+        const int b = fixed ? r : a;
+        if (z - b > need) {
+            z = MAX(b + need, a);
         }
+        e2 += shift;
     }
+    d->limbs = buf + a;
+    d->count = z - a;
+    d->limb_exp10 = 9 * (r - 1 - a);
+    _decimal_normalize(d);
+}
 
-    if (len < PICO_PRINTF_FTOA_BUFFER_SIZE) {
-        if (negative) {
-            buf[len++] = '-';
-        } else if (flags & FLAGS_PLUS) {
-            buf[len++] = '+';  // ignore the space if the '+' exists
-        } else if (flags & FLAGS_SPACE) {
-            buf[len++] = ' ';
+// internal rounding of d to keep significant digits; keep may only be negative when rounding to nearest (or down),
+// in which case the value is less than half the unit being rounded to
+static void _decimal_round(_decimal_t *d, int keep, int mode) {
+    if (!d->count) {
+        return;
+    }
+    if (keep < 0) {
+        d->count = 0;
+        _decimal_normalize(d);
+        return;
+    }
+    const int pos = keep + 9 - d->first_digits;
+    const int i = pos / 9;
+    if (i >= d->count) {
+        return;
+    }
+    const uint32_t unit = _pow10[9 - pos % 9];
+    const uint32_t rem = d->limbs[i] % unit;
+    bool tail = false;
+    for (int j = i + 1; j < d->count && !tail; j++) {
+        tail = d->limbs[j] != 0U;
+    }
+    bool up;
+    if (mode == DECIMAL_ROUND_DOWN) {
+        up = false;
+    } else if (mode == DECIMAL_ROUND_UP) {
+        up = rem || tail;
+    } else if ((rem != unit / 2U) || tail) {
+        up = rem >= unit / 2U;
+    } else {
+        // exactly half way, so round to even
+        up = ((unit < 1000000000U) ? d->limbs[i] / unit : (i ? d->limbs[i - 1] : 0U)) & 1U;
+    }
+    d->limbs[i] -= rem;
+    d->count = i + 1;
+    if (up) {
+        d->limbs[i] += unit;
+        for (int j = i; d->limbs[j] >= 1000000000U;) {
+            d->limbs[j] -= 1000000000U;
+            if (j) {
+                d->limbs[--j]++;
+            } else {
+                *--d->limbs = 1U;
+                d->count++;
+                d->limb_exp10 += 9;
+                break;
+            }
         }
     }
-
-    return _out_rev(out, buffer, idx, maxlen, buf, len, width, flags);
+    _decimal_normalize(d);
 }
 
-
-#if PICO_PRINTF_SUPPORT_EXPONENTIAL
-
-// internal ftoa variant for exponential floating-point type, contributed by Martijn Jasperse <m.jasperse@gmail.com>
-static size_t _etoa(out_fct_type out, char *buffer, size_t idx, size_t maxlen, double value, unsigned int prec,
-                    unsigned int width, unsigned int flags) {
-    // check for NaN and special values
-    if (is_nan(value) || (value > DBL_MAX) || (value < -DBL_MAX)) {
-        return _ftoa(out, buffer, idx, maxlen, value, prec, width, flags);
+// internal count of the significant digits of d, excluding trailing zeros
+static int _decimal_digits(const _decimal_t *d) {
+    if (!d->count) {
+        return 0;
     }
-
-    // determine the sign
-    const bool negative = value < 0;
-    if (negative) {
-        value = -value;
+    uint32_t last = d->limbs[d->count - 1];
+    int digits = d->first_digits + 9 * (d->count - 1);
+    while (!(last % 10U)) {
+        last /= 10U;
+        digits--;
     }
+    return digits;
+}
 
-    // default precision
-    if (!(flags & FLAGS_PRECISION)) {
-        prec = PICO_PRINTF_DEFAULT_FLOAT_PRECISION;
+// sequential access to the digits of a decimal, starting with the first
+typedef struct {
+    const _decimal_t *d;
+    int next_limb;
+    unsigned int pos;   // the index of the next digit in digits, or 9 if the next limb is needed
+    char digits[9];     // the digits of the current limb, least significant first
+} _digit_reader_t;
+
+static inline void _digit_reader_init(_digit_reader_t *r, const _decimal_t *d) {
+    r->d = d;
+    r->next_limb = 0;
+    r->pos = 9U;
+}
+
+// \return The next digit, which is '0' beyond the digits held
+static char _next_digit(_digit_reader_t *r) {
+    if (r->pos == 9U) {
+        if (r->next_limb >= r->d->count) {
+            return '0';
+        }
+        _nine_digits_rev(r->digits, r->d->limbs[r->next_limb]);
+        r->pos = r->next_limb ? 0U : 9U - (unsigned int) r->d->first_digits;
+        r->next_limb++;
     }
+    return r->digits[8U - r->pos++];
+}
 
-    // determine the decimal exponent
-    // based on the algorithm by David Gay (https://www.ampl.com/netlib/fp/dtoa.c)
+// internal ftoa, for fixed (%f), exponential (%e, with FLAGS_EXPONENT) and general (%g, with FLAGS_ADAPT_EXP) formats
+static size_t _ftoa(out_fct_type out, char *buffer, size_t idx, size_t maxlen, double value, unsigned int prec,
+                    unsigned int width, unsigned int flags) {
     union {
         uint64_t U;
         double F;
     } conv;
 
     conv.F = value;
-    int expval;
-    if (conv.U) {
-        int exp2 = (int) ((conv.U >> 52U) & 0x07FFU) - 1023;           // effectively log2
-        conv.U = (conv.U & ((1ULL << 52U) - 1U)) | (1023ULL << 52U);  // drop the exponent so conv.F is now in [1,2)
-        // now approximate log10 from the log2 integer part and an expansion of ln around 1.5
-        expval = (int) (0.1760912590558 + exp2 * 0.301029995663981 + (conv.F - 1.5) * 0.289529654602168);
-        // now we want to compute 10^expval but we want to be sure it won't overflow
-        exp2 = (int) (expval * 3.321928094887362 + 0.5);
-        const double z = expval * 2.302585092994046 - exp2 * 0.6931471805599453;
-        const double z2 = z * z;
-        conv.U = (uint64_t) (exp2 + 1023) << 52U;
-        // compute exp(z) using continued fractions, see https://en.wikipedia.org/wiki/Exponential_function#Continued_fractions_for_ex
-        conv.F *= 1 + 2 * z / (2 - z + (z2 / (6 + (z2 / (10 + z2 / 14)))));
-        // correct for rounding errors
-        if (value < conv.F) {
-            expval--;
-            conv.F /= 10;
-        }
+    const unsigned int biased_exp = (unsigned int) (conv.U >> 52U) & 0x7ffU;
+    uint64_t m = conv.U & ((1ULL << 52U) - 1U);
+    const char sign = (conv.U >> 63U) ? '-' : ((flags & FLAGS_PLUS) ? '+' : ((flags & FLAGS_SPACE) ? ' ' : 0));
+    size_t len = sign ? 1U : 0U;
+
+    const char *special = NULL;
+    bool exponential = PICO_PRINTF_SUPPORT_EXPONENTIAL && (flags & FLAGS_EXPONENT);
+    unsigned int frac_digits = 0U;
+    bool point = false;
+    uint32_t limbs[DECIMAL_LIMBS];
+    _decimal_t d;
+
+    if (biased_exp == 0x7ffU) {
+        // inf and nan are only padded with spaces
+        special = m ? ((flags & FLAGS_UPPERCASE) ? "NAN" : "nan") : ((flags & FLAGS_UPPERCASE) ? "INF" : "inf");
+        flags &= ~FLAGS_ZEROPAD;
+        len += 3U;
     } else {
-        expval = 0;
+        const int e2 = biased_exp ? (int) biased_exp - 1075 : -1074;
+        if (biased_exp) {
+            m |= 1ULL << 52U;
+        }
+
+        // set default precision, if not set explicitly
+        if (!(flags & FLAGS_PRECISION)) {
+            prec = PICO_PRINTF_DEFAULT_FLOAT_PRECISION;
+        }
+        const bool adapt = PICO_PRINTF_SUPPORT_EXPONENTIAL && (flags & FLAGS_ADAPT_EXP);
+        if (adapt && !prec) {
+            prec = 1U;
+        }
+        // digits beyond those held are zero anyway
+        const int p = (int) MIN(prec, 9U * DECIMAL_LIMBS);
+        _decimal_from_binary(&d, limbs, m, e2, 1 + (p + DECIMAL_GUARD_DIGITS) / 9, !(exponential || adapt));
+
+        frac_digits = prec;
+        if (exponential) {
+            _decimal_round(&d, p + 1, DECIMAL_ROUND_NEAREST);
+        } else if (adapt) {
+            // in "%g" mode, "prec" is the number of *significant figures*, and "%e" style is used only for large or
+            // small exponents
+            _decimal_round(&d, p, DECIMAL_ROUND_NEAREST);
+            exponential = (d.exp10 < -4) || (d.exp10 >= p);
+            frac_digits = (unsigned int) (exponential ? p - 1 : p - 1 - d.exp10);
+            if (!(flags & FLAGS_HASH)) {
+                // trailing zeros are removed
+                const int needed = _decimal_digits(&d) - 1 - (exponential ? 0 : d.exp10);
+                frac_digits = MIN(frac_digits, (unsigned int) MAX(needed, 0));
+            }
+        } else {
+            _decimal_round(&d, d.exp10 + 1 + p, DECIMAL_ROUND_NEAREST);
+        }
+
+        point = frac_digits || (flags & FLAGS_HASH);
+        len += point ? 1U + frac_digits : 0U;
+        if (exponential) {
+            len += ((d.exp10 <= -100) || (d.exp10 >= 100)) ? 6U : 5U;
+        } else {
+            len += (d.count && (d.exp10 > 0)) ? (unsigned int) d.exp10 + 1U : 1U;
+        }
     }
 
-    // the exponent format is "%+03d" and largest value is "307", so set aside 4-5 characters
-    unsigned int minwidth = ((expval < 100) && (expval > -100)) ? 4U : 5U;
+    const size_t start_idx = idx;
 
-    // in "%g" mode, "prec" is the number of *significant figures* not decimals
-    if (flags & FLAGS_ADAPT_EXP) {
-        // do we want to fall-back to "%f" mode?
-        if ((conv.U == 0) || ((value >= 1e-4) && (value < 1e6))) {
-            if ((int) prec > expval) {
-                prec = (unsigned) ((int) prec - expval - 1);
-            } else {
-                prec = 0;
+    // pad spaces or zeros up to given width
+    if (!(flags & FLAGS_LEFT) && !(flags & FLAGS_ZEROPAD)) {
+        for (size_t i = len; i < width; i++) {
+            out(' ', buffer, idx++, maxlen);
+        }
+    }
+    if (sign) {
+        out(sign, buffer, idx++, maxlen);
+    }
+    if (!(flags & FLAGS_LEFT) && (flags & FLAGS_ZEROPAD)) {
+        for (size_t i = len; i < width; i++) {
+            out('0', buffer, idx++, maxlen);
+        }
+    }
+
+    if (special) {
+        while (*special) {
+            out(*special++, buffer, idx++, maxlen);
+        }
+    } else {
+        _digit_reader_t digits;
+        _digit_reader_init(&digits, &d);
+        if (exponential) {
+            out(_next_digit(&digits), buffer, idx++, maxlen);
+            if (point) {
+                out('.', buffer, idx++, maxlen);
+            }
+            for (unsigned int i = 0U; i < frac_digits; i++) {
+                out(_next_digit(&digits), buffer, idx++, maxlen);
             }
-            flags |= FLAGS_PRECISION;   // make sure _ftoa respects precision
-            // no characters in exponent
-            minwidth = 0U;
-            expval = 0;
+            // the exponent format is "%+03d"
+            out((flags & FLAGS_UPPERCASE) ? 'E' : 'e', buffer, idx++, maxlen);
+            out(d.exp10 < 0 ? '-' : '+', buffer, idx++, maxlen);
+            unsigned int exp10 = (unsigned int) (d.exp10 < 0 ? -d.exp10 : d.exp10);
+            if (exp10 >= 100U) {
+                out((char) ('0' + exp10 / 100U), buffer, idx++, maxlen);
+                exp10 %= 100U;
+            }
+            out(_digit_pairs[exp10 * 2U], buffer, idx++, maxlen);
+            out(_digit_pairs[exp10 * 2U + 1U], buffer, idx++, maxlen);
         } else {
-            // we use one sigfig for the whole part
-            if ((prec > 0) && (flags & FLAGS_PRECISION)) {
-                --prec;
+            if (d.count && (d.exp10 >= 0)) {
+                for (int i = 0; i <= d.exp10; i++) {
+                    out(_next_digit(&digits), buffer, idx++, maxlen);
+                }
+            } else {
+                out('0', buffer, idx++, maxlen);
+            }
+            if (point) {
+                out('.', buffer, idx++, maxlen);
+            }
+            for (unsigned int i = 0U; i < frac_digits; i++) {
+                // values less than 1 start with exp10 - 1 zeros after the point
+                out(((int) i < -d.exp10 - 1) ? '0' : _next_digit(&digits), buffer, idx++, maxlen);
             }
         }
     }
 
-    // will everything fit?
-    unsigned int fwidth = width;
-    if (width > minwidth) {
-        // we didn't fall-back so subtract the characters required for the exponent
-        fwidth -= minwidth;
-    } else {
-        // not enough characters, so go back to default sizing
-        fwidth = 0U;
+    // append pad spaces up to given width
+    if (flags & FLAGS_LEFT) {
+        while (idx - start_idx < width) {
+            out(' ', buffer, idx++, maxlen);
+        }
     }
-    if ((flags & FLAGS_LEFT) && minwidth) {
-        // if we're padding on the right, DON'T pad the floating part
-        fwidth = 0U;
+    return idx;
+}
+
+// internal comparison of two decimals
+// \return A negative, zero or positive value as x is less than, equal to or greater than y
+static int _decimal_compare(const _decimal_t *x, const _decimal_t *y) {
+    if (!x->count || !y->count) {
+        return (x->count > 0) - (y->count > 0);
+    }
+    // limbs are aligned on exponents which are multiples of 9, and the first limb is never zero
+    if (x->limb_exp10 != y->limb_exp10) {
+        return x->limb_exp10 < y->limb_exp10 ? -1 : 1;
+    }
+    for (int i = 0; i < MAX(x->count, y->count); i++) {
+        const uint32_t x_limb = i < x->count ? x->limbs[i] : 0U;
+        const uint32_t y_limb = i < y->count ? y->limbs[i] : 0U;
+        if (x_limb != y_limb) {
+            return x_limb < y_limb ? -1 : 1;
+        }
     }
+    return 0;
+}
 
-    // rescale the float value
-    if (expval) {
-        value /= conv.F;
+// internal copy of enough of src to round it to keep significant digits, to buf (of 6 limbs) for keep <= 18
+static void _decimal_copy(_decimal_t *dst, uint32_t *buf, const _decimal_t *src, int keep) {
+    const int count = MIN(src->count, (keep + 9 - src->first_digits) / 9 + 2);
+    for (int i = 0; i < count; i++) {
+        buf[1 + i] = src->limbs[i];
+    }
+    // any non zero digits not copied only matter for rounding, so are replaced by a single digit just after those kept
+    for (int i = count; i < src->count; i++) {
+        if (src->limbs[i]) {
+            buf[count] |= 1U;
+            break;
+        }
     }
+    *dst = *src;
+    dst->limbs = buf + 1;
+    dst->count = count;
+}
 
-    // output the floating part
-    const size_t start_idx = idx;
-    idx = _ftoa(out, buffer, idx, maxlen, negative ? -value : value, prec, fwidth, flags & ~FLAGS_ADAPT_EXP);
+// internal rounding of value to digits significant digits, to the nearest value, or failing that in the other
+// direction, such that the result lies within the interval from low to high
+// \return true if such a value was found
+static bool _shortest_candidate(_decimal_t *result, uint32_t *buf, const _decimal_t *value, const _decimal_t *low,
+                                const _decimal_t *high, bool inclusive, int digits) {
+    int mode = DECIMAL_ROUND_NEAREST;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        _decimal_copy(result, buf, value, digits);
+        _decimal_round(result, digits, mode);
+        const int low_cmp = _decimal_compare(result, low);
+        const int high_cmp = _decimal_compare(result, high);
+        if (((low_cmp > 0) || (inclusive && !low_cmp)) && ((high_cmp < 0) || (inclusive && !high_cmp))) {
+            return true;
+        }
+        mode = low_cmp <= 0 ? DECIMAL_ROUND_UP : DECIMAL_ROUND_DOWN;
+    }
+    return false;
+}
 
-    // output the exponent part
-    if (minwidth) {
-        // output the exponential symbol
-        out((flags & FLAGS_UPPERCASE) ? 'E' : 'e', buffer, idx++, maxlen);
-        // output the exponent value
-        idx = _ntoa_long(out, buffer, idx, maxlen, (uint)((expval < 0) ? -expval : expval), expval < 0, 10, 0, minwidth - 1,
-                         FLAGS_ZEROPAD | FLAGS_PLUS);
-        // might need to right-pad spaces
-        if (flags & FLAGS_LEFT) {
-            while (idx - start_idx < width) out(' ', buffer, idx++, maxlen);
+// internal shortest round trip conversion of the floating point value with the given bits, which has mant_bits
+// explicit mantissa bits and exp_bits exponent bits, and is always exactly represented by max_digits digits
+static int _ftoa_shortest(char *buf, size_t size, uint64_t bits, unsigned int mant_bits, unsigned int exp_bits,
+                          int max_digits) {
+    char str[32];
+    int len = 0;
+    const unsigned int exp_max = (1U << exp_bits) - 1U;
+    const unsigned int biased_exp = (unsigned int) (bits >> mant_bits) & exp_max;
+    uint64_t m = bits & ((1ULL << mant_bits) - 1U);
+
+    if ((bits >> (mant_bits + exp_bits)) & 1U) {
+        str[len++] = '-';
+    }
+    if (biased_exp == exp_max) {
+        for (const char *s = m ? "nan" : "inf"; *s; s++) {
+            str[len++] = *s;
+        }
+    } else if (!biased_exp && !m) {
+        str[len++] = '0';
+    } else {
+        // the value is m * 2^e2 * 4, and values up to half way to the next (or previous) value convert to it; the
+        // previous value is closer for powers of 2 (other than the smallest normal value)
+        const int e2 = (biased_exp ? (int) biased_exp : 1) - (int) (exp_max >> 1U) - (int) mant_bits - 2;
+        const bool closer_below = !m && (biased_exp > 1U);
+        if (biased_exp) {
+            m |= 1ULL << mant_bits;
+        }
+        // a value exactly half way converts to the one with an even mantissa
+        const bool inclusive = !(m & 1U);
+
+        uint32_t value_limbs[DECIMAL_LIMBS], low_limbs[DECIMAL_LIMBS], high_limbs[DECIMAL_LIMBS];
+        _decimal_t value, low, high;
+        const int need = 1 + (max_digits + DECIMAL_GUARD_DIGITS) / 9;
+        _decimal_from_binary(&value, value_limbs, m << 2U, e2, need, false);
+        _decimal_from_binary(&low, low_limbs, (m << 2U) - (closer_below ? 1U : 2U), e2, need, false);
+        _decimal_from_binary(&high, high_limbs, (m << 2U) + 2U, e2, need, false);
+
+        // find the fewest significant digits for which there is a value within the interval, noting that if there
+        // is one for some number of digits, there is one for any more digits
+        uint32_t result_limbs[6];
+        _decimal_t result;
+        int min_digits = 1;
+        int digits = max_digits;
+        while (min_digits < digits) {
+            const int mid = (min_digits + digits) / 2;
+            if (_shortest_candidate(&result, result_limbs, &value, &low, &high, inclusive, mid)) {
+                digits = mid;
+            } else {
+                min_digits = mid + 1;
+            }
+        }
+        _shortest_candidate(&result, result_limbs, &value, &low, &high, inclusive, digits);
+        digits = _decimal_digits(&result);
+
+        // lay out as by "%g" with a precision of max_digits
+        _digit_reader_t reader;
+        _digit_reader_init(&reader, &result);
+        int exp10 = result.exp10;
+        if ((exp10 < -4) || (exp10 >= max_digits)) {
+            str[len++] = _next_digit(&reader);
+            if (digits > 1) {
+                str[len++] = '.';
+                for (int i = 1; i < digits; i++) {
+                    str[len++] = _next_digit(&reader);
+                }
+            }
+            str[len++] = 'e';
+            str[len++] = exp10 < 0 ? '-' : '+';
+            if (exp10 < 0) {
+                exp10 = -exp10;
+            }
+            if (exp10 >= 100) {
+                str[len++] = (char) ('0' + exp10 / 100);
+                exp10 %= 100;
+            }
+            str[len++] = _digit_pairs[exp10 * 2];
+            str[len++] = _digit_pairs[exp10 * 2 + 1];
+        } else if (exp10 < 0) {
+            str[len++] = '0';
+            str[len++] = '.';
+            for (int i = -1; i > exp10; i--) {
+                str[len++] = '0';
+            }
+            for (int i = 0; i < digits; i++) {
+                str[len++] = _next_digit(&reader);
+            }
+        } else {
+            for (int i = 0; i <= exp10; i++) {
+                str[len++] = _next_digit(&reader);
+            }
+            if (digits > exp10 + 1) {
+                str[len++] = '.';
+                for (int i = exp10 + 1; i < digits; i++) {
+                    str[len++] = _next_digit(&reader);
+                }
+            }
         }
     }
-    return idx;
+
+    if (size) {
+        const size_t n = MIN((size_t) len, size - 1U);
+        for (size_t i = 0U; i < n; i++) {
+            buf[i] = str[i];
+        }
+        buf[n] = 0;
+    }
+    return len;
 }
 
-#endif  // PICO_PRINTF_SUPPORT_EXPONENTIAL
 #endif  // PICO_PRINTF_SUPPORT_FLOAT
 
 // internal vsnprintf
@@ -725,18 +1097,18 @@ static int _vsnprintf(out_fct_type out, char *buffer, const size_t maxlen, const
 #if PICO_PRINTF_SUPPORT_LONG_LONG
                         const long long value = va_arg(va, long long);
                         idx = _ntoa_long_long(out, buffer, idx, maxlen,
-                                              (unsigned long long) (value > 0 ? value : 0 - value), value < 0, base,
+                                              value > 0 ? (unsigned long long) value : 0U - (unsigned long long) value, value < 0, base,
                                               precision, width, flags);
 #endif
                     } else if (flags & FLAGS_LONG) {
                         const long value = va_arg(va, long);
-                        idx = _ntoa_long(out, buffer, idx, maxlen, (unsigned long) (value > 0 ? value : 0 - value),
+                        idx = _ntoa_long(out, buffer, idx, maxlen, value > 0 ? (unsigned long) value : 0U - (unsigned long) value,
                                          value < 0, base, precision, width, flags);
                     } else {
                         const int value = (flags & FLAGS_CHAR) ? (char) va_arg(va, int) : (flags & FLAGS_SHORT)
                                                                                           ? (short int) va_arg(va, int)
                                                                                           : va_arg(va, int);
-                        idx = _ntoa_long(out, buffer, idx, maxlen, (unsigned int) (value > 0 ? value : 0 - value),
+                        idx = _ntoa_long(out, buffer, idx, maxlen, value > 0 ? (unsigned int) value : 0U - (unsigned int) value,
                                          value < 0, base, precision, width, flags);
                     }
                 } else {
@@ -778,8 +1150,9 @@ static int _vsnprintf(out_fct_type out, char *buffer, const size_t maxlen, const
             case 'G':
 #if PICO_PRINTF_SUPPORT_FLOAT && PICO_PRINTF_SUPPORT_EXPONENTIAL
                 if ((*format == 'g') || (*format == 'G')) flags |= FLAGS_ADAPT_EXP;
+                else flags |= FLAGS_EXPONENT;
                 if ((*format == 'E') || (*format == 'G')) flags |= FLAGS_UPPERCASE;
-                idx = _etoa(out, buffer, idx, maxlen, va_arg(va, double), precision, width, flags);
+                idx = _ftoa(out, buffer, idx, maxlen, va_arg(va, double), precision, width, flags);
 #else
                 for(int i=0;i<2;i++) out('?', buffer, idx++, maxlen);
                 va_arg(va, double);
@@ -898,6 +1271,26 @@ int vfctprintf(void (*out)(char character, void *arg), void *arg, const char *fo
     return _vsnprintf(_out_fct, (char *) (uintptr_t) &out_fct_wrap, (size_t) -1, format, va);
 }
 
+#if PICO_PRINTF_SUPPORT_FLOAT
+int pico_dtoa_shortest(char *buf, size_t size, double value) {
+    union {
+        uint64_t U;
+        double F;
+    } conv;
+    conv.F = value;
+    return _ftoa_shortest(buf, size, conv.U, 52U, 11U, 17);
+}
+
+int pico_ftoa_shortest(char *buf, size_t size, float value) {
+    union {
+        uint32_t U;
+        float F;
+    } conv;
+    conv.F = value;
+    return _ftoa_shortest(buf, size, conv.U, 23U, 8U, 9);
+}
+#endif
+
 #if LIB_PICO_PRINTF_PICO
 #if !PICO_PRINTF_ALWAYS_INCLUDED
 /**
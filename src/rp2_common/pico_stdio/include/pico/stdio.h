@@ -46,6 +46,21 @@
 #define PICO_STDIO_SHORT_CIRCUIT_CLIB_FUNCS 1
 #endif
 
+// PICO_CONFIG: PICO_STDIO_BUFFERED, Enable/disable support for buffered output, where each driver's output is queued in a ring buffer and sent from the background, type=bool, default=0, group=pico_stdio
+#ifndef PICO_STDIO_BUFFERED
+#define PICO_STDIO_BUFFERED 0
+#endif
+
+// PICO_CONFIG: PICO_STDIO_BUFFER_SIZE, Size of the output buffer given to each of stdio_uart and stdio_usb during their initialization if PICO_STDIO_BUFFERED is set; a power of 2, or 0 for none, type=int, min=0, default=1024, depends=PICO_STDIO_BUFFERED, group=pico_stdio
+#ifndef PICO_STDIO_BUFFER_SIZE
+#define PICO_STDIO_BUFFER_SIZE 1024
+#endif
+
+// PICO_CONFIG: PICO_STDIO_BUFFER_OVERFLOW, What to do with output which does not fit in the output buffers given to stdio_uart and stdio_usb during their initialization, type=enum, default=STDIO_BUFFER_OVERFLOW_BLOCK, depends=PICO_STDIO_BUFFERED, group=pico_stdio
+#ifndef PICO_STDIO_BUFFER_OVERFLOW
+#define PICO_STDIO_BUFFER_OVERFLOW STDIO_BUFFER_OVERFLOW_BLOCK
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -54,6 +69,16 @@ extern "C" {
 
 typedef struct stdio_driver stdio_driver_t;
 
+/*! \brief A run of characters, one of a sequence passed to a vectored output function
+ *  \ingroup pico_stdio
+ *
+ * This has the same layout as the POSIX `struct iovec`
+ */
+typedef struct stdio_iovec {
+    const void *iov_base;
+    size_t iov_len;
+} stdio_iovec_t;
+
 /*! \brief Initialize all of the present standard stdio types that are linked into the binary.
  * \ingroup pico_stdio
  *
@@ -80,9 +105,55 @@ bool stdio_deinit_all(void);
 
 /*! \brief Flushes any buffered output.
  * \ingroup pico_stdio
+ *
+ * If any drivers have output buffers (see \ref stdio_set_driver_buffer), this waits for up to
+ * PICO_STDIO_DEADLOCK_TIMEOUT_MS for them to be emptied.
  */
 void stdio_flush(void);
 
+#if PICO_STDIO_BUFFERED
+/*! \brief Action taken when output does not fit in a driver's output buffer
+ * \ingroup pico_stdio
+ */
+enum stdio_buffer_overflow {
+    STDIO_BUFFER_OVERFLOW_BLOCK = 0,   ///< Wait for space in the buffer; output is dropped if there is still no space after PICO_STDIO_DEADLOCK_TIMEOUT_MS
+    STDIO_BUFFER_OVERFLOW_DROP,        ///< Drop the output which does not fit
+    STDIO_BUFFER_OVERFLOW_OVERWRITE,   ///< Discard the oldest output in the buffer to make room
+};
+
+/*! \brief Queue a driver's output in a ring buffer, from which the driver sends it in the background
+ * \ingroup pico_stdio
+ *
+ * The output is then sent from an IRQ handler (such as the UART TX interrupt, or the USB background task), so
+ * the time taken by printf no longer depends on the speed of the driver. Only drivers which can send their output
+ * in the background (i.e. which provide an \c out_kick function) support this; \ref stdio_uart and \ref stdio_usb
+ * do. If PICO_STDIO_BUFFER_SIZE is non zero, they are given buffers of that size when they are initialized.
+ *
+ * \param driver the driver
+ * \param buf the buffer, or NULL to send output directly again (any output in the previous buffer is sent first)
+ * \param size the size of the buffer in bytes, which must be a power of 2
+ * \param overflow what to do with output which does not fit in the buffer
+ * \return true if successful, or false if the driver does not support buffered output
+ */
+bool stdio_set_driver_buffer(stdio_driver_t *driver, char *buf, uint size, enum stdio_buffer_overflow overflow);
+
+/*! \brief Flushes any buffered output, waiting until a timeout for the driver output buffers to be emptied
+ * \ingroup pico_stdio
+ *
+ * \param until the time after which to give up waiting
+ * \return true if all the output was sent, false if the timeout was reached
+ */
+bool stdio_flush_until(absolute_time_t until);
+
+/*! \brief Return the number of characters of output so far dropped or overwritten because a driver's output buffer
+ * was full
+ * \ingroup pico_stdio
+ *
+ * \param driver the driver
+ */
+uint32_t stdio_get_dropped_count(stdio_driver_t *driver);
+#endif
+
 /*! \brief Return a character from stdin if there is one available within a timeout
  * \ingroup pico_stdio
  *
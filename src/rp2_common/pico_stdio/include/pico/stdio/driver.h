@@ -9,6 +9,18 @@
 
 #include "pico/stdio.h"
 
+#if PICO_STDIO_BUFFERED
+// output queued for a driver by stdio_set_driver_buffer
+typedef struct stdio_buffer {
+    char *chars;
+    uint size;                  // 0 if output is not buffered
+    volatile uint32_t head;     // number of characters ever added
+    volatile uint32_t tail;     // number of characters ever removed
+    uint32_t dropped;
+    enum stdio_buffer_overflow overflow;
+} stdio_buffer_t;
+#endif
+
 struct stdio_driver {
     void (*out_chars)(const char *buf, int len);
     void (*out_flush)(void);
@@ -18,7 +30,32 @@ struct stdio_driver {
 #if PICO_STDIO_ENABLE_CRLF_SUPPORT
     bool last_ended_with_cr;
     bool crlf_enabled;
+#endif
+    // optional; if present, called instead of out_chars with all the segments of one piece of output (after any CR/LF translation)
+    void (*out_chars_v)(const stdio_iovec_t *iov, int iovcnt);
+    // if true, out_flush is only called by stdio_flush, not after each write, leaving the driver to send partial
+    // output in its own time
+    bool out_flush_explicit_only;
+#if PICO_STDIO_BUFFERED
+    // called (from any core, possibly from an IRQ handler) after output is added to out_buffer; the driver must then
+    // remove and send it from the background via stdio_buffer_take
+    void (*out_kick)(void);
+    stdio_buffer_t out_buffer;
 #endif
 };
 
+#if PICO_STDIO_BUFFERED
+/*! \brief Remove characters from a driver's output buffer, for the driver to send
+ *  \ingroup pico_stdio
+ *
+ * This may be called from any core, and from IRQ handlers.
+ *
+ * \param driver the driver
+ * \param buf the buffer to copy the characters to
+ * \param len the maximum number of characters to remove
+ * \return the number of characters removed, which is 0 if the output buffer is empty
+ */
+int stdio_buffer_take(stdio_driver_t *driver, char *buf, int len);
+#endif
+
 #endif
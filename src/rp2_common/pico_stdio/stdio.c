@@ -18,6 +18,9 @@
 #if PICO_STDOUT_MUTEX
 #include "pico/mutex.h"
 #endif
+#if PICO_STDIO_BUFFERED
+#include "pico/critical_section.h"
+#endif
 
 #if LIB_PICO_STDIO_UART
 #include "pico/stdio_uart.h"
@@ -56,36 +59,235 @@ static bool stdout_serialize_begin(void) {
 static void stdout_serialize_end(void) {
 }
 #endif
-static void stdio_out_chars_no_crlf(stdio_driver_t *driver, const char *s, int len) {
-    driver->out_chars(s, len);
+#if PICO_STDIO_BUFFERED
+// protects all the driver output buffers
+static critical_section_t buffer_crit;
+
+// internal addition of output to a driver's buffer
+static void stdio_buffer_put(stdio_driver_t *driver, const char *s, int len) {
+    stdio_buffer_t *buffer = &driver->out_buffer;
+    absolute_time_t until = nil_time;
+    while (len > 0) {
+        critical_section_enter_blocking(&buffer_crit);
+        uint used = buffer->head - buffer->tail;
+        uint space = buffer->size - used;
+        if ((uint)len > space && buffer->overflow == STDIO_BUFFER_OVERFLOW_OVERWRITE) {
+            // discard the oldest output, which may include the start of s
+            uint discard = MIN((uint)len - space, used);
+            buffer->tail += discard;
+            space += discard;
+            if ((uint)len > space) {
+                discard += (uint)len - space;
+                s += (uint)len - space;
+                len = (int)space;
+            }
+            buffer->dropped += discard;
+        }
+        uint n = MIN((uint)len, space);
+        uint pos = buffer->head & (buffer->size - 1);
+        uint first = MIN(n, buffer->size - pos);
+        memcpy(buffer->chars + pos, s, first);
+        memcpy(buffer->chars, s + first, n - first);
+        buffer->head += n;
+        if (n < (uint)len && buffer->overflow == STDIO_BUFFER_OVERFLOW_DROP) {
+            buffer->dropped += (uint)len - n;
+            len = (int)n;
+        }
+        critical_section_exit(&buffer_crit);
+        s += n;
+        len -= (int)n;
+        if (n) {
+            driver->out_kick();
+            until = nil_time;
+        } else {
+            // the buffer is full, so wait for the driver to send some output
+            if (is_nil_time(until)) {
+                until = make_timeout_time_ms(PICO_STDIO_DEADLOCK_TIMEOUT_MS);
+            } else if (time_reached(until)) {
+                // we are likely blocking the driver (e.g. by printing from a higher priority IRQ)
+                critical_section_enter_blocking(&buffer_crit);
+                buffer->dropped += (uint)len;
+                critical_section_exit(&buffer_crit);
+                return;
+            }
+            tight_loop_contents();
+        }
+    }
 }
 
-static void stdio_out_chars_crlf(stdio_driver_t *driver, const char *s, int len) {
-#if PICO_STDIO_ENABLE_CRLF_SUPPORT
-    if (!driver->crlf_enabled) {
-        driver->out_chars(s, len);
+int stdio_buffer_take(stdio_driver_t *driver, char *buf, int len) {
+    stdio_buffer_t *buffer = &driver->out_buffer;
+    critical_section_enter_blocking(&buffer_crit);
+    uint n = MIN((uint)len, buffer->head - buffer->tail);
+    if (n) {
+        uint pos = buffer->tail & (buffer->size - 1);
+        uint first = MIN(n, buffer->size - pos);
+        memcpy(buf, buffer->chars + pos, first);
+        memcpy(buf + first, buffer->chars, n - first);
+        buffer->tail += n;
+    }
+    critical_section_exit(&buffer_crit);
+    return (int)n;
+}
+
+static bool stdio_buffer_wait_empty(stdio_driver_t *driver, absolute_time_t until) {
+    while (driver->out_buffer.head != driver->out_buffer.tail) {
+        if (time_reached(until)) return false;
+        tight_loop_contents();
+    }
+    return true;
+}
+
+bool stdio_set_driver_buffer(stdio_driver_t *driver, char *buf, uint size, enum stdio_buffer_overflow overflow) {
+    if (!driver->out_kick) return false;
+    // the size must be a power of 2
+    assert(!buf || (size && !(size & (size - 1))));
+    if (!critical_section_is_initialized(&buffer_crit)) critical_section_init(&buffer_crit);
+    if (driver->out_buffer.size) {
+        stdio_buffer_wait_empty(driver, make_timeout_time_ms(PICO_STDIO_DEADLOCK_TIMEOUT_MS));
+    }
+    critical_section_enter_blocking(&buffer_crit);
+    driver->out_buffer.chars = buf;
+    driver->out_buffer.size = buf ? size : 0;
+    driver->out_buffer.tail = driver->out_buffer.head;
+    driver->out_buffer.overflow = overflow;
+    critical_section_exit(&buffer_crit);
+    return true;
+}
+
+uint32_t stdio_get_dropped_count(stdio_driver_t *driver) {
+    return driver->out_buffer.dropped;
+}
+#endif
+
+// internal output of a list of segments to a single driver, via its buffer if it has one
+static void stdio_out_chars_v(stdio_driver_t *driver, const stdio_iovec_t *iov, int iovcnt) {
+#if PICO_STDIO_BUFFERED
+    if (driver->out_buffer.size) {
+        for (int i = 0; i < iovcnt; i++) {
+            stdio_buffer_put(driver, (const char *)iov[i].iov_base, (int)iov[i].iov_len);
+        }
         return;
     }
-    int first_of_chunk = 0;
-    static const char crlf_str[] = {'\r', '\n'};
-    for (int i = 0; i < len; i++) {
-        bool prev_char_was_cr = i > 0 ? s[i - 1] == '\r' : driver->last_ended_with_cr;
-        if (s[i] == '\n' && !prev_char_was_cr) {
-            if (i > first_of_chunk) {
-                driver->out_chars(&s[first_of_chunk], i - first_of_chunk);
-            }
-            driver->out_chars(crlf_str, 2);
-            first_of_chunk = i + 1;
+#endif
+    if (driver->out_chars_v) {
+        driver->out_chars_v(iov, iovcnt);
+    } else {
+        for (int i = 0; i < iovcnt; i++) {
+            driver->out_chars((const char *)iov[i].iov_base, (int)iov[i].iov_len);
+        }
+    }
+}
+
+static inline bool stdio_driver_translates_crlf(__unused stdio_driver_t *driver, __unused bool cr_translation) {
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    return cr_translation && driver->crlf_enabled;
+#else
+    return false;
+#endif
+}
+
+static const char crlf_str[] = {'\r', '\n'};
+
+// output is split into segments once, and the same segments are then passed to every driver
+#define STDIO_SEGMENTS_MAX 16
+typedef struct stdio_segments {
+    stdio_iovec_t iov[STDIO_SEGMENTS_MAX];
+    int count;
+    bool cr_translation;
+    bool translated;            // these segments are for the drivers which translate LF to CRLF
+    bool starts_with_crlf;      // the first segment is the translation of an LF at the very start of the output
+} stdio_segments_t;
+
+static void stdio_segments_send(stdio_segments_t *segs) {
+    if (!segs->count) return;
+    for (stdio_driver_t *driver = drivers; driver; driver = driver->next) {
+        if (!driver->out_chars) continue;
+        if (filter && filter != driver) continue;
+        if (stdio_driver_translates_crlf(driver, segs->cr_translation) != segs->translated) continue;
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+        if (segs->starts_with_crlf && driver->last_ended_with_cr) {
+            // the CR was already sent at the end of this driver's previous output
+            stdio_iovec_t first = segs->iov[0];
+            segs->iov[0].iov_base = crlf_str + 1;
+            segs->iov[0].iov_len = 1;
+            stdio_out_chars_v(driver, segs->iov, segs->count);
+            segs->iov[0] = first;
+            continue;
+        }
+#endif
+        stdio_out_chars_v(driver, segs->iov, segs->count);
+    }
+    segs->count = 0;
+    segs->starts_with_crlf = false;
+}
+
+static void stdio_segments_add(stdio_segments_t *segs, const char *s, size_t len) {
+    if (!len) return;
+    if (segs->count == STDIO_SEGMENTS_MAX) stdio_segments_send(segs);
+    segs->iov[segs->count].iov_base = s;
+    segs->iov[segs->count].iov_len = len;
+    segs->count++;
+}
+
+// internal output of a string (and optional newline) to all drivers
+static void stdio_out_string(const char *s, int len, bool newline, bool cr_translation) {
+    bool any_translated = false;
+    bool any_untranslated = false;
+    for (stdio_driver_t *driver = drivers; driver; driver = driver->next) {
+        if (!driver->out_chars) continue;
+        if (filter && filter != driver) continue;
+        if (stdio_driver_translates_crlf(driver, cr_translation)) {
+            any_translated = true;
+        } else {
+            any_untranslated = true;
         }
     }
-    if (first_of_chunk < len) {
-        driver->out_chars(&s[first_of_chunk], len - first_of_chunk);
+    stdio_segments_t segs;
+    segs.count = 0;
+    segs.cr_translation = cr_translation;
+    segs.starts_with_crlf = false;
+    if (any_untranslated) {
+        segs.translated = false;
+        stdio_segments_add(&segs, s, (size_t)len);
+        if (newline) stdio_segments_add(&segs, crlf_str + 1, 1);
+        stdio_segments_send(&segs);
     }
-    if (len > 0) {
-        driver->last_ended_with_cr = s[len - 1] == '\r';
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    if (any_translated) {
+        segs.translated = true;
+        const char *chunk = s;
+        const char *end = s + len;
+        const char *lf;
+        // each LF which does not follow a CR is replaced by CRLF
+        for (const char *p = s; p < end && (lf = memchr(p, '\n', (size_t)(end - p))); p = lf + 1) {
+            if (lf > s && lf[-1] == '\r') continue;
+            stdio_segments_add(&segs, chunk, (size_t)(lf - chunk));
+            stdio_segments_add(&segs, crlf_str, 2);
+            if (lf == s) segs.starts_with_crlf = true;
+            chunk = lf + 1;
+        }
+        stdio_segments_add(&segs, chunk, (size_t)(end - chunk));
+        if (newline) {
+            if (len && s[len - 1] == '\r') {
+                stdio_segments_add(&segs, crlf_str + 1, 1);
+            } else {
+                stdio_segments_add(&segs, crlf_str, 2);
+                if (!len) segs.starts_with_crlf = true;
+            }
+        }
+        stdio_segments_send(&segs);
+        if (len || newline) {
+            bool ends_with_cr = !newline && s[len - 1] == '\r';
+            for (stdio_driver_t *driver = drivers; driver; driver = driver->next) {
+                if (!driver->out_chars) continue;
+                if (filter && filter != driver) continue;
+                if (driver->crlf_enabled) driver->last_ended_with_cr = ends_with_cr;
+            }
+        }
     }
 #else
-    driver->out_chars(s, len);
+    ((void)any_translated);
 #endif
 }
 
@@ -97,16 +299,7 @@ int stdio_put_string(const char *s, int len, bool newline, bool cr_translation)
 #endif
     }
     if (len == -1) len = (int)strlen(s);
-    void (*out_func)(stdio_driver_t *, const char *, int) = cr_translation ? stdio_out_chars_crlf : stdio_out_chars_no_crlf;
-    for (stdio_driver_t *driver = drivers; driver; driver = driver->next) {
-        if (!driver->out_chars) continue;
-        if (filter && filter != driver) continue;
-        out_func(driver, s, len);
-        if (newline) {
-            const char c = '\n';
-            out_func(driver, &c, 1);
-        }
-    }
+    stdio_out_string(s, len, newline, cr_translation);
     if (serialized) {
         stdout_serialize_end();
     }
@@ -135,6 +328,38 @@ int stdio_get_until(char *buf, int len, absolute_time_t until) {
     } while (true);
 }
 
+#if PICO_STDIO_BUFFERED
+bool stdio_flush_until(absolute_time_t until) {
+    bool rc = true;
+    for (stdio_driver_t *d = drivers; d; d = d->next) {
+        if (d->out_buffer.size && !stdio_buffer_wait_empty(d, until)) rc = false;
+        if (d->out_flush) d->out_flush();
+    }
+    return rc;
+}
+
+void stdio_flush(void) {
+    stdio_flush_until(make_timeout_time_ms(PICO_STDIO_DEADLOCK_TIMEOUT_MS));
+}
+#else
+void stdio_flush(void) {
+    for (stdio_driver_t *d = drivers; d; d = d->next) {
+        if (d->out_flush) d->out_flush();
+    }
+}
+#endif
+
+// internal flush after printing, which leaves drivers with output buffers, or which only want explicit flushes, to
+// send their output in the background
+static void stdio_flush_unbuffered(void) {
+    for (stdio_driver_t *d = drivers; d; d = d->next) {
+#if PICO_STDIO_BUFFERED
+        if (d->out_buffer.size) continue;
+#endif
+        if (d->out_flush && !d->out_flush_explicit_only) d->out_flush();
+    }
+}
+
 int stdio_putchar_raw(int c) {
     char cc = (char)c;
     stdio_put_string(&cc, 1, false, false);
@@ -144,7 +369,7 @@ int stdio_putchar_raw(int c) {
 int stdio_puts_raw(const char *s) {
     int len = (int)strlen(s);
     stdio_put_string(s, len, true, false);
-    stdio_flush();
+    stdio_flush_unbuffered();
     return len;
 }
 
@@ -165,12 +390,6 @@ void stdio_set_driver_enabled(stdio_driver_t *driver, bool enable) {
     }
 }
 
-void stdio_flush(void) {
-    for (stdio_driver_t *d = drivers; d; d = d->next) {
-        if (d->out_flush) d->out_flush();
-    }
-}
-
 #if LIB_PICO_PRINTF_PICO
 typedef struct stdio_stack_buffer {
     int used;
@@ -179,11 +398,7 @@ typedef struct stdio_stack_buffer {
 
 static void stdio_stack_buffer_flush(stdio_stack_buffer_t *buffer) {
     if (buffer->used) {
-        for (stdio_driver_t *d = drivers; d; d = d->next) {
-            if (!d->out_chars) continue;
-            if (filter && filter != d) continue;
-            stdio_out_chars_crlf(d, buffer->buf, buffer->used);
-        }
+        stdio_out_string(buffer->buf, buffer->used, false, true);
         buffer->used = 0;
     }
 }
@@ -308,7 +523,7 @@ int PRIMARY_STDIO_FUNC(putchar)(int c) {
 int PRIMARY_STDIO_FUNC(puts)(const char *s) {
     int len = (int)strlen(s);
     stdio_put_string(s, len, true, true);
-    stdio_flush();
+    stdio_flush_unbuffered();
     return len;
 }
 
@@ -327,7 +542,7 @@ int PRIMARY_STDIO_FUNC(vprintf)(const char *format, va_list va) {
     buffer.used = 0;
     ret = vfctprintf(stdio_buffered_printer, &buffer, format, va);
     stdio_stack_buffer_flush(&buffer);
-    stdio_flush();
+    stdio_flush_unbuffered();
 #elif LIB_PICO_PRINTF_NONE
     ((void)format);
     ((void)va);
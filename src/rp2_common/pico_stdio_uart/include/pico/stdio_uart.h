@@ -16,6 +16,12 @@
  *
  *  Linking this library or calling `pico_enable_stdio_uart(TARGET ENABLED)` in the CMake (which
  *  achieves the same thing) will add UART to the drivers used for standard input/output
+ *
+ *  If PICO_STDIO_UART_DMA is set, output is sent by DMA from a pair of buffers (one being sent while the other is filled),
+ *  and input is received by DMA into a ring buffer, rather than the CPU handling every character. Two DMA channels
+ *  are claimed when stdio over UART is initialized. In this mode the chars available callback is called once input has
+ *  been idle for PICO_STDIO_UART_DMA_RX_IDLE_US (or the ring buffer is half full), rather than for each character, and
+ *  input which is not read before the ring buffer fills is lost.
  */
 
 // PICO_CONFIG: PICO_STDIO_UART_DEFAULT_CRLF, Default state of CR/LF translation for UART output, type=bool, default=PICO_STDIO_DEFAULT_CRLF, group=pico_stdio_uart
@@ -28,6 +34,31 @@
 #define PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK 1
 #endif
 
+// PICO_CONFIG: PICO_STDIO_UART_DMA, Use DMA rather than the CPU to move characters to and from the UART, type=bool, default=0, group=pico_stdio_uart
+#ifndef PICO_STDIO_UART_DMA
+#define PICO_STDIO_UART_DMA 0
+#endif
+
+// PICO_CONFIG: PICO_STDIO_UART_DMA_TX_BUFFER_SIZE, Size of each of the two buffers used for UART output when PICO_STDIO_UART_DMA is set, type=int, min=1, default=128, group=pico_stdio_uart
+#ifndef PICO_STDIO_UART_DMA_TX_BUFFER_SIZE
+#define PICO_STDIO_UART_DMA_TX_BUFFER_SIZE 128
+#endif
+
+// PICO_CONFIG: PICO_STDIO_UART_DMA_RX_BUFFER_SIZE_BITS, Log2 of the size of the ring buffer used for UART input when PICO_STDIO_UART_DMA is set, type=int, min=2, max=15, default=8, group=pico_stdio_uart
+#ifndef PICO_STDIO_UART_DMA_RX_BUFFER_SIZE_BITS
+#define PICO_STDIO_UART_DMA_RX_BUFFER_SIZE_BITS 8
+#endif
+
+// PICO_CONFIG: PICO_STDIO_UART_DMA_IRQ, The DMA IRQ (0 or 1) used for UART DMA completion when PICO_STDIO_UART_DMA is set, type=int, min=0, max=1, default=0, group=pico_stdio_uart
+#ifndef PICO_STDIO_UART_DMA_IRQ
+#define PICO_STDIO_UART_DMA_IRQ 0
+#endif
+
+// PICO_CONFIG: PICO_STDIO_UART_DMA_RX_IDLE_US, How long UART input must be idle before the chars available callback is called when PICO_STDIO_UART_DMA is set, type=int, min=1, default=1000, group=pico_stdio_uart
+#ifndef PICO_STDIO_UART_DMA_RX_IDLE_US
+#define PICO_STDIO_UART_DMA_RX_IDLE_US 1000
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -8,6 +8,22 @@
 #include "pico/stdio_uart.h"
 #include "pico/binary_info.h"
 #include "hardware/gpio.h"
+#if PICO_STDIO_UART_DMA
+#include <string.h>
+#include "hardware/dma.h"
+#include "pico/time.h"
+#endif
+
+// with DMA, the UART interrupt is not used; output completion comes from the DMA interrupt, and input is polled by an alarm
+#define STDIO_UART_TX_IRQ (PICO_STDIO_BUFFERED && !PICO_STDIO_UART_DMA)
+#define STDIO_UART_RX_IRQ (PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK && !PICO_STDIO_UART_DMA)
+
+#if STDIO_UART_TX_IRQ || STDIO_UART_RX_IRQ || PICO_STDIO_UART_DMA
+#include "hardware/irq.h"
+#endif
+#if PICO_STDIO_BUFFERED || PICO_STDIO_UART_DMA
+#include "pico/critical_section.h"
+#endif
 
 static uart_inst_t *uart_instance;
 
@@ -16,6 +32,55 @@ static void (*chars_available_callback)(void*);
 static void *chars_available_param;
 #endif
 
+#if PICO_STDIO_BUFFERED || PICO_STDIO_UART_DMA
+// serializes moving output to the UART (or the TX DMA buffers), which is done both by the IRQ handler and by out_chars/out_kick
+static critical_section_t tx_crit;
+#endif
+
+#if PICO_STDIO_BUFFERED && PICO_STDIO_BUFFER_SIZE
+static char out_buffer[PICO_STDIO_BUFFER_SIZE];
+#endif
+
+#if PICO_STDIO_UART_DMA
+#define RX_DMA_RING_SIZE (1u << PICO_STDIO_UART_DMA_RX_BUFFER_SIZE_BITS)
+static_assert(PICO_STDIO_UART_DMA_RX_BUFFER_SIZE_BITS >= 2 && PICO_STDIO_UART_DMA_RX_BUFFER_SIZE_BITS <= 15, "");
+
+static int tx_dma_chan = -1;
+static int rx_dma_chan = -1;
+static bool dma_irq_handler_added;
+
+// output alternates between two buffers; the first is being sent, and the second (if any) is waiting to be sent and may still be added to
+static char tx_dma_buffers[2][PICO_STDIO_UART_DMA_TX_BUFFER_SIZE];
+static uint tx_dma_lengths[2];
+static uint tx_dma_first;
+static uint tx_dma_count;
+
+// input is written continuously around the ring by DMA, and read from rx_read_index
+static char rx_dma_ring[RX_DMA_RING_SIZE] __aligned(RX_DMA_RING_SIZE);
+static uint rx_read_index;
+#if PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK
+// the input is polled by an alarm from the default alarm pool, so the callback is not supported without one
+static alarm_id_t rx_idle_alarm;
+static uint rx_last_write_index;
+static volatile bool rx_notified;
+#endif
+#endif
+
+#if STDIO_UART_TX_IRQ || STDIO_UART_RX_IRQ
+static void on_uart_irq(void);
+
+static void stdio_uart_set_irq_handler_enabled(bool enabled) {
+    uint irq_num = UART_IRQ_NUM(uart_instance);
+    if (enabled) {
+        irq_set_exclusive_handler(irq_num, on_uart_irq);
+        irq_set_enabled(irq_num, true);
+    } else {
+        irq_set_enabled(irq_num, false);
+        irq_remove_handler(irq_num, on_uart_irq);
+    }
+}
+#endif
+
 #if PICO_NO_BI_STDIO_UART
 #define stdio_bi_decl_if_func_used(x)
 #else
@@ -90,11 +155,92 @@ void stdin_uart_init(void) {
 #endif
 }
 
+#if PICO_STDIO_UART_DMA
+static void on_dma_irq(void);
+static void stdio_uart_out_flush(void);
+
+static uint stdio_uart_dma_rx_write_index(void) {
+    return (uint)(dma_channel_hw_addr((uint)rx_dma_chan)->write_addr - (uintptr_t)rx_dma_ring) & (RX_DMA_RING_SIZE - 1);
+}
+
+static void stdio_uart_dma_init(int tx_pin, int rx_pin) {
+    if (!dma_irq_handler_added) {
+        irq_add_shared_handler(DMA_IRQ_NUM(PICO_STDIO_UART_DMA_IRQ), on_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_NUM(PICO_STDIO_UART_DMA_IRQ), true);
+        dma_irq_handler_added = true;
+    }
+    if (tx_pin >= 0 && tx_dma_chan < 0) {
+        tx_dma_chan = dma_claim_unused_channel(true);
+        tx_dma_count = 0;
+        tx_dma_lengths[0] = tx_dma_lengths[1] = 0;
+        dma_channel_config c = dma_channel_get_default_config((uint)tx_dma_chan);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+        channel_config_set_dreq(&c, uart_get_dreq_num(uart_instance, true));
+        dma_channel_configure((uint)tx_dma_chan, &c, &uart_get_hw(uart_instance)->dr, NULL, 0, false);
+        dma_irqn_set_channel_enabled(PICO_STDIO_UART_DMA_IRQ, (uint)tx_dma_chan, true);
+    }
+    if (rx_pin >= 0 && rx_dma_chan < 0) {
+        rx_dma_chan = dma_claim_unused_channel(true);
+        rx_read_index = 0;
+        dma_channel_config c = dma_channel_get_default_config((uint)rx_dma_chan);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_ring(&c, true, PICO_STDIO_UART_DMA_RX_BUFFER_SIZE_BITS);
+        channel_config_set_dreq(&c, uart_get_dreq_num(uart_instance, false));
+#if PICO_RP2040
+        // endless transfers are not supported, so the longest transfer possible is restarted from the IRQ when it completes
+        dma_channel_configure((uint)rx_dma_chan, &c, rx_dma_ring, &uart_get_hw(uart_instance)->dr, 0xffffffffu, true);
+        dma_irqn_set_channel_enabled(PICO_STDIO_UART_DMA_IRQ, (uint)rx_dma_chan, true);
+#else
+        dma_channel_configure((uint)rx_dma_chan, &c, rx_dma_ring, &uart_get_hw(uart_instance)->dr, dma_encode_endless_transfer_count(), true);
+#endif
+    }
+}
+
+static void stdio_uart_dma_deinit(int tx_pin, int rx_pin) {
+    if (tx_pin >= 0 && tx_dma_chan >= 0) {
+        stdio_uart_out_flush();
+        dma_channel_cleanup((uint)tx_dma_chan);
+        dma_channel_unclaim((uint)tx_dma_chan);
+        tx_dma_chan = -1;
+    }
+    if (rx_pin >= 0 && rx_dma_chan >= 0) {
+#if PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK && !PICO_TIME_DEFAULT_ALARM_POOL_DISABLED
+        if (rx_idle_alarm > 0) {
+            cancel_alarm(rx_idle_alarm);
+            rx_idle_alarm = 0;
+        }
+#endif
+        dma_channel_cleanup((uint)rx_dma_chan);
+        dma_channel_unclaim((uint)rx_dma_chan);
+        rx_dma_chan = -1;
+    }
+    if (tx_dma_chan < 0 && rx_dma_chan < 0 && dma_irq_handler_added) {
+        irq_remove_handler(DMA_IRQ_NUM(PICO_STDIO_UART_DMA_IRQ), on_dma_irq);
+        dma_irq_handler_added = false;
+    }
+}
+#endif
+
 void stdio_uart_init_full(struct uart_inst *uart, uint baud_rate, int tx_pin, int rx_pin) {
     uart_instance = uart;
     if (tx_pin >= 0) gpio_set_function((uint)tx_pin, UART_FUNCSEL_NUM(uart, tx_pin));
     if (rx_pin >= 0) gpio_set_function((uint)rx_pin, UART_FUNCSEL_NUM(uart, rx_pin));
     uart_init(uart_instance, baud_rate);
+#if PICO_STDIO_BUFFERED || PICO_STDIO_UART_DMA
+    if (!critical_section_is_initialized(&tx_crit)) critical_section_init(&tx_crit);
+#endif
+#if PICO_STDIO_UART_DMA
+    stdio_uart_dma_init(tx_pin, rx_pin);
+#elif PICO_STDIO_BUFFERED
+    // the TX interrupt is raised when the TX FIFO is down to its last 4 characters
+    hw_write_masked(&uart_get_hw(uart_instance)->ifls, 0 << UART_UARTIFLS_TXIFLSEL_LSB, UART_UARTIFLS_TXIFLSEL_BITS);
+    stdio_uart_set_irq_handler_enabled(true);
+#endif
+#if PICO_STDIO_BUFFERED && PICO_STDIO_BUFFER_SIZE
+    if (tx_pin >= 0) stdio_set_driver_buffer(&stdio_uart, out_buffer, sizeof(out_buffer), PICO_STDIO_BUFFER_OVERFLOW);
+#endif
     stdio_set_driver_enabled(&stdio_uart, true);
 }
 
@@ -127,6 +273,14 @@ void stdin_uart_deinit(void) {
 void stdio_uart_deinit_full(struct uart_inst *uart, int tx_pin, int rx_pin) {
     uart_instance = uart;
     stdio_set_driver_enabled(&stdio_uart, false);
+#if PICO_STDIO_BUFFERED
+    stdio_set_driver_buffer(&stdio_uart, NULL, 0, STDIO_BUFFER_OVERFLOW_BLOCK);
+#endif
+#if PICO_STDIO_UART_DMA
+    stdio_uart_dma_deinit(tx_pin, rx_pin);
+#elif PICO_STDIO_BUFFERED
+    stdio_uart_set_irq_handler_enabled(false);
+#endif
     uart_deinit(uart_instance);
 #if HAS_PADS_BANK0_ISOLATION
     // Leave pads isolated
@@ -138,49 +292,239 @@ void stdio_uart_deinit_full(struct uart_inst *uart, int tx_pin, int rx_pin) {
 #endif
 }
 
+#if PICO_STDIO_UART_DMA
+// the following are called with tx_crit held
+
+static void dma_tx_start(uint i) {
+    dma_channel_transfer_from_buffer_now((uint)tx_dma_chan, tx_dma_buffers[i], tx_dma_lengths[i]);
+}
+
+// moves on to the next buffer if the one being sent has finished
+static void dma_tx_poll(void) {
+    if (tx_dma_count && !dma_channel_is_busy((uint)tx_dma_chan)) {
+        tx_dma_lengths[tx_dma_first] = 0;
+        tx_dma_first ^= 1u;
+        if (--tx_dma_count) dma_tx_start(tx_dma_first);
+    }
+}
+
+// returns where output may be added, which is the buffer not being sent, and how much room is left in it
+static char *dma_tx_space(uint *space) {
+    uint i = tx_dma_first ^ (tx_dma_count != 0);
+    *space = PICO_STDIO_UART_DMA_TX_BUFFER_SIZE - tx_dma_lengths[i];
+    return tx_dma_buffers[i] + tx_dma_lengths[i];
+}
+
+// adds n > 0 characters written at dma_tx_space(), starting the DMA if it was idle
+static void dma_tx_commit(uint n) {
+    uint i = tx_dma_first ^ (tx_dma_count != 0);
+    tx_dma_lengths[i] += n;
+    if (!tx_dma_count) {
+        dma_tx_start(i);
+        tx_dma_count = 1;
+    } else {
+        tx_dma_count = 2;
+    }
+}
+#endif
+
 static void stdio_uart_out_chars(const char *buf, int length) {
+#if PICO_STDIO_UART_DMA
+    while (length > 0) {
+        critical_section_enter_blocking(&tx_crit);
+        dma_tx_poll();
+        uint space;
+        char *dst = dma_tx_space(&space);
+        uint n = MIN(space, (uint)length);
+        if (n) {
+            memcpy(dst, buf, n);
+            dma_tx_commit(n);
+        }
+        critical_section_exit(&tx_crit);
+        if (n) {
+            buf += n;
+            length -= (int)n;
+        } else {
+            // both buffers are in use; completion is polled above, so this does not rely on the DMA IRQ being able to run
+            tight_loop_contents();
+        }
+    }
+#else
     for (int i = 0; i <length; i++) {
         uart_putc(uart_instance, buf[i]);
     }
+#endif
 }
 
+#if PICO_STDIO_BUFFERED
+#if PICO_STDIO_UART_DMA
+// moves buffered output to whichever TX DMA buffers are free
+static void stdio_uart_tx_fill(void) {
+    critical_section_enter_blocking(&tx_crit);
+    dma_tx_poll();
+    uint space;
+    char *dst;
+    while ((dst = dma_tx_space(&space)), space) {
+        int n = stdio_buffer_take(&stdio_uart, dst, (int)space);
+        if (!n) break;
+        dma_tx_commit((uint)n);
+    }
+    critical_section_exit(&tx_crit);
+}
+#else
+// moves buffered output to the TX FIFO, leaving the TX interrupt enabled while there is more to send
+static void stdio_uart_tx_fill(void) {
+    critical_section_enter_blocking(&tx_crit);
+    bool more = true;
+    while (uart_is_writable(uart_instance)) {
+        char c;
+        if (!stdio_buffer_take(&stdio_uart, &c, 1)) {
+            more = false;
+            break;
+        }
+        uart_putc_raw(uart_instance, c);
+    }
+    if (more) {
+        hw_set_bits(&uart_get_hw(uart_instance)->imsc, UART_UARTIMSC_TXIM_BITS);
+    } else {
+        hw_clear_bits(&uart_get_hw(uart_instance)->imsc, UART_UARTIMSC_TXIM_BITS);
+    }
+    critical_section_exit(&tx_crit);
+}
+#endif
+#endif
+
+#if PICO_STDIO_UART_DMA
+static void on_dma_irq(void) {
+    if (tx_dma_chan >= 0 && dma_irqn_get_channel_status(PICO_STDIO_UART_DMA_IRQ, (uint)tx_dma_chan)) {
+        dma_irqn_acknowledge_channel(PICO_STDIO_UART_DMA_IRQ, (uint)tx_dma_chan);
+#if PICO_STDIO_BUFFERED
+        stdio_uart_tx_fill();
+#else
+        critical_section_enter_blocking(&tx_crit);
+        dma_tx_poll();
+        critical_section_exit(&tx_crit);
+#endif
+    }
+#if PICO_RP2040
+    if (rx_dma_chan >= 0 && dma_irqn_get_channel_status(PICO_STDIO_UART_DMA_IRQ, (uint)rx_dma_chan)) {
+        dma_irqn_acknowledge_channel(PICO_STDIO_UART_DMA_IRQ, (uint)rx_dma_chan);
+        dma_channel_set_transfer_count((uint)rx_dma_chan, 0xffffffffu, true);
+    }
+#endif
+}
+#endif
+
+#if STDIO_UART_RX_IRQ
+// the RX interrupts are enabled and disabled without affecting the TX interrupt
+static void stdio_uart_set_rx_irqs_enabled(bool enabled) {
+    const uint32_t rx_bits = UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS;
+    if (enabled) {
+        hw_set_bits(&uart_get_hw(uart_instance)->imsc, rx_bits);
+    } else {
+        hw_clear_bits(&uart_get_hw(uart_instance)->imsc, rx_bits);
+    }
+}
+#endif
+
 int stdio_uart_in_chars(char *buf, int length) {
     int i=0;
+#if PICO_STDIO_UART_DMA
+    if (rx_dma_chan >= 0) {
+        uint write_index = stdio_uart_dma_rx_write_index();
+        while (i<length && rx_read_index != write_index) {
+            buf[i++] = rx_dma_ring[rx_read_index];
+            rx_read_index = (rx_read_index + 1) & (RX_DMA_RING_SIZE - 1);
+        }
+    }
+#if PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK
+    // allow the callback to be called again
+    rx_notified = false;
+#endif
+#else
     while (i<length && uart_is_readable(uart_instance)) {
         buf[i++] = uart_getc(uart_instance);
     }
 #if PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK
     if (chars_available_callback) {
         // Re-enable interrupts after reading a character
-        uart_set_irqs_enabled(uart_instance, true, false);
+        stdio_uart_set_rx_irqs_enabled(true);
     }
+#endif
 #endif
     return i ? i : PICO_ERROR_NO_DATA;
 }
 
-#if PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK
-static void on_uart_rx(void) {
-    if (chars_available_callback) {
+#if STDIO_UART_TX_IRQ || STDIO_UART_RX_IRQ
+static void on_uart_irq(void) {
+    uint32_t status = uart_get_hw(uart_instance)->mis;
+#if STDIO_UART_TX_IRQ
+    if (status & UART_UARTMIS_TXMIS_BITS) {
+        stdio_uart_tx_fill();
+    }
+#endif
+#if STDIO_UART_RX_IRQ
+    if (chars_available_callback && (status & (UART_UARTMIS_RXMIS_BITS | UART_UARTMIS_RTMIS_BITS))) {
         // Interrupts will go off until the uart is read, so disable them
-        uart_set_irqs_enabled(uart_instance, false, false);
+        stdio_uart_set_rx_irqs_enabled(false);
         chars_available_callback(chars_available_param);
     }
+#else
+    ((void)status);
+#endif
 }
+#endif
 
-#include "hardware/irq.h"
+#if PICO_STDIO_UART_SUPPORT_CHARS_AVAILABLE_CALLBACK
+#if PICO_STDIO_UART_DMA && !PICO_TIME_DEFAULT_ALARM_POOL_DISABLED
+// rather than interrupting for every character, the callback is called once input stops arriving (or the ring is half full)
+static int64_t stdio_uart_rx_idle_check(__unused alarm_id_t id, __unused void *user_data) {
+    uint write_index = stdio_uart_dma_rx_write_index();
+    uint available = (write_index - rx_read_index) & (RX_DMA_RING_SIZE - 1);
+    if (available && !rx_notified && (write_index == rx_last_write_index || available >= RX_DMA_RING_SIZE / 2)) {
+        rx_notified = true;
+        chars_available_callback(chars_available_param);
+    }
+    rx_last_write_index = write_index;
+    return PICO_STDIO_UART_DMA_RX_IDLE_US;
+}
+#endif
 
 static void stdio_uart_set_chars_available_callback(void (*fn)(void*), void *param) {
-    uint irq_num = UART_IRQ_NUM(uart_instance);
     if (fn && !chars_available_callback) {
         chars_available_callback = fn;
         chars_available_param = param;
-        irq_set_exclusive_handler(irq_num, on_uart_rx);
-        irq_set_enabled(irq_num, true);
-        uart_set_irqs_enabled(uart_instance, true, false);
+#if PICO_STDIO_UART_DMA
+#if !PICO_TIME_DEFAULT_ALARM_POOL_DISABLED
+        if (rx_dma_chan >= 0) {
+            rx_notified = false;
+            rx_last_write_index = stdio_uart_dma_rx_write_index();
+            alarm_id_t id = add_alarm_in_us(PICO_STDIO_UART_DMA_RX_IDLE_US, stdio_uart_rx_idle_check, NULL, true);
+            if (id > 0) rx_idle_alarm = id;
+        }
+#endif
+#else
+#if !STDIO_UART_TX_IRQ
+        stdio_uart_set_irq_handler_enabled(true);
+#endif
+        // Set minimum threshold
+        hw_write_masked(&uart_get_hw(uart_instance)->ifls, 0 << UART_UARTIFLS_RXIFLSEL_LSB, UART_UARTIFLS_RXIFLSEL_BITS);
+        stdio_uart_set_rx_irqs_enabled(true);
+#endif
     } else if (!fn && chars_available_callback) {
-        uart_set_irqs_enabled(uart_instance, false, false);
-        irq_set_enabled(irq_num, false);
-        irq_remove_handler(irq_num, on_uart_rx);
+#if PICO_STDIO_UART_DMA
+#if !PICO_TIME_DEFAULT_ALARM_POOL_DISABLED
+        if (rx_idle_alarm > 0) {
+            cancel_alarm(rx_idle_alarm);
+            rx_idle_alarm = 0;
+        }
+#endif
+#else
+        stdio_uart_set_rx_irqs_enabled(false);
+#if !STDIO_UART_TX_IRQ
+        stdio_uart_set_irq_handler_enabled(false);
+#endif
+#endif
         chars_available_callback = NULL;
         chars_available_param = NULL;
     }
@@ -188,6 +532,17 @@ static void stdio_uart_set_chars_available_callback(void (*fn)(void*), void *par
 #endif
 
 static void stdio_uart_out_flush(void) {
+#if PICO_STDIO_UART_DMA
+    if (tx_dma_chan >= 0) {
+        bool sending;
+        do {
+            critical_section_enter_blocking(&tx_crit);
+            dma_tx_poll();
+            sending = tx_dma_count != 0;
+            critical_section_exit(&tx_crit);
+        } while (sending);
+    }
+#endif
     uart_tx_wait_blocking(uart_instance);
 }
 
@@ -199,6 +554,9 @@ stdio_driver_t stdio_uart = {
     .set_chars_available_callback = stdio_uart_set_chars_available_callback,
 #endif
 #if PICO_STDIO_ENABLE_CRLF_SUPPORT
-    .crlf_enabled = PICO_STDIO_UART_DEFAULT_CRLF
+    .crlf_enabled = PICO_STDIO_UART_DEFAULT_CRLF,
+#endif
+#if PICO_STDIO_BUFFERED
+    .out_kick = stdio_uart_tx_fill,
 #endif
 };
@@ -162,6 +162,11 @@
 #define PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK 1
 #endif
 
+// PICO_CONFIG: PICO_STDIO_USB_COALESCE_WRITES, Leave output which does not fill a USB packet to be sent by the background task (within PICO_STDIO_USB_TASK_INTERVAL_US) rather than sending it at the end of every write; stdio_flush still sends it immediately. Requires PICO_STDIO_USB_ENABLE_IRQ_BACKGROUND_TASK, type=bool, default=0, group=pico_stdio_usb
+#ifndef PICO_STDIO_USB_COALESCE_WRITES
+#define PICO_STDIO_USB_COALESCE_WRITES 0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -193,6 +198,19 @@ bool stdio_usb_deinit(void);
  */
 bool stdio_usb_connected(void);
 
+/*! \brief Write a sequence of character runs to the USB CDC connection, without first gathering them together
+ *  \ingroup pico_stdio_usb
+ *
+ * The characters are written straight to the CDC FIFO as-is (there is no CR/LF translation), and are
+ * not sent to any other stdio driver. As with regular stdio output, characters are discarded if there is no
+ * connection, or if the host stops reading for PICO_STDIO_USB_STDOUT_TIMEOUT_US.
+ *
+ * \param iov the runs of characters to write
+ * \param iovcnt the number of runs
+ * \return the number of characters written
+ */
+int stdio_usb_write_v(const stdio_iovec_t *iov, int iovcnt);
+
 #if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
 /*! \brief Explicitly calls the registered USB stdio chars_available_callback
  *  \ingroup pico_stdio_usb
@@ -21,6 +21,9 @@
 
 static mutex_t stdio_usb_mutex;
 
+// coalesced output relies on the background task to send any final partial packet
+#define STDIO_USB_COALESCE_WRITES (PICO_STDIO_USB_COALESCE_WRITES && PICO_STDIO_USB_ENABLE_IRQ_BACKGROUND_TASK)
+
 #if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
 static void (*chars_available_callback)(void*);
 static void *chars_available_param;
@@ -57,9 +60,48 @@ static int64_t timer_task(__unused alarm_id_t id, __unused void *user_data) {
     }
 }
 
+#if PICO_STDIO_BUFFERED
+#if PICO_STDIO_BUFFER_SIZE
+static char out_buffer[PICO_STDIO_BUFFER_SIZE];
+#endif
+
+// moves as much buffered output as fits to the CDC FIFO; called with stdio_usb_mutex held
+static void stdio_usb_drain_buffer(void) {
+    char chunk[64];
+    if (!stdio_usb_connected()) {
+        // as with unbuffered output, output is discarded while there is no connection
+        while (stdio_buffer_take(&stdio_usb, chunk, (int)sizeof(chunk))) {}
+        return;
+    }
+    uint32_t avail;
+    while ((avail = tud_cdc_write_available())) {
+        int n = stdio_buffer_take(&stdio_usb, chunk, (int)MIN(avail, sizeof(chunk)));
+        if (!n) break;
+        tud_cdc_write(chunk, (uint32_t)n);
+    }
+    tud_cdc_write_flush();
+}
+#endif
+
+static void schedule_one_shot_timer(void) {
+    bool need_timer;
+    critical_section_enter_blocking(&one_shot_timer_crit_sec);
+    need_timer = !one_shot_timer_pending;
+    one_shot_timer_pending = true;
+    critical_section_exit(&one_shot_timer_crit_sec);
+    if (need_timer) {
+        add_alarm_in_us(PICO_STDIO_USB_TASK_INTERVAL_US, timer_task, NULL, true);
+    }
+}
+
 static void low_priority_worker_irq(void) {
     if (mutex_try_enter(&stdio_usb_mutex, NULL)) {
         tud_task();
+#if PICO_STDIO_BUFFERED
+        stdio_usb_drain_buffer();
+#elif STDIO_USB_COALESCE_WRITES
+        tud_cdc_write_flush();
+#endif
 #if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
         uint32_t chars_avail = tud_cdc_available();
 #endif
@@ -79,14 +121,7 @@ static void low_priority_worker_irq(void) {
         // will be called again as a result, and will try the mutex_try_enter again, and if that fails
         // create another one shot timer again, and so on).
         if (critical_section_is_initialized(&one_shot_timer_crit_sec)) {
-            bool need_timer;
-            critical_section_enter_blocking(&one_shot_timer_crit_sec);
-            need_timer = !one_shot_timer_pending;
-            one_shot_timer_pending = true;
-            critical_section_exit(&one_shot_timer_crit_sec);
-            if (need_timer) {
-                add_alarm_in_us(PICO_STDIO_USB_TASK_INTERVAL_US, timer_task, NULL, true);
-            }
+            schedule_one_shot_timer();
         }
     }
 }
@@ -95,38 +130,90 @@ static void usb_irq(void) {
     irq_set_pending(low_priority_irq_num);
 }
 
+#if PICO_STDIO_BUFFERED
+static void stdio_usb_out_kick(void) {
+    if (get_core_num() == alarm_pool_core_num(alarm_pool_get_default())) {
+        irq_set_pending(low_priority_irq_num);
+    } else if (critical_section_is_initialized(&one_shot_timer_crit_sec)) {
+        // the low priority IRQ is only enabled on the other core
+        schedule_one_shot_timer();
+    }
+    // otherwise the periodic timer will send the output
+}
 #endif
 
-static void stdio_usb_out_chars(const char *buf, int length) {
+#endif
+
+// writes the runs of characters to the CDC FIFO, returning the number written; called with stdio_usb_mutex held
+static int stdio_usb_write_locked(const stdio_iovec_t *iov, int iovcnt) {
     static uint64_t last_avail_time;
-    if (!mutex_try_enter_block_until(&stdio_usb_mutex, make_timeout_time_ms(PICO_STDIO_DEADLOCK_TIMEOUT_MS))) {
-        return;
+    if (!stdio_usb_connected()) {
+        // reset our timeout
+        last_avail_time = 0;
+        return 0;
     }
-    if (stdio_usb_connected()) {
+    int written = 0;
+    for (int v = 0; v < iovcnt; v++) {
+        const char *buf = (const char *) iov[v].iov_base;
+        int length = (int) iov[v].iov_len;
         for (int i = 0; i < length;) {
             int n = length - i;
             int avail = (int) tud_cdc_write_available();
             if (n > avail) n = avail;
             if (n) {
+                // note tud_cdc_write itself sends each packet as it is filled
                 int n2 = (int) tud_cdc_write(buf + i, (uint32_t)n);
+#if !STDIO_USB_COALESCE_WRITES
                 tud_task();
                 tud_cdc_write_flush();
+#endif
                 i += n2;
+                written += n2;
                 last_avail_time = time_us_64();
             } else {
                 tud_task();
                 tud_cdc_write_flush();
                 if (!stdio_usb_connected() ||
                     (!tud_cdc_write_available() && time_us_64() > last_avail_time + PICO_STDIO_USB_STDOUT_TIMEOUT_US)) {
-                    break;
+                    return written;
                 }
             }
         }
-    } else {
-        // reset our timeout
-        last_avail_time = 0;
     }
+#if STDIO_USB_COALESCE_WRITES
+    // any partial packet is sent by the background task
+    if (critical_section_is_initialized(&one_shot_timer_crit_sec)) {
+        schedule_one_shot_timer();
+    }
+    // otherwise the periodic timer will send it
+#endif
+    return written;
+}
+
+static void stdio_usb_out_chars_v(const stdio_iovec_t *iov, int iovcnt) {
+    if (!mutex_try_enter_block_until(&stdio_usb_mutex, make_timeout_time_ms(PICO_STDIO_DEADLOCK_TIMEOUT_MS))) {
+        return;
+    }
+    stdio_usb_write_locked(iov, iovcnt);
+    mutex_exit(&stdio_usb_mutex);
+}
+
+static void stdio_usb_out_chars(const char *buf, int length) {
+    const stdio_iovec_t iov = { .iov_base = buf, .iov_len = (size_t)length };
+    stdio_usb_out_chars_v(&iov, 1);
+}
+
+int stdio_usb_write_v(const stdio_iovec_t *iov, int iovcnt) {
+    if (!mutex_try_enter_block_until(&stdio_usb_mutex, make_timeout_time_ms(PICO_STDIO_DEADLOCK_TIMEOUT_MS))) {
+        return 0;
+    }
+#if PICO_STDIO_BUFFERED && PICO_STDIO_USB_ENABLE_IRQ_BACKGROUND_TASK
+    // keep the output in order with regular stdio output which is waiting in the buffer
+    stdio_usb_drain_buffer();
+#endif
+    int written = stdio_usb_write_locked(iov, iovcnt);
     mutex_exit(&stdio_usb_mutex);
+    return written;
 }
 
 static void stdio_usb_out_flush(void) {
@@ -180,15 +267,21 @@ void stdio_usb_call_chars_available_callback(void) {
 
 stdio_driver_t stdio_usb = {
     .out_chars = stdio_usb_out_chars,
+    .out_chars_v = stdio_usb_out_chars_v,
     .out_flush = stdio_usb_out_flush,
+    // a partial packet is sent by the background task, unless stdio_flush is called
+    .out_flush_explicit_only = STDIO_USB_COALESCE_WRITES,
     .in_chars = stdio_usb_in_chars,
 #if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
     .set_chars_available_callback = stdio_usb_set_chars_available_callback,
 #endif
 #if PICO_STDIO_ENABLE_CRLF_SUPPORT
-    .crlf_enabled = PICO_STDIO_USB_DEFAULT_CRLF
+    .crlf_enabled = PICO_STDIO_USB_DEFAULT_CRLF,
+#endif
+#if PICO_STDIO_BUFFERED && PICO_STDIO_USB_ENABLE_IRQ_BACKGROUND_TASK
+    // output can only be sent from the background if there is a background task
+    .out_kick = stdio_usb_out_kick,
 #endif
-
 };
 
 bool stdio_usb_init(void) {
@@ -231,6 +324,9 @@ bool stdio_usb_init(void) {
     }
 #endif
     if (rc) {
+#if PICO_STDIO_BUFFERED && PICO_STDIO_USB_ENABLE_IRQ_BACKGROUND_TASK && PICO_STDIO_BUFFER_SIZE
+        stdio_set_driver_buffer(&stdio_usb, out_buffer, sizeof(out_buffer), PICO_STDIO_BUFFER_OVERFLOW);
+#endif
         stdio_set_driver_enabled(&stdio_usb, true);
 #if PICO_STDIO_USB_CONNECT_WAIT_TIMEOUT_MS
 #if PICO_STDIO_USB_CONNECT_WAIT_TIMEOUT_MS > 0
@@ -265,6 +361,9 @@ bool stdio_usb_deinit(void) {
     bool rc = true;
 
     stdio_set_driver_enabled(&stdio_usb, false);
+#if PICO_STDIO_BUFFERED
+    stdio_set_driver_buffer(&stdio_usb, NULL, 0, STDIO_BUFFER_OVERFLOW_BLOCK);
+#endif
 
 #if PICO_STDIO_USB_DEINIT_DELAY_MS != 0
     sleep_ms(PICO_STDIO_USB_DEINIT_DELAY_MS);
@@ -0,0 +1,458 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Micro-benchmarks of the SDK primitives, which print their results as JSON, e.g.
+//
+// {"sdk_version":"2.0.0","platform":"host","benchmarks":[
+//   {"name":"mutex_enter_exit","iterations":1048576,"ns_per_op":21.362},
+//   ...
+// ]}
+//
+// Each benchmark is run with an increasing number of iterations until it takes at least BENCHMARK_MIN_TIME_US, and
+// the best of BENCHMARK_REPEATS such runs is reported, so that the results are comparable between SDK versions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/version.h"
+#include "pico/mutex.h"
+#include "pico/sem.h"
+#include "pico/util/queue.h"
+#include "pico/util/pheap.h"
+#include "pico/async_context_poll.h"
+
+#ifndef BENCHMARK_MIN_TIME_US
+#define BENCHMARK_MIN_TIME_US 100000
+#endif
+
+#ifndef BENCHMARK_REPEATS
+#define BENCHMARK_REPEATS 3
+#endif
+
+// the benchmark names selected on the command line (host only), or none for all
+static int selected_count;
+static char **selected;
+
+static bool first_result = true;
+
+// prevent the compiler optimizing away results
+static volatile uint32_t sink;
+
+static bool is_selected(const char *name) {
+    if (!selected_count) return true;
+    for (int i = 0; i < selected_count; i++) {
+        if (!strcmp(selected[i], name)) return true;
+    }
+    return false;
+}
+
+// runs fn(iterations), which must perform the operation being measured that many times
+static void run_benchmark(const char *name, void (*fn)(uint32_t iterations)) {
+    if (!is_selected(name)) return;
+    uint64_t best_ps_per_op = UINT64_MAX;
+    uint32_t best_iterations = 0;
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        uint32_t iterations = 64;
+        uint64_t elapsed_us;
+        while (true) {
+            absolute_time_t start = get_absolute_time();
+            fn(iterations);
+            elapsed_us = (uint64_t)absolute_time_diff_us(start, get_absolute_time());
+            if (elapsed_us >= BENCHMARK_MIN_TIME_US || iterations >= (1u << 30)) break;
+            // aim for a little over the minimum time next
+            uint64_t scale = elapsed_us ? (BENCHMARK_MIN_TIME_US * 5 / 4) / elapsed_us + 1 : 16;
+            iterations = (uint32_t)MIN((uint64_t)iterations * MIN(scale, 16), 1u << 30);
+        }
+        uint64_t ps_per_op = elapsed_us * 1000000 / iterations;
+        if (ps_per_op < best_ps_per_op) {
+            best_ps_per_op = ps_per_op;
+            best_iterations = iterations;
+        }
+    }
+    printf("%s\n  {\"name\":\"%s\",\"iterations\":%u,\"ns_per_op\":%u.%03u}", first_result ? "" : ",", name,
+           (uint)best_iterations, (uint)(best_ps_per_op / 1000), (uint)(best_ps_per_op % 1000));
+    first_result = false;
+}
+
+// ----------------------------------------------------------------------------
+// pico_sync
+
+static mutex_t mutex;
+static semaphore_t sem;
+
+static void bench_mutex_enter_exit(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        mutex_enter_blocking(&mutex);
+        mutex_exit(&mutex);
+    }
+}
+
+static void bench_mutex_try_enter_exit(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (mutex_try_enter(&mutex, NULL)) mutex_exit(&mutex);
+    }
+}
+
+static void bench_sem_acquire_release(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        sem_acquire_blocking(&sem);
+        sem_release(&sem);
+    }
+}
+
+static void bench_sem_try_acquire_release(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (sem_try_acquire(&sem)) sem_release(&sem);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// pico_util queue
+
+static queue_t queue;
+
+static void bench_queue_add_remove_blocking(uint32_t iterations) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        queue_add_blocking(&queue, &i);
+        queue_remove_blocking(&queue, &value);
+    }
+    sink = value;
+}
+
+static void bench_queue_try_add_remove(uint32_t iterations) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        queue_try_add(&queue, &i);
+        queue_try_remove(&queue, &value);
+    }
+    sink = value;
+}
+
+// ----------------------------------------------------------------------------
+// pico_time (the host build has no alarm support by default)
+
+#if !PICO_TIME_DEFAULT_ALARM_POOL_DISABLED
+static int64_t alarm_callback(__unused alarm_id_t id, __unused void *user_data) {
+    return 0;
+}
+
+static void bench_alarm_add_cancel(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        alarm_id_t id = add_alarm_in_ms(60000, alarm_callback, NULL, true);
+        cancel_alarm(id);
+    }
+}
+
+// adding to, and cancelling from, the middle of a pool which already has other alarms pending
+static void bench_alarm_add_cancel_busy(uint32_t iterations) {
+    alarm_id_t ids[16];
+    for (uint i = 0; i < count_of(ids); i++) {
+        ids[i] = add_alarm_in_ms(60000 + i * 1000, alarm_callback, NULL, true);
+    }
+    for (uint32_t i = 0; i < iterations; i++) {
+        alarm_id_t id = add_alarm_in_ms(60000 + (i & 15) * 1000 + 500, alarm_callback, NULL, true);
+        cancel_alarm(id);
+    }
+    for (uint i = 0; i < count_of(ids); i++) {
+        cancel_alarm(ids[i]);
+    }
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// pico_async_context
+
+static async_context_poll_t async_context;
+static uint32_t worker_runs;
+
+static void when_pending_work(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    worker_runs++;
+}
+
+static async_when_pending_worker_t when_pending_worker = {
+    .do_work = when_pending_work,
+};
+
+static void bench_async_context_when_pending(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        async_context_set_work_pending(&async_context.core, &when_pending_worker);
+        async_context_poll(&async_context.core);
+    }
+    sink = worker_runs;
+}
+
+static void at_time_work(__unused async_context_t *context, __unused async_at_time_worker_t *worker) {
+}
+
+static async_at_time_worker_t at_time_worker = {
+    .do_work = at_time_work,
+};
+
+static void bench_async_context_at_time_add_remove(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        async_context_add_at_time_worker_in_ms(&async_context.core, &at_time_worker, 60000);
+        async_context_remove_at_time_worker(&async_context.core, &at_time_worker);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// printf
+
+static char print_buffer[128];
+
+static void bench_snprintf_int(uint32_t iterations) {
+    int n = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        n += snprintf(print_buffer, sizeof(print_buffer), "%d %u %08x", -(int)i, (uint)i * 2654435761u, (uint)i);
+    }
+    sink = (uint32_t)n;
+}
+
+static void bench_snprintf_float(uint32_t iterations) {
+    int n = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        n += snprintf(print_buffer, sizeof(print_buffer), "%f %g", (double)i * 0.37, (double)i * 1.0e-3);
+    }
+    sink = (uint32_t)n;
+}
+
+// ----------------------------------------------------------------------------
+// pico_util pheap
+
+#define PHEAP_NODES 64
+
+static uint32_t pheap_keys[PHEAP_NODES + 1];
+static uint32_t pheap_random;
+
+static bool pheap_key_less(__unused void *user_data, pheap_node_id_t a, pheap_node_id_t b) {
+    return pheap_keys[a] < pheap_keys[b];
+}
+
+PHEAP_DEFINE_STATIC(bench_heap, PHEAP_NODES);
+
+static uint32_t next_random(void) {
+    // xorshift32
+    pheap_random ^= pheap_random << 13;
+    pheap_random ^= pheap_random >> 17;
+    pheap_random ^= pheap_random << 5;
+    return pheap_random;
+}
+
+// a heap with all but one node in use
+static void fill_heap(void) {
+    ph_post_alloc_init(&bench_heap, PHEAP_NODES, pheap_key_less, NULL);
+    pheap_random = 1;
+    for (uint i = 0; i < PHEAP_NODES - 1; i++) {
+        pheap_node_id_t id = ph_new_node(&bench_heap);
+        pheap_keys[id] = next_random();
+        ph_insert_node(&bench_heap, id);
+    }
+}
+
+// one insert and one remove of the head, with a steady state of PHEAP_NODES - 1 nodes
+static void bench_pheap_insert_remove_head(uint32_t iterations) {
+    fill_heap();
+    for (uint32_t i = 0; i < iterations; i++) {
+        pheap_node_id_t id = ph_new_node(&bench_heap);
+        pheap_keys[id] = next_random();
+        ph_insert_node(&bench_heap, id);
+        ph_remove_and_free_head(&bench_heap);
+    }
+}
+
+// one insert and one removal of an arbitrary node, with a steady state of PHEAP_NODES - 1 nodes
+static void bench_pheap_insert_remove_node(uint32_t iterations) {
+    fill_heap();
+    for (uint32_t i = 0; i < iterations; i++) {
+        pheap_node_id_t id = ph_new_node(&bench_heap);
+        pheap_keys[id] = next_random();
+        ph_insert_node(&bench_heap, id);
+        // remove a pseudo-random node, which is likely not the one just added
+        pheap_node_id_t victim = (pheap_node_id_t)(next_random() % PHEAP_NODES + 1);
+        if (!ph_contains_node(&bench_heap, victim)) victim = id;
+        ph_remove_and_free_node(&bench_heap, victim);
+    }
+}
+
+// keys are decreased by a random amount of up to half, so most decreases move the node past at least one other; a
+// key which has become too small is first re-seeded with a fresh random value (for about 3% of decreases)
+#define PHEAP_RESEED_KEY 0x10000u
+
+static uint32_t decreased_key(uint32_t key) {
+    return key - 1 - next_random() % (key / 2);
+}
+
+// decrease the key of a pseudo-random node
+static void bench_pheap_decrease_key(uint32_t iterations) {
+    fill_heap();
+    for (uint32_t i = 0; i < iterations; i++) {
+        pheap_node_id_t id = (pheap_node_id_t)(next_random() % (PHEAP_NODES - 1) + 1);
+        if (pheap_keys[id] < PHEAP_RESEED_KEY) {
+            pheap_keys[id] = next_random() | PHEAP_RESEED_KEY;
+            ph_reposition(&bench_heap, id);
+        }
+        pheap_keys[id] = decreased_key(pheap_keys[id]);
+        ph_decrease_key(&bench_heap, id);
+    }
+}
+
+// build a heap of PHEAP_NODES nodes, and remove them all
+static void bench_pheap_heapify_drain(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i += PHEAP_NODES) {
+        pheap_random = i | 1;
+        for (uint j = 1; j <= PHEAP_NODES; j++) pheap_keys[j] = next_random();
+        ph_heapify(&bench_heap, PHEAP_NODES);
+        while (ph_peek_head(&bench_heap)) ph_remove_and_free_head(&bench_heap);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// binary heap of the same ids and keys as above, for comparison with pheap
+
+static uint8_t bheap[PHEAP_NODES];
+static uint8_t bheap_pos[PHEAP_NODES + 1];
+static uint bheap_count;
+
+static void bheap_set(uint pos, uint8_t id) {
+    bheap[pos] = id;
+    bheap_pos[id] = (uint8_t)pos;
+}
+
+static void bheap_sift_up(uint pos) {
+    uint8_t id = bheap[pos];
+    while (pos) {
+        uint parent = (pos - 1) / 2;
+        if (pheap_keys[bheap[parent]] <= pheap_keys[id]) break;
+        bheap_set(pos, bheap[parent]);
+        pos = parent;
+    }
+    bheap_set(pos, id);
+}
+
+static void bheap_sift_down(uint pos) {
+    uint8_t id = bheap[pos];
+    while (true) {
+        uint child = pos * 2 + 1;
+        if (child >= bheap_count) break;
+        if (child + 1 < bheap_count && pheap_keys[bheap[child + 1]] < pheap_keys[bheap[child]]) child++;
+        if (pheap_keys[id] <= pheap_keys[bheap[child]]) break;
+        bheap_set(pos, bheap[child]);
+        pos = child;
+    }
+    bheap_set(pos, id);
+}
+
+static void bheap_insert(uint8_t id) {
+    bheap[bheap_count++] = id;
+    bheap_sift_up(bheap_count - 1);
+}
+
+static uint8_t bheap_remove_head(void) {
+    uint8_t id = bheap[0];
+    if (--bheap_count) {
+        bheap[0] = bheap[bheap_count];
+        bheap_sift_down(0);
+    }
+    return id;
+}
+
+static void bheap_heapify(uint count) {
+    bheap_count = count;
+    for (uint i = 0; i < count; i++) bheap_set(i, (uint8_t)(i + 1));
+    for (uint i = count / 2; i--;) bheap_sift_down(i);
+}
+
+static void fill_bheap(void) {
+    pheap_random = 1;
+    for (uint i = 1; i < PHEAP_NODES; i++) pheap_keys[i] = next_random();
+    bheap_heapify(PHEAP_NODES - 1);
+}
+
+static void bench_binary_heap_insert_remove_head(uint32_t iterations) {
+    fill_bheap();
+    uint8_t id = PHEAP_NODES;
+    for (uint32_t i = 0; i < iterations; i++) {
+        pheap_keys[id] = next_random();
+        bheap_insert(id);
+        id = bheap_remove_head();
+    }
+}
+
+static void bench_binary_heap_decrease_key(uint32_t iterations) {
+    fill_bheap();
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint8_t id = (uint8_t)(next_random() % (PHEAP_NODES - 1) + 1);
+        if (pheap_keys[id] < PHEAP_RESEED_KEY) {
+            pheap_keys[id] = next_random() | PHEAP_RESEED_KEY;
+            bheap_sift_down(bheap_pos[id]);
+        }
+        pheap_keys[id] = decreased_key(pheap_keys[id]);
+        bheap_sift_up(bheap_pos[id]);
+    }
+}
+
+static void bench_binary_heap_heapify_drain(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i += PHEAP_NODES) {
+        pheap_random = i | 1;
+        for (uint j = 1; j <= PHEAP_NODES; j++) pheap_keys[j] = next_random();
+        bheap_heapify(PHEAP_NODES);
+        while (bheap_count) bheap_remove_head();
+    }
+}
+
+int main(int argc, char **argv) {
+    stdio_init_all();
+#if !PICO_ON_DEVICE
+    selected_count = argc - 1;
+    selected = argv + 1;
+#else
+    ((void)argc);
+    ((void)argv);
+#endif
+
+    mutex_init(&mutex);
+    sem_init(&sem, 1, 1);
+    queue_init(&queue, sizeof(uint32_t), 4);
+    async_context_poll_init_with_defaults(&async_context);
+    async_context_add_when_pending_worker(&async_context.core, &when_pending_worker);
+
+#if !PICO_ON_DEVICE
+    const char *platform = "host";
+#elif PICO_RP2040
+    const char *platform = "rp2040";
+#else
+    const char *platform = "rp2350";
+#endif
+    printf("{\"sdk_version\":\"%s\",\"platform\":\"%s\",\"benchmarks\":[", PICO_SDK_VERSION_STRING, platform);
+    run_benchmark("mutex_enter_exit", bench_mutex_enter_exit);
+    run_benchmark("mutex_try_enter_exit", bench_mutex_try_enter_exit);
+    run_benchmark("sem_acquire_release", bench_sem_acquire_release);
+    run_benchmark("sem_try_acquire_release", bench_sem_try_acquire_release);
+    run_benchmark("queue_add_remove_blocking", bench_queue_add_remove_blocking);
+    run_benchmark("queue_try_add_remove", bench_queue_try_add_remove);
+#if !PICO_TIME_DEFAULT_ALARM_POOL_DISABLED
+    run_benchmark("alarm_add_cancel", bench_alarm_add_cancel);
+    run_benchmark("alarm_add_cancel_busy", bench_alarm_add_cancel_busy);
+#endif
+    run_benchmark("async_context_when_pending", bench_async_context_when_pending);
+    run_benchmark("async_context_at_time_add_remove", bench_async_context_at_time_add_remove);
+    run_benchmark("snprintf_int", bench_snprintf_int);
+    run_benchmark("snprintf_float", bench_snprintf_float);
+    run_benchmark("pheap_insert_remove_head", bench_pheap_insert_remove_head);
+    run_benchmark("pheap_insert_remove_node", bench_pheap_insert_remove_node);
+    run_benchmark("pheap_decrease_key", bench_pheap_decrease_key);
+    run_benchmark("pheap_heapify_drain", bench_pheap_heapify_drain);
+    run_benchmark("binary_heap_insert_remove_head", bench_binary_heap_insert_remove_head);
+    run_benchmark("binary_heap_decrease_key", bench_binary_heap_decrease_key);
+    run_benchmark("binary_heap_heapify_drain", bench_binary_heap_heapify_drain);
+    printf("\n]}\n");
+
+    async_context_deinit(&async_context.core);
+    return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Benchmarks of malloc/free via pico_malloc on one and on both cores, which print their results as JSON in the same
+// format as pico_benchmarks. This is built with the default locked allocator (pico_malloc_benchmarks), with
+// PICO_MALLOC_PER_CORE_ARENAS (pico_malloc_arena_benchmarks) and with PICO_MALLOC_TLSF (pico_malloc_tlsf_benchmarks),
+// so the scaling and the worst case times of each can be compared.
+//
+// The same churn is also run on a pico_util pool of fixed size objects, for comparison with malloc of the same
+// size. The arena variant enables the pool's per-core caches (PICO_POOL_PER_CORE_CACHE) too.
+//
+// Each core repeatedly frees and reallocates a pseudo-random slot in its own working set of blocks, and ns_per_op is
+// the elapsed time divided by the total number of malloc/free pairs done by all cores, so perfect scaling halves it.
+//
+// The worst case benchmarks instead time every malloc and every free individually on one core, with a wide spread of
+// sizes to fragment the heap, and also report the longest (max_ns). They are run once beforehand untimed, so that
+// the heap has already grown to its working size. Note the times are only to the nearest microsecond on device.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+#include "pico/version.h"
+#include "pico/malloc.h"
+#include "pico/multicore.h"
+#include "pico/util/pool.h"
+
+#if !PICO_ON_DEVICE
+#include <time.h>
+#endif
+
+#ifndef BENCHMARK_ITERATIONS
+#if PICO_ON_DEVICE
+#define BENCHMARK_ITERATIONS (1u << 16)
+#else
+#define BENCHMARK_ITERATIONS (1u << 21)
+#endif
+#endif
+
+#ifndef BENCHMARK_REPEATS
+#define BENCHMARK_REPEATS 3
+#endif
+
+#define WORKING_SET_SLOTS 32
+#define WORST_CASE_SLOTS 64
+
+static bool first_result = true;
+
+typedef struct {
+    uint32_t min_size;
+    uint32_t max_size;
+} size_range_t;
+
+static const size_range_t size_ranges[] = {
+    {16, 256},      // small; within the per-core arenas
+    {512, 1024},    // large; always from the heap
+    {64, 64},       // fixed; the size of the pool's objects
+};
+
+#define POOL_OBJECT_SIZE 64
+// the index passed instead of a size range for the pool benchmarks
+#define POOL_BENCHMARK count_of(size_ranges)
+
+static pool_t pool;
+
+static inline uint32_t xorshift32(uint32_t random) {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
+
+static void churn(const size_range_t *sizes, uint32_t iterations, uint32_t random) {
+    void *slots[WORKING_SET_SLOTS] = {0};
+    for (uint32_t i = 0; i < iterations; i++) {
+        random = xorshift32(random);
+        uint slot = random % WORKING_SET_SLOTS;
+        free(slots[slot]);
+        slots[slot] = malloc(sizes->min_size + (random >> 8) % (sizes->max_size - sizes->min_size + 1));
+    }
+    for (uint i = 0; i < WORKING_SET_SLOTS; i++) {
+        free(slots[i]);
+    }
+}
+
+static void churn_pool(uint32_t iterations, uint32_t random) {
+    void *slots[WORKING_SET_SLOTS] = {0};
+    for (uint32_t i = 0; i < iterations; i++) {
+        random = xorshift32(random);
+        uint slot = random % WORKING_SET_SLOTS;
+        if (slots[slot]) pool_free(&pool, slots[slot]);
+        slots[slot] = pool_alloc(&pool);
+    }
+    for (uint i = 0; i < WORKING_SET_SLOTS; i++) {
+        if (slots[i]) pool_free(&pool, slots[i]);
+    }
+}
+
+static void run_churn(uint range, uint32_t iterations, uint32_t random) {
+    if (range == POOL_BENCHMARK) {
+        churn_pool(iterations, random);
+    } else {
+        churn(&size_ranges[range], iterations, random);
+    }
+}
+
+static uint64_t time_ns(void) {
+#if PICO_ON_DEVICE
+    return time_us_64() * 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+typedef struct {
+    uint64_t total_ns;
+    uint64_t max_ns;
+} op_times_t;
+
+static inline void record_op(op_times_t *times, uint64_t start_ns) {
+    uint64_t ns = time_ns() - start_ns;
+    times->total_ns += ns;
+    times->max_ns = MAX(times->max_ns, ns);
+}
+
+// sizes are spread evenly over each power of 2 from 16 to 2048 bytes
+static void churn_timed(uint32_t iterations, op_times_t *malloc_times, op_times_t *free_times) {
+    void *slots[WORST_CASE_SLOTS] = {0};
+    uint32_t random = 1;
+    for (uint32_t i = 0; i < iterations; i++) {
+        random = xorshift32(random);
+        uint slot = random % WORST_CASE_SLOTS;
+        uint min_size = 16u << ((random >> 8) % 7);
+        size_t size = min_size + (random >> 12) % min_size;
+        uint64_t start_ns = time_ns();
+        free(slots[slot]);
+        record_op(free_times, start_ns);
+        start_ns = time_ns();
+        slots[slot] = malloc(size);
+        record_op(malloc_times, start_ns);
+    }
+    for (uint i = 0; i < WORST_CASE_SLOTS; i++) {
+        free(slots[i]);
+    }
+}
+
+static void core1_entry(void) {
+    while (true) {
+        // pointers do not fit in the FIFO on a 64-bit host, so the size range is passed by index
+        uint32_t range = multicore_fifo_pop_blocking();
+        uint32_t iterations = multicore_fifo_pop_blocking();
+        run_churn(range, iterations, 0x9e3779b9);
+        multicore_fifo_push_blocking(iterations);
+    }
+}
+
+static void run_benchmark(const char *name, uint range, uint cores) {
+    uint64_t best_us = UINT64_MAX;
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        absolute_time_t start = get_absolute_time();
+        if (cores > 1) {
+            multicore_fifo_push_blocking(range);
+            multicore_fifo_push_blocking(BENCHMARK_ITERATIONS);
+        }
+        run_churn(range, BENCHMARK_ITERATIONS, 1);
+        if (cores > 1) {
+            multicore_fifo_pop_blocking();
+        }
+        uint64_t elapsed_us = (uint64_t)absolute_time_diff_us(start, get_absolute_time());
+        best_us = MIN(best_us, elapsed_us);
+    }
+    uint64_t iterations = (uint64_t)BENCHMARK_ITERATIONS * cores;
+    uint64_t ps_per_op = best_us * 1000000 / iterations;
+    printf("%s\n  {\"name\":\"%s\",\"iterations\":%u,\"ns_per_op\":%u.%03u}", first_result ? "" : ",", name,
+           (uint)iterations, (uint)(ps_per_op / 1000), (uint)(ps_per_op % 1000));
+    first_result = false;
+}
+
+static void print_worst_case(const char *name, uint32_t iterations, const op_times_t *times) {
+    uint64_t ps_per_op = times->total_ns * 1000 / iterations;
+    printf(",\n  {\"name\":\"%s\",\"iterations\":%u,\"ns_per_op\":%u.%03u,\"max_ns\":%u}", name, (uint)iterations,
+           (uint)(ps_per_op / 1000), (uint)(ps_per_op % 1000), (uint)times->max_ns);
+}
+
+static void run_worst_case_benchmark(void) {
+    op_times_t malloc_times = {0}, free_times = {0};
+    churn_timed(BENCHMARK_ITERATIONS, &malloc_times, &free_times);
+    malloc_times = (op_times_t){0};
+    free_times = (op_times_t){0};
+    churn_timed(BENCHMARK_ITERATIONS, &malloc_times, &free_times);
+    print_worst_case("malloc_mixed_worst_case", BENCHMARK_ITERATIONS, &malloc_times);
+    print_worst_case("free_mixed_worst_case", BENCHMARK_ITERATIONS, &free_times);
+}
+
+int main(void) {
+    stdio_init_all();
+    multicore_launch_core1(core1_entry);
+    // each core's working set, plus the most each core's cache can hold
+    pool_init(&pool, POOL_OBJECT_SIZE, NUM_CORES * (WORKING_SET_SLOTS + PICO_POOL_PER_CORE_CACHE_SIZE));
+
+#if !PICO_ON_DEVICE
+    const char *platform = "host";
+#elif PICO_RP2040
+    const char *platform = "rp2040";
+#else
+    const char *platform = "rp2350";
+#endif
+#if PICO_MALLOC_TLSF
+    const char *allocator = "tlsf";
+#elif PICO_MALLOC_PER_CORE_ARENAS
+    const char *allocator = "per_core_arenas";
+#else
+    const char *allocator = "locked";
+#endif
+    printf("{\"sdk_version\":\"%s\",\"platform\":\"%s\",\"allocator\":\"%s\",\"benchmarks\":[", PICO_SDK_VERSION_STRING,
+           platform, allocator);
+    run_benchmark("malloc_free_small_1_core", 0, 1);
+    run_benchmark("malloc_free_small_2_cores", 0, 2);
+    run_benchmark("malloc_free_large_1_core", 1, 1);
+    run_benchmark("malloc_free_large_2_cores", 1, 2);
+    run_benchmark("malloc_free_fixed_1_core", 2, 1);
+    run_benchmark("malloc_free_fixed_2_cores", 2, 2);
+    run_benchmark("pool_alloc_free_1_core", POOL_BENCHMARK, 1);
+    run_benchmark("pool_alloc_free_2_cores", POOL_BENCHMARK, 2);
+    run_worst_case_benchmark();
+    printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,413 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/test.h"
+#include "pico/async_context_poll.h"
+#if LIB_PICO_ASYNC_CONTEXT_MULTICORE
+#include "pico/async_context_multicore.h"
+#include "pico/multicore.h"
+#endif
+#if LIB_PICO_ASYNC_CONTEXT_EPOLL
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "pico/async_context_epoll.h"
+#endif
+
+PICOTEST_MODULE_NAME("ASYNC_CONTEXT", "async_context test");
+
+#define MAX_AT_TIME_WORKERS 128
+
+static async_at_time_worker_t at_time_workers[MAX_AT_TIME_WORKERS];
+static uint run_count;
+static absolute_time_t last_run_time;
+static bool run_in_order;
+
+static void at_time_do_work(__unused async_context_t *context, async_at_time_worker_t *worker) {
+    if (absolute_time_diff_us(last_run_time, worker->next_time) < 0) {
+        run_in_order = false;
+    }
+    last_run_time = worker->next_time;
+    run_count++;
+}
+
+static async_when_pending_worker_t when_pending_workers[4];
+static async_when_pending_worker_t *when_pending_run_order[count_of(when_pending_workers)];
+static uint when_pending_run_count;
+static uint32_t when_pending_work_us;
+
+static void when_pending_do_work(__unused async_context_t *context, async_when_pending_worker_t *worker) {
+    if (when_pending_run_count < count_of(when_pending_run_order)) {
+        when_pending_run_order[when_pending_run_count] = worker;
+    }
+    when_pending_run_count++;
+    busy_wait_us_32(when_pending_work_us);
+}
+
+static async_when_pending_worker_t *worker_to_remove;
+static bool repeat_work;
+
+static void removing_do_work(async_context_t *context, async_when_pending_worker_t *worker) {
+    when_pending_do_work(context, worker);
+    if (worker_to_remove) {
+        async_context_remove_when_pending_worker(context, worker_to_remove);
+        worker_to_remove = NULL;
+    }
+    // as lwIP does, mark the worker pending again directly
+    if (repeat_work) {
+        worker->work_pending = true;
+        repeat_work = false;
+    }
+}
+
+static void reset_run_state(void) {
+    run_count = 0;
+    last_run_time = nil_time;
+    run_in_order = true;
+}
+
+#if LIB_PICO_ASYNC_CONTEXT_MULTICORE
+static async_context_multicore_t multicore_context;
+static volatile bool core1_added;
+static volatile bool core1_should_remove;
+static semaphore_t multicore_worker_done;
+static volatile uint multicore_worker_core_num;
+
+static void multicore_do_work(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    multicore_worker_core_num = get_core_num();
+    sem_release(&multicore_worker_done);
+}
+
+static void core1_entry(void) {
+    async_context_multicore_config_t config = async_context_multicore_default_config();
+    core1_added = async_context_multicore_add_core(&multicore_context, &config);
+    while (!core1_should_remove) {
+        tight_loop_contents();
+    }
+    async_context_multicore_remove_core(&multicore_context);
+    core1_added = false;
+    while (true) {
+        __wfi();
+    }
+}
+#endif
+
+#if LIB_PICO_ASYNC_CONTEXT_EPOLL
+static async_context_epoll_t epoll_context;
+static int epoll_test_pipe[2];
+static volatile uint epoll_fd_bytes_read;
+
+static void epoll_fd_do_work(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    char buf[16];
+    ssize_t n = read(epoll_test_pipe[0], buf, sizeof(buf));
+    if (n > 0) epoll_fd_bytes_read += (uint)n;
+}
+
+static bool wait_for_count(volatile uint *count, uint expected, uint32_t timeout_ms) {
+    absolute_time_t until = make_timeout_time_ms(timeout_ms);
+    while (*count < expected) {
+        if (time_reached(until)) return false;
+        sleep_ms(1);
+    }
+    return true;
+}
+
+static void test_epoll_context(async_context_t *context, bool threaded) {
+    reset_run_state();
+    when_pending_run_count = 0;
+    when_pending_work_us = 0;
+    absolute_time_t start = get_absolute_time();
+    at_time_workers[0].do_work = at_time_do_work;
+    async_context_add_at_time_worker_in_ms(context, &at_time_workers[0], 20);
+    async_when_pending_worker_t *worker = &when_pending_workers[0];
+    *worker = (async_when_pending_worker_t) {
+        .do_work = when_pending_do_work,
+    };
+    async_context_add_when_pending_worker(context, worker);
+    async_when_pending_worker_t *fd_worker = &when_pending_workers[1];
+    *fd_worker = (async_when_pending_worker_t) {
+        .do_work = epoll_fd_do_work,
+    };
+    async_context_add_when_pending_worker(context, fd_worker);
+    PICOTEST_CHECK(!pipe(epoll_test_pipe), "pipe failed");
+    epoll_fd_bytes_read = 0;
+    PICOTEST_CHECK(async_context_epoll_add_fd(&epoll_context, epoll_test_pipe[0], EPOLLIN, fd_worker), "add fd failed");
+    PICOTEST_CHECK(!async_context_epoll_add_fd(&epoll_context, epoll_test_pipe[0], EPOLLIN, fd_worker), "duplicate fd added");
+    async_context_set_work_pending(context, worker);
+    PICOTEST_CHECK(write(epoll_test_pipe[1], "hello", 5) == 5, "write failed");
+    if (!threaded) {
+        // nothing happens until the owner polls
+        sleep_ms(2);
+        PICOTEST_CHECK(!when_pending_run_count, "when_pending worker ran without a poll");
+        while (!time_reached(delayed_by_ms(start, 100)) && (run_count < 1 || epoll_fd_bytes_read < 5)) {
+            async_context_wait_for_work_ms(context, 100);
+            async_context_poll(context);
+        }
+    }
+    PICOTEST_CHECK(wait_for_count(&when_pending_run_count, 1, 100), "when_pending worker did not run");
+    PICOTEST_CHECK(wait_for_count(&epoll_fd_bytes_read, 5, 100), "fd worker did not run");
+    PICOTEST_CHECK(wait_for_count(&run_count, 1, 100), "at_time worker did not run");
+    PICOTEST_CHECK(absolute_time_diff_us(start, get_absolute_time()) >= 20000, "at_time worker ran early");
+    async_context_epoll_remove_fd(&epoll_context, epoll_test_pipe[0]);
+    async_context_remove_when_pending_worker(context, worker);
+    async_context_remove_when_pending_worker(context, fd_worker);
+    close(epoll_test_pipe[0]);
+    close(epoll_test_pipe[1]);
+}
+#endif
+
+int main() {
+    async_context_poll_t poll_context;
+
+    stdio_init_all();
+    async_context_poll_init_with_defaults(&poll_context);
+    async_context_t *context = &poll_context.core;
+
+    PICOTEST_START();
+
+    PICOTEST_START_SECTION("at_time workers run in time order");
+        reset_run_state();
+        absolute_time_t base = make_timeout_time_ms(10);
+        for (uint i = 0; i < MAX_AT_TIME_WORKERS; i++) {
+            at_time_workers[i].do_work = at_time_do_work;
+            // scatter the times so the workers are not added in order
+            PICOTEST_CHECK(async_context_add_at_time_worker_at(context, &at_time_workers[i],
+                                                               delayed_by_us(base, (i * 7919) % 5000)),
+                           "worker not added");
+        }
+        PICOTEST_CHECK(!async_context_add_at_time_worker(context, &at_time_workers[0]), "duplicate worker added");
+        async_context_poll(context);
+        PICOTEST_CHECK(run_count == 0, "worker ran early");
+        PICOTEST_CHECK(absolute_time_diff_us(context->next_time, base) == 0, "wrong next timeout");
+        sleep_until(delayed_by_us(base, 5000));
+        async_context_poll(context);
+        PICOTEST_CHECK(run_count == MAX_AT_TIME_WORKERS, "not all workers ran");
+        PICOTEST_CHECK(run_in_order, "workers ran out of order");
+        PICOTEST_CHECK(is_at_the_end_of_time(context->next_time), "unexpected next timeout");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("at_time worker re-add with new time");
+        reset_run_state();
+        async_at_time_worker_t *worker = &at_time_workers[0];
+        PICOTEST_CHECK(async_context_add_at_time_worker_in_ms(context, worker, 10000), "worker not added");
+        PICOTEST_CHECK(async_context_add_at_time_worker_in_ms(context, &at_time_workers[1], 5000), "worker not added");
+        PICOTEST_CHECK(!async_context_add_at_time_worker_in_ms(context, worker, 1), "duplicate worker added");
+        sleep_ms(2);
+        async_context_poll(context);
+        PICOTEST_CHECK(run_count == 1, "re-added worker did not run at its new time");
+        PICOTEST_CHECK(async_context_remove_at_time_worker(context, &at_time_workers[1]), "worker not removed");
+        PICOTEST_CHECK(!async_context_remove_at_time_worker(context, &at_time_workers[1]), "worker removed twice");
+        PICOTEST_CHECK(context->at_time_list == NULL, "worker still present");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("when_pending worker priorities");
+        static const int8_t priorities[count_of(when_pending_workers)] = {
+                ASYNC_WHEN_PENDING_WORKER_PRIORITY_LOW,
+                ASYNC_WHEN_PENDING_WORKER_PRIORITY_NORMAL,
+                ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGHEST,
+                ASYNC_WHEN_PENDING_WORKER_PRIORITY_HIGH,
+        };
+        for (uint i = 0; i < count_of(when_pending_workers); i++) {
+            when_pending_workers[i].do_work = when_pending_do_work;
+            when_pending_workers[i].priority = priorities[i];
+            PICOTEST_CHECK(async_context_add_when_pending_worker(context, &when_pending_workers[i]), "worker not added");
+        }
+        PICOTEST_CHECK(!async_context_add_when_pending_worker(context, &when_pending_workers[1]), "duplicate worker added");
+        when_pending_run_count = 0;
+        when_pending_work_us = 0;
+        for (uint i = 0; i < count_of(when_pending_workers); i++) {
+            async_context_set_work_pending(context, &when_pending_workers[i]);
+        }
+        async_context_poll(context);
+        PICOTEST_CHECK(when_pending_run_count == 4, "not all workers ran");
+        PICOTEST_CHECK(when_pending_run_order[0] == &when_pending_workers[2] &&
+                       when_pending_run_order[1] == &when_pending_workers[3] &&
+                       when_pending_run_order[2] == &when_pending_workers[1] &&
+                       when_pending_run_order[3] == &when_pending_workers[0], "workers ran out of priority order");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("when_pending worker budget");
+        async_context_set_when_pending_budget_us(context, 100);
+        when_pending_run_count = 0;
+        when_pending_work_us = 150;
+        for (uint i = 0; i < count_of(when_pending_workers); i++) {
+            async_context_set_work_pending(context, &when_pending_workers[i]);
+        }
+        async_context_poll(context);
+        // the high priority workers are never deferred, but the rest are
+        PICOTEST_CHECK(when_pending_run_count == 2, "low priority workers were not deferred");
+        PICOTEST_CHECK(absolute_time_diff_us(context->next_time, get_absolute_time()) >= 0, "deferred work not rescheduled");
+        async_context_set_work_pending(context, &when_pending_workers[3]);
+        async_context_poll(context);
+        PICOTEST_CHECK(when_pending_run_count == 3 && when_pending_run_order[2] == &when_pending_workers[3],
+                       "newly pending high priority worker did not run first");
+        async_context_poll(context);
+        async_context_poll(context);
+        PICOTEST_CHECK(when_pending_run_count == 5, "deferred workers did not run");
+        async_context_set_when_pending_budget_us(context, 0);
+        for (uint i = 0; i < count_of(when_pending_workers); i++) {
+            PICOTEST_CHECK(async_context_remove_when_pending_worker(context, &when_pending_workers[i]), "worker not removed");
+        }
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("when_pending workers removed while pending");
+        for (uint i = 0; i < count_of(when_pending_workers); i++) {
+            when_pending_workers[i].do_work = i ? when_pending_do_work : removing_do_work;
+            when_pending_workers[i].priority = ASYNC_WHEN_PENDING_WORKER_PRIORITY_NORMAL;
+            PICOTEST_CHECK(async_context_add_when_pending_worker(context, &when_pending_workers[i]), "worker not added");
+        }
+        when_pending_run_count = 0;
+        // workers of the same priority run in the order they were marked pending
+        async_context_set_work_pending(context, &when_pending_workers[3]);
+        async_context_set_work_pending(context, &when_pending_workers[0]);
+        async_context_set_work_pending(context, &when_pending_workers[2]);
+        async_context_set_work_pending(context, &when_pending_workers[1]);
+        async_context_set_work_pending(context, &when_pending_workers[3]);
+        PICOTEST_CHECK(async_context_remove_when_pending_worker(context, &when_pending_workers[1]), "worker not removed");
+        worker_to_remove = &when_pending_workers[2];
+        repeat_work = true;
+        async_context_poll(context);
+        PICOTEST_CHECK(when_pending_run_count == 2 && when_pending_run_order[0] == &when_pending_workers[3] &&
+                       when_pending_run_order[1] == &when_pending_workers[0], "removed workers ran, or wrong order");
+        async_context_poll(context);
+        PICOTEST_CHECK(when_pending_run_count == 3 && when_pending_run_order[2] == &when_pending_workers[0],
+                       "worker which set work_pending on itself did not run again");
+        async_context_poll(context);
+        PICOTEST_CHECK(when_pending_run_count == 3, "worker ran without work pending");
+        PICOTEST_CHECK(!context->when_pending_levels, "no work pending, but a level is flagged");
+        PICOTEST_CHECK(async_context_remove_when_pending_worker(context, &when_pending_workers[0]), "worker not removed");
+        PICOTEST_CHECK(async_context_remove_when_pending_worker(context, &when_pending_workers[3]), "worker not removed");
+    PICOTEST_END_SECTION();
+
+#if PICO_ASYNC_CONTEXT_PROFILE
+    PICOTEST_START_SECTION("worker profiling");
+        async_context_reset_profiles(context);
+        reset_run_state();
+        when_pending_run_count = 0;
+        when_pending_work_us = 500;
+        async_when_pending_worker_t *worker = &when_pending_workers[0];
+        *worker = (async_when_pending_worker_t) {
+            .do_work = when_pending_do_work,
+        };
+        async_context_add_when_pending_worker(context, worker);
+        for (uint i = 0; i < 3; i++) {
+            async_context_set_work_pending(context, worker);
+            busy_wait_us_32(200);
+            async_context_poll(context);
+        }
+        async_context_worker_profile_t profile;
+        async_context_get_when_pending_worker_profile(context, worker, &profile);
+        PICOTEST_CHECK(profile.invocation_count == 3, "wrong when_pending invocation count");
+        PICOTEST_CHECK(profile.max_run_us >= 500 && profile.total_run_us >= 1500, "when_pending run time not recorded");
+        PICOTEST_CHECK(profile.max_wait_us >= 200 && profile.total_wait_us >= 600, "when_pending wait time not recorded");
+        async_context_remove_when_pending_worker(context, worker);
+        when_pending_work_us = 0;
+
+        at_time_workers[0] = (async_at_time_worker_t) {
+            .do_work = at_time_do_work,
+        };
+        async_context_add_at_time_worker_in_ms(context, &at_time_workers[0], 1);
+        busy_wait_ms(3);
+        async_context_poll(context);
+        async_context_get_at_time_worker_profile(context, &at_time_workers[0], &profile);
+        PICOTEST_CHECK(profile.invocation_count == 1, "wrong at_time invocation count");
+        PICOTEST_CHECK(profile.max_wait_us >= 1000, "at_time lateness not recorded");
+
+        async_context_acquire_lock_blocking(context);
+        async_context_acquire_lock_blocking(context);
+        busy_wait_us_32(100);
+        async_context_release_lock(context);
+        async_context_release_lock(context);
+        async_context_lock_profile_t lock_profile;
+        async_context_get_lock_profile(context, &lock_profile);
+        PICOTEST_CHECK(lock_profile.acquire_count == 1, "nested lock acquisition counted");
+        PICOTEST_CHECK(lock_profile.max_hold_us >= 100, "lock hold time not recorded");
+    PICOTEST_END_SECTION();
+#endif
+
+    PICOTEST_START_SECTION("at_time worker benchmark");
+        for (uint n = 8; n <= MAX_AT_TIME_WORKERS; n *= 2) {
+            reset_run_state();
+            absolute_time_t now = get_absolute_time();
+            uint64_t t0 = time_us_64();
+            for (uint i = 0; i < n; i++) {
+                async_context_add_at_time_worker_at(context, &at_time_workers[i], delayed_by_us(now, (i * 7919) % n));
+            }
+            uint64_t t1 = time_us_64();
+            busy_wait_us(n);
+            async_context_poll(context);
+            uint64_t t2 = time_us_64();
+            PICOTEST_CHECK(run_count == n, "not all workers ran");
+            printf("%3u workers: add %d us, execute %d us\n", n, (int)(t1 - t0), (int)(t2 - t1 - n));
+        }
+    PICOTEST_END_SECTION();
+
+    async_context_deinit(context);
+
+    PICOTEST_START_SECTION("each context has its own spin lock");
+        static async_context_poll_t other_context;
+        // more times than there are spin locks to claim, so a lock not released by deinit runs them out
+        for (uint i = 0; i < NUM_SPIN_LOCKS * 2; i++) {
+            PICOTEST_CHECK_AND_ABORT(async_context_poll_init_with_defaults(&poll_context), "init failed");
+            PICOTEST_CHECK_AND_ABORT(async_context_poll_init_with_defaults(&other_context), "init failed");
+            PICOTEST_CHECK(poll_context.core.when_pending_spin_lock != other_context.core.when_pending_spin_lock,
+                           "contexts share a spin lock");
+            async_context_deinit(&other_context.core);
+            async_context_deinit(&poll_context.core);
+        }
+    PICOTEST_END_SECTION();
+
+#if LIB_PICO_ASYNC_CONTEXT_MULTICORE
+    PICOTEST_START_SECTION("multicore when_pending worker affinity");
+        PICOTEST_CHECK_AND_ABORT(async_context_multicore_init_with_defaults(&multicore_context), "init failed");
+        context = &multicore_context.core;
+        sem_init(&multicore_worker_done, 0, 1);
+        multicore_launch_core1(core1_entry);
+        while (!core1_added) {
+            tight_loop_contents();
+        }
+        async_when_pending_worker_t *worker = &when_pending_workers[0];
+        *worker = (async_when_pending_worker_t) {
+            .do_work = multicore_do_work,
+            .core_affinity = 1u << 1,
+        };
+        async_context_add_when_pending_worker(context, worker);
+        async_context_set_work_pending(context, worker);
+        PICOTEST_CHECK(sem_acquire_timeout_ms(&multicore_worker_done, 1000), "core 1 worker did not run");
+        PICOTEST_CHECK(multicore_worker_core_num == 1, "core 1 worker ran on the wrong core");
+        worker->core_affinity = 0;
+        async_context_set_work_pending(context, worker);
+        PICOTEST_CHECK(sem_acquire_timeout_ms(&multicore_worker_done, 1000), "core 0 worker did not run");
+        PICOTEST_CHECK(multicore_worker_core_num == 0, "core 0 worker ran on the wrong core");
+        async_context_remove_when_pending_worker(context, worker);
+        core1_should_remove = true;
+        while (core1_added) {
+            tight_loop_contents();
+        }
+        async_context_deinit(context);
+    PICOTEST_END_SECTION();
+#endif
+
+#if LIB_PICO_ASYNC_CONTEXT_EPOLL
+    PICOTEST_START_SECTION("epoll with thread");
+        PICOTEST_CHECK_AND_ABORT(async_context_epoll_init_with_defaults(&epoll_context), "init failed");
+        test_epoll_context(&epoll_context.core, true);
+        async_context_deinit(&epoll_context.core);
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("epoll polled");
+        async_context_epoll_config_t config = async_context_epoll_default_config();
+        config.create_thread = false;
+        PICOTEST_CHECK_AND_ABORT(async_context_epoll_init(&epoll_context, &config), "init failed");
+        test_epoll_context(&epoll_context.core, false);
+        async_context_deinit(&epoll_context.core);
+    PICOTEST_END_SECTION();
+#endif
+
+    PICOTEST_END_TEST();
+}
@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Logs records of each kind of argument, and decodes them with tools/binary_log_decode.py, checking the messages
+// match those formatted by the C library.
+//
+// Usage: pico_binary_log_test
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "pico/binary_log.h"
+#include "pico/test.h"
+
+PICOTEST_MODULE_NAME("pico_binary_log_test", "binary log test harness");
+
+#define MAX_LINES 256
+#define MAX_LINE_LEN 128
+
+static char output[64 * 1024];
+static uint output_len;
+
+static char expected[MAX_LINES][MAX_LINE_LEN];
+static uint expected_count;
+static uint drained_count;
+
+static void capture(const char *buf, int len) {
+    if (output_len + (uint)len <= sizeof(output)) memcpy(output + output_len, buf, (size_t)len);
+    output_len += (uint)len;
+}
+
+static void expect(const char *fmt, ...) {
+    if (expected_count == MAX_LINES) return;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(expected[expected_count++], MAX_LINE_LEN, fmt, args);
+    va_end(args);
+}
+
+// logs a record, and expects the message the C library formats from the same arguments
+#define LOG_AND_EXPECT(fmt, ...) ({ \
+    pico_binary_log(fmt, ##__VA_ARGS__); \
+    expect(fmt, ##__VA_ARGS__); \
+})
+
+static void drain(void) {
+    drained_count += pico_binary_log_drain();
+}
+
+// regular text output between the records, which the decoder passes through; the records logged so far are sent
+// first, so that the text follows them
+static void text(const char *s) {
+    drain();
+    capture(s, (int)strlen(s));
+    expect("%.*s", (int)strcspn(s, "\n"), s);
+}
+
+static uint zero_count(void) {
+    uint count = 0;
+    for (uint i = 0; i < output_len; i++) count += !output[i];
+    return count;
+}
+
+// runs the decoder on the output, checking each line matches the expected message; returns the number of mismatches
+static uint decode_and_check(const char *elf_path) {
+    char path[] = "/tmp/pico_binary_log_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, output, output_len) != (ssize_t)output_len) {
+        printf("failed to write %s\n", path);
+        return 1;
+    }
+    close(fd);
+    static char command[1024];
+    snprintf(command, sizeof(command), "%s %s %s %s", PYTHON3_EXECUTABLE, BINARY_LOG_DECODE_PY, elf_path, path);
+    FILE *decoder = popen(command, "r");
+    if (!decoder) {
+        printf("failed to run %s\n", command);
+        unlink(path);
+        return 1;
+    }
+    uint mismatches = 0;
+    uint n = 0;
+    static char line[1024];
+    while (fgets(line, sizeof(line), decoder)) {
+        line[strcspn(line, "\n")] = 0;
+        // records are prefixed with the core number and timestamp
+        const char *message = line;
+        if (!strncmp(line, "[0:", 3) && strstr(line, "] ")) message = strstr(line, "] ") + 2;
+        if (n >= expected_count || strcmp(message, expected[n])) {
+            printf("decoded \"%s\", expected \"%s\"\n", line, n < expected_count ? expected[n] : "");
+            mismatches++;
+        }
+        n++;
+    }
+    if (pclose(decoder)) {
+        printf("%s failed\n", command);
+        mismatches++;
+    }
+    if (n != expected_count) {
+        printf("decoded %u lines, expected %u\n", n, expected_count);
+        mismatches++;
+    }
+    unlink(path);
+    return mismatches;
+}
+
+int main(__unused int argc, char **argv) {
+    stdio_init_all();
+    PICOTEST_START();
+
+    pico_binary_log_set_output(capture);
+
+    PICOTEST_START_SECTION("records of each type of argument");
+        text("text before the first record\n");
+        LOG_AND_EXPECT("no arguments");
+        LOG_AND_EXPECT("int %d unsigned %u hex %x octal %o", -42, 42u, 0xbeefu, 0755);
+        LOG_AND_EXPECT("char %c short %hd unsigned char %hhu", 'x', (short)-1234, (unsigned char)200);
+        LOG_AND_EXPECT("long long %lld unsigned long long %llu", -1234567890123ll, 12345678901234567890ull);
+        LOG_AND_EXPECT("double %.3f float %g exponent %e", 3.14159, 0.5f, -1.5e-10);
+        LOG_AND_EXPECT("width %5d|%-5d|%05d precision %.2f", 42, 42, 42, 2.0 / 3);
+        LOG_AND_EXPECT("percent %d%%", 50);
+        LOG_AND_EXPECT("eight %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8);
+        text("text between records\n");
+        LOG_AND_EXPECT("string '%s' and empty string '%s'", "hello", "");
+        // only the first PICO_BINARY_LOG_MAX_STRING_LEN characters of a string are logged
+        static const char *long_string = "a string which is longer than the number of characters copied into the "
+                                         "record";
+        pico_binary_log("long string '%s' then %d", long_string, 99);
+        expect("long string '%.*s' then %d", PICO_BINARY_LOG_MAX_STRING_LEN, long_string, 99);
+        drain();
+        PICOTEST_CHECK(drained_count == 10, "wrong number of records drained");
+        PICOTEST_CHECK(zero_count() == 2 * drained_count, "records not framed by zeros");
+        PICOTEST_CHECK(!pico_binary_log_drain(), "records drained twice");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("dropped records");
+        uint32_t dropped = pico_binary_log_get_dropped_count();
+        // more than fit in the ring
+        uint count = PICO_BINARY_LOG_RING_WORDS / 4 + 10;
+        for (uint i = 0; i < count; i++) {
+            pico_binary_log("record %u", i);
+        }
+        dropped = pico_binary_log_get_dropped_count() - dropped;
+        PICOTEST_CHECK(dropped && dropped < count, "wrong number of records dropped");
+        // the dropped records are reported first
+        expect("<%u records dropped>", dropped);
+        for (uint i = 0; i < count - dropped; i++) {
+            expect("record %u", i);
+        }
+        PICOTEST_CHECK(pico_binary_log_drain() == count - dropped + 1, "wrong number of records drained");
+        text("text after the last record\n");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("decoded by binary_log_decode.py");
+        PICOTEST_CHECK(!decode_and_check(argv[0]), "decoded messages don't match");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_END_TEST();
+}
@@ -0,0 +1,387 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/malloc.h"
+#include "pico/multicore.h"
+#include "pico/test.h"
+
+PICOTEST_MODULE_NAME("pico_malloc_test", "pico_malloc test harness");
+
+// Random malloc, calloc, realloc and free on both cores at once, with the contents of every live allocation checked
+// whenever it is touched. Most allocations are small, to exercise the arenas if PICO_MALLOC_PER_CORE_ARENAS is set,
+// with some much larger ones.
+#if PICO_ON_DEVICE
+#define SLOT_COUNT 64
+#define LARGE_SIZE_MAX 4096
+#define ITERATIONS 20000
+// an allocation of this size should succeed once everything has been freed, if free blocks are merged
+#define COALESCED_SIZE (32 * 1024)
+#else
+#define SLOT_COUNT 512
+#define LARGE_SIZE_MAX (64 * 1024)
+#define ITERATIONS 200000
+#define COALESCED_SIZE (8 * 1024 * 1024)
+#endif
+
+typedef struct {
+    uint8_t *mem;
+    uint32_t size;
+    uint32_t tag;
+} slot_t;
+
+static slot_t slots[NUM_CORES][SLOT_COUNT];
+
+#if PICO_MALLOC_TLSF
+static uint64_t extra_region[2048];
+#endif
+
+#if PICO_MALLOC_PROFILE
+// the parts of a pico_malloc_profile_dump which are checked
+#define SIZE_CLASS_COUNT 16
+#define MAX_SITES 64
+
+typedef struct {
+    uintptr_t address;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    uint32_t bytes_at_peak;
+} profile_site_t;
+
+typedef struct {
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    uint32_t live_count;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t failed_count;
+    uint32_t size_class_alloc_count[SIZE_CLASS_COUNT];
+    uint32_t site_count;
+    profile_site_t sites[MAX_SITES + 1];
+} profile_t;
+
+static uint8_t dump_buf[4096];
+
+static uint32_t dump_u32(size_t *pos) {
+    const uint8_t *b = dump_buf + *pos;
+    *pos += 4;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uintptr_t dump_address(size_t *pos) {
+    uintptr_t address = dump_u32(pos);
+#if __SIZEOF_POINTER__ == 8
+    address |= (uintptr_t)dump_u32(pos) << 32;
+#endif
+    return address;
+}
+
+// returns false if the dump is malformed
+static bool read_profile(profile_t *profile) {
+    size_t size = pico_malloc_profile_dump(dump_buf, sizeof(dump_buf));
+    if (size > sizeof(dump_buf)) return false;
+    size_t pos = 0;
+    if (dump_u32(&pos) != 0x46504d50) return false;
+    // version, pointer size and size class count
+    if (dump_u32(&pos) != (1u | (sizeof(void *) << 8) | (SIZE_CLASS_COUNT << 16))) return false;
+    if (dump_address(&pos) != (uintptr_t)pico_malloc_profile_dump) return false;
+    profile->live_bytes = dump_u32(&pos);
+    profile->peak_bytes = dump_u32(&pos);
+    profile->live_count = dump_u32(&pos);
+    profile->alloc_count = dump_u32(&pos);
+    profile->free_count = dump_u32(&pos);
+    profile->failed_count = dump_u32(&pos);
+    pos += 3 * 4; // heap bytes, free bytes and largest free block
+    for (uint i = 0; i < SIZE_CLASS_COUNT; i++) {
+        profile->size_class_alloc_count[i] = dump_u32(&pos);
+        pos += 3 * 4;
+    }
+    profile->site_count = dump_u32(&pos);
+    if (profile->site_count > MAX_SITES + 1) return false;
+    for (uint i = 0; i < profile->site_count; i++) {
+        profile_site_t *site = &profile->sites[i];
+        site->address = dump_address(&pos);
+        site->alloc_count = dump_u32(&pos);
+        site->free_count = dump_u32(&pos);
+        site->live_bytes = dump_u32(&pos);
+        site->peak_bytes = dump_u32(&pos);
+        site->bytes_at_peak = dump_u32(&pos);
+    }
+    return pos == size;
+}
+
+// the site in after which is either new or has more allocations than in before, and has alloc_count allocations and
+// live_bytes bytes live in total; NULL if there isn't exactly one
+static const profile_site_t *changed_site(const profile_t *before, const profile_t *after, uint32_t alloc_count,
+                                          uint32_t live_bytes) {
+    const profile_site_t *rc = NULL;
+    for (uint i = 0; i < after->site_count; i++) {
+        const profile_site_t *site = &after->sites[i];
+        uint32_t previous_count = 0;
+        for (uint j = 0; j < before->site_count; j++) {
+            if (before->sites[j].address == site->address) previous_count = before->sites[j].alloc_count;
+        }
+        if (site->alloc_count != previous_count && site->alloc_count == alloc_count && site->live_bytes == live_bytes) {
+            if (rc) return NULL;
+            rc = site;
+        }
+    }
+    return rc;
+}
+
+// separate functions, so each is one call site however often it is called; the result is passed through a volatile
+// so that the calls can't be made as tail calls, which would record the call sites in the caller
+static void *volatile last_alloc;
+
+static void __noinline *alloc_at_site_a(size_t size) {
+    last_alloc = malloc(size);
+    return last_alloc;
+}
+
+static void __noinline *alloc_at_site_b(size_t size) {
+    last_alloc = calloc(1, size);
+    return last_alloc;
+}
+
+static void __noinline *alloc_at_site_c(size_t size) {
+    last_alloc = realloc(NULL, size);
+    return last_alloc;
+}
+
+static profile_t profile_before, profile_after;
+#endif
+
+static uint32_t xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static inline uint8_t pattern_byte(uint32_t tag, uint32_t i) {
+    return (uint8_t)(tag + i * 131u + (i >> 8));
+}
+
+static void fill(slot_t *slot, uint32_t from) {
+    for (uint32_t i = from; i < slot->size; i++) {
+        slot->mem[i] = pattern_byte(slot->tag, i);
+    }
+}
+
+static bool check(const slot_t *slot, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        if (slot->mem[i] != pattern_byte(slot->tag, i)) {
+            printf("slot %p size %u: byte %u is %02x, expected %02x\n", slot->mem, (uint) slot->size, (uint) i,
+                   slot->mem[i], pattern_byte(slot->tag, i));
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t random_size(uint32_t *state) {
+    uint32_t r = xorshift32(state);
+    if ((r & 15) == 0) return 1 + (r >> 8) % LARGE_SIZE_MAX;
+    if ((r & 15) < 4) return 1 + (r >> 8) % 1024;
+    return 1 + (r >> 8) % 128;
+}
+
+static bool aligned(const void *mem) {
+    return !((uintptr_t)mem & 7);
+}
+
+// returns the number of errors found
+static uint32_t stress(uint core, uint32_t seed) {
+    uint32_t errors = 0;
+    uint32_t state = seed;
+    for (uint32_t n = 0; n < ITERATIONS; n++) {
+        uint32_t r = xorshift32(&state);
+        slot_t *slot = &slots[core][(r >> 4) % SLOT_COUNT];
+        if (!slot->mem) {
+            slot->size = random_size(&state);
+            slot->tag = xorshift32(&state);
+            if (r & 1) {
+                slot->mem = (uint8_t *)calloc(1, slot->size);
+                if (slot->mem) {
+                    for (uint32_t i = 0; i < slot->size; i++) {
+                        if (slot->mem[i]) {
+                            printf("calloc of %u bytes returned non zero memory\n", (uint) slot->size);
+                            errors++;
+                            break;
+                        }
+                    }
+                }
+            } else {
+                slot->mem = (uint8_t *)malloc(slot->size);
+            }
+            if (!slot->mem || !aligned(slot->mem)) {
+                printf("allocation of %u bytes returned %p\n", (uint) slot->size, slot->mem);
+                errors++;
+                slot->mem = NULL;
+                continue;
+            }
+            fill(slot, 0);
+        } else {
+            if (!check(slot, slot->size)) errors++;
+            if (r & 2) {
+                free(slot->mem);
+                slot->mem = NULL;
+            } else {
+                uint32_t new_size = random_size(&state);
+                uint8_t *mem = (uint8_t *)realloc(slot->mem, new_size);
+                if (!mem || !aligned(mem)) {
+                    printf("reallocation of %u bytes to %u bytes returned %p\n", (uint) slot->size, (uint) new_size, mem);
+                    errors++;
+                    if (mem) free(mem);
+                    slot->mem = NULL;
+                    continue;
+                }
+                slot->mem = mem;
+                uint32_t old_size = slot->size;
+                slot->size = new_size;
+                if (!check(slot, MIN(old_size, new_size))) errors++;
+                fill(slot, MIN(old_size, new_size));
+            }
+        }
+    }
+    // check everything that is still live
+    for (uint i = 0; i < SLOT_COUNT; i++) {
+        if (slots[core][i].mem && !check(&slots[core][i], slots[core][i].size)) errors++;
+    }
+    return errors;
+}
+
+static void core1_entry(void) {
+    multicore_fifo_push_blocking(stress(1, multicore_fifo_pop_blocking()));
+}
+
+int main(void) {
+    stdio_init_all();
+    PICOTEST_START();
+
+#if PICO_MALLOC_TLSF
+    PICOTEST_START_SECTION("pico_malloc_add_region");
+        PICOTEST_CHECK(pico_malloc_add_region(extra_region, sizeof(extra_region)), "pico_malloc_add_region failed");
+        // an empty region is rejected
+        PICOTEST_CHECK(!pico_malloc_add_region(NULL, 0), "pico_malloc_add_region accepted an empty region");
+    PICOTEST_END_SECTION();
+#endif
+
+#if PICO_MALLOC_PROFILE
+    PICOTEST_START_SECTION("pico_malloc_profile_dump");
+        PICOTEST_CHECK_AND_ABORT(read_profile(&profile_before), "malformed dump");
+        // three allocations of 100 bytes at one site, one freed; one of 1000 bytes at another
+        void *a[3];
+        for (uint i = 0; i < 3; i++) a[i] = alloc_at_site_a(100);
+        void *b = alloc_at_site_b(1000);
+        free(a[1]);
+        // then a new peak, from a third site
+        uint32_t peak_size = profile_before.peak_bytes + 4096;
+        void *c = alloc_at_site_c(peak_size);
+        free(c);
+        PICOTEST_CHECK_AND_ABORT(read_profile(&profile_after), "malformed dump");
+        PICOTEST_CHECK(profile_after.alloc_count == profile_before.alloc_count + 5, "wrong alloc_count");
+        PICOTEST_CHECK(profile_after.free_count == profile_before.free_count + 2, "wrong free_count");
+        PICOTEST_CHECK(profile_after.live_count == profile_before.live_count + 3, "wrong live_count");
+        PICOTEST_CHECK(profile_after.live_bytes == profile_before.live_bytes + 1200, "wrong live_bytes");
+        PICOTEST_CHECK(profile_after.peak_bytes == profile_before.live_bytes + 1200 + peak_size, "wrong peak_bytes");
+        PICOTEST_CHECK(profile_after.failed_count == profile_before.failed_count, "wrong failed_count");
+        PICOTEST_CHECK(profile_after.site_count == profile_before.site_count + 3, "wrong site_count");
+        // 100 bytes are in the size class up to 128 bytes, and 1000 in the one up to 1024
+        PICOTEST_CHECK(profile_after.size_class_alloc_count[4] == profile_before.size_class_alloc_count[4] + 3,
+                       "wrong size class count");
+        PICOTEST_CHECK(profile_after.size_class_alloc_count[7] == profile_before.size_class_alloc_count[7] + 1,
+                       "wrong size class count");
+        const profile_site_t *site = changed_site(&profile_before, &profile_after, 3, 200);
+        PICOTEST_CHECK(site && site->free_count == 1 && site->peak_bytes == 300 && site->bytes_at_peak == 200,
+                       "wrong counts for the first site");
+        site = changed_site(&profile_before, &profile_after, 1, 1000);
+        PICOTEST_CHECK(site && site->free_count == 0 && site->peak_bytes == 1000 && site->bytes_at_peak == 1000,
+                       "wrong counts for the second site");
+        site = changed_site(&profile_before, &profile_after, 1, 0);
+        PICOTEST_CHECK(site && site->free_count == 1 && site->peak_bytes == peak_size &&
+                       site->bytes_at_peak == peak_size, "wrong counts for the third site");
+        free(a[0]);
+        free(a[2]);
+        free(b);
+        PICOTEST_CHECK_AND_ABORT(read_profile(&profile_after), "malformed dump");
+        PICOTEST_CHECK(profile_after.live_bytes == profile_before.live_bytes &&
+                       profile_after.live_count == profile_before.live_count, "live counts wrong after freeing");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("free of memory allocated by the C library");
+        PICOTEST_CHECK_AND_ABORT(read_profile(&profile_before), "malformed dump");
+        // allocated within the C library, so without a profile header
+        char *s = strdup("allocated by the C library");
+        PICOTEST_CHECK_AND_ABORT(s, "strdup failed");
+        s = realloc(s, 1000);
+        PICOTEST_CHECK_AND_ABORT(s, "realloc failed");
+        PICOTEST_CHECK(!strcmp(s, "allocated by the C library"), "contents lost by realloc");
+        free(s);
+        PICOTEST_CHECK_AND_ABORT(read_profile(&profile_after), "malformed dump");
+        PICOTEST_CHECK(profile_after.alloc_count == profile_before.alloc_count &&
+                       profile_after.free_count == profile_before.free_count, "C library allocation was profiled");
+    PICOTEST_END_SECTION();
+
+    // to check that everything allocated by the tests below is accounted as freed
+    PICOTEST_CHECK_AND_ABORT(read_profile(&profile_before), "malformed dump");
+#endif
+
+    PICOTEST_START_SECTION("random malloc, calloc, realloc and free on one core");
+        PICOTEST_CHECK(!stress(0, 0x12345678), "contents check failed");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("random malloc, calloc, realloc and free on both cores");
+        multicore_launch_core1(core1_entry);
+        multicore_fifo_push_blocking(0x9e3779b9);
+        PICOTEST_CHECK(!stress(0, 0x2545f491), "contents check failed on core 0");
+        PICOTEST_CHECK(!multicore_fifo_pop_blocking(), "contents check failed on core 1");
+        multicore_reset_core1();
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("free on the other core");
+        // core 1's allocations are freed by core 0
+        uint32_t errors = 0;
+        for (uint core = 0; core < NUM_CORES; core++) {
+            for (uint i = 0; i < SLOT_COUNT; i++) {
+                slot_t *slot = &slots[core][i];
+                if (slot->mem) {
+                    if (!check(slot, slot->size)) errors++;
+                    free(slot->mem);
+                    slot->mem = NULL;
+                }
+            }
+        }
+        PICOTEST_CHECK(!errors, "contents check failed");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("large allocation after freeing everything");
+        void *mem = malloc(COALESCED_SIZE);
+        PICOTEST_CHECK(mem, "allocation failed");
+        if (mem) {
+            memset(mem, 0xa5, COALESCED_SIZE);
+            free(mem);
+        }
+    PICOTEST_END_SECTION();
+
+#if PICO_MALLOC_PROFILE
+    PICOTEST_START_SECTION("profile after freeing everything");
+        PICOTEST_CHECK_AND_ABORT(read_profile(&profile_after), "malformed dump");
+        PICOTEST_CHECK(profile_after.live_bytes == profile_before.live_bytes &&
+                       profile_after.live_count == profile_before.live_count, "live counts wrong after freeing");
+        PICOTEST_CHECK(profile_after.alloc_count - profile_before.alloc_count ==
+                       profile_after.free_count - profile_before.free_count, "allocations and frees differ");
+    PICOTEST_END_SECTION();
+#endif
+
+    PICOTEST_END_TEST();
+}
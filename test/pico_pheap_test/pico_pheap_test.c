@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/util/pheap.h"
+#include "pico/test.h"
+
+PICOTEST_MODULE_NAME("pico_pheap_test", "pheap test harness");
+
+// more nodes than fit in an 8-bit id, when the ids are wider
+#if PICO_PHEAP_MAX_ENTRIES < 256
+#define NODE_COUNT 200
+#else
+#define NODE_COUNT 1000
+#endif
+#define KEY_CHANGES 5000
+
+static uint32_t keys[NODE_COUNT + 1];
+static bool in_heap[NODE_COUNT + 1];
+static uint32_t random_state = 1;
+
+PHEAP_DEFINE_STATIC(heap, NODE_COUNT);
+
+static bool key_less(__unused void *user_data, pheap_node_id_t a, pheap_node_id_t b) {
+    return keys[a] < keys[b];
+}
+
+static uint32_t next_random(void) {
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// a key with plenty of duplicates
+static uint32_t random_key(void) {
+    return next_random() % (NODE_COUNT * 4);
+}
+
+// true if the head of the heap has the smallest key of the nodes in it
+static bool head_is_min(void) {
+    pheap_node_id_t head = ph_peek_head(&heap);
+    for (uint id = 1; id <= NODE_COUNT; id++) {
+        if (in_heap[id] && (!head || keys[id] < keys[head])) return false;
+    }
+    return !head || in_heap[head];
+}
+
+// removes every node from the heap, checking they come out in order, and each node that is in it comes out once;
+// returns the number removed, or -1 if the order or the nodes are wrong
+static int drain(void) {
+    int count = 0;
+    uint32_t last_key = 0;
+    pheap_node_id_t id;
+    while ((id = ph_peek_head(&heap))) {
+        if (id > NODE_COUNT || !in_heap[id] || keys[id] < last_key) {
+            printf("node %u with key %u removed out of order\n", (uint) id, (uint) keys[id]);
+            return -1;
+        }
+        last_key = keys[id];
+        in_heap[id] = false;
+        if (ph_remove_and_free_head(&heap) != id) return -1;
+        count++;
+    }
+    for (uint i = 1; i <= NODE_COUNT; i++) {
+        if (in_heap[i]) {
+            printf("node %u was never removed\n", i);
+            return -1;
+        }
+    }
+    return count;
+}
+
+// changes the keys of random nodes in the heap, with either ph_decrease_key or ph_reposition, checking the head is
+// correct after each; returns false if it isn't
+static bool change_keys(void) {
+    for (uint i = 0; i < KEY_CHANGES; i++) {
+        pheap_node_id_t id = (pheap_node_id_t)(next_random() % NODE_COUNT + 1);
+        if (!in_heap[id]) continue;
+        if (next_random() & 1) {
+            if (!keys[id]) continue;
+            keys[id] = next_random() % keys[id];
+            ph_decrease_key(&heap, id);
+        } else {
+            keys[id] = random_key();
+            ph_reposition(&heap, id);
+        }
+        if (!head_is_min()) {
+            printf("wrong head after changing the key of node %u\n", (uint) id);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    stdio_init_all();
+    PICOTEST_START();
+
+    ph_post_alloc_init(&heap, NODE_COUNT, key_less, NULL);
+
+    PICOTEST_START_SECTION("ph_heapify");
+        for (uint id = 1; id <= NODE_COUNT; id++) {
+            keys[id] = random_key();
+            in_heap[id] = true;
+        }
+        ph_heapify(&heap, NODE_COUNT);
+        PICOTEST_CHECK(head_is_min(), "wrong head after ph_heapify");
+        PICOTEST_CHECK(drain() == NODE_COUNT, "nodes removed out of order, or the wrong number of them");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("ph_decrease_key and ph_reposition after ph_heapify");
+        for (uint id = 1; id <= NODE_COUNT; id++) {
+            keys[id] = random_key();
+            in_heap[id] = true;
+        }
+        ph_heapify(&heap, NODE_COUNT);
+        PICOTEST_CHECK(change_keys(), "wrong head after changing a key");
+        PICOTEST_CHECK(drain() == NODE_COUNT, "nodes removed out of order, or the wrong number of them");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("ph_insert_nodes into a non empty heap");
+        ph_clear(&heap);
+        // a third inserted one at a time, then the rest in a batch
+        static pheap_node_id_t ids[NODE_COUNT];
+        uint count = 0;
+        for (uint i = 0; i < NODE_COUNT; i++) {
+            pheap_node_id_t id = ph_new_node(&heap);
+            keys[id] = random_key();
+            in_heap[id] = true;
+            if (i < NODE_COUNT / 3) {
+                ph_insert_node(&heap, id);
+            } else {
+                ids[count++] = id;
+            }
+        }
+        ph_insert_nodes(&heap, ids, count);
+        PICOTEST_CHECK(head_is_min(), "wrong head after ph_insert_nodes");
+        PICOTEST_CHECK(!ph_new_node(&heap), "more nodes allocated than the heap holds");
+        PICOTEST_CHECK(change_keys(), "wrong head after changing a key");
+        // remove some arbitrary nodes, and reinsert half of them with new keys
+        uint removed = 0;
+        for (uint i = 0; i < NODE_COUNT / 4; i++) {
+            pheap_node_id_t id = (pheap_node_id_t)(next_random() % NODE_COUNT + 1);
+            if (!in_heap[id]) continue;
+            ph_remove_and_free_node(&heap, id);
+            in_heap[id] = false;
+            removed++;
+            if (i & 1) {
+                id = ph_new_node(&heap);
+                keys[id] = random_key();
+                in_heap[id] = true;
+                ph_insert_node(&heap, id);
+                removed--;
+            }
+        }
+        PICOTEST_CHECK(head_is_min(), "wrong head after removing nodes");
+        PICOTEST_CHECK(drain() == (int)(NODE_COUNT - removed), "nodes removed out of order, or the wrong number of them");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_END_TEST();
+}
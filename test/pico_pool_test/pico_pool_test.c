@@ -0,0 +1,305 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/util/pool.h"
+#include "pico/test.h"
+
+PICOTEST_MODULE_NAME("pico_pool_test", "pool test harness");
+
+// more than fit in the per-core caches, so objects have to move between the caches and the shared free list
+#define ELEMENT_COUNT 32
+// not a multiple of 8, so is rounded up
+#define OBJECT_SIZE 20
+#define ITERATIONS 100000
+#define HELD_MAX 8
+// sent to core 1 in place of an object index when it should stop
+#define STOP 0xffffffffu
+
+typedef struct {
+    uint32_t index;
+    uint32_t tag;
+    uint8_t data[OBJECT_SIZE - 8];
+} object_t;
+static_assert(sizeof(object_t) == OBJECT_SIZE, "");
+
+POOL_DEFINE_STATIC_STORAGE(storage, OBJECT_SIZE, ELEMENT_COUNT);
+static pool_t pool;
+// the objects each core has allocated, by index
+static object_t *objects[NUM_CORES][ELEMENT_COUNT];
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static uint32_t object_index(const object_t *obj) {
+    return (uint32_t)(((const uint8_t *)obj - (const uint8_t *)storage) / POOL_ELEMENT_SIZE(OBJECT_SIZE));
+}
+
+static void fill(object_t *obj, uint32_t tag) {
+    obj->index = object_index(obj);
+    obj->tag = tag;
+    for (uint i = 0; i < sizeof(obj->data); i++) obj->data[i] = (uint8_t)(tag + i);
+}
+
+static bool check(const object_t *obj, uint32_t tag) {
+    if (obj->index != object_index(obj) || obj->tag != tag) return false;
+    for (uint i = 0; i < sizeof(obj->data); i++) {
+        if (obj->data[i] != (uint8_t)(tag + i)) return false;
+    }
+    return true;
+}
+
+// a valid object from the pool, which isn't in use on either core
+static bool valid_new_object(const object_t *obj) {
+    if (!obj || !pool_contains(&pool, obj) || (uintptr_t)obj & 7) return false;
+    if (((const uint8_t *)obj - (const uint8_t *)storage) % POOL_ELEMENT_SIZE(OBJECT_SIZE)) return false;
+    for (uint core = 0; core < NUM_CORES; core++) {
+        if (objects[core][object_index(obj)]) return false;
+    }
+    return true;
+}
+
+// allocates from the pool on the calling core until it is empty, checking each object and filling it in with tag;
+// returns the number allocated, or -1 if an object was wrong
+static int alloc_all(uint32_t tag) {
+    int count = 0;
+    object_t *obj;
+    while ((obj = (object_t *)pool_alloc(&pool))) {
+        if (!valid_new_object(obj)) {
+            printf("pool_alloc returned %p, which is invalid or already in use\n", obj);
+            return -1;
+        }
+        fill(obj, tag);
+        objects[get_core_num()][object_index(obj)] = obj;
+        count++;
+    }
+    return count;
+}
+
+// frees every object in use on the calling core, checking it still holds tag; returns false if any didn't
+static bool free_all(uint32_t tag) {
+    bool rc = true;
+    object_t **held = objects[get_core_num()];
+    for (uint i = 0; i < ELEMENT_COUNT; i++) {
+        if (held[i]) {
+            if (!check(held[i], tag)) rc = false;
+            pool_free(&pool, held[i]);
+            held[i] = NULL;
+        }
+    }
+    return rc;
+}
+
+static volatile uint32_t core1_errors;
+
+// frees the objects whose indexes are sent by core 0, until told to stop
+static void core1_free_entry(void) {
+    uint32_t index;
+    while ((index = multicore_fifo_pop_blocking()) != STOP) {
+        object_t *obj = (object_t *)((uint8_t *)storage + index * POOL_ELEMENT_SIZE(OBJECT_SIZE));
+        if (!check(obj, index)) core1_errors++;
+        pool_free(&pool, obj);
+    }
+    multicore_fifo_push_blocking(0);
+}
+
+// allocates everything it can, then frees it all, when told to by core 0
+static void core1_alloc_entry(void) {
+    while (multicore_fifo_pop_blocking() != STOP) {
+        multicore_fifo_push_blocking((uint32_t)alloc_all(1));
+        multicore_fifo_pop_blocking();
+        multicore_fifo_push_blocking(free_all(1));
+    }
+    multicore_fifo_push_blocking(0);
+}
+
+int main(void) {
+    stdio_init_all();
+    PICOTEST_START();
+
+    pool_stats_t stats;
+    pool_init_with_storage_and_spinlock(&pool, storage, OBJECT_SIZE, ELEMENT_COUNT,
+                                        (uint)spin_lock_claim_unused(true));
+
+    PICOTEST_START_SECTION("allocate until exhausted");
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(stats.element_count == ELEMENT_COUNT && !stats.in_use && !stats.high_water,
+                       "wrong stats for a new pool");
+        PICOTEST_CHECK(alloc_all(0) == ELEMENT_COUNT, "wrong number of objects allocated");
+        PICOTEST_CHECK(!pool_alloc(&pool), "allocation from an empty pool succeeded");
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(stats.in_use == ELEMENT_COUNT && stats.high_water == ELEMENT_COUNT,
+                       "wrong in_use or high_water");
+        // the failure which ended alloc_all, and the one above
+        PICOTEST_CHECK(stats.alloc_count == ELEMENT_COUNT && stats.failed_count == 2,
+                       "wrong alloc_count or failed_count");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("pool_contains");
+        PICOTEST_CHECK(pool_contains(&pool, storage), "first object not contained");
+        PICOTEST_CHECK(pool_contains(&pool, (uint8_t *)storage + sizeof(storage) - 1), "last byte not contained");
+        PICOTEST_CHECK(!pool_contains(&pool, (uint8_t *)storage + sizeof(storage)), "byte after the end contained");
+        PICOTEST_CHECK(!pool_contains(&pool, (uint8_t *)storage - 1), "byte before the start contained");
+        PICOTEST_CHECK(!pool_contains(&pool, &stats), "unrelated object contained");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("free and reallocate");
+        // free every other object, which can all be allocated again
+        for (uint i = 0; i < ELEMENT_COUNT; i += 2) {
+            PICOTEST_CHECK(check(objects[0][i], 0), "object contents changed");
+            pool_free(&pool, objects[0][i]);
+            objects[0][i] = NULL;
+        }
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(stats.in_use == ELEMENT_COUNT / 2 && stats.high_water == ELEMENT_COUNT,
+                       "wrong in_use or high_water");
+        PICOTEST_CHECK(stats.free_count == ELEMENT_COUNT / 2, "wrong free_count");
+        for (uint i = 0; i < ELEMENT_COUNT; i += 2) {
+            object_t *obj = (object_t *)pool_alloc(&pool);
+            PICOTEST_CHECK_AND_ABORT(valid_new_object(obj), "freed object not reallocated");
+            fill(obj, 0);
+            objects[0][object_index(obj)] = obj;
+        }
+        PICOTEST_CHECK(!pool_alloc(&pool), "allocation from an empty pool succeeded");
+        PICOTEST_CHECK(free_all(0), "object contents changed");
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(!stats.in_use && stats.high_water == ELEMENT_COUNT, "wrong in_use or high_water");
+        PICOTEST_CHECK(stats.failed_count == 3, "wrong failed_count");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("free on the other core");
+        // core 1 frees everything core 0 allocated, which with the per-core caches fills core 1's cache and spills
+        // the rest to the shared free list
+        multicore_launch_core1(core1_free_entry);
+        core1_errors = 0;
+        PICOTEST_CHECK(alloc_all(0) == ELEMENT_COUNT, "wrong number of objects allocated");
+        for (uint i = 0; i < ELEMENT_COUNT; i++) {
+            fill(objects[0][i], i);
+            multicore_fifo_push_blocking(i);
+            objects[0][i] = NULL;
+        }
+        multicore_fifo_push_blocking(STOP);
+        multicore_fifo_pop_blocking();
+        multicore_reset_core1();
+        PICOTEST_CHECK(!core1_errors, "object contents changed");
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(!stats.in_use, "wrong in_use");
+
+        // then core 0 can allocate everything not left in core 1's cache, refilling its own cache from the shared
+        // free list repeatedly, and core 1 allocates the rest
+        multicore_launch_core1(core1_alloc_entry);
+        int count = alloc_all(0);
+#if PICO_POOL_PER_CORE_CACHE
+        PICOTEST_CHECK(count >= ELEMENT_COUNT - PICO_POOL_PER_CORE_CACHE_SIZE, "objects not spilled by core 1");
+#else
+        PICOTEST_CHECK(count == ELEMENT_COUNT, "wrong number of objects allocated");
+#endif
+        multicore_fifo_push_blocking(0);
+        int core1_count = (int)multicore_fifo_pop_blocking();
+        PICOTEST_CHECK(count >= 0 && core1_count >= 0 && count + core1_count == ELEMENT_COUNT,
+                       "wrong number of objects allocated between the cores");
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(stats.in_use == ELEMENT_COUNT && stats.high_water == ELEMENT_COUNT,
+                       "wrong in_use or high_water");
+        // core 0 frees what it holds, and core 1 what it does
+        PICOTEST_CHECK(free_all(0), "object contents changed");
+        multicore_fifo_push_blocking(0);
+        PICOTEST_CHECK(multicore_fifo_pop_blocking(), "object contents changed on core 1");
+        multicore_fifo_push_blocking(STOP);
+        multicore_fifo_pop_blocking();
+        multicore_reset_core1();
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(!stats.in_use, "wrong in_use");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("random allocations freed on both cores");
+        // core 0 holds a few objects at a time, freeing some itself and sending the rest to core 1 to free
+        multicore_launch_core1(core1_free_entry);
+        core1_errors = 0;
+        uint32_t errors = 0;
+        uint held = 0;
+        for (uint n = 0; n < ITERATIONS; n++) {
+            uint32_t r = next_random();
+            if (held < HELD_MAX && (r & 1)) {
+                // objects in core 1's cache or in the FIFO may not be available to core 0
+                object_t *obj = (object_t *)pool_alloc(&pool);
+                if (!obj) continue;
+                if (!valid_new_object(obj)) {
+                    errors++;
+                    break;
+                }
+                fill(obj, object_index(obj));
+                objects[0][object_index(obj)] = obj;
+                held++;
+            } else if (held) {
+                uint i = (r >> 8) % ELEMENT_COUNT;
+                while (!objects[0][i]) i = (i + 1) % ELEMENT_COUNT;
+                if (r & 2) {
+                    if (!check(objects[0][i], i)) errors++;
+                    pool_free(&pool, objects[0][i]);
+                } else {
+                    multicore_fifo_push_blocking(i);
+                }
+                objects[0][i] = NULL;
+                held--;
+            }
+        }
+        PICOTEST_CHECK(!errors, "pool_alloc returned an invalid object, or object contents changed");
+        for (uint i = 0; i < ELEMENT_COUNT; i++) {
+            if (objects[0][i]) {
+                multicore_fifo_push_blocking(i);
+                objects[0][i] = NULL;
+            }
+        }
+        multicore_fifo_push_blocking(STOP);
+        multicore_fifo_pop_blocking();
+        multicore_reset_core1();
+        PICOTEST_CHECK(!core1_errors, "object contents changed on core 1");
+        pool_get_stats(&pool, &stats);
+        PICOTEST_CHECK(!stats.in_use && stats.alloc_count == stats.free_count, "wrong in_use");
+        PICOTEST_CHECK(stats.high_water == ELEMENT_COUNT, "wrong high_water");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_START_SECTION("pool_init and pool_deinit");
+        pool_t heap_pool;
+        pool_init(&heap_pool, 100, 10);
+        PICOTEST_CHECK_AND_ABORT(heap_pool.storage, "no storage allocated");
+        uint8_t *mem[10];
+        bool valid = true;
+        for (uint i = 0; i < 10; i++) {
+            mem[i] = (uint8_t *)pool_alloc(&heap_pool);
+            if (!mem[i] || !pool_contains(&heap_pool, mem[i]) || ((uintptr_t)mem[i] & 7)) valid = false;
+            // the whole of each object can be used
+            if (mem[i]) memset(mem[i], (int)i, 100);
+        }
+        PICOTEST_CHECK(valid, "pool_alloc returned an invalid object");
+        PICOTEST_CHECK(!pool_alloc(&heap_pool), "allocation from an empty pool succeeded");
+        for (uint i = 0; i < 10; i++) {
+            for (uint j = 0; j < 100; j++) {
+                if (mem[i] && mem[i][j] != i) valid = false;
+            }
+            if (mem[i]) pool_free(&heap_pool, mem[i]);
+        }
+        PICOTEST_CHECK(valid, "object contents changed");
+        pool_get_stats(&heap_pool, &stats);
+        PICOTEST_CHECK(stats.element_count == 10 && !stats.in_use && stats.high_water == 10, "wrong stats");
+        pool_deinit(&heap_pool);
+        PICOTEST_CHECK(!heap_pool.storage && !heap_pool.element_count, "pool not cleared by pool_deinit");
+        PICOTEST_CHECK(!pool_contains(&heap_pool, mem[0]), "object contained after pool_deinit");
+    PICOTEST_END_SECTION();
+
+    PICOTEST_END_TEST();
+}
@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Compares the output of pico_printf with that of the host C library (glibc), which formats floating point values
+// exactly, and checks that pico_ftoa_shortest and pico_dtoa_shortest produce the shortest strings which convert back
+// to the same value.
+//
+// Usage: pico_printf_test [exhaustive | benchmark]
+//
+// By default a sample of the float values is checked; "exhaustive" checks every float (which takes a few days),
+// and "benchmark" instead reports the time taken by pico_printf and the C library for some common conversions.
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+// pico_printf is built into the test, with its functions named pico_snprintf etc. rather than being wrappers of the
+// C library functions
+#undef WRAPPER_FUNC
+#define WRAPPER_FUNC(x) pico_##x
+#include "printf.c"
+
+static uint32_t failures;
+static uint32_t checks;
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t random64(void) {
+    // xorshift64*
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545f4914f6cdd1dull;
+}
+
+static void compare(const char *fmt, const char *expected, const char *actual) {
+    checks++;
+    // glibc gets "%#g" wrong when rounding increases the exponent, e.g. giving "1.e+06" for 999999.5
+    if (!strcmp(fmt, "%#g") && strstr(expected, ".e")) {
+        return;
+    }
+    if (strcmp(expected, actual)) {
+        if (failures++ < 20) {
+            printf("FAIL: \"%s\" expected \"%s\" got \"%s\"\n", fmt, expected, actual);
+        }
+    }
+}
+
+#define CHECK(fmt, value) ({ \
+    char expected[512], actual[512]; \
+    snprintf(expected, sizeof(expected), fmt, value); \
+    pico_snprintf(actual, sizeof(actual), fmt, value); \
+    compare(fmt, expected, actual); \
+})
+
+static void check_integers(uint64_t value) {
+    CHECK("%d", (int)value);
+    CHECK("%i", (int)value);
+    CHECK("%u", (unsigned int)value);
+    CHECK("%x", (unsigned int)value);
+    CHECK("%X", (unsigned int)value);
+    CHECK("%o", (unsigned int)value);
+    CHECK("%#x", (unsigned int)value);
+    CHECK("%12d", (int)value);
+    CHECK("%-12d|", (int)value);
+    CHECK("%012d", (int)value);
+    CHECK("%+d", (int)value);
+    CHECK("% d", (int)value);
+    CHECK("%.7d", (int)value);
+    CHECK("%hd", (short)value);
+    CHECK("%hhu", (unsigned char)value);
+    CHECK("%ld", (long)value);
+    CHECK("%lu", (unsigned long)value);
+    CHECK("%lld", (long long)value);
+    CHECK("%llu", (unsigned long long)value);
+    CHECK("%llx", (unsigned long long)value);
+    CHECK("%llX", (unsigned long long)value);
+    CHECK("%llo", (unsigned long long)value);
+    CHECK("%#llx", (unsigned long long)value);
+    CHECK("%24lld", (long long)value);
+    CHECK("%-24llu|", (unsigned long long)value);
+    CHECK("%.22llu", (unsigned long long)value);
+    CHECK("%zu", (size_t)value);
+}
+
+static void check_floating(double value) {
+    CHECK("%f", value);
+    CHECK("%F", value);
+    CHECK("%.0f", value);
+    CHECK("%.1f", value);
+    CHECK("%.3f", value);
+    CHECK("%.12f", value);
+    CHECK("%#.0f", value);
+    CHECK("%e", value);
+    CHECK("%E", value);
+    CHECK("%.0e", value);
+    CHECK("%.2e", value);
+    CHECK("%.8e", value);
+    CHECK("%.16e", value);
+    CHECK("%#.0e", value);
+    CHECK("%g", value);
+    CHECK("%G", value);
+    CHECK("%.1g", value);
+    CHECK("%.3g", value);
+    CHECK("%.9g", value);
+    CHECK("%.17g", value);
+    CHECK("%#g", value);
+    CHECK("%14.3e", value);
+    CHECK("%-14.4f|", value);
+    CHECK("%+.2f", value);
+    CHECK("% g", value);
+    CHECK("%016.3e", value);
+    CHECK("%08.2f", value);
+}
+
+// the significant digits of the value in a "%e" format string, without trailing zeros, and its exponent
+static int parse_exponential(const char *s, char *digits, int *exp10) {
+    int n = 0;
+    for (; *s && *s != 'e'; s++) {
+        if (*s >= '0' && *s <= '9' && (n || *s != '0')) digits[n++] = *s;
+    }
+    while (n > 1 && digits[n - 1] == '0') n--;
+    digits[n] = 0;
+    *exp10 = *s ? atoi(s + 1) : 0;
+    return n;
+}
+
+// lay out the digits as pico_ftoa_shortest does, i.e. as by "%g" with a precision of max_digits
+static void layout(char *s, bool negative, const char *digits, int n, int exp10, int max_digits) {
+    if (negative) *s++ = '-';
+    if (exp10 < -4 || exp10 >= max_digits) {
+        *s++ = digits[0];
+        if (n > 1) s += sprintf(s, ".%s", digits + 1);
+        sprintf(s, "e%c%02d", exp10 < 0 ? '-' : '+', abs(exp10));
+    } else if (exp10 < 0) {
+        s += sprintf(s, "0.");
+        for (int i = -1; i > exp10; i--) *s++ = '0';
+        strcpy(s, digits);
+    } else {
+        for (int i = 0; i <= exp10; i++) *s++ = i < n ? digits[i] : '0';
+        if (n > exp10 + 1) s += sprintf(s, ".%s", digits + exp10 + 1);
+        *s = 0;
+    }
+}
+
+static bool round_trips(const char *s, double value, bool is_float) {
+    if (is_float) {
+        float f = strtof(s, NULL);
+        return !memcmp(&f, &(float){(float)value}, sizeof(f));
+    }
+    double d = strtod(s, NULL);
+    return !memcmp(&d, &value, sizeof(d));
+}
+
+// whether any decimal with the given number of significant digits converts to value
+static bool any_round_trip(double value, int digits, bool is_float) {
+    char s[64], mantissa[32];
+    int exp10;
+    snprintf(s, sizeof(s), "%.*e", digits - 1, value);
+    parse_exponential(s, mantissa, &exp10);
+    // the nearest decimal with that many digits, and the ones either side of it
+    long long m = 0;
+    char *e = strchr(s, 'e');
+    for (char *p = s; p < e; p++) {
+        if (*p >= '0' && *p <= '9') m = m * 10 + (*p - '0');
+    }
+    exp10 = atoi(e + 1) - (digits - 1);
+    for (int delta = -1; delta <= 1; delta++) {
+        snprintf(s, sizeof(s), "%s%llde%d", value < 0 ? "-" : "", m + delta, exp10);
+        if (round_trips(s, value, is_float)) return true;
+    }
+    return false;
+}
+
+static void check_shortest(double value, bool is_float) {
+    char actual[32], expected[64], digits[32], s[64];
+    int exp10;
+    int max_digits = is_float ? 9 : 17;
+    if (is_float) {
+        pico_ftoa_shortest(actual, sizeof(actual), (float)value);
+    } else {
+        pico_dtoa_shortest(actual, sizeof(actual), value);
+    }
+    checks++;
+    if (isnan(value) || isinf(value)) {
+        snprintf(expected, sizeof(expected), "%s", isnan(value) ? (signbit(value) ? "-nan" : "nan") : (value < 0 ? "-inf" : "inf"));
+        compare("shortest", expected, actual);
+        return;
+    }
+    if (!round_trips(actual, value, is_float)) {
+        if (failures++ < 20) printf("FAIL: shortest %.17g gave \"%s\" which does not convert back\n", value, actual);
+        return;
+    }
+    if (!value) {
+        compare("shortest", signbit(value) ? "-0" : "0", actual);
+        return;
+    }
+    // the actual value must have as few significant digits as possible
+    int n = parse_exponential(actual, digits, &exp10);
+    if (n > 1 && any_round_trip(value, n - 1, is_float)) {
+        if (failures++ < 20) printf("FAIL: shortest %.17g gave \"%s\" which is not the shortest\n", value, actual);
+        return;
+    }
+    // and must be the nearest value with that many digits, if that converts back (when it doesn't, the value must be
+    // a power of 2, and the other value with that many digits was chosen)
+    snprintf(s, sizeof(s), "%.*e", n - 1, value);
+    if (round_trips(s, value, is_float)) {
+        parse_exponential(s, digits, &exp10);
+        layout(expected, signbit(value), digits, (int)strlen(digits), exp10, max_digits);
+        compare("shortest", expected, actual);
+    }
+}
+
+static void check_float(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    check_floating(f);
+    check_shortest(f, true);
+}
+
+static void check_double(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    check_floating(d);
+    check_shortest(d, false);
+}
+
+#define BENCHMARK(name, iterations, ...) ({ \
+    char buf[64]; \
+    uint64_t start = time_us_64(); \
+    for (int i = 0; i < (iterations); i++) __VA_ARGS__; \
+    printf("  %-26s %8.1f ns\n", name, (double)(time_us_64() - start) * 1000 / (iterations)); \
+    (void)buf; \
+})
+
+static void benchmark(void) {
+    const int n = 1000000;
+    static const double doubles[] = { 3.14159265358979, 0.1, 1234.5678, 6.02214076e23, -2.5e-7 };
+    volatile int sink = 0;
+    for (int impl = 0; impl < 2; impl++) {
+        int (*fn)(char *, size_t, const char *, ...) = impl ? snprintf : pico_snprintf;
+        printf("%s:\n", impl ? "C library" : "pico_printf");
+        BENCHMARK("%d", n, sink += fn(buf, sizeof(buf), "%d", (i - n / 2) * 997));
+        BENCHMARK("%u (large)", n, sink += fn(buf, sizeof(buf), "%u", 4000000000u - (unsigned)i));
+        BENCHMARK("%x", n, sink += fn(buf, sizeof(buf), "%x", (unsigned)i * 2654435761u));
+        BENCHMARK("%llu", n, sink += fn(buf, sizeof(buf), "%llu", 0xfedcba9876543210ull + (unsigned)i));
+        BENCHMARK("%f", n, sink += fn(buf, sizeof(buf), "%f", doubles[i % 5]));
+        BENCHMARK("%.3f", n, sink += fn(buf, sizeof(buf), "%.3f", doubles[i % 5]));
+        BENCHMARK("%e", n, sink += fn(buf, sizeof(buf), "%e", doubles[i % 5]));
+        BENCHMARK("%g", n, sink += fn(buf, sizeof(buf), "%g", doubles[i % 5]));
+        BENCHMARK("%.17g", n, sink += fn(buf, sizeof(buf), "%.17g", doubles[i % 5]));
+    }
+    printf("shortest:\n");
+    BENCHMARK("pico_dtoa_shortest", n, sink += pico_dtoa_shortest(buf, sizeof(buf), doubles[i % 5]));
+    BENCHMARK("pico_ftoa_shortest", n, sink += pico_ftoa_shortest(buf, sizeof(buf), (float)doubles[i % 5]));
+}
+
+int main(int argc, char **argv) {
+    stdio_init_all();
+    if (argc > 1 && !strcmp(argv[1], "benchmark")) {
+        benchmark();
+        return 0;
+    }
+    bool exhaustive = argc > 1 && !strcmp(argv[1], "exhaustive");
+
+    static const uint64_t integers[] = { 0, 1, 9, 10, 99, 100, 12345, 0x7fffffff, 0x80000000, 0xffffffff,
+                                         0x100000000ull, 999999999, 1000000000, 9999999999999999999ull,
+                                         0x7fffffffffffffffull, 0x8000000000000000ull, 0xffffffffffffffffull };
+    for (uint i = 0; i < count_of(integers); i++) {
+        check_integers(integers[i]);
+        check_integers(-integers[i]);
+    }
+    for (int i = 0; i < 100000; i++) {
+        uint64_t value = random64();
+        check_integers(value >> (value & 63));
+    }
+    printf("integers: %u checks, %u failures\n", checks, failures);
+
+    static const double doubles[] = { 0.0, 0.5, 1.5, 2.5, 0.125, 0.05, 0.15, 0.25, 0.35, 9.5, 99.5, 999.9999999,
+                                      1e-5, 1e-4, 9.9999e-5, 123456.5, 999999.5, 1e15, 1e16, 1e17, 1e21, 1e22, 1e23,
+                                      DBL_MAX, DBL_MIN, DBL_TRUE_MIN, DBL_EPSILON, 5e-324, 1.7976931348623157e308,
+                                      2.2250738585072009e-308, 4.9406564584124654e-324, 0.1, 0.2, 0.3, 1.0 / 3,
+                                      M_PI, 6.02214076e23, 1.602176634e-19, INFINITY, NAN };
+    for (uint i = 0; i < count_of(doubles); i++) {
+        uint64_t bits;
+        memcpy(&bits, &doubles[i], sizeof(bits));
+        check_double(bits);
+        check_double(bits ^ (1ull << 63));
+    }
+    for (int i = 0; i < (exhaustive ? 10000000 : 20000); i++) {
+        uint64_t bits = random64();
+        check_double(bits);
+        // and values of more usual magnitudes
+        check_double((bits & 0x800fffffffffffffull) | ((uint64_t)(1023 - 20 + (bits >> 52) % 40) << 52));
+    }
+    printf("doubles: %u checks, %u failures\n", checks, failures);
+
+    uint32_t step = exhaustive ? 1 : 65537;
+    uint32_t bits = 0;
+    do {
+        check_float(bits);
+        if (exhaustive && !(bits & 0xffffff)) {
+            printf("floats: 0x%08x, %u failures\n", bits, failures);
+        }
+        bits += step;
+    } while (bits >= step);
+    printf("floats: %u checks, %u failures\n", checks, failures);
+
+    printf(failures ? "FAILED\n" : "PASSED\n");
+    return failures ? 1 : 0;
+}
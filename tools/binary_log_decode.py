@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Decodes the output of pico_binary_log, using the format strings from the ELF file of the program which produced it.
+#
+# Usage:
+#
+#   tools/binary_log_decode.py program.elf [input]
+#
+# where input is a file or (raw mode) serial device; stdin is used if omitted. Any regular text output interleaved
+# with the binary log records is passed through unchanged. Decoding may start part way through the stream (e.g. when
+# attaching to a running device); it picks up from the next complete record.
+
+import argparse
+import re
+import struct
+import sys
+
+FORMAT_SECTION = "pico_binary_log_formats"
+DROPPED_ID = 0xffffffff
+RECORD_HEADER_WORDS = 3
+MAX_ARGS = 8
+MAX_STRING_LEN = 64
+# the core number, the header, and the arguments (each at most a length word and a string), plus the COBS overhead
+MAX_RECORD_BYTES = 1 + 4 * (RECORD_HEADER_WORDS + MAX_ARGS * (1 + (MAX_STRING_LEN + 3) // 4))
+MAX_FRAME_BYTES = MAX_RECORD_BYTES + MAX_RECORD_BYTES // 254 + 1
+
+def read_format_section(elf_path):
+    with open(elf_path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF":
+        sys.exit(f"{elf_path} is not an ELF file")
+    is64 = elf[4] == 2
+    endian = "<" if elf[5] == 1 else ">"
+    if is64:
+        shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x3a)
+    else:
+        shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x2e)
+
+    def section(i):
+        if is64:
+            name, type_, _, _, offset, size = struct.unpack_from(endian + "IIQQQQ", elf, shoff + i * shentsize)
+        else:
+            name, type_, _, _, offset, size = struct.unpack_from(endian + "IIIIII", elf, shoff + i * shentsize)
+        return name, type_, offset, size
+
+    _, _, strtab_offset, _ = section(shstrndx)
+    for i in range(shnum):
+        name, type_, offset, size = section(i)
+        end = elf.index(b"\0", strtab_offset + name)
+        if elf[strtab_offset + name:end].decode() == FORMAT_SECTION:
+            return elf[offset:offset + size]
+    sys.exit(f"{elf_path} contains no {FORMAT_SECTION} section")
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+CONVERSION = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXeEfFgGaAcspn%])")
+
+class Args:
+    def __init__(self, words, info):
+        self.words = words
+        self.info = info
+        self.index = 0
+        self.pos = 0
+
+    def next(self, kind):
+        i = self.index
+        self.index += 1
+        if i >= self.info >> 16 & 0xf or self.pos >= len(self.words):
+            raise ValueError("missing argument")
+        if self.info >> (8 + i) & 1:
+            length = self.words[self.pos]
+            data = b"".join(struct.pack("<I", w) for w in self.words[self.pos + 1:self.pos + 1 + (length + 3) // 4])
+            self.pos += 1 + (length + 3) // 4
+            return data[:length].decode(errors="replace")
+        wide = self.info >> i & 1
+        value = self.words[self.pos]
+        if wide:
+            value |= self.words[self.pos + 1] << 32
+        self.pos += 1 + wide
+        if kind == "float":
+            return struct.unpack("<d", struct.pack("<Q", value))[0]
+        if kind == "signed":
+            bits = 64 if wide else 32
+            if value >> (bits - 1):
+                value -= 1 << bits
+        return value
+
+def format_message(fmt, words, info):
+    args = Args(words, info)
+
+    def convert(m):
+        flags, width, precision, _, conversion = m.groups()
+        if conversion == "%":
+            return "%"
+        if width == "*":
+            width = str(args.next("signed"))
+        if precision == "*":
+            precision = str(args.next("signed"))
+        spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        if conversion in "di":
+            return (spec + "d") % args.next("signed")
+        if conversion in "ouxX":
+            return (spec + conversion) % args.next("unsigned")
+        if conversion in "eEfFgG":
+            return (spec + conversion) % args.next("float")
+        if conversion in "aA":
+            return args.next("float").hex()
+        if conversion == "c":
+            return (spec + "c") % chr(args.next("unsigned") & 0xff)
+        if conversion == "s":
+            return (spec + "s") % args.next("string")
+        if conversion == "p":
+            return (spec + "s") % hex(args.next("unsigned"))
+        return m.group(0)
+
+    try:
+        return CONVERSION.sub(convert, fmt)
+    except ValueError as e:
+        return f"{fmt!r} ({e})"
+
+def decode_record(formats, frame):
+    record = cobs_decode(frame)
+    if not record or (len(record) - 1) % 4 or len(record) < 1 + RECORD_HEADER_WORDS * 4:
+        return None
+    core = record[0]
+    words = struct.unpack(f"<{(len(record) - 1) // 4}I", record[1:])
+    format_id, info, timestamp = words[:RECORD_HEADER_WORDS]
+    if info >> 24 != len(words):
+        return None
+    if format_id == DROPPED_ID:
+        message = f"<{words[3]} records dropped>"
+    elif format_id < len(formats):
+        fmt = formats[format_id:formats.index(b"\0", format_id)].decode(errors="replace")
+        message = format_message(fmt, words[RECORD_HEADER_WORDS:], info)
+    else:
+        return None
+    return f"[{core}:{timestamp / 1e6:12.6f}] {message}"
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode pico_binary_log output")
+    parser.add_argument("elf", help="the ELF file of the program which produced the log")
+    parser.add_argument("input", nargs="?", help="file or serial device to read (default stdin)")
+    args = parser.parse_args()
+
+    formats = read_format_section(args.elf)
+    stream = open(args.input, "rb", buffering=0) if args.input else sys.stdin.buffer
+    out = sys.stdout
+    # each record is framed by a zero byte at either end, and the bytes outside the frames are regular text, which
+    # contains no zeros. Every zero is treated as a delimiter, and each run of bytes between two zeros is decoded as a
+    # record if it is a valid one and passed through as text otherwise, so that decoding resynchronizes on the next
+    # record when started part way through the stream. A run too long to be a record is passed through as text
+    # straight away, rather than being held until the next zero
+    run = bytearray()
+    while True:
+        data = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+        if not data:
+            break
+        text = bytearray()
+        for b in data:
+            if b == 0:
+                message = decode_record(formats, bytes(run)) if run else None
+                text += (message + "\n").encode() if message is not None else run
+                run.clear()
+            else:
+                run.append(b)
+                if len(run) > MAX_FRAME_BYTES:
+                    text += run
+                    run.clear()
+        out.write(text.decode(errors="replace"))
+        out.flush()
+    out.write(run.decode(errors="replace"))
+
+if __name__ == "__main__":
+    main()
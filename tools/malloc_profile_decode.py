@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Prints a heap profile written by pico_malloc_profile_dump (with PICO_MALLOC_PROFILE set), with the call sites
+# symbolized using the ELF file of the program which produced it.
+#
+# Usage:
+#
+#   tools/malloc_profile_decode.py [--addr2line arm-none-eabi-addr2line] [--sort column] program.elf dump
+#
+# where dump is a file holding the raw dump, or the dump as hexadecimal text (e.g. as printed over stdio). If an
+# addr2line tool is given, the source file and line of each call site are shown as well as the function.
+
+import argparse
+import bisect
+import re
+import struct
+import subprocess
+import sys
+
+DUMP_MAGIC = 0x46504d50
+DUMP_VERSION = 1
+ANCHOR_SYMBOL = "pico_malloc_profile_dump"
+HEADER_FIELDS = ("live_bytes", "peak_bytes", "live_count", "alloc_count", "free_count", "failed_count",
+                 "heap_bytes", "free_bytes", "largest_free")
+SIZE_CLASS_FIELDS = ("alloc_count", "live_count", "live_bytes", "peak_bytes")
+SITE_FIELDS = ("alloc_count", "free_count", "live_bytes", "peak_bytes", "bytes_at_peak")
+STT_FUNC = 2
+
+def read_function_symbols(elf_path):
+    with open(elf_path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF":
+        sys.exit(f"{elf_path} is not an ELF file")
+    is64 = elf[4] == 2
+    endian = "<" if elf[5] == 1 else ">"
+    if is64:
+        shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+        shentsize, shnum = struct.unpack_from(endian + "HH", elf, 0x3a)
+    else:
+        shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+        shentsize, shnum = struct.unpack_from(endian + "HH", elf, 0x2e)
+
+    def section(i):
+        if is64:
+            _, type_, _, _, offset, size, link, _, _, entsize = struct.unpack_from(endian + "IIQQQQIIQQ", elf,
+                                                                                  shoff + i * shentsize)
+        else:
+            _, type_, _, _, offset, size, link, _, _, entsize = struct.unpack_from(endian + "IIIIIIIIII", elf,
+                                                                                  shoff + i * shentsize)
+        return type_, offset, size, link, entsize
+
+    symbols = []
+    for i in range(shnum):
+        type_, offset, size, link, entsize = section(i)
+        if type_ != 2:  # SHT_SYMTAB
+            continue
+        _, strtab_offset, _, _, _ = section(link)
+        for pos in range(offset, offset + size, entsize):
+            if is64:
+                name, info, _, _, value, sym_size = struct.unpack_from(endian + "IBBHQQ", elf, pos)
+            else:
+                name, value, sym_size, info, _, _ = struct.unpack_from(endian + "IIIBBH", elf, pos)
+            if info & 0xf != STT_FUNC or not value:
+                continue
+            end = elf.index(b"\0", strtab_offset + name)
+            # the bottom bit of Thumb function addresses is set
+            symbols.append((value & ~1, sym_size, elf[strtab_offset + name:end].decode(errors="replace")))
+    symbols.sort()
+    return symbols
+
+def read_dump(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    text = data.decode("ascii", errors="replace")
+    if re.fullmatch(r"[0-9a-fA-F\s]+", text):
+        data = bytes.fromhex("".join(text.split()))
+    if len(data) < 8:
+        sys.exit(f"{path} is too short to be a heap profile")
+    magic, version, address_size, class_count = struct.unpack_from("<IBBB", data, 0)
+    if magic != DUMP_MAGIC:
+        sys.exit(f"{path} is not a heap profile")
+    if version != DUMP_VERSION:
+        sys.exit(f"{path} is version {version} of the heap profile format; only {DUMP_VERSION} is supported")
+    address_format = "<Q" if address_size == 8 else "<I"
+    pos = 8
+
+    def take(fmt):
+        nonlocal pos
+        if pos + struct.calcsize(fmt) > len(data):
+            sys.exit(f"{path} is truncated; was the buffer passed to pico_malloc_profile_dump big enough?")
+        values = struct.unpack_from(fmt, data, pos)
+        pos += struct.calcsize(fmt)
+        return values
+
+    anchor, = take(address_format)
+    header = dict(zip(HEADER_FIELDS, take(f"<{len(HEADER_FIELDS)}I")))
+    size_classes = [dict(zip(SIZE_CLASS_FIELDS, take(f"<{len(SIZE_CLASS_FIELDS)}I"))) for _ in range(class_count)]
+    sites = []
+    site_count, = take("<I")
+    for _ in range(site_count):
+        address, = take(address_format)
+        site = dict(zip(SITE_FIELDS, take(f"<{len(SITE_FIELDS)}I")))
+        site["address"] = address
+        sites.append(site)
+    return anchor, header, size_classes, sites
+
+def symbolize(symbols, addresses, addr2line, elf_path):
+    starts = [s[0] for s in symbols]
+    names = {}
+    for address in addresses:
+        # the return address is just after the call
+        call = (address & ~1) - 1
+        i = bisect.bisect_right(starts, call) - 1
+        if i >= 0 and call < symbols[i][0] + max(symbols[i][1], 1):
+            names[address] = f"{symbols[i][2]}+0x{(address & ~1) - symbols[i][0]:x}"
+        else:
+            names[address] = f"0x{address:x}"
+    if addr2line and addresses:
+        calls = [f"0x{(address & ~1) - 1:x}" for address in addresses]
+        try:
+            out = subprocess.run([addr2line, "-e", elf_path] + calls, capture_output=True, text=True,
+                                 check=True).stdout.splitlines()
+            for address, line in zip(addresses, out):
+                if not line.startswith("??"):
+                    names[address] += f" ({line})"
+        except (OSError, subprocess.CalledProcessError) as e:
+            print(f"warning: {addr2line} failed: {e}", file=sys.stderr)
+    return names
+
+def size_class_name(i, count):
+    if i == count - 1:
+        return f"> {8 << (i - 1)}"
+    return f"<= {8 << i}"
+
+def main():
+    parser = argparse.ArgumentParser(description="Print a pico_malloc heap profile")
+    parser.add_argument("elf", help="the ELF file of the program which produced the dump")
+    parser.add_argument("dump", help="file holding the dump, either raw or as hexadecimal text")
+    parser.add_argument("--addr2line", help="addr2line tool used to show source lines, e.g. arm-none-eabi-addr2line")
+    parser.add_argument("--sort", choices=SITE_FIELDS, default="bytes_at_peak",
+                        help="the call site column to sort by (default bytes_at_peak)")
+    args = parser.parse_args()
+
+    anchor, header, size_classes, sites = read_dump(args.dump)
+    symbols = read_function_symbols(args.elf)
+    anchors = [s[0] for s in symbols if s[2] == ANCHOR_SYMBOL]
+    if not anchors:
+        sys.exit(f"{args.elf} does not contain {ANCHOR_SYMBOL}; is it the right ELF file?")
+    # non zero for position independent executables
+    load_offset = (anchor & ~1) - anchors[0]
+    symbols = [(start + load_offset, size, name) for start, size, name in symbols]
+
+    print(f"live:    {header['live_bytes']} bytes in {header['live_count']} allocations")
+    print(f"peak:    {header['peak_bytes']} bytes")
+    print(f"totals:  {header['alloc_count']} allocations, {header['free_count']} frees, "
+          f"{header['failed_count']} failures")
+    heap, free, largest = header["heap_bytes"], header["free_bytes"], header["largest_free"]
+    print(f"heap:    {heap} bytes, {free} free", end="")
+    if largest:
+        print(f", largest free block {largest} bytes; fragmentation {100 * (1 - largest / free):.1f}% "
+              "(1 - largest free block / free bytes)")
+    elif free:
+        print(" (the largest free block is only known with PICO_MALLOC_TLSF)")
+    else:
+        print()
+    if heap:
+        overhead = heap - free - header["live_bytes"]
+        print(f"overhead: {overhead} bytes ({100 * overhead / heap:.1f}% of the heap) not in live allocations "
+              "(headers, padding and unused arena pages)")
+
+    print("\nsize class     allocs       live  live_bytes  peak_bytes")
+    for i, size_class in enumerate(size_classes):
+        if size_class["alloc_count"]:
+            print(f"{size_class_name(i, len(size_classes)):>10} {size_class['alloc_count']:>10} "
+                  f"{size_class['live_count']:>10} {size_class['live_bytes']:>11} {size_class['peak_bytes']:>11}")
+
+    names = symbolize(symbols, [s["address"] for s in sites if s["address"]], args.addr2line, args.elf)
+    print("\n    allocs      frees  live_bytes  peak_bytes  bytes_at_peak  call site")
+    for site in sorted(sites, key=lambda s: s[args.sort], reverse=True):
+        name = names[site["address"]] if site["address"] else "<other call sites>"
+        print(f"{site['alloc_count']:>10} {site['free_count']:>10} {site['live_bytes']:>11} {site['peak_bytes']:>11} "
+              f"{site['bytes_at_peak']:>14}  {name}")
+
+if __name__ == "__main__":
+    main()